@@ -3,6 +3,10 @@ plugins {
     id("org.jetbrains.kotlin.android")
 }
 
+// -PvulkanRuntimeShaderc=true 时 shader 在运行时编译 (开发用, 需要 jniLibs 里的 libshaderc), 不需要 shaders.spvpack
+val vulkanRuntimeShaderc = (findProperty("vulkanRuntimeShaderc") as String?)?.toBoolean() ?: false
+val hostToolsDir = layout.buildDirectory.dir("host-tools").get().asFile
+
 android {
     namespace = "com.arcsoft.myapplication"
     compileSdk = 34
@@ -15,6 +19,14 @@ android {
         versionName = "1.0"
 
         testInstrumentationRunner = "androidx.test.runner.AndroidJUnitRunner"
+
+        externalNativeBuild {
+            cmake {
+                if (vulkanRuntimeShaderc) {
+                    arguments += "-DVULKAN_RUNTIME_SHADERC=ON"
+                }
+            }
+        }
     }
 
     buildTypes {
@@ -42,6 +54,35 @@ android {
     buildFeatures {
         viewBinding = true
     }
+    androidResources {
+        // shaders.spvpack, .mesh 和 .ktx2 不压缩, 运行时直接 map
+        noCompress += "spvpack"
+        noCompress += "mesh"
+        noCompress += "ktx2"
+    }
+}
+
+// shaders.spvpack 由 host 构建的 shader_archive target 生成 (需要 host 上的 Vulkan SDK 和 shaderc),
+// 在配置 CMake 和合并 assets 之前运行. NDK 构建在 archive 不存在时会失败
+val configureHostTools by tasks.registering(Exec::class) {
+    commandLine("cmake", "-S", file("src/main/cpp").absolutePath, "-B", hostToolsDir.absolutePath,
+        "-DCMAKE_BUILD_TYPE=Release")
+}
+val buildShaderArchive by tasks.registering(Exec::class) {
+    dependsOn(configureHostTools)
+    commandLine("cmake", "--build", hostToolsDir.absolutePath, "--target", "shader_archive")
+    // 和 CMake 里 shader_archive 的依赖一致, shader 改了之后不会跳过而打包旧的 archive
+    inputs.files(fileTree("src/main/cpp/vulkan_object") { include("*.cpp") },
+        "src/main/cpp/host/shader_archiver.cpp", "src/main/cpp/shader_archive.cpp",
+        "src/main/cpp/spirv_cache.cpp", "src/main/cpp/CMakeLists.txt")
+    outputs.file("src/main/assets/shaders.spvpack")
+}
+tasks.configureEach {
+    val needsArchive = name.startsWith("configureCMake") || name.startsWith("buildCMake") ||
+        (name.startsWith("merge") && name.endsWith("Assets"))
+    if (!vulkanRuntimeShaderc && needsArchive) {
+        dependsOn(buildShaderArchive)
+    }
 }
 
 dependencies {
@@ -0,0 +1,104 @@
+//
+// Created by hj6231 on 2024/2/7.
+//
+
+#include "android_compat.h"
+
+#ifndef __ANDROID__
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+struct AAssetManager {
+    std::string directory;
+};
+
+struct AAsset {
+    int fd;
+    off_t length;
+    off_t position;
+    void* mapped;
+};
+
+AAssetManager* AAssetManager_fromDirectory(const char* directory) {
+    auto* mgr = new AAssetManager();
+    mgr->directory = directory ? directory : ".";
+    return mgr;
+}
+
+void AAssetManager_delete(AAssetManager* mgr) {
+    delete mgr;
+}
+
+AAsset* AAssetManager_open(AAssetManager* mgr, const char* filename, int mode) {
+    (void) mode;
+    if (mgr == nullptr || filename == nullptr) {
+        return nullptr;
+    }
+    std::string path = mgr->directory + "/" + filename;
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        fprintf(stderr, "AAssetManager_open %s failed\n", path.c_str());
+        return nullptr;
+    }
+    struct stat st{};
+    if (fstat(fd, &st) != 0) {
+        close(fd);
+        return nullptr;
+    }
+    auto* asset = new AAsset();
+    asset->fd = fd;
+    asset->length = st.st_size;
+    asset->position = 0;
+    asset->mapped = nullptr;
+    return asset;
+}
+
+off_t AAsset_getLength(AAsset* asset) {
+    return asset->length;
+}
+
+int AAsset_read(AAsset* asset, void* buf, size_t count) {
+    ssize_t ret = pread(asset->fd, buf, count, asset->position);
+    if (ret > 0) {
+        asset->position += ret;
+    }
+    return static_cast<int>(ret);
+}
+
+const void* AAsset_getBuffer(AAsset* asset) {
+    if (asset->mapped == nullptr && asset->length > 0) {
+        void* data = mmap(nullptr, asset->length, PROT_READ, MAP_PRIVATE, asset->fd, 0);
+        if (data == MAP_FAILED) {
+            return nullptr;
+        }
+        asset->mapped = data;
+    }
+    return asset->mapped;
+}
+
+void AAsset_close(AAsset* asset) {
+    if (asset == nullptr) {
+        return;
+    }
+    if (asset->mapped != nullptr) {
+        munmap(asset->mapped, asset->length);
+    }
+    close(asset->fd);
+    delete asset;
+}
+
+int32_t ANativeWindow_getWidth(ANativeWindow* window) {
+    (void) window;
+    return 0;
+}
+
+int32_t ANativeWindow_getHeight(ANativeWindow* window) {
+    (void) window;
+    return 0;
+}
+#endif
@@ -0,0 +1,41 @@
+//
+// Created by hj6231 on 2024/2/7.
+//
+
+#pragma once
+// Android 上直接使用 NDK 的头文件. 其他平台 (Linux 构建机, 没有显示器)
+// 提供 AAssetManager / ANativeWindow 的最小实现, asset 从本地目录读取,
+// 这样 vulkan_object 里的代码不需要修改就可以 headless 运行.
+#ifdef __ANDROID__
+#include <android/asset_manager.h>
+#include <android/asset_manager_jni.h>
+#include <android/native_window_jni.h>
+#else
+#include <sys/types.h>
+#include <cstddef>
+#include <cstdint>
+
+struct AAssetManager;
+struct AAsset;
+struct ANativeWindow;
+
+enum {
+    AASSET_MODE_UNKNOWN = 0,
+    AASSET_MODE_RANDOM = 1,
+    AASSET_MODE_STREAMING = 2,
+    AASSET_MODE_BUFFER = 3
+};
+
+AAsset* AAssetManager_open(AAssetManager* mgr, const char* filename, int mode);
+off_t AAsset_getLength(AAsset* asset);
+int AAsset_read(AAsset* asset, void* buf, size_t count);
+const void* AAsset_getBuffer(AAsset* asset);
+void AAsset_close(AAsset* asset);
+
+int32_t ANativeWindow_getWidth(ANativeWindow* window);
+int32_t ANativeWindow_getHeight(ANativeWindow* window);
+
+// 非 Android 平台专用: asset 根目录, 例如 app/src/main/assets
+AAssetManager* AAssetManager_fromDirectory(const char* directory);
+void AAssetManager_delete(AAssetManager* mgr);
+#endif
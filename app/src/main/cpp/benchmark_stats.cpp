@@ -0,0 +1,167 @@
+//
+// Created by hj6231 on 2024/2/8.
+//
+
+#include "benchmark_stats.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+BenchmarkStats::BenchmarkStats() :
+        warmup_frames_(0),
+        measured_frames_(0),
+        skipped_frames_(0),
+        setup_ns_(0),
+        first_frame_ns_(0),
+        full_quality_ns_(0),
+        gpu_timestamps_(false),
+        pipeline_cache_stats_{} {
+}
+
+void BenchmarkStats::Configure(uint32_t warmup_frames, uint32_t measured_frames) {
+    warmup_frames_ = warmup_frames;
+    measured_frames_ = measured_frames;
+    skipped_frames_ = 0;
+    setup_ns_ = 0;
+    first_frame_ns_ = 0;
+    full_quality_ns_ = 0;
+    gpu_timestamps_ = false;
+    pipeline_cache_stats_ = pipeline_cache_stats_t{};
+    setup_objects_.clear();
+    cpu_record_ms_.clear();
+    submit_to_fence_ms_.clear();
+    gpu_ms_.clear();
+    gpu_scope_ms_.clear();
+    cpu_record_ms_.reserve(measured_frames);
+    submit_to_fence_ms_.reserve(measured_frames);
+    gpu_ms_.reserve(measured_frames);
+}
+
+bool BenchmarkStats::enabled() const {
+    return measured_frames_ > 0;
+}
+
+bool BenchmarkStats::complete() const {
+    return cpu_record_ms_.size() >= measured_frames_;
+}
+
+void BenchmarkStats::AddSetupTime(uint64_t ns) {
+    setup_ns_ += ns;
+}
+
+void BenchmarkStats::SetPipelineCacheStats(const pipeline_cache_stats_t& stats) {
+    pipeline_cache_stats_ = stats;
+}
+
+void BenchmarkStats::SetLoadTimes(uint64_t first_frame_ns, uint64_t full_quality_ns) {
+    first_frame_ns_ = first_frame_ns;
+    full_quality_ns_ = full_quality_ns;
+}
+
+void BenchmarkStats::AddSetupObjects(const std::vector<object_setup_timing_t>& timings) {
+    setup_objects_.insert(setup_objects_.end(), timings.begin(), timings.end());
+}
+
+void BenchmarkStats::Add(const frame_timing_t& timing) {
+    if (!enabled() || !timing.valid || complete()) {
+        return;
+    }
+    if (skipped_frames_ < warmup_frames_) {
+        ++skipped_frames_;
+        return;
+    }
+    cpu_record_ms_.push_back(timing.cpu_record_ns / 1e6);
+    submit_to_fence_ms_.push_back(timing.submit_to_fence_ns / 1e6);
+    if (timing.gpu_ns > 0) {
+        gpu_timestamps_ = true;
+    }
+    gpu_ms_.push_back(timing.gpu_ns / 1e6);
+    for (const auto& scope : timing.gpu_scopes) {
+        if (strcmp(scope.name, VulkanCommandBuffer::FRAME_TIMESTAMP_SCOPE) == 0) {
+            continue;
+        }
+        GpuScopeSeries(scope.name)->push_back(scope.ns / 1e6);
+    }
+}
+
+std::vector<double>* BenchmarkStats::GpuScopeSeries(const char* name) {
+    for (auto& series : gpu_scope_ms_) {
+        if (strcmp(series.first, name) == 0) {
+            return &series.second;
+        }
+    }
+    gpu_scope_ms_.push_back(std::make_pair(name, std::vector<double>()));
+    gpu_scope_ms_.back().second.reserve(measured_frames_);
+    return &gpu_scope_ms_.back().second;
+}
+
+double BenchmarkStats::Percentile(std::vector<double> values, double p) {
+    if (values.empty()) {
+        return 0.0;
+    }
+    // nearest-rank
+    size_t rank = static_cast<size_t>(std::ceil(p / 100.0 * values.size()));
+    if (rank > 0) {
+        --rank;
+    }
+    rank = std::min(rank, values.size() - 1);
+    std::nth_element(values.begin(), values.begin() + rank, values.end());
+    return values[rank];
+}
+
+void BenchmarkStats::WriteSeries(FILE* file, const char* indent, const char* name, const std::vector<double>& values) {
+    double sum = 0.0;
+    double max = 0.0;
+    for (double v : values) {
+        sum += v;
+        max = std::max(max, v);
+    }
+    double mean = values.empty() ? 0.0 : sum / values.size();
+    fprintf(file, "%s\"%s\": {\"mean\": %.4f, \"p50\": %.4f, \"p95\": %.4f, \"p99\": %.4f, \"max\": %.4f}",
+            indent, name, mean, Percentile(values, 50.0), Percentile(values, 95.0), Percentile(values, 99.0), max);
+}
+
+void BenchmarkStats::WriteJson(FILE* file, const char* scene, uint32_t frames_in_flight) const {
+    fprintf(file, "  {\n");
+    fprintf(file, "    \"scene\": \"%s\",\n", scene);
+    fprintf(file, "    \"warmup_frames\": %u,\n", warmup_frames_);
+    fprintf(file, "    \"frames\": %u,\n", static_cast<uint32_t>(cpu_record_ms_.size()));
+    fprintf(file, "    \"frames_in_flight\": %u,\n", frames_in_flight);
+    fprintf(file, "    \"gpu_timestamps\": %s,\n", gpu_timestamps_ ? "true" : "false");
+    fprintf(file, "    \"setup_ms\": %.4f,\n", setup_ns_ / 1e6);
+    fprintf(file, "    \"first_frame_ms\": %.4f,\n", first_frame_ns_ / 1e6);
+    fprintf(file, "    \"full_quality_ms\": %.4f,\n", full_quality_ns_ / 1e6);
+    fprintf(file, "    \"pipeline_cache\": {\"loaded_bytes\": %llu, \"pipelines\": %llu, \"hits\": %llu, "
+                  "\"misses\": %llu, \"unknown\": %llu, \"create_ms\": %.4f},\n",
+            (long long unsigned int) pipeline_cache_stats_.loaded_bytes,
+            (long long unsigned int) pipeline_cache_stats_.pipelines,
+            (long long unsigned int) pipeline_cache_stats_.hits,
+            (long long unsigned int) pipeline_cache_stats_.misses,
+            (long long unsigned int) pipeline_cache_stats_.unknown,
+            pipeline_cache_stats_.create_ns / 1e6);
+    // 各个任务在不同线程上并行执行, 加起来可能大于 setup_ms
+    fprintf(file, "    \"setup_objects\": [");
+    for (size_t i = 0; i < setup_objects_.size(); ++i) {
+        const object_setup_timing_t& timing = setup_objects_[i];
+        fprintf(file, "%s\n      {\"object\": \"%s\", \"shaders\": %u, \"shader_ms\": %.4f, "
+                      "\"pipeline_ms\": %.4f, \"failures\": %u}",
+                i == 0 ? "" : ",", timing.object.c_str(), timing.shader_count,
+                timing.shader_ns / 1e6, timing.pipeline_ns / 1e6, timing.failures);
+    }
+    fprintf(file, setup_objects_.empty() ? "],\n" : "\n    ],\n");
+    WriteSeries(file, "    ", "cpu_record_ms", cpu_record_ms_);
+    fprintf(file, ",\n");
+    WriteSeries(file, "    ", "submit_to_fence_ms", submit_to_fence_ms_);
+    fprintf(file, ",\n");
+    WriteSeries(file, "    ", "gpu_ms", gpu_ms_);
+    fprintf(file, ",\n");
+    // 单位 ms, 和 gpu_ms 一样每个 scope 一组统计
+    fprintf(file, "    \"gpu_scopes_ms\": {");
+    for (size_t i = 0; i < gpu_scope_ms_.size(); ++i) {
+        fprintf(file, i == 0 ? "\n" : ",\n");
+        WriteSeries(file, "      ", gpu_scope_ms_[i].first, gpu_scope_ms_[i].second);
+    }
+    fprintf(file, gpu_scope_ms_.empty() ? "}" : "\n    }");
+    fprintf(file, "\n  }");
+}
@@ -0,0 +1,58 @@
+//
+// Created by hj6231 on 2024/2/8.
+//
+
+#pragma once
+#include <cstdint>
+#include <cstdio>
+#include <utility>
+#include <vector>
+#include "frame_context.h"
+#include "parallel_setup.h"
+#include "vulkan_pipeline_cache.h"
+
+// 收集 benchmark 每一帧的耗时, 丢掉前 warmup_frames 帧, 输出 JSON
+class BenchmarkStats {
+public:
+    BenchmarkStats();
+    ~BenchmarkStats() = default;
+
+    void Configure(uint32_t warmup_frames, uint32_t measured_frames);
+    bool enabled() const;
+    // 已经收集到 measured_frames 帧
+    bool complete() const;
+
+    // instance/device/pipeline/资源创建等第一帧之前的耗时, 可以多次累加
+    void AddSetupTime(uint64_t ns);
+    void Add(const frame_timing_t& timing);
+    // setup 结束时记录, 比较有无 pipeline cache 文件时的启动耗时
+    void SetPipelineCacheStats(const pipeline_cache_stats_t& stats);
+    // 每个 object 的 shader 编译和 pipeline 创建耗时, 可以多次调用追加
+    void AddSetupObjects(const std::vector<object_setup_timing_t>& timings);
+    // 从 render 线程开始到第一帧 present, 和到第一个完整画面 present 的时间. 同步加载时两者相同
+    void SetLoadTimes(uint64_t first_frame_ns, uint64_t full_quality_ns);
+
+    // {"scene": ..., "setup_ms": ..., "cpu_record_ms": {...}, ...}
+    void WriteJson(FILE* file, const char* scene, uint32_t frames_in_flight) const;
+
+private:
+    static double Percentile(std::vector<double> values, double p);
+    static void WriteSeries(FILE* file, const char* indent, const char* name, const std::vector<double>& values);
+    std::vector<double>* GpuScopeSeries(const char* name);
+
+    uint32_t warmup_frames_;
+    uint32_t measured_frames_;
+    uint32_t skipped_frames_;
+    uint64_t setup_ns_;
+    uint64_t first_frame_ns_;
+    uint64_t full_quality_ns_;
+    bool gpu_timestamps_;
+    pipeline_cache_stats_t pipeline_cache_stats_;
+    std::vector<object_setup_timing_t> setup_objects_;
+
+    std::vector<double> cpu_record_ms_;
+    std::vector<double> submit_to_fence_ms_;
+    std::vector<double> gpu_ms_;
+    // 除 FRAME_TIMESTAMP_SCOPE 之外每个 timestamp scope 的耗时, 按第一次出现的顺序
+    std::vector<std::pair<const char*, std::vector<double>>> gpu_scope_ms_;
+};
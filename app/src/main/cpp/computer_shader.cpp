@@ -5,8 +5,13 @@
 #include "computer_shader.h"
 
 #include <cassert>
-#include <unistd.h>
+#include <chrono>
 #include "log.h"
+#include "shader_archive.h"
+#ifdef VULKAN_RUNTIME_SHADERC
+#include "spirv_cache.h"
+#endif
+#include "vulkan_utils.h"
 
 static VkBool32 VKAPI_PTR debug_report_callback(
         VkDebugReportFlagsEXT                       flags,
@@ -41,98 +46,112 @@ static VkBool32 VKAPI_PTR debug_report_callback(
 ComputerShader::ComputerShader(AAssetManager * asset_manager) :
         TutorialBase(asset_manager),
         instance_(nullptr),
+        support_validation_(false),
+        surface_type_(CreateInfoFactory::SURFACE_PLATFORM),
         callback_{},
         physical_device_(nullptr),
         surface_(nullptr),
         queue_family_index_(0),
         logic_device_(nullptr),
         queue_(nullptr),
-        swap_chain_(nullptr),
+        present_backend_(nullptr),
         surface_format_{},
         swap_chain_extent_{},
         graphic_command_pool_(nullptr),
-        graphic_command_buffer_(nullptr),
+        frame_contexts_(nullptr),
         particle_(nullptr) {
 
 }
 
 void ComputerShader::Run() {
+    auto setup_begin = std::chrono::steady_clock::now();
     CreateSurface(window_);
     CreateLogicalDevice();
+    if (!cache_directory_.empty()) {
+        logic_device_->pipeline_cache()->Open(cache_directory_);
+    }
     CreateCommandPool();
-    CreateCommandBuffer();
-    CreateSyncObjects();
+    CreateFrameContexts();
 
-    CreateSwapChain(window_);
+    CreateSwapChain(window_, VK_NULL_HANDLE);
 
-    CreateComputerPipeline();
-    CreateGraphicPipeline();
+    CreatePipelines();
 
     CreateImageViews();
     CreateFrameBuffers(particle_graphic_->render_pass()->render_pass());
+    benchmark_stats_.AddSetupTime(std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now() - setup_begin).count());
+    benchmark_stats_.SetPipelineCacheStats(logic_device_->pipeline_cache()->stats());
+    logic_device_->pipeline_cache()->Save();
 
-
-    int thread_state;
-    std::unique_lock<std::mutex> lock(thread_state_mutex_);
-    thread_state = thread_state_;
-    lock.unlock();
     uint32_t image_index;
-    uint32_t flight_index = 0;
-    while (thread_state == 1) {
-        VkSemaphore frame_available_semaphore = swap_chain_image_available_semaphore_[flight_index]->semaphore();
-        VkSemaphore render_finished_semaphore = render_finished_semaphore_[flight_index]->semaphore();
-        VkFence cpu_wait_fence = cpu_wait_fence_[flight_index]->fence();
-        logic_device_->AcquireNextImageKHR(swap_chain_->swap_chain(),
-                                           UINT64_MAX,
-                                           frame_available_semaphore,
-                                           VK_NULL_HANDLE,
-                                           &image_index);
-        logic_device_->WaitForFences( 1, &cpu_wait_fence, VK_TRUE, UINT64_MAX);
-
+    frame_pacer_.ResetStats();
+    while (IsRunning()) {
+        frame_pacer_.BeginFrame();
+        frame_context_t* frame = frame_contexts_->WaitCurrent();
+        AddFrameTiming(frame->timing);
+        VkSemaphore frame_available_semaphore = frame->image_available_semaphore->semaphore();
+        VkSemaphore render_finished_semaphore = frame->render_finished_semaphore->semaphore();
+        VkFence cpu_wait_fence = frame->in_flight_fence->fence();
+        VkResult ret = present_backend_->AcquireNextImage(frame_available_semaphore, &image_index);
+        if (ret == VK_ERROR_OUT_OF_DATE_KHR) {
+            RecreateSwapChain(true);
+            frame_pacer_.EndFrame();
+            continue;
+        }
+        assert(ret == VK_SUCCESS || ret == VK_SUBOPTIMAL_KHR);
 
-        graphic_command_buffer_->ResetCommandBuffer(0);
+        frame->command_buffer->ResetCommandBuffer(0);
 
         VkPipelineStageFlags waitDstStage[] = { VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT };
-        VkCommandBuffer commandBuffers[] = { graphic_command_buffer_->command_buffer() };
+        VkCommandBuffer commandBuffers[] = { frame->command_buffer->command_buffer() };
+        // off-screen image 没有 acquire/present, 不需要 semaphore
+        uint32_t semaphoreCount = present_backend_->needs_semaphores() ? 1 : 0;
         VkSubmitInfo submitInfo{
                 .sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
                 .pNext = nullptr,
-                .waitSemaphoreCount = 1,
+                .waitSemaphoreCount = semaphoreCount,
                 .pWaitSemaphores = &frame_available_semaphore,
                 .pWaitDstStageMask = waitDstStage,
                 .commandBufferCount = 1,
                 .pCommandBuffers = commandBuffers,
-                .signalSemaphoreCount = 1,
+                .signalSemaphoreCount = semaphoreCount,
                 .pSignalSemaphores = &render_finished_semaphore
         };
-        LOG_D("HJ", "RUN 1 time");
         logic_device_->ResetFences(1, &cpu_wait_fence);
-        particle_->Draw(graphic_command_buffer_);
-        particle_graphic_->Draw(graphic_command_buffer_, frame_buffers_[image_index]);
-        VkResult ret = queue_->QueueSubmit(1, &submitInfo, cpu_wait_fence);
+        frame_contexts_->BeginRecord(frame);
+        particle_->Draw(frame->command_buffer, frame);
+        particle_graphic_->Draw(frame->command_buffer, frame_buffers_[image_index], frame);
+        frame_contexts_->EndRecord(frame);
+        ret = queue_->QueueSubmit(1, &submitInfo, cpu_wait_fence);
         assert(ret == VK_SUCCESS);
 
-        VkSwapchainKHR swapchainKhrs[] = { swap_chain_->swap_chain() };
-        VkPresentInfoKHR presentInfoKhr{
-            .sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR,
-            .pNext = nullptr,
-            .waitSemaphoreCount = 1,
-            .pWaitSemaphores = &render_finished_semaphore,
-            .swapchainCount = 1,
-            .pSwapchains = swapchainKhrs,
-            .pImageIndices = &image_index,
-            .pResults = nullptr
-        };
-        queue_->QueuePresentKHR(&presentInfoKhr);
+        ret = present_backend_->Present(queue_, render_finished_semaphore, image_index);
 
-        LOG_D("HJ", "RUN 1 time end");
-        lock.lock();
-        thread_state = thread_state_;
-        lock.unlock();
-        flight_index = (flight_index + 1) % FRAME_IN_FLIGHT;
+        frame_contexts_->Advance();
+        bool surface_changed = ConsumeSurfaceChanged();
+        if (ret == VK_ERROR_OUT_OF_DATE_KHR || ret == VK_SUBOPTIMAL_KHR) {
+            RecreateSwapChain(true);
+        } else if (surface_changed) {
+            RecreateSwapChain(false);
+        }
+        frame_pacer_.EndFrame();
     }
 
     logic_device_->DeviceWaitIdle();
+    frame_pacer_.LogStats("HJ");
+    logic_device_->memory_allocator()->LogStats("HJ");
+    logic_device_->pipeline_cache()->LogStats("HJ");
+    ShaderArchive::Instance()->LogStats("HJ");
+#ifdef VULKAN_RUNTIME_SHADERC
+    SpirvCache::Instance()->LogStats("HJ");
+#endif
+    if (frame_contexts_->frames() > 0) {
+        LOG_D("HJ", "%llu frames, %u frames in flight, avg fence wait %.3f ms\n",
+              (long long unsigned int) frame_contexts_->frames(), frame_contexts_->frame_count(),
+              frame_contexts_->fence_wait_ns() / 1e6 / frame_contexts_->frames());
+    }
+    LogGpuProfile("HJ");
 
     DestroyGraphicPipeline();
     DestroyComputerPipeline();
@@ -141,8 +160,7 @@ void ComputerShader::Run() {
     DestroyImageViews();
     DestroySwapChain();
 
-    DestroySyncObjects();
-    DestroyCommandBuffer();
+    DestroyFrameContexts();
     DestroyCommandPool();
 
     DestroyLogicalDevice();
@@ -186,33 +204,55 @@ void ComputerShader::CreateInstance() {
             .apiVersion = VK_API_VERSION_1_3
     };
 
+    // 开发机上不一定装了 validation layer
+    support_validation_ = CheckValidationLayerSupport(layer_properties);
+    surface_type_ = CreateInfoFactory::ChooseSurfaceType(headless_, use_headless_surface_);
+
     const std::vector<const char*> required_instance_layers = {"VK_LAYER_KHRONOS_validation"};
-    const std::vector<const char*> required_instance_extensions =
-            {VK_KHR_SURFACE_EXTENSION_NAME,
-             VK_KHR_ANDROID_SURFACE_EXTENSION_NAME,
-             VK_EXT_DEBUG_REPORT_EXTENSION_NAME,
-             VK_EXT_SWAPCHAIN_COLOR_SPACE_EXTENSION_NAME, // optional
-             VK_KHR_GET_SURFACE_CAPABILITIES_2_EXTENSION_NAME, // optional
-             VK_KHR_GET_PHYSICAL_DEVICE_PROPERTIES_2_EXTENSION_NAME, // optional
-             };
+    std::vector<const char*> required_instance_extensions;
+    if (surface_type_ != CreateInfoFactory::SURFACE_NONE) {
+        required_instance_extensions.push_back(VK_KHR_SURFACE_EXTENSION_NAME);
+#ifdef VK_USE_PLATFORM_ANDROID_KHR
+        if (surface_type_ == CreateInfoFactory::SURFACE_PLATFORM) {
+            required_instance_extensions.push_back(VK_KHR_ANDROID_SURFACE_EXTENSION_NAME);
+        }
+#endif
+        if (surface_type_ == CreateInfoFactory::SURFACE_HEADLESS) {
+            required_instance_extensions.push_back(VK_EXT_HEADLESS_SURFACE_EXTENSION_NAME);
+        }
+        if (CheckInstanceExtensionSupport(extensionProperties, VK_EXT_SWAPCHAIN_COLOR_SPACE_EXTENSION_NAME)) {
+            required_instance_extensions.push_back(VK_EXT_SWAPCHAIN_COLOR_SPACE_EXTENSION_NAME); // optional
+        }
+        if (CheckInstanceExtensionSupport(extensionProperties, VK_KHR_GET_SURFACE_CAPABILITIES_2_EXTENSION_NAME)) {
+            required_instance_extensions.push_back(VK_KHR_GET_SURFACE_CAPABILITIES_2_EXTENSION_NAME); // optional
+        }
+    }
+    if (support_validation_) {
+        required_instance_extensions.push_back(VK_EXT_DEBUG_REPORT_EXTENSION_NAME);
+    }
+    required_instance_extensions.push_back(VK_KHR_GET_PHYSICAL_DEVICE_PROPERTIES_2_EXTENSION_NAME); // optional
     VkInstanceCreateInfo instanceCreateInfo {
         .sType = VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO,
-        .pNext = &debugReportCallbackCreateInfoExt,
+        .pNext = support_validation_ ? &debugReportCallbackCreateInfoExt : nullptr,
         .flags = 0,
         .pApplicationInfo = &applicationInfo,
-        .enabledLayerCount = static_cast<uint32_t>(required_instance_layers.size()),
+        .enabledLayerCount = support_validation_ ? static_cast<uint32_t>(required_instance_layers.size()) : 0,
         .ppEnabledLayerNames = required_instance_layers.data(),
         .enabledExtensionCount = static_cast<uint32_t>(required_instance_extensions.size()),
         .ppEnabledExtensionNames = required_instance_extensions.data()
     };
     instance_ = VulkanInstance::CreateInstance(&instanceCreateInfo);
     assert(instance_);
-    instance_->CreateDebugReportCallbackEXT(&debugReportCallbackCreateInfoExt, &callback_);
+    if (support_validation_) {
+        instance_->CreateDebugReportCallbackEXT(&debugReportCallbackCreateInfoExt, &callback_);
+    }
 }
 
 void ComputerShader::DestroyInstance() {
     if (instance_) {
-        instance_->DestroyDebugReportCallbackEXT(callback_);
+        if (support_validation_) {
+            instance_->DestroyDebugReportCallbackEXT(callback_);
+        }
         VulkanInstance::DestroyInstance(&instance_);
     }
 }
@@ -230,18 +270,35 @@ bool ComputerShader::PickPhysicalDevice() {
 }
 
 void ComputerShader::CreateSurface(ANativeWindow* window) {
-    VkAndroidSurfaceCreateInfoKHR info{
-        .sType = VK_STRUCTURE_TYPE_ANDROID_SURFACE_CREATE_INFO_KHR,
-        .pNext = nullptr,
-        .flags = 0,
-        .window = window
-    };
-    surface_ = instance_->CreateAndroidSurface(&info);
+    if (surface_type_ == CreateInfoFactory::SURFACE_NONE) {
+        // 渲染到 off-screen image
+        return;
+    }
+    if (surface_type_ == CreateInfoFactory::SURFACE_HEADLESS) {
+        VkHeadlessSurfaceCreateInfoEXT info{
+            .sType = VK_STRUCTURE_TYPE_HEADLESS_SURFACE_CREATE_INFO_EXT,
+            .pNext = nullptr,
+            .flags = 0
+        };
+        surface_ = instance_->CreateHeadlessSurface(&info);
+    } else {
+#ifdef VK_USE_PLATFORM_ANDROID_KHR
+        VkAndroidSurfaceCreateInfoKHR info{
+            .sType = VK_STRUCTURE_TYPE_ANDROID_SURFACE_CREATE_INFO_KHR,
+            .pNext = nullptr,
+            .flags = 0,
+            .window = window
+        };
+        surface_ = instance_->CreateAndroidSurface(&info);
+#else
+        (void) window;
+#endif
+    }
     assert(surface_);
 }
 
 void ComputerShader::DestroySurface() {
-    VulkanInstance::DestroyAndroidSurface(&surface_);
+    VulkanInstance::DestroySurface(&surface_);
 }
 
 void ComputerShader::CreateLogicalDevice() {
@@ -253,8 +310,8 @@ void ComputerShader::CreateLogicalDevice() {
             break;
         }
     }
-    assert(physical_device_->GetSurfaceSupport(queue_family_index_,
-                                               surface_->surface()));
+    assert(surface_ == nullptr || physical_device_->GetSurfaceSupport(queue_family_index_,
+                                                                      surface_->surface()));
 
     float queuePriorities = 1.0;
 
@@ -280,7 +337,7 @@ void ComputerShader::CreateLogicalDevice() {
         .flags = 0,
         .queueCreateInfoCount = 1,
         .pQueueCreateInfos = &deviceQueueCreateInfo,
-        .enabledLayerCount = 1,
+        .enabledLayerCount = support_validation_ ? 1u : 0u,
         .ppEnabledLayerNames = &VK_LAYER_KHRONOS_validation,
         .enabledExtensionCount = 1,
         .ppEnabledExtensionNames = &SWAPCHAIN_EXTENSION,
@@ -312,51 +369,41 @@ void ComputerShader::DestroyCommandPool() {
     VulkanLogicDevice::DestroyCommandPool(&graphic_command_pool_);
 }
 
-void ComputerShader::CreateCommandBuffer() {
-    // 这里也应该分配 FRAME_IN_FLIGHT 个 CommandBuffer
-    graphic_command_buffer_ = graphic_command_pool_->AllocateCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY);
-}
-
-void ComputerShader::DestroyCommandBuffer() {
-    VulkanCommandPool::FreeCommandBuffer(&graphic_command_buffer_);
-}
-
-void ComputerShader::CreateSyncObjects() {
-    cpu_wait_fence_.resize(FRAME_IN_FLIGHT);
-    swap_chain_image_available_semaphore_.resize(FRAME_IN_FLIGHT);
-    render_finished_semaphore_.resize(FRAME_IN_FLIGHT);
-    for (int i=0; i<FRAME_IN_FLIGHT; ++i) {
-        VkFenceCreateInfo fenceCreateInfo {
-                .sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO,
-                .pNext = nullptr,
-                .flags = VK_FENCE_CREATE_SIGNALED_BIT
-        };
-        cpu_wait_fence_[i] = logic_device_->CreateFence(&fenceCreateInfo);
-
-        VkSemaphoreCreateInfo semaphoreCreateInfo{
-                .sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO,
-                .pNext = nullptr,
-                .flags = 0 // flags is reserved for future use.
-        };
-        swap_chain_image_available_semaphore_[i] = logic_device_->CreateSemaphore(&semaphoreCreateInfo);
-        render_finished_semaphore_[i] = logic_device_->CreateSemaphore(&semaphoreCreateInfo);
+void ComputerShader::CreateFrameContexts() {
+    frame_contexts_ = new FrameContextRing(logic_device_, graphic_command_pool_);
+    int ret = frame_contexts_->Create(frames_in_flight_, sizeof(delta_time_t));
+    assert(ret == 0);
+    if (GpuTimestampsRequested()) {
+        std::vector<VkQueueFamilyProperties> family_properties = physical_device_->GetQueueFamilyProperties();
+        frame_contexts_->EnableGpuTimestamps(family_properties[queue_family_index_].timestampValidBits);
     }
 }
 
-void ComputerShader::DestroySyncObjects() {
-    for (int i=0; i<FRAME_IN_FLIGHT; ++i) {
-        VulkanLogicDevice::DestroySemaphore(&render_finished_semaphore_[i]);
-        VulkanLogicDevice::DestroySemaphore(&swap_chain_image_available_semaphore_[i]);
-        VulkanLogicDevice::DestroyFence(&cpu_wait_fence_[i]);
-    }
-    render_finished_semaphore_.clear();
-    swap_chain_image_available_semaphore_.clear();
-    cpu_wait_fence_.clear();
+void ComputerShader::DestroyFrameContexts() {
+    delete frame_contexts_;
+    frame_contexts_ = nullptr;
 }
 
-void ComputerShader::CreateComputerPipeline() {
-    particle_ = new Particle(logic_device_, VK_FORMAT_R8G8B8A8_SRGB, swap_chain_extent_);
-    particle_->CreatePipeline();
+void ComputerShader::CreatePipelines() {
+    particle_ = new Particle(logic_device_, VK_FORMAT_R8G8B8A8_SRGB, swap_chain_extent_, frame_contexts_,
+                             particle_count_);
+    particle_graphic_ = new ParticleGraphic(logic_device_, VK_FORMAT_R8G8B8A8_SRGB, swap_chain_extent_, particle_);
+
+    // particle_graphic_ 只在 Draw 时用到 particle_ 的 buffer, 两个 pipeline 互不依赖.
+    // 先并行编译所有 shader stage, 再并行创建两个 pipeline, 返回时都已完成
+    ParallelSetup setup;
+    VulkanObject::AddShaderTasks(&setup, "particle", particle_->shader_sources());
+    VulkanObject::AddShaderTasks(&setup, "particle_graphic", particle_graphic_->shader_sources());
+    setup.Run();
+    setup.Add("particle", ParallelSetup::PHASE_PIPELINE, [this]() {
+        return particle_->CreatePipeline();
+    });
+    setup.Add("particle_graphic", ParallelSetup::PHASE_PIPELINE, [this]() {
+        return particle_graphic_->CreatePipeline();
+    });
+    setup.Run();
+    setup.LogStats("ComputerShader");
+    benchmark_stats_.AddSetupObjects(setup.object_timings());
 }
 
 void ComputerShader::DestroyComputerPipeline() {
@@ -365,18 +412,24 @@ void ComputerShader::DestroyComputerPipeline() {
     particle_ = nullptr;
 }
 
-void ComputerShader::CreateGraphicPipeline() {
-    particle_graphic_ = new ParticleGraphic(logic_device_, VK_FORMAT_R8G8B8A8_SRGB, swap_chain_extent_, particle_);
-    particle_graphic_->CreatePipeline();
-}
-
 void ComputerShader::DestroyGraphicPipeline() {
     particle_graphic_->DestroyPipeline();
     delete particle_graphic_;
     particle_graphic_ = nullptr;
 }
 
-void ComputerShader::CreateSwapChain(ANativeWindow* window) {
+void ComputerShader::CreateSwapChain(ANativeWindow* window, VkSwapchainKHR old_swap_chain) {
+    if (surface_ == nullptr) {
+        surface_format_.format = VK_FORMAT_R8G8B8A8_SRGB;
+        surface_format_.colorSpace = VK_COLOR_SPACE_SRGB_NONLINEAR_KHR;
+        swap_chain_extent_.width = headless_width_;
+        swap_chain_extent_.height = headless_height_;
+        auto* backend = new OffscreenPresentBackend(logic_device_, surface_format_.format, swap_chain_extent_);
+        int ret = backend->Create(frame_contexts_->frame_count());
+        assert(ret == 0);
+        present_backend_ = backend;
+        return;
+    }
     VkSurfaceCapabilitiesKHR capabilities{};
     physical_device_->GetSurfaceCapabilities(surface_->surface(), &capabilities);
 
@@ -416,12 +469,10 @@ void ComputerShader::CreateSwapChain(ANativeWindow* window) {
         }
         LOG_D("HJ", "\t present mode %d\n", mode);
     }
-    if (capabilities.currentExtent.width != std::numeric_limits<uint32_t>::max()) {
-        swap_chain_extent_ = capabilities.currentExtent;
-    } else {
-        swap_chain_extent_.width = ANativeWindow_getWidth(window);
-        swap_chain_extent_.height = ANativeWindow_getHeight(window);
+    if (frame_pacer_.present_bound()) {
+        present_mode = VK_PRESENT_MODE_FIFO_KHR;
     }
+    swap_chain_extent_ = ChooseSwapExtent(capabilities, window);
 
     VkSwapchainCreateInfoKHR swapchainCreateInfoKhr{
         .sType = VK_STRUCTURE_TYPE_SWAPCHAIN_CREATE_INFO_KHR,
@@ -441,18 +492,63 @@ void ComputerShader::CreateSwapChain(ANativeWindow* window) {
         .compositeAlpha = VK_COMPOSITE_ALPHA_INHERIT_BIT_KHR,
         .presentMode = present_mode,
         .clipped = VK_TRUE,
-        .oldSwapchain = VK_NULL_HANDLE
+        .oldSwapchain = old_swap_chain
     };
-    swap_chain_ = logic_device_->CreateSwapChain(&swapchainCreateInfoKhr);
-    assert(swap_chain_);
+    VulkanSwapChain* swap_chain = logic_device_->CreateSwapChain(&swapchainCreateInfoKhr);
+    assert(swap_chain);
+    present_backend_ = new SwapChainPresentBackend(logic_device_, swap_chain, surface_format_.format, swap_chain_extent_);
+}
+
+VkExtent2D ComputerShader::ChooseSwapExtent(const VkSurfaceCapabilitiesKHR& capabilities,
+                                            ANativeWindow* window) const {
+    if (capabilities.currentExtent.width != std::numeric_limits<uint32_t>::max()) {
+        return capabilities.currentExtent;
+    } else if (window == nullptr) {
+        // headless surface 没有 currentExtent, 由 SetHeadless 指定
+        return VkExtent2D{headless_width_, headless_height_};
+    }
+    return VkExtent2D{static_cast<uint32_t>(ANativeWindow_getWidth(window)),
+                      static_cast<uint32_t>(ANativeWindow_getHeight(window))};
 }
 
 void ComputerShader::DestroySwapChain() {
-    VulkanLogicDevice::DestroySwapChain(&swap_chain_);
+    delete present_backend_;
+    present_backend_ = nullptr;
+}
+
+void ComputerShader::RecreateSwapChain(bool out_of_date) {
+    if (surface_ == nullptr) {
+        return;
+    }
+    if (!out_of_date) {
+        VkSurfaceCapabilitiesKHR capabilities{};
+        physical_device_->GetSurfaceCapabilities(surface_->surface(), &capabilities);
+        // currentExtent 可能是 0xFFFFFFFF, 和 CreateSwapChain 一样换算之后再比较
+        VkExtent2D extent = ChooseSwapExtent(capabilities, window_);
+        if (extent.width == swap_chain_extent_.width && extent.height == swap_chain_extent_.height) {
+            return;
+        }
+    }
+    auto begin = std::chrono::steady_clock::now();
+    logic_device_->DeviceWaitIdle();
+    DestroyFrameBuffers();
+    DestroyImageViews();
+
+    auto* old_backend = static_cast<SwapChainPresentBackend*>(present_backend_);
+    CreateSwapChain(window_, old_backend->swap_chain());
+    delete old_backend;
+
+    CreateImageViews();
+    particle_graphic_->Resize(swap_chain_extent_);
+    CreateFrameBuffers(particle_graphic_->render_pass()->render_pass());
+    LOG_D("HJ", "swap chain recreated %ux%u in %.3f ms, %.3f ms after surfaceChanged\n",
+          swap_chain_extent_.width, swap_chain_extent_.height,
+          std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - begin).count(),
+          MillisecondsSinceSurfaceChanged());
 }
 
 void ComputerShader::CreateImageViews() {
-    std::vector<VkImage> swap_chain_images = swap_chain_->GetImages();
+    std::vector<VkImage> swap_chain_images = present_backend_->GetImages();
     for (const auto& image : swap_chain_images) {
         VkImageViewCreateInfo imageViewCreateInfo{
             .sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO,
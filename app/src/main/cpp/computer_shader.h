@@ -8,6 +8,9 @@
 #include "vulkan_physical_device.h"
 #include "particle.h"
 #include "particle_graphic.h"
+#include "frame_context.h"
+#include "present_backend.h"
+#include "create_info_factory.h"
 
 class ComputerShader : public TutorialBase {
 public:
@@ -28,18 +31,19 @@ private:
 
     void CreateCommandPool();
     void DestroyCommandPool();
-    void CreateCommandBuffer();
-    void DestroyCommandBuffer();
-    void CreateSyncObjects();
-    void DestroySyncObjects();
+    void CreateFrameContexts();
+    void DestroyFrameContexts();
 
-    void CreateComputerPipeline();
+    // 同时创建 particle_ 和 particle_graphic_ 的 pipeline
+    void CreatePipelines();
     void DestroyComputerPipeline();
-    void CreateGraphicPipeline();
     void DestroyGraphicPipeline();
 
-    void CreateSwapChain(ANativeWindow* window);
+    void CreateSwapChain(ANativeWindow* window, VkSwapchainKHR old_swap_chain);
+    // 和 Tutorial::ChooseSwapExtent 一样处理没有 currentExtent (0xFFFFFFFF) 的 surface
+    VkExtent2D ChooseSwapExtent(const VkSurfaceCapabilitiesKHR& capabilities, ANativeWindow* window) const;
     void DestroySwapChain();
+    void RecreateSwapChain(bool out_of_date);
     void CreateImageViews();
     void DestroyImageViews();
     void CreateFrameBuffers(VkRenderPass renderPass);
@@ -47,6 +51,8 @@ private:
 
     static void QueryPhysicalDeviceInfo(const VulkanPhysicalDevice& device);
     VulkanInstance* instance_;
+    bool support_validation_;
+    CreateInfoFactory::SurfaceType surface_type_;
     VkDebugReportCallbackEXT callback_;
     VulkanPhysicalDevice* physical_device_;
 
@@ -54,23 +60,17 @@ private:
     uint32_t queue_family_index_;
     VulkanLogicDevice* logic_device_;
     VulkanQueue* queue_;
-    VulkanSwapChain* swap_chain_;
+    PresentBackend* present_backend_;
     std::vector<VulkanImageView*> swap_chain_image_views_;
     std::vector<VulkanFrameBuffer*> frame_buffers_;
     VkSurfaceFormatKHR surface_format_;
     VkExtent2D swap_chain_extent_;
 
     VulkanCommandPool* graphic_command_pool_;
-    VulkanCommandBuffer* graphic_command_buffer_;
-
-    std::vector<VulkanFence*> cpu_wait_fence_;
-    std::vector<VulkanSemaphore*> swap_chain_image_available_semaphore_;
-    std::vector<VulkanSemaphore*> render_finished_semaphore_;
+    FrameContextRing* frame_contexts_;
 
     Particle* particle_;
     ParticleGraphic* particle_graphic_;
-
-    const static int FRAME_IN_FLIGHT = 1;
 };
 
 
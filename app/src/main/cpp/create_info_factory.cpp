@@ -4,7 +4,10 @@
 
 #include "create_info_factory.h"
 
+#include <cstring>
 #include "log.h"
+#include "vulkan_instance.h"
+#include "vulkan_utils.h"
 
 VkBool32 VKAPI_PTR debug_report_callback(
         VkDebugReportFlagsEXT                       flags,
@@ -42,11 +45,26 @@ CreateInfoFactory::CreateInfoFactory() : features_{} {
     features_.samplerAnisotropy = VK_TRUE;
 }
 
+CreateInfoFactory::SurfaceType CreateInfoFactory::ChooseSurfaceType(bool headless, bool use_headless_surface) {
+    if (!headless) {
+        return SURFACE_PLATFORM;
+    }
+    if (!use_headless_surface) {
+        return SURFACE_NONE;
+    }
+    std::vector<VkExtensionProperties> extension_properties = VulkanInstance::EnumerateExtensionProperties();
+    if (CheckInstanceExtensionSupport(extension_properties, VK_EXT_HEADLESS_SURFACE_EXTENSION_NAME)) {
+        return SURFACE_HEADLESS;
+    }
+    LOG_W("CreateInfoFactory", "%s not supported, render to off-screen images\n", VK_EXT_HEADLESS_SURFACE_EXTENSION_NAME);
+    return SURFACE_NONE;
+}
+
 VkDebugReportCallbackCreateInfoEXT CreateInfoFactory::GetDebugReportCallbackCreateInfo() const {
     return debug_report_callback_create_info_;
 }
 
-VkInstanceCreateInfo CreateInfoFactory::GetInstanceCreateInfo(bool enable_validation_layer) const {
+VkInstanceCreateInfo CreateInfoFactory::GetInstanceCreateInfo(bool enable_validation_layer, SurfaceType surface_type) {
     /* typedef struct VkInstanceCreateInfo {
         VkStructureType             sType;
         const void*                 pNext; // VkDebugReportCallbackCreateInfoEXT、VkDebugUtilsMessengerCreateInfoEXT、VkDirectDriverLoadingListLUNARG、VkExportMetalObjectCreateInfoEXT、VkLayerSettingsCreateInfoEXT、VkValidationFeaturesEXT或VkValidationFlagsEXT
@@ -57,6 +75,20 @@ VkInstanceCreateInfo CreateInfoFactory::GetInstanceCreateInfo(bool enable_valida
         uint32_t                    enabledExtensionCount;
         const char* const*          ppEnabledExtensionNames;
     } VkInstanceCreateInfo; */
+    instance_extensions_.clear();
+    if (surface_type == SURFACE_PLATFORM) {
+        instance_extensions_.push_back(VK_KHR_SURFACE_EXTENSION_NAME);
+#ifdef VK_USE_PLATFORM_ANDROID_KHR
+        instance_extensions_.push_back(VK_KHR_ANDROID_SURFACE_EXTENSION_NAME);
+#endif
+    } else if (surface_type == SURFACE_HEADLESS) {
+        instance_extensions_.push_back(VK_KHR_SURFACE_EXTENSION_NAME);
+        instance_extensions_.push_back(VK_EXT_HEADLESS_SURFACE_EXTENSION_NAME);
+    }
+    if (enable_validation_layer) {
+        instance_extensions_.push_back(VK_EXT_DEBUG_REPORT_EXTENSION_NAME);
+    }
+
     VkInstanceCreateInfo instance_create_info{};
     instance_create_info.sType = VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO;
     if (enable_validation_layer) {
@@ -66,17 +98,16 @@ VkInstanceCreateInfo CreateInfoFactory::GetInstanceCreateInfo(bool enable_valida
     if (enable_validation_layer) {
         instance_create_info.enabledLayerCount = static_cast<uint32_t>(required_instance_layers_.size());;
         instance_create_info.ppEnabledLayerNames = required_instance_layers_.data();
-        instance_create_info.enabledExtensionCount = static_cast<uint32_t>(required_instance_extensions_with_validation_.size());
-        instance_create_info.ppEnabledExtensionNames = required_instance_extensions_with_validation_.data();
     } else {
         instance_create_info.enabledLayerCount = 0;
         instance_create_info.ppEnabledLayerNames = nullptr;
-        instance_create_info.enabledExtensionCount = static_cast<uint32_t>(required_instance_extensions_.size());
-        instance_create_info.ppEnabledExtensionNames = required_instance_extensions_.data();
     }
+    instance_create_info.enabledExtensionCount = static_cast<uint32_t>(instance_extensions_.size());
+    instance_create_info.ppEnabledExtensionNames = instance_extensions_.empty() ? nullptr : instance_extensions_.data();
     return instance_create_info;
 }
 
+#ifdef VK_USE_PLATFORM_ANDROID_KHR
 VkAndroidSurfaceCreateInfoKHR CreateInfoFactory::GetAndroidSurfaceCreateInfo(ANativeWindow* window) const {
     /*typedef struct VkAndroidSurfaceCreateInfoKHR {
         VkStructureType                   sType;
@@ -89,9 +120,22 @@ VkAndroidSurfaceCreateInfoKHR CreateInfoFactory::GetAndroidSurfaceCreateInfo(ANa
     info.window = window;
     return info;
 }
+#endif
+
+VkHeadlessSurfaceCreateInfoEXT CreateInfoFactory::GetHeadlessSurfaceCreateInfo() const {
+    /*typedef struct VkHeadlessSurfaceCreateInfoEXT {
+        VkStructureType                    sType;
+        const void*                        pNext;
+        VkHeadlessSurfaceCreateFlagsEXT    flags;
+    } VkHeadlessSurfaceCreateInfoEXT;*/
+    VkHeadlessSurfaceCreateInfoEXT info{};
+    info.sType = VK_STRUCTURE_TYPE_HEADLESS_SURFACE_CREATE_INFO_EXT;
+    return info;
+}
 
 std::vector<VkDeviceQueueCreateInfo> CreateInfoFactory::GetDeviceQueueCreateInfos(uint32_t graphic_queue_family_index,
-                                                               uint32_t present_queue_family_index) const {
+                                                               uint32_t present_queue_family_index,
+                                                               uint32_t transfer_queue_family_index) const {
     /* typedef struct VkDeviceQueueCreateInfo {
         VkStructureType             sType;
         const void*                 pNext;
@@ -113,9 +157,31 @@ std::vector<VkDeviceQueueCreateInfo> CreateInfoFactory::GetDeviceQueueCreateInfo
         queue_create_info.pQueuePriorities = &queue_priority_;
         device_queue_create_infos.push_back(queue_create_info);
     }
+    if (transfer_queue_family_index != graphic_queue_family_index &&
+            transfer_queue_family_index != present_queue_family_index) {
+        queue_create_info.queueFamilyIndex = transfer_queue_family_index;
+        queue_create_info.queueCount = 1;
+        queue_create_info.pQueuePriorities = &queue_priority_;
+        device_queue_create_infos.push_back(queue_create_info);
+    }
     return device_queue_create_infos;
 }
 
+void CreateInfoFactory::EnableTextureCompression(const VkPhysicalDeviceFeatures& supported) {
+    features_.textureCompressionBC = supported.textureCompressionBC;
+    features_.textureCompressionETC2 = supported.textureCompressionETC2;
+    features_.textureCompressionASTC_LDR = supported.textureCompressionASTC_LDR;
+}
+
+void CreateInfoFactory::EnableExternalMemoryHost() {
+    for (const char* extension : device_extensions_) {
+        if (strcmp(extension, VK_EXT_EXTERNAL_MEMORY_HOST_EXTENSION_NAME) == 0) {
+            return;
+        }
+    }
+    device_extensions_.push_back(VK_EXT_EXTERNAL_MEMORY_HOST_EXTENSION_NAME);
+}
+
 VkDeviceCreateInfo CreateInfoFactory::GetDeviceCreateInfo(bool enable_validation_layer, const std::vector<VkDeviceQueueCreateInfo>& device_queue_create_infos) const {
     /* typedef struct VkDeviceCreateInfo {
         VkStructureType                    sType;
@@ -137,8 +203,8 @@ VkDeviceCreateInfo CreateInfoFactory::GetDeviceCreateInfo(bool enable_validation
         device_create_info.enabledLayerCount = 1;
         device_create_info.ppEnabledLayerNames = required_instance_layers_.data();
     }
-    device_create_info.enabledExtensionCount = static_cast<uint32_t>(required_device_extensions_.size());
-    device_create_info.ppEnabledExtensionNames = required_device_extensions_.data();
+    device_create_info.enabledExtensionCount = static_cast<uint32_t>(device_extensions_.size());
+    device_create_info.ppEnabledExtensionNames = device_extensions_.data();
     device_create_info.pEnabledFeatures = &features_;
     return device_create_info;
 }
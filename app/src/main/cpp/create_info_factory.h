@@ -9,17 +9,40 @@
 
 class CreateInfoFactory {
 public:
+    enum SurfaceType {
+        // 没有 surface, 渲染到 off-screen image
+        SURFACE_NONE = 0,
+        // 平台窗口, 目前只有 Android
+        SURFACE_PLATFORM,
+        // VK_EXT_headless_surface
+        SURFACE_HEADLESS,
+    };
+
     CreateInfoFactory();
     ~CreateInfoFactory() = default;
 
+    // headless 时优先 VK_EXT_headless_surface, instance 不支持就退回 SURFACE_NONE
+    static SurfaceType ChooseSurfaceType(bool headless, bool use_headless_surface);
+
     VkDebugReportCallbackCreateInfoEXT GetDebugReportCallbackCreateInfo() const;
-    VkInstanceCreateInfo GetInstanceCreateInfo(bool enable_validation_layer) const;
+    // 返回的 create info 指向 factory 内部的 extension 列表, 下一次调用前有效
+    VkInstanceCreateInfo GetInstanceCreateInfo(bool enable_validation_layer, SurfaceType surface_type);
+#ifdef VK_USE_PLATFORM_ANDROID_KHR
     VkAndroidSurfaceCreateInfoKHR GetAndroidSurfaceCreateInfo(ANativeWindow* window) const;
+#endif
+    VkHeadlessSurfaceCreateInfoEXT GetHeadlessSurfaceCreateInfo() const;
 
+    // transfer_queue_family_index 和前两个相同时不会重复创建
     std::vector<VkDeviceQueueCreateInfo> GetDeviceQueueCreateInfos(uint32_t graphic_queue_family_index,
-                                                                   uint32_t present_queue_family_index) const;
+                                                                   uint32_t present_queue_family_index,
+                                                                   uint32_t transfer_queue_family_index) const;
     VkDeviceCreateInfo GetDeviceCreateInfo(bool enable_validation_layer,
                                            const std::vector<VkDeviceQueueCreateInfo>& device_queue_create_infos) const;
+    // 打开 supported 里有的 BC, ETC2, ASTC LDR 纹理压缩 feature, 在 GetDeviceCreateInfo 之前调用
+    void EnableTextureCompression(const VkPhysicalDeviceFeatures& supported);
+    // 打开 VK_EXT_external_memory_host, 调用者先用 GetMinImportedHostPointerAlignment 确认支持.
+    // 在 GetDeviceCreateInfo 之前调用
+    void EnableExternalMemoryHost();
 
     VkSwapchainCreateInfoKHR GetSwapChainCreateInfo(VkSurfaceKHR surface, uint32_t min_image_count,
                                                     VkSurfaceFormatKHR surface_format, VkExtent2D swap_chain_extent,
@@ -50,9 +73,8 @@ private:
     const uint32_t application_version_ = VK_MAKE_VERSION(1, 0, 0);
     const uint32_t vulkan_api_version_ = VK_API_VERSION_1_3;
     const std::vector<const char*> required_instance_layers_ = {"VK_LAYER_KHRONOS_validation"};
-    const std::vector<const char*> required_instance_extensions_ = {VK_KHR_SURFACE_EXTENSION_NAME, VK_KHR_ANDROID_SURFACE_EXTENSION_NAME};
-    const std::vector<const char*> required_instance_extensions_with_validation_ = {VK_KHR_SURFACE_EXTENSION_NAME, VK_KHR_ANDROID_SURFACE_EXTENSION_NAME, VK_EXT_DEBUG_REPORT_EXTENSION_NAME};
+    std::vector<const char*> instance_extensions_;
     const float queue_priority_ = 1.0f;
-    const std::vector<const char*> required_device_extensions_ = { VK_KHR_SWAPCHAIN_EXTENSION_NAME };
+    std::vector<const char*> device_extensions_ = { VK_KHR_SWAPCHAIN_EXTENSION_NAME };
 };
 
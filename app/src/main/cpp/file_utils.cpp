@@ -0,0 +1,62 @@
+//
+// Created by hj6231 on 2024/2/13.
+//
+
+#include "file_utils.h"
+
+#include <cerrno>
+#include <cstdio>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "log.h"
+
+bool ReadFile(const std::string& path, std::vector<uint8_t>* content) {
+    FILE* file = fopen(path.c_str(), "rb");
+    if (file == nullptr) {
+        return false;
+    }
+    bool ok = fseek(file, 0, SEEK_END) == 0;
+    long size = ok ? ftell(file) : -1;
+    ok = size >= 0 && fseek(file, 0, SEEK_SET) == 0;
+    if (ok) {
+        content->resize(static_cast<size_t>(size));
+        ok = fread(content->data(), 1, content->size(), file) == content->size();
+    }
+    fclose(file);
+    if (!ok) {
+        content->clear();
+    }
+    return ok;
+}
+
+bool WriteFileAtomic(const std::string& path, const std::vector<uint8_t>& content) {
+    std::string tmp_path = path + ".tmp";
+    FILE* file = fopen(tmp_path.c_str(), "wb");
+    if (file == nullptr) {
+        LOG_E("WriteFileAtomic", "open %s failed\n", tmp_path.c_str());
+        return false;
+    }
+    bool ok = fwrite(content.data(), 1, content.size(), file) == content.size() &&
+            fflush(file) == 0 &&
+            fsync(fileno(file)) == 0;
+    ok = fclose(file) == 0 && ok;
+    if (!ok || rename(tmp_path.c_str(), path.c_str()) != 0) {
+        LOG_E("WriteFileAtomic", "write %s failed\n", path.c_str());
+        remove(tmp_path.c_str());
+        return false;
+    }
+    return true;
+}
+
+bool MakeDirectory(const std::string& path) {
+    return mkdir(path.c_str(), 0755) == 0 || errno == EEXIST;
+}
+
+uint64_t Fnv1a64(const void* data, size_t size, uint64_t hash) {
+    auto* bytes = static_cast<const uint8_t*>(data);
+    for (size_t i = 0; i < size; ++i) {
+        hash ^= bytes[i];
+        hash *= 0x100000001b3ull;
+    }
+    return hash;
+}
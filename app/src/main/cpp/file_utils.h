@@ -0,0 +1,21 @@
+//
+// Created by hj6231 on 2024/2/13.
+//
+
+#pragma once
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// 读整个文件, 文件不存在或者读失败返回 false
+bool ReadFile(const std::string& path, std::vector<uint8_t>* content);
+
+// 先写 path.tmp, fsync 之后 rename 到 path. 同一个目录下 rename 是原子的,
+// 读的一方只会看到完整的旧文件或者新文件, 中途崩溃只会留下 .tmp
+bool WriteFileAtomic(const std::string& path, const std::vector<uint8_t>& content);
+
+// 已经存在时也返回 true, 只创建最后一级
+bool MakeDirectory(const std::string& path);
+
+// FNV-1a, 用来发现截断和损坏的缓存文件, 以及做缓存的 key
+uint64_t Fnv1a64(const void* data, size_t size, uint64_t hash = 0xcbf29ce484222325ull);
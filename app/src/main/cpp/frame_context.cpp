@@ -0,0 +1,255 @@
+//
+// Created by hj6231 on 2024/2/5.
+//
+
+#include "frame_context.h"
+
+#include <cassert>
+#include <chrono>
+#include "log.h"
+
+static int64_t NowNs() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+FrameContextRing::FrameContextRing(VulkanLogicDevice* device, VulkanCommandPool* command_pool) :
+        device_(device),
+        command_pool_(command_pool),
+        current_(0),
+        uniform_buffer_(nullptr),
+        uniform_memory_(nullptr),
+        uniform_mapped_(nullptr),
+        uniform_slice_size_(0),
+        fence_wait_ns_(0),
+        frames_(0),
+        gpu_timestamps_(false),
+        timestamp_mask_(0),
+        timestamp_period_(0.0f) {
+}
+
+FrameContextRing::~FrameContextRing() {
+    Destroy();
+}
+
+int FrameContextRing::Create(uint32_t frame_count, VkDeviceSize uniform_slice_size) {
+    assert(contexts_.empty());
+    if (frame_count < MIN_FRAME_IN_FLIGHT) {
+        frame_count = MIN_FRAME_IN_FLIGHT;
+    } else if (frame_count > MAX_FRAME_IN_FLIGHT) {
+        frame_count = MAX_FRAME_IN_FLIGHT;
+    }
+    contexts_.resize(frame_count);
+    if (uniform_slice_size > 0) {
+        CreateUniformBuffer(uniform_slice_size);
+    }
+
+    VkFenceCreateInfo fence_info{};
+    fence_info.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+    // 第一次 WaitCurrent 不能阻塞
+    fence_info.flags = VK_FENCE_CREATE_SIGNALED_BIT;
+    VkSemaphoreCreateInfo semaphore_info{};
+    semaphore_info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+
+    for (uint32_t i = 0; i < frame_count; ++i) {
+        frame_context_t& context = contexts_[i];
+        context.index = i;
+        context.timestamp_query_pool = nullptr;
+        context.timing = frame_timing_t{};
+        context.record_begin_ns = 0;
+        context.record_ns = 0;
+        context.submit_ns = 0;
+        context.pending = false;
+        context.command_buffer = command_pool_->AllocateCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY);
+        context.image_available_semaphore = device_->CreateSemaphore(&semaphore_info);
+        context.render_finished_semaphore = device_->CreateSemaphore(&semaphore_info);
+        context.in_flight_fence = device_->CreateFence(&fence_info);
+        context.uniform_offset = uniform_slice_size_ * i;
+        context.uniform_data = uniform_mapped_ ? static_cast<char*>(uniform_mapped_) + context.uniform_offset : nullptr;
+        if (context.command_buffer == nullptr || context.image_available_semaphore == nullptr ||
+                context.render_finished_semaphore == nullptr || context.in_flight_fence == nullptr) {
+            LOG_E("FrameContextRing", "create frame context %u failed\n", i);
+            Destroy();
+            return -1;
+        }
+    }
+    current_ = 0;
+    LOG_D("FrameContextRing", "%u frames in flight, uniform slice %llu\n",
+          frame_count, (long long unsigned int) uniform_slice_size_);
+    return 0;
+}
+
+void FrameContextRing::Destroy() {
+    for (auto& context : contexts_) {
+        VulkanCommandPool::FreeCommandBuffer(&context.command_buffer);
+        VulkanLogicDevice::DestroySemaphore(&context.image_available_semaphore);
+        VulkanLogicDevice::DestroySemaphore(&context.render_finished_semaphore);
+        VulkanLogicDevice::DestroyFence(&context.in_flight_fence);
+        VulkanLogicDevice::DestroyQueryPool(&context.timestamp_query_pool);
+    }
+    gpu_timestamps_ = false;
+    timestamp_results_.clear();
+    contexts_.clear();
+    DestroyUniformBuffer();
+}
+
+int FrameContextRing::EnableGpuTimestamps(uint32_t timestamp_valid_bits) {
+    VkPhysicalDeviceProperties properties{};
+    device_->GetPhysicalDeviceProperties(&properties);
+    if (timestamp_valid_bits == 0 || properties.limits.timestampPeriod <= 0.0f) {
+        LOG_W("FrameContextRing", "timestamp query not supported\n");
+        return -1;
+    }
+    VkQueryPoolCreateInfo query_pool_info{};
+    query_pool_info.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+    query_pool_info.queryType = VK_QUERY_TYPE_TIMESTAMP;
+    query_pool_info.queryCount = MAX_TIMESTAMP_SCOPES * 2;
+    for (auto& context : contexts_) {
+        context.timestamp_query_pool = device_->CreateQueryPool(&query_pool_info);
+        if (context.timestamp_query_pool == nullptr) {
+            LOG_E("FrameContextRing", "create timestamp query pool failed\n");
+            return -1;
+        }
+        context.command_buffer->SetTimestampQueryPool(context.timestamp_query_pool->query_pool(),
+                                                      query_pool_info.queryCount);
+        context.timing.gpu_scopes.reserve(MAX_TIMESTAMP_SCOPES);
+    }
+    // 每个 query 一个结果加一个 availability
+    timestamp_results_.resize(query_pool_info.queryCount * 2);
+    timestamp_mask_ = timestamp_valid_bits >= 64 ? UINT64_MAX : ((1ull << timestamp_valid_bits) - 1);
+    timestamp_period_ = properties.limits.timestampPeriod;
+    gpu_timestamps_ = true;
+    return 0;
+}
+
+bool FrameContextRing::gpu_timestamps() const {
+    return gpu_timestamps_;
+}
+
+frame_context_t* FrameContextRing::WaitCurrent() {
+    frame_context_t* context = &contexts_[current_];
+    VkFence fence = context->in_flight_fence->fence();
+    auto begin = std::chrono::steady_clock::now();
+    device_->WaitForFences(1, &fence, VK_TRUE, UINT64_MAX);
+    fence_wait_ns_ += std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now() - begin).count();
+
+    context->timing.valid = false;
+    if (context->pending) {
+        context->pending = false;
+        context->timing.valid = true;
+        context->timing.cpu_record_ns = context->record_ns;
+        context->timing.submit_to_fence_ns = NowNs() - context->submit_ns;
+        context->timing.gpu_ns = 0;
+        context->timing.gpu_scopes.clear();
+        if (gpu_timestamps_) {
+            ReadGpuTimestamps(context);
+        }
+    }
+    return context;
+}
+
+void FrameContextRing::ReadGpuTimestamps(frame_context_t* context) {
+    const std::vector<timestamp_scope_t>& scopes = context->command_buffer->timestamp_scopes();
+    if (scopes.empty()) {
+        return;
+    }
+    // 只读实际用到的 query, 每个 query 后面跟一个 availability. 没有结束的 scope 的 end query 没有写入,
+    // 这时返回 VK_NOT_READY, 其余 query 的结果照样有效. 不带 WAIT_BIT, 不会阻塞
+    uint32_t query_count = static_cast<uint32_t>(scopes.size()) * 2;
+    VkResult ret = context->timestamp_query_pool->GetQueryPoolResults(0, query_count,
+                                                                     query_count * 2 * sizeof(uint64_t),
+                                                                     timestamp_results_.data(),
+                                                                     2 * sizeof(uint64_t),
+                                                                     VK_QUERY_RESULT_64_BIT |
+                                                                     VK_QUERY_RESULT_WITH_AVAILABILITY_BIT);
+    if (ret != VK_SUCCESS && ret != VK_NOT_READY) {
+        return;
+    }
+    for (const auto& scope : scopes) {
+        const uint64_t* begin_result = &timestamp_results_[scope.begin_query * 2];
+        const uint64_t* end_result = &timestamp_results_[(scope.begin_query + 1) * 2];
+        if (!scope.ended || begin_result[1] == 0 || end_result[1] == 0) {
+            continue;
+        }
+        uint64_t begin = begin_result[0] & timestamp_mask_;
+        uint64_t end = end_result[0] & timestamp_mask_;
+        uint64_t ticks = (end - begin) & timestamp_mask_;
+        gpu_scope_timing_t scope_timing{};
+        scope_timing.name = scope.name;
+        scope_timing.ns = static_cast<uint64_t>(ticks * static_cast<double>(timestamp_period_));
+        context->timing.gpu_scopes.push_back(scope_timing);
+    }
+    if (!context->timing.gpu_scopes.empty() &&
+            context->timing.gpu_scopes[0].name == VulkanCommandBuffer::FRAME_TIMESTAMP_SCOPE) {
+        context->timing.gpu_ns = context->timing.gpu_scopes[0].ns;
+    }
+}
+
+void FrameContextRing::BeginRecord(frame_context_t* context) {
+    context->record_begin_ns = NowNs();
+}
+
+void FrameContextRing::EndRecord(frame_context_t* context) {
+    context->submit_ns = NowNs();
+    context->record_ns = context->submit_ns - context->record_begin_ns;
+    context->pending = true;
+}
+
+void FrameContextRing::Advance() {
+    current_ = (current_ + 1) % contexts_.size();
+    ++frames_;
+}
+
+uint32_t FrameContextRing::frame_count() const {
+    return static_cast<uint32_t>(contexts_.size());
+}
+
+VkBuffer FrameContextRing::uniform_buffer() const {
+    return uniform_buffer_ ? uniform_buffer_->buffer() : VK_NULL_HANDLE;
+}
+
+VkDeviceSize FrameContextRing::uniform_slice_size() const {
+    return uniform_slice_size_;
+}
+
+uint64_t FrameContextRing::fence_wait_ns() const {
+    return fence_wait_ns_;
+}
+
+uint64_t FrameContextRing::frames() const {
+    return frames_;
+}
+
+void FrameContextRing::CreateUniformBuffer(VkDeviceSize uniform_slice_size) {
+    VkPhysicalDeviceProperties properties{};
+    device_->GetPhysicalDeviceProperties(&properties);
+    VkDeviceSize alignment = properties.limits.minUniformBufferOffsetAlignment;
+    if (alignment == 0) {
+        alignment = 1;
+    }
+    uniform_slice_size_ = (uniform_slice_size + alignment - 1) / alignment * alignment;
+
+    VkBufferCreateInfo buffer_info{};
+    buffer_info.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+    buffer_info.size = uniform_slice_size_ * contexts_.size();
+    buffer_info.usage = VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT;
+    buffer_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+    uniform_buffer_ = device_->CreateBuffer(&buffer_info);
+    assert(uniform_buffer_);
+
+    uniform_memory_ = device_->AllocateBufferMemory(uniform_buffer_, MEMORY_USAGE_CPU_TO_GPU);
+    assert(uniform_memory_);
+    uniform_memory_->BindBufferMemory(uniform_buffer_->buffer(), 0);
+    uniform_memory_->MapMemory(0, buffer_info.size, &uniform_mapped_);
+}
+
+void FrameContextRing::DestroyUniformBuffer() {
+    if (uniform_memory_ != nullptr && uniform_mapped_ != nullptr) {
+        uniform_memory_->UnmapMemory();
+        uniform_mapped_ = nullptr;
+    }
+    VulkanLogicDevice::FreeMemory(&uniform_memory_);
+    VulkanLogicDevice::DestroyBuffer(&uniform_buffer_);
+    uniform_slice_size_ = 0;
+}
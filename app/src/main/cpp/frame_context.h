@@ -0,0 +1,108 @@
+//
+// Created by hj6231 on 2024/2/5.
+//
+
+#pragma once
+#include <vector>
+#include <vulkan/vulkan.h>
+#include "vulkan_logic_device.h"
+
+// command buffer 里一个 timestamp scope 的 GPU 耗时
+typedef struct {
+    const char* name;
+    uint64_t ns;
+} gpu_scope_timing_t;
+
+// 一帧的耗时, 在这个 context 下一次 WaitCurrent 之后才能拿到
+typedef struct {
+    bool valid;
+    uint64_t cpu_record_ns;
+    // 从 submit 到 WaitCurrent 返回, frames in flight 为 1 时就是 GPU 完成这一帧的延迟
+    uint64_t submit_to_fence_ns;
+    // 整个 command buffer 的时间, 0 表示没有 timestamp query
+    uint64_t gpu_ns;
+    // 按录制顺序, 第一个是 VulkanCommandBuffer::FRAME_TIMESTAMP_SCOPE. 没有结束的 scope 不在里面
+    std::vector<gpu_scope_timing_t> gpu_scopes;
+} frame_timing_t;
+
+// 每一个 frame in flight 独占的资源
+typedef struct {
+    VulkanCommandBuffer* command_buffer;
+    VulkanSemaphore* image_available_semaphore;
+    VulkanSemaphore* render_finished_semaphore;
+    VulkanFence* in_flight_fence;
+    // FrameContextRing::uniform_buffer() 里这一帧的 slice, 录制这一帧时由 CPU 写入
+    VkDeviceSize uniform_offset;
+    void* uniform_data;
+    uint32_t index;
+    // 每个 timestamp scope 两个 query, 由 command buffer 写入
+    VulkanQueryPool* timestamp_query_pool;
+    // 上一次使用这个 context 的那一帧
+    frame_timing_t timing;
+    int64_t record_begin_ns;
+    int64_t record_ns;
+    int64_t submit_ns;
+    bool pending;
+} frame_context_t;
+
+class FrameContextRing {
+public:
+    FrameContextRing(VulkanLogicDevice* device, VulkanCommandPool* command_pool);
+    FrameContextRing(const FrameContextRing&) = delete;
+    ~FrameContextRing();
+
+    // frame_count 限制在 [MIN_FRAME_IN_FLIGHT, MAX_FRAME_IN_FLIGHT]. uniform_slice_size 为 0 时不创建 uniform buffer,
+    // 否则按 minUniformBufferOffsetAlignment 对齐
+    int Create(uint32_t frame_count, VkDeviceSize uniform_slice_size);
+    void Destroy();
+    // 在 Create 之后调用, timestamp_valid_bits 是提交队列的 VkQueueFamilyProperties::timestampValidBits.
+    // 每个 context 有自己的 query pool, 结果在这个 context 下一次 WaitCurrent 时读回, 不会额外等待 GPU.
+    // 不支持 timestamp 时返回 -1, gpu_ns 保持为 0
+    int EnableGpuTimestamps(uint32_t timestamp_valid_bits);
+    bool gpu_timestamps() const;
+
+    // 等 GPU 用完当前 context 后返回它. fence 保持 signaled, 在使用它的 submit 之前再 reset.
+    // 返回后 context 的 timing 是它上一次 submit 的结果
+    frame_context_t* WaitCurrent();
+    // 包住 command buffer 的录制, EndRecord 之后马上 submit
+    void BeginRecord(frame_context_t* context);
+    void EndRecord(frame_context_t* context);
+    void Advance();
+
+    uint32_t frame_count() const;
+    VkBuffer uniform_buffer() const;
+    VkDeviceSize uniform_slice_size() const;
+
+    // CPU 等待 in flight fence 的累计时间
+    uint64_t fence_wait_ns() const;
+    uint64_t frames() const;
+
+    const static uint32_t MIN_FRAME_IN_FLIGHT = 1;
+    const static uint32_t MAX_FRAME_IN_FLIGHT = 4;
+    // 每帧最多的 timestamp scope 数量, 包括 FRAME_TIMESTAMP_SCOPE
+    const static uint32_t MAX_TIMESTAMP_SCOPES = 16;
+
+    FrameContextRing& operator = (const FrameContextRing&) = delete;
+private:
+    void CreateUniformBuffer(VkDeviceSize uniform_slice_size);
+    void DestroyUniformBuffer();
+    void ReadGpuTimestamps(frame_context_t* context);
+
+    VulkanLogicDevice* device_;
+    VulkanCommandPool* command_pool_;
+    std::vector<frame_context_t> contexts_;
+    uint32_t current_;
+
+    VulkanBuffer* uniform_buffer_;
+    VulkanMemory* uniform_memory_;
+    void* uniform_mapped_;
+    VkDeviceSize uniform_slice_size_;
+
+    uint64_t fence_wait_ns_;
+    uint64_t frames_;
+
+    bool gpu_timestamps_;
+    uint64_t timestamp_mask_;
+    float timestamp_period_;
+    std::vector<uint64_t> timestamp_results_;
+};
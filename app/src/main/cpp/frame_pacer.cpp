@@ -0,0 +1,103 @@
+//
+// Created by hj6231 on 2024/2/6.
+//
+
+#include "frame_pacer.h"
+
+#include <thread>
+#include "log.h"
+
+FramePacer::FramePacer() :
+        mode_(MODE_TARGET_FPS),
+        target_fps_(30),
+        period_(std::chrono::microseconds(1000000 / 30)),
+        deadline_valid_(false),
+        frames_(0),
+        missed_deadlines_(0),
+        total_frame_time_(clock::duration::zero()),
+        max_frame_time_(clock::duration::zero()) {
+}
+
+void FramePacer::SetMode(Mode mode, uint32_t target_fps) {
+    mode_ = mode;
+    if (target_fps == 0) {
+        target_fps = 30;
+    }
+    target_fps_ = target_fps;
+    period_ = std::chrono::duration_cast<clock::duration>(std::chrono::microseconds(1000000 / target_fps_));
+    deadline_valid_ = false;
+}
+
+FramePacer::Mode FramePacer::mode() const {
+    return mode_;
+}
+
+bool FramePacer::present_bound() const {
+    return mode_ == MODE_PRESENT_BOUND;
+}
+
+void FramePacer::BeginFrame() {
+    frame_begin_ = clock::now();
+    if (!deadline_valid_) {
+        deadline_ = frame_begin_;
+        deadline_valid_ = true;
+    }
+}
+
+void FramePacer::EndFrame() {
+    clock::time_point now = clock::now();
+    clock::duration frame_time = now - frame_begin_;
+    total_frame_time_ += frame_time;
+    if (frame_time > max_frame_time_) {
+        max_frame_time_ = frame_time;
+    }
+    ++frames_;
+
+    if (mode_ != MODE_TARGET_FPS) {
+        return;
+    }
+    deadline_ += period_;
+    if (now > deadline_) {
+        // 错过了 deadline, 从现在重新开始计时, 不去追赶丢掉的帧
+        ++missed_deadlines_;
+        deadline_ = now;
+        return;
+    }
+    std::this_thread::sleep_until(deadline_);
+}
+
+void FramePacer::ResetStats() {
+    frames_ = 0;
+    missed_deadlines_ = 0;
+    total_frame_time_ = clock::duration::zero();
+    max_frame_time_ = clock::duration::zero();
+    deadline_valid_ = false;
+}
+
+void FramePacer::LogStats(const char* tag) const {
+    if (frames_ == 0) {
+        return;
+    }
+    LOG_D(tag, "pacer mode %d target %u fps: %llu frames, avg %.3f ms, max %.3f ms, missed deadlines %llu\n",
+          mode_, target_fps_, (long long unsigned int) frames_,
+          average_frame_ms(), max_frame_ms(), (long long unsigned int) missed_deadlines_);
+}
+
+uint64_t FramePacer::frames() const {
+    return frames_;
+}
+
+uint64_t FramePacer::missed_deadlines() const {
+    return missed_deadlines_;
+}
+
+double FramePacer::average_frame_ms() const {
+    if (frames_ == 0) {
+        return 0.0;
+    }
+    return std::chrono::duration<double, std::milli>(total_frame_time_).count() / frames_;
+}
+
+double FramePacer::max_frame_ms() const {
+    return std::chrono::duration<double, std::milli>(max_frame_time_).count();
+}
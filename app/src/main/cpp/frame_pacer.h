@@ -0,0 +1,54 @@
+//
+// Created by hj6231 on 2024/2/6.
+//
+
+#pragma once
+#include <chrono>
+#include <cstdint>
+
+// 控制 render loop 的节奏, 替代固定的 usleep
+class FramePacer {
+public:
+    enum Mode {
+        // sleep until the next 1/target_fps deadline, the frame cost is already subtracted
+        MODE_TARGET_FPS = 0,
+        // never sleep, used for benchmarking
+        MODE_UNCAPPED,
+        // never sleep, QueuePresentKHR with FIFO blocks on vsync
+        MODE_PRESENT_BOUND,
+    };
+
+    FramePacer();
+    ~FramePacer() = default;
+
+    void SetMode(Mode mode, uint32_t target_fps);
+    Mode mode() const;
+    bool present_bound() const;
+
+    // 每一帧开始前调用一次, 结束后调用 EndFrame
+    void BeginFrame();
+    void EndFrame();
+
+    void ResetStats();
+    void LogStats(const char* tag) const;
+
+    uint64_t frames() const;
+    uint64_t missed_deadlines() const;
+    double average_frame_ms() const;
+    double max_frame_ms() const;
+
+private:
+    typedef std::chrono::steady_clock clock;
+
+    Mode mode_;
+    uint32_t target_fps_;
+    clock::duration period_;
+    clock::time_point frame_begin_;
+    clock::time_point deadline_;
+    bool deadline_valid_;
+
+    uint64_t frames_;
+    uint64_t missed_deadlines_;
+    clock::duration total_frame_time_;
+    clock::duration max_frame_time_;
+};
@@ -0,0 +1,198 @@
+//
+// Created by hj6231 on 2024/2/8.
+//
+
+// 每个 scene 在 off-screen image 上跑 warmup + measured 帧, 结果以 JSON 数组输出
+// usage: vulkan_benchmark [--warmup N] [--frames M] [--frames-in-flight F] [--assets DIR]
+//                         [--size W H] [--output FILE] [--cache-dir DIR] [--no-mesh-optimization]
+//                         [--quantize-vertices] [--compute-mipmaps box|kaiser] [--async-loading]
+//                         [--nv12-stream W H] [--particles N] [scene ...]
+// 指定 --cache-dir 时 pipeline cache 在运行之间保留, 两次运行的 pipeline_cache.create_ms 对比就是 cache 的收益.
+// --no-mesh-optimization 时 viking_room 每个三角形顶点一个 vertex, 和默认运行的 gpu_scopes_ms 对比就是 mesh 优化的收益.
+// --quantize-vertices 时 viking_room 的 vertex 从 20 字节量化到 12 字节
+// --compute-mipmaps 时 viking_room_mipmap 的 PNG 纹理用 compute shader 生成 mip 链, 单独的耗时对比见 mip_benchmark
+// --async-loading 时 scene 在 loader 线程创建, first_frame_ms 是清屏帧的时间, full_quality_ms 是 scene 第一帧的时间
+// --nv12-stream 时 nv12_image_texture 每帧上传一帧 WxH 的合成画面, 上传耗时在 gpu_scopes_ms 的 nv12_stream_upload,
+// 只测上传吞吐量见 nv12_stream_benchmark
+// --particles 设置 particle 场景的粒子数, 只测模拟的吞吐量见 particle_benchmark
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+#include "tutorial.h"
+#include "computer_shader.h"
+#include "log.h"
+
+static const char* PARTICLE_SCENE = "particle";
+
+static TutorialBase* CreateScene(const std::string& name, AAssetManager* asset_manager) {
+    if (name == PARTICLE_SCENE) {
+        return new ComputerShader(asset_manager);
+    }
+    for (int i = 0; i < Tutorial::SCENE_COUNT; ++i) {
+        auto scene = static_cast<Tutorial::SceneType>(i);
+        if (name == Tutorial::SceneName(scene)) {
+            auto* tutorial = new Tutorial(asset_manager);
+            tutorial->SetScene(scene);
+            return tutorial;
+        }
+    }
+    return nullptr;
+}
+
+static void PrintUsage(const char* name) {
+    fprintf(stderr, "usage: %s [--warmup N] [--frames M] [--frames-in-flight F] [--assets DIR]"
+                    " [--size W H] [--output FILE] [--cache-dir DIR] [--no-mesh-optimization]"
+                    " [--quantize-vertices] [--compute-mipmaps box|kaiser] [--async-loading] [--nv12-stream W H]"
+                    " [--particles N] [scene ...]\n", name);
+    fprintf(stderr, "scenes:");
+    for (int i = 0; i < Tutorial::SCENE_COUNT; ++i) {
+        fprintf(stderr, " %s", Tutorial::SceneName(static_cast<Tutorial::SceneType>(i)));
+    }
+    fprintf(stderr, " %s\n", PARTICLE_SCENE);
+}
+
+int main(int argc, char** argv) {
+    uint32_t warmup_frames = 60;
+    uint32_t measured_frames = 600;
+    // 1 帧 in flight 时 submit_to_fence 就是这一帧的 GPU 延迟
+    uint32_t frames_in_flight = 1;
+    uint32_t width = 1280;
+    uint32_t height = 720;
+    const char* asset_dir = "app/src/main/assets";
+    const char* output = nullptr;
+    const char* cache_dir = nullptr;
+    bool optimize_mesh = true;
+    bool quantize_vertices = false;
+    bool compute_mipmaps = false;
+    bool kaiser_mipmaps = false;
+    bool async_loading = false;
+    uint32_t nv12_stream_width = 0;
+    uint32_t nv12_stream_height = 0;
+    uint32_t particle_count = 0;
+    std::vector<std::string> scenes;
+    for (int i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "--warmup") == 0 && i + 1 < argc) {
+            warmup_frames = static_cast<uint32_t>(atoi(argv[++i]));
+        } else if (strcmp(argv[i], "--frames") == 0 && i + 1 < argc) {
+            measured_frames = static_cast<uint32_t>(atoi(argv[++i]));
+        } else if (strcmp(argv[i], "--frames-in-flight") == 0 && i + 1 < argc) {
+            frames_in_flight = static_cast<uint32_t>(atoi(argv[++i]));
+        } else if (strcmp(argv[i], "--assets") == 0 && i + 1 < argc) {
+            asset_dir = argv[++i];
+        } else if (strcmp(argv[i], "--size") == 0 && i + 2 < argc) {
+            width = static_cast<uint32_t>(atoi(argv[++i]));
+            height = static_cast<uint32_t>(atoi(argv[++i]));
+        } else if (strcmp(argv[i], "--output") == 0 && i + 1 < argc) {
+            output = argv[++i];
+        } else if (strcmp(argv[i], "--cache-dir") == 0 && i + 1 < argc) {
+            cache_dir = argv[++i];
+        } else if (strcmp(argv[i], "--no-mesh-optimization") == 0) {
+            optimize_mesh = false;
+        } else if (strcmp(argv[i], "--quantize-vertices") == 0) {
+            quantize_vertices = true;
+        } else if (strcmp(argv[i], "--compute-mipmaps") == 0 && i + 1 < argc &&
+                (strcmp(argv[i + 1], "box") == 0 || strcmp(argv[i + 1], "kaiser") == 0)) {
+            compute_mipmaps = true;
+            kaiser_mipmaps = strcmp(argv[++i], "kaiser") == 0;
+        } else if (strcmp(argv[i], "--async-loading") == 0) {
+            async_loading = true;
+        } else if (strcmp(argv[i], "--nv12-stream") == 0 && i + 2 < argc) {
+            // NV12 的宽高必须是偶数
+            nv12_stream_width = static_cast<uint32_t>(atoi(argv[++i])) & ~1u;
+            nv12_stream_height = static_cast<uint32_t>(atoi(argv[++i])) & ~1u;
+        } else if (strcmp(argv[i], "--particles") == 0 && i + 1 < argc) {
+            particle_count = static_cast<uint32_t>(strtoul(argv[++i], nullptr, 10));
+        } else if (argv[i][0] == '-') {
+            PrintUsage(argv[0]);
+            return 1;
+        } else {
+            scenes.push_back(argv[i]);
+        }
+    }
+    if (measured_frames == 0) {
+        measured_frames = 1;
+    }
+    // 和 FrameContextRing::Create 的限制一致, 输出里的 frames_in_flight 才是实际值
+    if (frames_in_flight < FrameContextRing::MIN_FRAME_IN_FLIGHT) {
+        frames_in_flight = FrameContextRing::MIN_FRAME_IN_FLIGHT;
+    } else if (frames_in_flight > FrameContextRing::MAX_FRAME_IN_FLIGHT) {
+        frames_in_flight = FrameContextRing::MAX_FRAME_IN_FLIGHT;
+    }
+    if (scenes.empty()) {
+        for (int i = 0; i < Tutorial::SCENE_COUNT; ++i) {
+            scenes.push_back(Tutorial::SceneName(static_cast<Tutorial::SceneType>(i)));
+        }
+        scenes.push_back(PARTICLE_SCENE);
+    }
+
+    FILE* file = stdout;
+    if (output != nullptr) {
+        file = fopen(output, "w");
+        if (file == nullptr) {
+            LOG_E("benchmark", "open %s failed\n", output);
+            return 1;
+        }
+    }
+
+    AAssetManager* asset_manager = AAssetManager_fromDirectory(asset_dir);
+    int failed = 0;
+    bool first = true;
+    fprintf(file, "[\n");
+    for (const auto& name : scenes) {
+        TutorialBase* tutorial = CreateScene(name, asset_manager);
+        if (tutorial == nullptr) {
+            LOG_E("benchmark", "unknown scene %s\n", name.c_str());
+            PrintUsage(argv[0]);
+            ++failed;
+            continue;
+        }
+        tutorial->SetHeadless(width, height, false);
+        tutorial->SetFramesInFlight(frames_in_flight);
+        tutorial->SetBenchmark(warmup_frames, measured_frames);
+        if (cache_dir != nullptr) {
+            tutorial->SetCacheDirectory(cache_dir);
+        }
+        tutorial->SetMeshOptimization(optimize_mesh);
+        tutorial->SetVertexQuantization(quantize_vertices);
+        tutorial->SetComputeMipmaps(compute_mipmaps, kaiser_mipmaps);
+        tutorial->SetAsyncLoading(async_loading);
+        tutorial->SetNv12Stream(nv12_stream_width, nv12_stream_height);
+        tutorial->SetParticleCount(particle_count);
+
+        auto instance_begin = std::chrono::steady_clock::now();
+        tutorial->CreateInstance();
+        bool picked = tutorial->PickPhysicalDevice();
+        auto instance_end = std::chrono::steady_clock::now();
+        if (!picked) {
+            LOG_E("benchmark", "%s: no suitable physical device\n", name.c_str());
+            tutorial->DestroyInstance();
+            delete tutorial;
+            ++failed;
+            continue;
+        }
+        LOG_D("benchmark", "%s: %u warm-up + %u measured frames\n", name.c_str(), warmup_frames, measured_frames);
+        tutorial->StartThread(nullptr);
+        tutorial->WaitThread();
+
+        tutorial->AddBenchmarkSetupTime(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                instance_end - instance_begin).count());
+        if (!first) {
+            fprintf(file, ",\n");
+        }
+        first = false;
+        tutorial->benchmark_stats().WriteJson(file, name.c_str(), frames_in_flight);
+        fflush(file);
+
+        tutorial->DestroyInstance();
+        delete tutorial;
+    }
+    fprintf(file, "\n]\n");
+    if (file != stdout) {
+        fclose(file);
+    }
+    AAssetManager_delete(asset_manager);
+    return failed == 0 ? 0 : 1;
+}
@@ -0,0 +1,99 @@
+//
+// Created by hj6231 on 2024/2/7.
+//
+
+// Linux 上没有窗口时运行 Tutorial / ComputerShader 的 scene
+// usage: headless_main <scene|particle> [seconds] [asset_dir] [width] [height] [--headless-surface] [--cache-dir DIR]
+//                      [--gpu-profiling]
+// --gpu-profiling 时退出前 log 每个 timestamp scope 的平均 GPU 耗时
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <thread>
+#include "tutorial.h"
+#include "computer_shader.h"
+#include "log.h"
+
+static void PrintUsage(const char* name) {
+    fprintf(stderr, "usage: %s <scene> [seconds] [asset_dir] [width] [height] [--headless-surface] [--cache-dir DIR]"
+                    " [--gpu-profiling]\n", name);
+    fprintf(stderr, "scenes:");
+    for (int i = 0; i < Tutorial::SCENE_COUNT; ++i) {
+        fprintf(stderr, " %s", Tutorial::SceneName(static_cast<Tutorial::SceneType>(i)));
+    }
+    fprintf(stderr, " particle\n");
+}
+
+int main(int argc, char** argv) {
+    if (argc < 2) {
+        PrintUsage(argv[0]);
+        return 1;
+    }
+    bool use_headless_surface = false;
+    const char* cache_dir = nullptr;
+    bool gpu_profiling = false;
+    std::vector<const char*> args;
+    for (int i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "--headless-surface") == 0) {
+            use_headless_surface = true;
+        } else if (strcmp(argv[i], "--cache-dir") == 0 && i + 1 < argc) {
+            cache_dir = argv[++i];
+        } else if (strcmp(argv[i], "--gpu-profiling") == 0) {
+            gpu_profiling = true;
+        } else {
+            args.push_back(argv[i]);
+        }
+    }
+    if (args.empty()) {
+        PrintUsage(argv[0]);
+        return 1;
+    }
+    const char* scene_name = args[0];
+    int seconds = args.size() > 1 ? atoi(args[1]) : 5;
+    const char* asset_dir = args.size() > 2 ? args[2] : "app/src/main/assets";
+    uint32_t width = args.size() > 3 ? static_cast<uint32_t>(atoi(args[3])) : 1280;
+    uint32_t height = args.size() > 4 ? static_cast<uint32_t>(atoi(args[4])) : 720;
+
+    AAssetManager* asset_manager = AAssetManager_fromDirectory(asset_dir);
+    TutorialBase* tutorial = nullptr;
+    if (strcmp(scene_name, "particle") == 0) {
+        tutorial = new ComputerShader(asset_manager);
+    } else {
+        for (int i = 0; i < Tutorial::SCENE_COUNT; ++i) {
+            auto scene = static_cast<Tutorial::SceneType>(i);
+            if (strcmp(scene_name, Tutorial::SceneName(scene)) == 0) {
+                auto* t = new Tutorial(asset_manager);
+                t->SetScene(scene);
+                tutorial = t;
+                break;
+            }
+        }
+    }
+    if (tutorial == nullptr) {
+        PrintUsage(argv[0]);
+        AAssetManager_delete(asset_manager);
+        return 1;
+    }
+
+    tutorial->SetHeadless(width, height, use_headless_surface);
+    if (cache_dir != nullptr) {
+        tutorial->SetCacheDirectory(cache_dir);
+    }
+    tutorial->SetGpuProfiling(gpu_profiling);
+    tutorial->CreateInstance();
+    if (!tutorial->PickPhysicalDevice()) {
+        LOG_E("headless", "no suitable physical device\n");
+        tutorial->DestroyInstance();
+        delete tutorial;
+        AAssetManager_delete(asset_manager);
+        return 1;
+    }
+    tutorial->StartThread(nullptr);
+    std::this_thread::sleep_for(std::chrono::seconds(seconds));
+    tutorial->StopThread();
+    tutorial->DestroyInstance();
+    delete tutorial;
+    AAssetManager_delete(asset_manager);
+    return 0;
+}
@@ -0,0 +1,82 @@
+//
+// Created by hj6231 on 2024/2/15.
+//
+
+// 构建时运行: 用 ObjParser 解析 OBJ, 用 MeshBuilder 焊接重排, 写成 MeshFile 读取的 .mesh.
+// vertex layout 和 VikingRoom::vertex_t 一致 (vec3 pos + vec2 coordinate, v 翻转)
+// usage: mesh_converter <input.obj> <output.mesh>
+#include <algorithm>
+#include <cfloat>
+#include <cstddef>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+#include "file_utils.h"
+#include "mesh_builder.h"
+#include "mesh_file.h"
+#include "obj_parser.h"
+#include "log.h"
+
+typedef struct {
+    float pos[3];
+    float coordinate[2];
+} converter_vertex_t;
+
+// VkFormat 的值, host 工具不依赖 Vulkan 头文件
+const static uint32_t FORMAT_R32G32_SFLOAT = 103;
+const static uint32_t FORMAT_R32G32B32_SFLOAT = 106;
+
+int main(int argc, char** argv) {
+    if (argc < 3) {
+        fprintf(stderr, "usage: %s <input.obj> <output.mesh>\n", argv[0]);
+        return 1;
+    }
+    std::vector<uint8_t> content;
+    ObjParser parser;
+    if (!ReadFile(argv[1], &content) ||
+            !parser.Parse(reinterpret_cast<const char*>(content.data()), content.size())) {
+        LOG_E("mesh_converter", "load %s failed\n", argv[1]);
+        return 1;
+    }
+    if (parser.indices().empty()) {
+        LOG_E("mesh_converter", "%s has no face\n", argv[1]);
+        return 1;
+    }
+    parser.LogStats("mesh_converter");
+
+    const std::vector<float>& positions = parser.positions();
+    const std::vector<float>& texcoords = parser.texcoords();
+    MeshBuilder builder(sizeof(converter_vertex_t), true);
+    builder.Reserve(parser.indices().size());
+    float bounds_min[3] = {FLT_MAX, FLT_MAX, FLT_MAX};
+    float bounds_max[3] = {-FLT_MAX, -FLT_MAX, -FLT_MAX};
+    for (const auto& index : parser.indices()) {
+        converter_vertex_t vertex{};
+        for (int k = 0; k < 3; ++k) {
+            vertex.pos[k] = positions[3 * index.position + k];
+            bounds_min[k] = std::min(bounds_min[k], vertex.pos[k]);
+            bounds_max[k] = std::max(bounds_max[k], vertex.pos[k]);
+        }
+        if (index.texcoord >= 0) {
+            vertex.coordinate[0] = texcoords[2 * index.texcoord + 0];
+            vertex.coordinate[1] = 1.0f - texcoords[2 * index.texcoord + 1];
+        }
+        builder.AddVertex(&vertex);
+    }
+    builder.Build();
+    builder.LogStats("mesh_converter");
+
+    const std::vector<mesh_attribute_t> attributes = {
+            {0, FORMAT_R32G32B32_SFLOAT, offsetof(converter_vertex_t, pos), 0},
+            {1, FORMAT_R32G32_SFLOAT, offsetof(converter_vertex_t, coordinate), 0}};
+    uint32_t index_size = builder.uint16_indices() ? sizeof(uint16_t) : sizeof(uint32_t);
+    if (!MeshFile::Write(argv[2], sizeof(converter_vertex_t), attributes, builder.vertices(),
+                         index_size, builder.index_data(), builder.index_count(),
+                         bounds_min, bounds_max)) {
+        LOG_E("mesh_converter", "write %s failed\n", argv[2]);
+        return 1;
+    }
+    LOG_D("mesh_converter", "%u vertices, %u indices written to %s\n",
+          builder.vertex_count(), builder.index_count(), argv[2]);
+    return 0;
+}
@@ -0,0 +1,462 @@
+//
+// Created by hj6231 on 2024/2/16.
+//
+
+// 对比 blit 链和 MipGenerator 生成整条 mip 链的 GPU 耗时 (timestamp query), 结果以 JSON 数组输出.
+// compute 方式分别在 graphic queue 和 async compute queue (有只支持 compute 的 queue family 时) 上测量,
+// 并读回所有 level 和 blit 的结果逐字节比较
+// usage: mip_benchmark [--assets DIR] [--iterations N] [--sizes S1,S2,...] [--output FILE]
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+#include "create_info_factory.h"
+#include "mip_generator.h"
+#include "shader_archive.h"
+#include "vulkan_instance.h"
+#include "vulkan_physical_device.h"
+#include "vulkan_logic_device.h"
+#include "vulkan_utils.h"
+#include "log.h"
+
+typedef enum {
+    METHOD_BLIT = 0,
+    METHOD_COMPUTE_BOX,
+    METHOD_COMPUTE_KAISER,
+} method_t;
+
+typedef struct {
+    VulkanLogicDevice* device;
+    uint32_t family_index;
+    VulkanQueue* queue;
+    VulkanCommandPool* command_pool;
+    VulkanQueryPool* query_pool;
+} queue_context_t;
+
+typedef struct {
+    double median_ms;
+    double min_ms;
+} timing_t;
+
+static timing_t Summarize(std::vector<double> samples) {
+    std::sort(samples.begin(), samples.end());
+    return timing_t{samples[samples.size() / 2], samples.front()};
+}
+
+static const char* MethodName(method_t method) {
+    switch (method) {
+        case METHOD_BLIT: return "blit";
+        case METHOD_COMPUTE_BOX: return "compute_box";
+        default: return "compute_kaiser";
+    }
+}
+
+static VkDeviceSize LevelBytes(uint32_t size, uint32_t level) {
+    VkDeviceSize side = std::max(size >> level, 1u);
+    return side * side * 4;
+}
+
+// mip 0 之外的 level 依次排在 mip 0 后面
+static VkDeviceSize ChainBytes(uint32_t size, uint32_t mip_levels) {
+    VkDeviceSize bytes = 0;
+    for (uint32_t level = 0; level < mip_levels; ++level) {
+        bytes += LevelBytes(size, level);
+    }
+    return bytes;
+}
+
+static VulkanBuffer* CreateHostBuffer(VulkanLogicDevice* device, VkDeviceSize size, VkBufferUsageFlags usage,
+                                      VulkanMemoryUsage memory_usage, VulkanMemory** memory, void** mapped) {
+    VkBufferCreateInfo buffer_info{};
+    buffer_info.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+    buffer_info.size = size;
+    buffer_info.usage = usage;
+    buffer_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+    VulkanBuffer* buffer = device->CreateBuffer(&buffer_info);
+    *memory = device->AllocateBufferMemory(buffer, memory_usage);
+    (*memory)->BindBufferMemory(buffer->buffer(), 0);
+    (*memory)->MapMemory(0, size, mapped);
+    return buffer;
+}
+
+static void CmdImageBarrier(VulkanCommandBuffer* command_buffer, VkImage image, uint32_t mip_levels,
+                            VkImageLayout old_layout, VkImageLayout new_layout,
+                            VkPipelineStageFlags src_stage_mask, VkAccessFlags src_access_mask,
+                            VkPipelineStageFlags dst_stage_mask, VkAccessFlags dst_access_mask) {
+    VkImageMemoryBarrier barrier{};
+    barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+    barrier.oldLayout = old_layout;
+    barrier.newLayout = new_layout;
+    barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.image = image;
+    barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    barrier.subresourceRange.levelCount = mip_levels;
+    barrier.subresourceRange.layerCount = 1;
+    barrier.srcAccessMask = src_access_mask;
+    barrier.dstAccessMask = dst_access_mask;
+    command_buffer->CmdPipelineBarrier(src_stage_mask, dst_stage_mask, 0, 0, nullptr, 0, nullptr, 1, &barrier);
+}
+
+// copy mip 0, 生成 mip 链, readback 不为 nullptr 时把所有 level 读回. 返回生成 mip 链的 GPU 毫秒数, 失败返回 -1
+static double RunOnce(const queue_context_t& context, method_t method, MipGenerator* generator,
+                      uint32_t size, const VulkanBuffer* source, const VulkanBuffer* readback,
+                      double timestamp_period) {
+    VulkanLogicDevice* device = context.device;
+    uint32_t mip_levels = MipGenerator::GetMipLevels(size, size);
+    VkImageCreateInfo image_info{};
+    image_info.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+    image_info.imageType = VK_IMAGE_TYPE_2D;
+    image_info.format = VK_FORMAT_R8G8B8A8_UNORM;
+    image_info.extent = {size, size, 1};
+    image_info.mipLevels = mip_levels;
+    image_info.arrayLayers = 1;
+    image_info.samples = VK_SAMPLE_COUNT_1_BIT;
+    image_info.tiling = VK_IMAGE_TILING_OPTIMAL;
+    image_info.usage = VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT |
+                       VK_IMAGE_USAGE_STORAGE_BIT;
+    image_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+    image_info.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    VulkanImage* image = device->CreateImage(&image_info);
+    VulkanMemory* image_memory = device->AllocateImageMemory(image, MEMORY_USAGE_GPU_ONLY);
+    image_memory->BindImageMemory(image->image(), 0);
+
+    VulkanCommandBuffer* command_buffer = context.command_pool->AllocateCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY);
+    VkCommandBufferBeginInfo begin_info{};
+    begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    begin_info.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+    command_buffer->BeginCommandBuffer(&begin_info);
+    command_buffer->CmdResetQueryPool(context.query_pool->query_pool(), 0, 2);
+    CmdImageBarrier(command_buffer, image->image(), mip_levels,
+                    VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+                    VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, 0,
+                    VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT);
+    VkBufferImageCopy region{};
+    region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    region.imageSubresource.layerCount = 1;
+    region.imageExtent = {size, size, 1};
+    command_buffer->CmdCopyBufferToImage(source->buffer(), image->image(),
+                                         VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &region);
+    // BOTTOM_OF_PIPE 的 timestamp 在之前的命令都完成后写入, 两个 timestamp 之间只有 mip 链的生成
+    command_buffer->CmdWriteTimestamp(VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, context.query_pool->query_pool(), 0);
+
+    image_upload_t upload{};
+    upload.image = image->image();
+    upload.format = VK_FORMAT_R8G8B8A8_UNORM;
+    upload.width = size;
+    upload.height = size;
+    upload.mip_levels = mip_levels;
+    upload.generate_mipmaps = true;
+    upload.mipmap_generator = generator;
+    upload.final_layout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+    upload.dst_stage_mask = VK_PIPELINE_STAGE_TRANSFER_BIT;
+    upload.dst_access_mask = VK_ACCESS_TRANSFER_READ_BIT;
+    bool recorded = true;
+    if (method == METHOD_BLIT) {
+        VulkanUploadContext::CmdGenerateMipmaps(command_buffer, upload);
+    } else {
+        recorded = generator->CmdGenerateMipmaps(command_buffer, upload);
+    }
+    command_buffer->CmdWriteTimestamp(VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, context.query_pool->query_pool(), 1);
+
+    if (readback != nullptr) {
+        std::vector<VkBufferImageCopy> regions(mip_levels);
+        VkDeviceSize offset = 0;
+        for (uint32_t level = 0; level < mip_levels; ++level) {
+            uint32_t side = std::max(size >> level, 1u);
+            regions[level] = VkBufferImageCopy{};
+            regions[level].bufferOffset = offset;
+            regions[level].imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+            regions[level].imageSubresource.mipLevel = level;
+            regions[level].imageSubresource.layerCount = 1;
+            regions[level].imageExtent = {side, side, 1};
+            offset += LevelBytes(size, level);
+        }
+        command_buffer->CmdCopyImageToBuffer(image->image(), VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+                                             readback->buffer(), mip_levels, regions.data());
+    }
+    command_buffer->EndCommandBuffer();
+
+    double ms = -1.0;
+    if (recorded) {
+        VkFenceCreateInfo fence_info{};
+        fence_info.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+        VulkanFence* fence = device->CreateFence(&fence_info);
+        VkCommandBuffer vk_command_buffer = command_buffer->command_buffer();
+        VkSubmitInfo submit_info{};
+        submit_info.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+        submit_info.commandBufferCount = 1;
+        submit_info.pCommandBuffers = &vk_command_buffer;
+        context.queue->QueueSubmit(1, &submit_info, fence->fence());
+        VkFence vk_fence = fence->fence();
+        device->WaitForFences(1, &vk_fence, VK_TRUE, UINT64_MAX);
+        VulkanLogicDevice::DestroyFence(&fence);
+
+        uint64_t timestamps[2] = {0, 0};
+        VkResult ret = context.query_pool->GetQueryPoolResults(0, 2, sizeof(timestamps), timestamps, sizeof(uint64_t),
+                                                               VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WAIT_BIT);
+        if (ret == VK_SUCCESS) {
+            ms = static_cast<double>(timestamps[1] - timestamps[0]) * timestamp_period / 1e6;
+        }
+    }
+    if (generator != nullptr) {
+        generator->ReleaseJobs();
+    }
+    VulkanCommandPool::FreeCommandBuffer(&command_buffer);
+    VulkanLogicDevice::DestroyImage(&image);
+    VulkanLogicDevice::FreeMemory(&image_memory);
+    return ms;
+}
+
+static bool CreateQueueContext(VulkanLogicDevice* device, uint32_t family_index, queue_context_t* context) {
+    context->device = device;
+    context->family_index = family_index;
+    context->queue = device->GetDeviceQueue(family_index, 0);
+    VkCommandPoolCreateInfo pool_info = CreateInfoFactory::GetCommandPoolCreateInfo(family_index);
+    context->command_pool = device->CreateCommandPool(&pool_info);
+    VkQueryPoolCreateInfo query_info{};
+    query_info.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+    query_info.queryType = VK_QUERY_TYPE_TIMESTAMP;
+    query_info.queryCount = 2;
+    context->query_pool = device->CreateQueryPool(&query_info);
+    return context->command_pool != nullptr && context->query_pool != nullptr;
+}
+
+static void DestroyQueueContext(queue_context_t* context) {
+    VulkanLogicDevice::DestroyQueryPool(&context->query_pool);
+    VulkanLogicDevice::DestroyCommandPool(&context->command_pool);
+    delete context->queue;
+    context->queue = nullptr;
+}
+
+static std::vector<uint32_t> ParseSizes(const char* text) {
+    std::vector<uint32_t> sizes;
+    for (const char* p = text; *p != '\0';) {
+        char* end = nullptr;
+        long value = strtol(p, &end, 10);
+        if (end == p) {
+            break;
+        }
+        if (value > 0 && value <= static_cast<long>(MipGenerator::MAX_SIZE)) {
+            sizes.push_back(static_cast<uint32_t>(value));
+        }
+        p = *end == ',' ? end + 1 : end;
+    }
+    return sizes;
+}
+
+int main(int argc, char** argv) {
+    const char* asset_dir = "app/src/main/assets";
+    const char* output = nullptr;
+    uint32_t iterations = 20;
+    std::vector<uint32_t> sizes = {1024, 2048, 4096};
+    for (int i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "--assets") == 0 && i + 1 < argc) {
+            asset_dir = argv[++i];
+        } else if (strcmp(argv[i], "--iterations") == 0 && i + 1 < argc) {
+            iterations = static_cast<uint32_t>(atoi(argv[++i]));
+        } else if (strcmp(argv[i], "--sizes") == 0 && i + 1 < argc) {
+            sizes = ParseSizes(argv[++i]);
+        } else if (strcmp(argv[i], "--output") == 0 && i + 1 < argc) {
+            output = argv[++i];
+        } else {
+            fprintf(stderr, "usage: %s [--assets DIR] [--iterations N] [--sizes S1,S2,...] [--output FILE]\n",
+                    argv[0]);
+            return 1;
+        }
+    }
+    if (iterations == 0) {
+        iterations = 1;
+    }
+    if (sizes.empty()) {
+        LOG_E("mip_benchmark", "no valid size, max %u\n", MipGenerator::MAX_SIZE);
+        return 1;
+    }
+
+    AAssetManager* asset_manager = AAssetManager_fromDirectory(asset_dir);
+    ShaderArchive::Instance()->Open(asset_manager);
+
+    CreateInfoFactory create_info_factory;
+    VkInstanceCreateInfo instance_info = create_info_factory.GetInstanceCreateInfo(false,
+                                                                                   CreateInfoFactory::SURFACE_NONE);
+    VulkanInstance* instance = VulkanInstance::CreateInstance(&instance_info);
+    VulkanPhysicalDevice* physical_device = nullptr;
+    uint32_t graphic_family = 0;
+    for (auto& candidate : instance->EnumeratePhysicalDevices()) {
+        uint32_t count = 0;
+        GetGraphicQueueFamilyIndexes(candidate, &graphic_family, 1, &count);
+        if (count > 0) {
+            physical_device = new VulkanPhysicalDevice(candidate);
+            break;
+        }
+    }
+    if (physical_device == nullptr) {
+        LOG_E("mip_benchmark", "no suitable physical device\n");
+        VulkanInstance::DestroyInstance(&instance);
+        AAssetManager_delete(asset_manager);
+        return 1;
+    }
+    VkPhysicalDeviceProperties properties{};
+    physical_device->GetProperties(&properties);
+    std::vector<VkQueueFamilyProperties> families = physical_device->GetQueueFamilyProperties();
+    uint32_t compute_family = 0;
+    bool has_compute_queue = GetComputeQueueFamilyIndex(*physical_device, &compute_family) &&
+                             families[compute_family].timestampValidBits > 0;
+    if (properties.limits.timestampPeriod == 0 || families[graphic_family].timestampValidBits == 0) {
+        LOG_E("mip_benchmark", "timestamp query not supported\n");
+        delete physical_device;
+        VulkanInstance::DestroyInstance(&instance);
+        AAssetManager_delete(asset_manager);
+        return 1;
+    }
+
+    // 第三个 queue family 和前两个不同时才会额外创建, 这里用来放 async compute queue
+    std::vector<VkDeviceQueueCreateInfo> queue_infos = create_info_factory.GetDeviceQueueCreateInfos(
+            graphic_family, graphic_family, has_compute_queue ? compute_family : graphic_family);
+    VkDeviceCreateInfo device_info = create_info_factory.GetDeviceCreateInfo(false, queue_infos);
+    VulkanLogicDevice* device = physical_device->CreateDevice(&device_info);
+    queue_context_t graphic_context{};
+    queue_context_t compute_context{};
+    bool created = CreateQueueContext(device, graphic_family, &graphic_context);
+    if (has_compute_queue) {
+        created = created && CreateQueueContext(device, compute_family, &compute_context);
+    }
+    MipGenerator box_generator(device, VK_FORMAT_R8G8B8A8_UNORM, MIP_FILTER_BOX);
+    MipGenerator kaiser_generator(device, VK_FORMAT_R8G8B8A8_UNORM, MIP_FILTER_KAISER);
+    created = created && box_generator.Create() == 0 && kaiser_generator.Create() == 0 &&
+              box_generator.IsSupported(sizes.front(), sizes.front());
+    if (!created) {
+        LOG_E("mip_benchmark", "create compute mip generator failed\n");
+    }
+
+    FILE* file = stdout;
+    if (output != nullptr) {
+        file = fopen(output, "w");
+        if (file == nullptr) {
+            LOG_E("mip_benchmark", "open %s failed\n", output);
+            created = false;
+        }
+    }
+    int failed = created ? 0 : 1;
+    if (created) {
+        const double period = properties.limits.timestampPeriod;
+        bool first = true;
+        fprintf(file, "[\n");
+        for (uint32_t size : sizes) {
+            uint32_t mip_levels = MipGenerator::GetMipLevels(size, size);
+            VkDeviceSize chain_bytes = ChainBytes(size, mip_levels);
+            VulkanMemory* source_memory = nullptr;
+            void* source_data = nullptr;
+            VulkanBuffer* source = CreateHostBuffer(device, LevelBytes(size, 0), VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+                                                    MEMORY_USAGE_CPU_ONLY, &source_memory, &source_data);
+            // 高频的棋盘格加上渐变, Kaiser 和 box 的差别在这种内容上最明显
+            auto* texels = static_cast<uint8_t*>(source_data);
+            for (uint32_t y = 0; y < size; ++y) {
+                for (uint32_t x = 0; x < size; ++x) {
+                    uint8_t* texel = texels + (static_cast<size_t>(y) * size + x) * 4;
+                    texel[0] = static_cast<uint8_t>(((x ^ y) & 1) * 255);
+                    texel[1] = static_cast<uint8_t>(x * 255 / size);
+                    texel[2] = static_cast<uint8_t>(y * 255 / size);
+                    texel[3] = static_cast<uint8_t>((x * 7 + y * 13) & 0xff);
+                }
+            }
+            VulkanMemory* blit_memory = nullptr;
+            VulkanMemory* box_memory = nullptr;
+            void* blit_data = nullptr;
+            void* box_data = nullptr;
+            VulkanBuffer* blit_readback = CreateHostBuffer(device, chain_bytes, VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                                                           MEMORY_USAGE_GPU_TO_CPU, &blit_memory, &blit_data);
+            VulkanBuffer* box_readback = CreateHostBuffer(device, chain_bytes, VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                                                          MEMORY_USAGE_GPU_TO_CPU, &box_memory, &box_data);
+
+            // blit 只能在 graphic queue 上, compute 两种 queue 都测
+            const struct {
+                method_t method;
+                MipGenerator* generator;
+                const queue_context_t* context;
+                const char* queue;
+            } runs[] = {
+                    {METHOD_BLIT, nullptr, &graphic_context, "graphic"},
+                    {METHOD_COMPUTE_BOX, &box_generator, &graphic_context, "graphic"},
+                    {METHOD_COMPUTE_KAISER, &kaiser_generator, &graphic_context, "graphic"},
+                    {METHOD_COMPUTE_BOX, &box_generator, &compute_context, "async_compute"},
+                    {METHOD_COMPUTE_KAISER, &kaiser_generator, &compute_context, "async_compute"},
+            };
+            double blit_median = 0;
+            for (const auto& run : runs) {
+                if (run.context->queue == nullptr) {
+                    continue;
+                }
+                std::vector<double> samples;
+                // 第一次不计时, 只用来读回结果
+                const VulkanBuffer* readback = nullptr;
+                if (run.context == &graphic_context && run.method == METHOD_BLIT) {
+                    readback = blit_readback;
+                } else if (run.context == &graphic_context && run.method == METHOD_COMPUTE_BOX) {
+                    readback = box_readback;
+                }
+                bool ok = RunOnce(*run.context, run.method, run.generator, size, source, readback, period) >= 0;
+                for (uint32_t i = 0; ok && i < iterations; ++i) {
+                    double ms = RunOnce(*run.context, run.method, run.generator, size, source, nullptr, period);
+                    ok = ms >= 0;
+                    samples.push_back(ms);
+                }
+                if (!ok) {
+                    LOG_E("mip_benchmark", "%s on %s queue failed at %u\n", MethodName(run.method), run.queue, size);
+                    ++failed;
+                    continue;
+                }
+                timing_t timing = Summarize(samples);
+                if (run.method == METHOD_BLIT) {
+                    blit_median = timing.median_ms;
+                }
+                fprintf(file, "%s  {\n", first ? "" : ",\n");
+                first = false;
+                fprintf(file, "    \"size\": %u,\n", size);
+                fprintf(file, "    \"mip_levels\": %u,\n", mip_levels);
+                fprintf(file, "    \"method\": \"%s\",\n", MethodName(run.method));
+                fprintf(file, "    \"queue\": \"%s\",\n", run.queue);
+                fprintf(file, "    \"iterations\": %u,\n", iterations);
+                fprintf(file, "    \"gpu_ms\": {\"median\": %.4f, \"min\": %.4f},\n", timing.median_ms, timing.min_ms);
+                fprintf(file, "    \"speedup_vs_blit\": %.2f", timing.median_ms > 0 ? blit_median / timing.median_ms : 0);
+                if (readback == box_readback) {
+                    // 2x2 平均和线性过滤的 blit 只有舍入的差别
+                    int max_diff = 0;
+                    auto* a = static_cast<const uint8_t*>(blit_data);
+                    auto* b = static_cast<const uint8_t*>(box_data);
+                    for (VkDeviceSize i = 0; i < chain_bytes; ++i) {
+                        max_diff = std::max(max_diff, std::abs(static_cast<int>(a[i]) - static_cast<int>(b[i])));
+                    }
+                    fprintf(file, ",\n    \"max_diff_vs_blit\": %d", max_diff);
+                }
+                fprintf(file, "\n  }");
+                fflush(file);
+            }
+            VulkanLogicDevice::DestroyBuffer(&box_readback);
+            VulkanLogicDevice::FreeMemory(&box_memory);
+            VulkanLogicDevice::DestroyBuffer(&blit_readback);
+            VulkanLogicDevice::FreeMemory(&blit_memory);
+            VulkanLogicDevice::DestroyBuffer(&source);
+            VulkanLogicDevice::FreeMemory(&source_memory);
+        }
+        fprintf(file, "\n]\n");
+    }
+    if (file != stdout && file != nullptr) {
+        fclose(file);
+    }
+
+    device->DeviceWaitIdle();
+    box_generator.Destroy();
+    kaiser_generator.Destroy();
+    if (has_compute_queue) {
+        DestroyQueueContext(&compute_context);
+    }
+    DestroyQueueContext(&graphic_context);
+    VulkanPhysicalDevice::DestroyDevice(&device);
+    delete physical_device;
+    VulkanInstance::DestroyInstance(&instance);
+    AAssetManager_delete(asset_manager);
+    return failed == 0 ? 0 : 1;
+}
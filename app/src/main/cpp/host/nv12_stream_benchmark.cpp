@@ -0,0 +1,325 @@
+//
+// Created by hj6231 on 2024/2/16.
+//
+
+// Nv12StreamRing 的上传吞吐量: 每帧生成一帧 NV12 后 copy 到下一个 slot, slots 个 command buffer 轮流提交,
+// 和 render loop 的 frames in flight 一样. 每个尺寸跑三种模式: staging (SyntheticNv12Source 直接写进 staging),
+// copy (PooledNv12Source 的帧 memcpy 到 staging) 和 import (同样的帧通过 VK_EXT_external_memory_host 直接 copy,
+// device 不支持时跳过). 结果以 JSON 数组输出, frames_per_second 和 copy_mib_per_second 按墙上时间,
+// gpu_copy_ms 是 timestamp query 测量的单帧 copy 耗时, copied_mib_per_frame 是 CPU 每帧复制的字节数
+// usage: nv12_stream_benchmark [--frames N] [--slots K] [--sizes WxH,WxH,...] [--output FILE]
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+#include "create_info_factory.h"
+#include "nv12_stream.h"
+#include "vulkan_instance.h"
+#include "vulkan_physical_device.h"
+#include "vulkan_logic_device.h"
+#include "vulkan_utils.h"
+#include "log.h"
+
+typedef struct {
+    VulkanCommandBuffer* command_buffer;
+    VulkanFence* fence;
+    bool pending;
+} submit_slot_t;
+
+static const uint32_t WARMUP_FRAMES = 30;
+
+typedef enum {
+    MODE_STAGING = 0,
+    MODE_COPY,
+    MODE_IMPORT,
+    MODE_COUNT
+} upload_mode_t;
+
+static const char* ModeName(upload_mode_t mode) {
+    switch (mode) {
+        case MODE_STAGING:
+            return "staging";
+        case MODE_COPY:
+            return "copy";
+        case MODE_IMPORT:
+            return "import";
+        default:
+            return "unknown";
+    }
+}
+
+static std::vector<VkExtent2D> ParseSizes(const char* text) {
+    std::vector<VkExtent2D> sizes;
+    for (const char* p = text; *p != '\0';) {
+        char* end = nullptr;
+        long width = strtol(p, &end, 10);
+        if (end == p || *end != 'x') {
+            break;
+        }
+        p = end + 1;
+        long height = strtol(p, &end, 10);
+        if (end == p) {
+            break;
+        }
+        // NV12 的宽高必须是偶数
+        if (width > 0 && height > 0 && width % 2 == 0 && height % 2 == 0) {
+            sizes.push_back(VkExtent2D{static_cast<uint32_t>(width), static_cast<uint32_t>(height)});
+        }
+        p = *end == ',' ? end + 1 : end;
+    }
+    return sizes;
+}
+
+// 跑 WARMUP_FRAMES + frames 帧, 输出一个 JSON 对象. 失败返回 false
+static bool RunSize(VulkanLogicDevice* device, VulkanQueue* queue, VulkanCommandPool* command_pool,
+                    VulkanQueryPool* query_pool, double timestamp_period, VkExtent2D size, upload_mode_t mode,
+                    uint32_t slot_count, uint32_t frames, FILE* file, bool first) {
+    // pooled 在 ring 之后销毁, ring 缓存的 import 引用它的内存
+    SyntheticNv12Source synthetic(size.width, size.height);
+    PooledNv12Source pooled(size.width, size.height, slot_count);
+    if (mode != MODE_STAGING && pooled.Create() != 0) {
+        return false;
+    }
+    Nv12FrameSource* source = mode == MODE_STAGING ? static_cast<Nv12FrameSource*>(&synthetic) : &pooled;
+    Nv12StreamRing ring(device, size.width, size.height, slot_count);
+    if (ring.Create(nullptr) != 0) {
+        return false;
+    }
+    ring.set_host_import(mode == MODE_IMPORT);
+    std::vector<submit_slot_t> submits(slot_count);
+    for (auto& submit : submits) {
+        submit.command_buffer = command_pool->AllocateCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY);
+        VkFenceCreateInfo fence_info{};
+        fence_info.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+        submit.fence = device->CreateFence(&fence_info);
+        submit.pending = false;
+    }
+
+    std::vector<double> gpu_ms;
+    gpu_ms.reserve(frames);
+    std::chrono::steady_clock::time_point measure_begin;
+    nv12_stream_stats_t measured{};
+    bool ok = true;
+    for (uint32_t frame = 0; ok && frame < WARMUP_FRAMES + frames; ++frame) {
+        if (frame == WARMUP_FRAMES) {
+            measure_begin = std::chrono::steady_clock::now();
+            measured = ring.stats();
+        }
+        uint32_t index = frame % slot_count;
+        submit_slot_t& submit = submits[index];
+        // 和 frame context 一样, 只等 slot_count 帧之前用这个 command buffer 的提交
+        if (submit.pending) {
+            VkFence fence = submit.fence->fence();
+            device->WaitForFences(1, &fence, VK_TRUE, UINT64_MAX);
+            device->ResetFences(1, &fence);
+            submit.pending = false;
+            uint64_t timestamps[2] = {0, 0};
+            VkResult ret = query_pool->GetQueryPoolResults(index * 2, 2, sizeof(timestamps), timestamps,
+                                                           sizeof(uint64_t), VK_QUERY_RESULT_64_BIT);
+            if (ret == VK_SUCCESS && frame >= WARMUP_FRAMES + slot_count) {
+                gpu_ms.push_back(static_cast<double>(timestamps[1] - timestamps[0]) * timestamp_period / 1e6);
+            }
+        }
+        submit.command_buffer->ResetCommandBuffer(0);
+        VkCommandBufferBeginInfo begin_info{};
+        begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+        begin_info.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+        submit.command_buffer->BeginCommandBuffer(&begin_info);
+        submit.command_buffer->CmdResetQueryPool(query_pool->query_pool(), index * 2, 2);
+        submit.command_buffer->CmdWriteTimestamp(VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, query_pool->query_pool(), index * 2);
+        // 没有 render pass, 之后的采样按 fragment shader 算
+        ok = ring.CmdUpload(submit.command_buffer, source, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT) >= 0;
+        submit.command_buffer->CmdWriteTimestamp(VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, query_pool->query_pool(),
+                                                 index * 2 + 1);
+        submit.command_buffer->EndCommandBuffer();
+
+        VkCommandBuffer vk_command_buffer = submit.command_buffer->command_buffer();
+        VkSubmitInfo submit_info{};
+        submit_info.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+        submit_info.commandBufferCount = 1;
+        submit_info.pCommandBuffers = &vk_command_buffer;
+        ok = ok && queue->QueueSubmit(1, &submit_info, submit.fence->fence()) == VK_SUCCESS;
+        submit.pending = ok;
+    }
+    queue->QueueWaitIdle();
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - measure_begin).count();
+    nv12_stream_stats_t stats = ring.stats();
+
+    if (ok) {
+        std::sort(gpu_ms.begin(), gpu_ms.end());
+        double gpu_median = gpu_ms.empty() ? 0 : gpu_ms[gpu_ms.size() / 2];
+        double frame_mib = ring.frame_bytes() / (1024.0 * 1024.0);
+        fprintf(file, "%s  {\n", first ? "" : ",\n");
+        fprintf(file, "    \"width\": %u,\n", size.width);
+        fprintf(file, "    \"height\": %u,\n", size.height);
+        fprintf(file, "    \"mode\": \"%s\",\n", ModeName(mode));
+        fprintf(file, "    \"slots\": %u,\n", slot_count);
+        fprintf(file, "    \"frames\": %u,\n", frames);
+        fprintf(file, "    \"frame_mib\": %.4f,\n", frame_mib);
+        fprintf(file, "    \"frames_per_second\": %.2f,\n", frames / seconds);
+        fprintf(file, "    \"copy_mib_per_second\": %.2f,\n", frame_mib * frames / seconds);
+        fprintf(file, "    \"staging_write_ms\": %.4f,\n", (stats.write_ns - measured.write_ns) / 1e6 / frames);
+        fprintf(file, "    \"copied_mib_per_frame\": %.4f,\n",
+                (stats.copied_bytes - measured.copied_bytes) / (1024.0 * 1024.0) / frames);
+        fprintf(file, "    \"imported_mib_per_frame\": %.4f,\n",
+                (stats.imported_bytes - measured.imported_bytes) / (1024.0 * 1024.0) / frames);
+        fprintf(file, "    \"gpu_copy_ms\": {\"median\": %.4f, \"min\": %.4f},\n",
+                gpu_median, gpu_ms.empty() ? 0 : gpu_ms.front());
+        fprintf(file, "    \"gpu_copy_mib_per_second\": %.2f\n", gpu_median > 0 ? frame_mib * 1000.0 / gpu_median : 0);
+        fprintf(file, "  }");
+        fflush(file);
+    }
+
+    for (auto& submit : submits) {
+        VulkanLogicDevice::DestroyFence(&submit.fence);
+        VulkanCommandPool::FreeCommandBuffer(&submit.command_buffer);
+    }
+    ring.Destroy();
+    return ok;
+}
+
+int main(int argc, char** argv) {
+    const char* output = nullptr;
+    uint32_t frames = 300;
+    // 和默认 2 帧 in flight 相比多一个 slot, 上传和上一帧的采样重叠
+    uint32_t slot_count = 3;
+    std::vector<VkExtent2D> sizes = {{1280, 720}, {1920, 1080}, {3840, 2160}};
+    for (int i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "--frames") == 0 && i + 1 < argc) {
+            frames = static_cast<uint32_t>(atoi(argv[++i]));
+        } else if (strcmp(argv[i], "--slots") == 0 && i + 1 < argc) {
+            slot_count = static_cast<uint32_t>(atoi(argv[++i]));
+        } else if (strcmp(argv[i], "--sizes") == 0 && i + 1 < argc) {
+            sizes = ParseSizes(argv[++i]);
+        } else if (strcmp(argv[i], "--output") == 0 && i + 1 < argc) {
+            output = argv[++i];
+        } else {
+            fprintf(stderr, "usage: %s [--frames N] [--slots K] [--sizes WxH,WxH,...] [--output FILE]\n", argv[0]);
+            return 1;
+        }
+    }
+    frames = std::max(frames, 1u);
+    slot_count = std::max(slot_count, 1u);
+    if (sizes.empty()) {
+        LOG_E("nv12_stream_benchmark", "no valid size, width and height must be even\n");
+        return 1;
+    }
+
+    CreateInfoFactory create_info_factory;
+    VkInstanceCreateInfo instance_info = create_info_factory.GetInstanceCreateInfo(false,
+                                                                                   CreateInfoFactory::SURFACE_NONE);
+    VulkanInstance* instance = VulkanInstance::CreateInstance(&instance_info);
+    VulkanPhysicalDevice* physical_device = nullptr;
+    uint32_t graphic_family = 0;
+    for (auto& candidate : instance->EnumeratePhysicalDevices()) {
+        uint32_t count = 0;
+        GetGraphicQueueFamilyIndexes(candidate, &graphic_family, 1, &count);
+        if (count > 0) {
+            physical_device = new VulkanPhysicalDevice(candidate);
+            break;
+        }
+    }
+    if (physical_device == nullptr) {
+        LOG_E("nv12_stream_benchmark", "no suitable physical device\n");
+        VulkanInstance::DestroyInstance(&instance);
+        return 1;
+    }
+    VkPhysicalDeviceProperties properties{};
+    physical_device->GetProperties(&properties);
+    std::vector<VkQueueFamilyProperties> families = physical_device->GetQueueFamilyProperties();
+    VkPhysicalDeviceVulkan11Features vulkan_11_features{};
+    vulkan_11_features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_1_FEATURES;
+    VkPhysicalDeviceFeatures2 features{};
+    features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+    features.pNext = &vulkan_11_features;
+    physical_device->GetFeatures2(&features);
+    VkFormatProperties format_properties{};
+    physical_device->GetFormatProperties(VK_FORMAT_G8_B8R8_2PLANE_420_UNORM, &format_properties);
+    const char* error = nullptr;
+    if (!vulkan_11_features.samplerYcbcrConversion ||
+            (format_properties.optimalTilingFeatures & VK_FORMAT_FEATURE_TRANSFER_DST_BIT) == 0) {
+        error = "VK_FORMAT_G8_B8R8_2PLANE_420_UNORM upload not supported";
+    } else if (properties.limits.timestampPeriod == 0 || families[graphic_family].timestampValidBits == 0) {
+        error = "timestamp query not supported";
+    }
+    if (error != nullptr) {
+        LOG_E("nv12_stream_benchmark", "%s\n", error);
+        delete physical_device;
+        VulkanInstance::DestroyInstance(&instance);
+        return 1;
+    }
+
+    // 只打开 samplerYcbcrConversion, 多平面 format 的 image 需要它
+    VkPhysicalDeviceVulkan11Features enabled_11_features{};
+    enabled_11_features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_1_FEATURES;
+    enabled_11_features.samplerYcbcrConversion = VK_TRUE;
+    std::vector<VkDeviceQueueCreateInfo> queue_infos = create_info_factory.GetDeviceQueueCreateInfos(
+            graphic_family, graphic_family, graphic_family);
+    // import 模式需要 VK_EXT_external_memory_host, 不支持时只跑前两种模式
+    VkDeviceSize host_import_alignment = GetMinImportedHostPointerAlignment(*physical_device);
+    if (host_import_alignment > 0) {
+        create_info_factory.EnableExternalMemoryHost();
+    }
+    VkDeviceCreateInfo device_info = create_info_factory.GetDeviceCreateInfo(false, queue_infos);
+    device_info.pNext = &enabled_11_features;
+    VulkanLogicDevice* device = physical_device->CreateDevice(&device_info);
+    if (host_import_alignment > 0) {
+        device->EnableHostImport(host_import_alignment);
+    } else {
+        LOG_W("nv12_stream_benchmark", "VK_EXT_external_memory_host not supported, skip import mode\n");
+    }
+    VulkanQueue* queue = device->GetDeviceQueue(graphic_family, 0);
+    VkCommandPoolCreateInfo pool_info = CreateInfoFactory::GetCommandPoolCreateInfo(graphic_family);
+    VulkanCommandPool* command_pool = device->CreateCommandPool(&pool_info);
+    VkQueryPoolCreateInfo query_info{};
+    query_info.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+    query_info.queryType = VK_QUERY_TYPE_TIMESTAMP;
+    query_info.queryCount = slot_count * 2;
+    VulkanQueryPool* query_pool = device->CreateQueryPool(&query_info);
+
+    FILE* file = stdout;
+    if (output != nullptr) {
+        file = fopen(output, "w");
+        if (file == nullptr) {
+            LOG_E("nv12_stream_benchmark", "open %s failed\n", output);
+        }
+    }
+    int failed = command_pool != nullptr && query_pool != nullptr && file != nullptr ? 0 : 1;
+    if (failed == 0) {
+        bool first = true;
+        fprintf(file, "[\n");
+        for (const auto& size : sizes) {
+            for (int mode = 0; mode < MODE_COUNT; ++mode) {
+                if (mode == MODE_IMPORT && host_import_alignment == 0) {
+                    continue;
+                }
+                if (!RunSize(device, queue, command_pool, query_pool, properties.limits.timestampPeriod, size,
+                             static_cast<upload_mode_t>(mode), slot_count, frames, file, first)) {
+                    LOG_E("nv12_stream_benchmark", "%ux%u %s failed\n", size.width, size.height,
+                          ModeName(static_cast<upload_mode_t>(mode)));
+                    ++failed;
+                    continue;
+                }
+                first = false;
+            }
+        }
+        fprintf(file, "\n]\n");
+    }
+    if (file != stdout && file != nullptr) {
+        fclose(file);
+    }
+
+    device->DeviceWaitIdle();
+    if (device->host_importer() != nullptr) {
+        device->host_importer()->LogStats("nv12_stream_benchmark");
+    }
+    VulkanLogicDevice::DestroyQueryPool(&query_pool);
+    VulkanLogicDevice::DestroyCommandPool(&command_pool);
+    delete queue;
+    VulkanPhysicalDevice::DestroyDevice(&device);
+    delete physical_device;
+    VulkanInstance::DestroyInstance(&instance);
+    return failed == 0 ? 0 : 1;
+}
@@ -0,0 +1,201 @@
+//
+// Created by hj6231 on 2024/2/16.
+//
+
+// 对比 ObjParser 和原来 tinyobj + std::stringstream 的加载耗时, 结果以 JSON 数组输出.
+// 输入是 viking_room.obj.txt 和把它重复 --scale 次拼成的大文件 (后面几份的 f 仍然引用第一份的 vertex)
+// usage: obj_parser_benchmark [--assets DIR] [--iterations N] [--scale S] [--threads T] [--output FILE]
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <sstream>
+#include <string>
+#include <vector>
+#include "android_compat.h"
+#include "obj_parser.h"
+#include "log.h"
+
+#define TINYOBJLOADER_IMPLEMENTATION
+#include <tiny_obj_loader.h>
+
+typedef struct {
+    double median_ms;
+    double min_ms;
+} timing_t;
+
+static uint64_t NowNs() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static timing_t Summarize(std::vector<double> samples) {
+    std::sort(samples.begin(), samples.end());
+    return timing_t{samples[samples.size() / 2], samples.front()};
+}
+
+// 和改动之前的 VikingRoom::ReadVerticesIndexes 一样: 复制一份以 0 结尾的字符串, 再放进 stringstream
+static bool LoadTinyObj(const char* data, size_t size, tinyobj::attrib_t* attrib,
+                        std::vector<tinyobj::shape_t>* shapes) {
+    char* content = new char[size + 1];
+    memcpy(content, data, size);
+    content[size] = 0;
+    std::stringstream sstr(content);
+    delete[] content;
+    std::vector<tinyobj::material_t> materials;
+    std::string warn, err;
+    return tinyobj::LoadObj(attrib, shapes, &materials, &warn, &err, &sstr);
+}
+
+// 逐个三角形顶点比较两边的 position 和 texcoord
+static bool SameMesh(const tinyobj::attrib_t& attrib, const std::vector<tinyobj::shape_t>& shapes,
+                     const ObjParser& parser) {
+    size_t corner = 0;
+    for (const auto& shape : shapes) {
+        for (const auto& index : shape.mesh.indices) {
+            if (corner >= parser.indices().size()) {
+                return false;
+            }
+            const obj_index_t& other = parser.indices()[corner++];
+            for (int k = 0; k < 3; ++k) {
+                float expected = attrib.vertices[3 * index.vertex_index + k];
+                float actual = parser.positions()[3 * other.position + k];
+                if (std::fabs(expected - actual) > 1e-6f * std::max(1.0f, std::fabs(expected))) {
+                    return false;
+                }
+            }
+            if ((index.texcoord_index >= 0) != (other.texcoord >= 0)) {
+                return false;
+            }
+            for (int k = 0; k < 2 && other.texcoord >= 0; ++k) {
+                float expected = attrib.texcoords[2 * index.texcoord_index + k];
+                float actual = parser.texcoords()[2 * other.texcoord + k];
+                if (std::fabs(expected - actual) > 1e-6f * std::max(1.0f, std::fabs(expected))) {
+                    return false;
+                }
+            }
+        }
+    }
+    return corner == parser.indices().size();
+}
+
+static bool RunCase(FILE* file, bool first, const char* name, const char* data, size_t size,
+                    uint32_t iterations, uint32_t threads) {
+    std::vector<double> tinyobj_samples;
+    std::vector<double> parser_samples;
+    tinyobj::attrib_t attrib;
+    std::vector<tinyobj::shape_t> shapes;
+    ObjParser parser(threads);
+    bool success = true;
+    for (uint32_t i = 0; i < iterations && success; ++i) {
+        attrib = tinyobj::attrib_t();
+        shapes.clear();
+        uint64_t begin = NowNs();
+        success = LoadTinyObj(data, size, &attrib, &shapes);
+        tinyobj_samples.push_back((NowNs() - begin) / 1e6);
+
+        begin = NowNs();
+        success = parser.Parse(data, size) && success;
+        parser_samples.push_back((NowNs() - begin) / 1e6);
+    }
+    if (!success) {
+        LOG_E("obj_parser_benchmark", "%s: parse failed\n", name);
+        return false;
+    }
+    bool match = SameMesh(attrib, shapes, parser);
+    if (!match) {
+        LOG_E("obj_parser_benchmark", "%s: ObjParser and tinyobj disagree\n", name);
+    }
+    parser.LogStats("obj_parser_benchmark");
+
+    timing_t tinyobj_timing = Summarize(tinyobj_samples);
+    timing_t parser_timing = Summarize(parser_samples);
+    const obj_parse_stats_t& stats = parser.stats();
+    fprintf(file, "%s  {\n", first ? "" : ",\n");
+    fprintf(file, "    \"input\": \"%s\",\n", name);
+    fprintf(file, "    \"bytes\": %llu,\n", (unsigned long long) stats.bytes);
+    fprintf(file, "    \"triangles\": %u,\n", stats.triangles);
+    fprintf(file, "    \"threads\": %u,\n", stats.threads);
+    fprintf(file, "    \"iterations\": %u,\n", iterations);
+    fprintf(file, "    \"tinyobj_ms\": {\"median\": %.3f, \"min\": %.3f},\n",
+            tinyobj_timing.median_ms, tinyobj_timing.min_ms);
+    fprintf(file, "    \"obj_parser_ms\": {\"median\": %.3f, \"min\": %.3f},\n",
+            parser_timing.median_ms, parser_timing.min_ms);
+    fprintf(file, "    \"speedup\": %.2f,\n",
+            parser_timing.median_ms > 0 ? tinyobj_timing.median_ms / parser_timing.median_ms : 0.0);
+    fprintf(file, "    \"match\": %s\n", match ? "true" : "false");
+    fprintf(file, "  }");
+    return match;
+}
+
+int main(int argc, char** argv) {
+    const char* asset_dir = "app/src/main/assets";
+    const char* output = nullptr;
+    uint32_t iterations = 10;
+    uint32_t scale = 10;
+    uint32_t threads = 0;
+    for (int i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "--assets") == 0 && i + 1 < argc) {
+            asset_dir = argv[++i];
+        } else if (strcmp(argv[i], "--iterations") == 0 && i + 1 < argc) {
+            iterations = static_cast<uint32_t>(atoi(argv[++i]));
+        } else if (strcmp(argv[i], "--scale") == 0 && i + 1 < argc) {
+            scale = static_cast<uint32_t>(atoi(argv[++i]));
+        } else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+            threads = static_cast<uint32_t>(atoi(argv[++i]));
+        } else if (strcmp(argv[i], "--output") == 0 && i + 1 < argc) {
+            output = argv[++i];
+        } else {
+            fprintf(stderr, "usage: %s [--assets DIR] [--iterations N] [--scale S] [--threads T] [--output FILE]\n",
+                    argv[0]);
+            return 1;
+        }
+    }
+    iterations = std::max(iterations, 1u);
+    scale = std::max(scale, 1u);
+
+    AAssetManager* asset_manager = AAssetManager_fromDirectory(asset_dir);
+    AAsset* asset = AAssetManager_open(asset_manager, "viking_room.obj.txt", AASSET_MODE_BUFFER);
+    if (asset == nullptr) {
+        AAssetManager_delete(asset_manager);
+        return 1;
+    }
+    size_t size = static_cast<size_t>(AAsset_getLength(asset));
+    const auto* data = static_cast<const char*>(AAsset_getBuffer(asset));
+    std::string synthetic;
+    synthetic.reserve(size * scale + scale);
+    for (uint32_t i = 0; i < scale && data != nullptr; ++i) {
+        synthetic.append(data, size);
+        synthetic += '\n';
+    }
+
+    FILE* file = stdout;
+    if (output != nullptr) {
+        file = fopen(output, "w");
+        if (file == nullptr) {
+            LOG_E("obj_parser_benchmark", "open %s failed\n", output);
+            AAsset_close(asset);
+            AAssetManager_delete(asset_manager);
+            return 1;
+        }
+    }
+    int failed = 0;
+    if (data == nullptr) {
+        ++failed;
+    } else {
+        std::string synthetic_name = "viking_room.obj.txt x" + std::to_string(scale);
+        fprintf(file, "[\n");
+        failed += RunCase(file, true, "viking_room.obj.txt", data, size, iterations, threads) ? 0 : 1;
+        failed += RunCase(file, false, synthetic_name.c_str(), synthetic.data(), synthetic.size(),
+                          iterations, threads) ? 0 : 1;
+        fprintf(file, "\n]\n");
+    }
+    if (file != stdout) {
+        fclose(file);
+    }
+    AAsset_close(asset);
+    AAssetManager_delete(asset_manager);
+    return failed == 0 ? 0 : 1;
+}
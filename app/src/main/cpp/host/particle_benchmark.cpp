@@ -0,0 +1,223 @@
+//
+// Created by hj6231 on 2024/2/16.
+//
+
+// Particle 一步模拟的吞吐量: 每个粒子数跑 WARMUP_FRAMES + frames 步, 每步一个 command buffer, 经过 FrameContextRing
+// 轮流提交, 和 render loop 一样. 结果以 JSON 数组输出, gpu_step_ms 是 particle_compute timestamp scope 的耗时,
+// particles_per_second 和 gpu_gib_per_second (每个粒子读一次写一次) 按它的中位数计算, steps_per_second 按墙上时间.
+// 粒子数超过 device 限制时按限制减少, 实际的数在 count
+// usage: particle_benchmark [--assets DIR] [--frames N] [--frames-in-flight F] [--counts N1,N2,...] [--output FILE]
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+#include "create_info_factory.h"
+#include "frame_context.h"
+#include "particle.h"
+#include "shader_archive.h"
+#include "vulkan_instance.h"
+#include "vulkan_physical_device.h"
+#include "vulkan_logic_device.h"
+#include "vulkan_utils.h"
+#include "log.h"
+
+static const uint32_t WARMUP_FRAMES = 30;
+
+static std::vector<uint32_t> ParseCounts(const char* text) {
+    std::vector<uint32_t> counts;
+    for (const char* p = text; *p != '\0';) {
+        char* end = nullptr;
+        unsigned long value = strtoul(p, &end, 10);
+        if (end == p) {
+            break;
+        }
+        if (value > 0 && value <= UINT32_MAX) {
+            counts.push_back(static_cast<uint32_t>(value));
+        }
+        p = *end == ',' ? end + 1 : end;
+    }
+    return counts;
+}
+
+// 跑 WARMUP_FRAMES + frames 步, 输出一个 JSON 对象. 失败返回 false
+static bool RunCount(VulkanLogicDevice* device, VulkanQueue* queue, FrameContextRing* frame_contexts,
+                     uint32_t count, uint32_t frames, FILE* file, bool first) {
+    Particle particle(device, VK_FORMAT_R8G8B8A8_SRGB, VkExtent2D{1280, 720}, frame_contexts, count);
+    if (particle.CreatePipeline() != 0) {
+        return false;
+    }
+
+    std::vector<double> gpu_ms;
+    gpu_ms.reserve(frames);
+    std::chrono::steady_clock::time_point measure_begin;
+    bool ok = true;
+    uint32_t frame_count = frame_contexts->frame_count();
+    // 多等 frame_count 次, 最后几步的 timestamp 也读回
+    for (uint32_t frame = 0; frame < WARMUP_FRAMES + frames + frame_count; ++frame) {
+        if (frame == WARMUP_FRAMES) {
+            measure_begin = std::chrono::steady_clock::now();
+        }
+        // 返回的 timing 是 frame - frame_count 那一步的
+        frame_context_t* context = frame_contexts->WaitCurrent();
+        if (context->timing.valid && frame >= WARMUP_FRAMES + frame_count) {
+            for (const auto& scope : context->timing.gpu_scopes) {
+                if (strcmp(scope.name, "particle_compute") == 0) {
+                    gpu_ms.push_back(scope.ns / 1e6);
+                }
+            }
+        }
+        if (!ok || frame >= WARMUP_FRAMES + frames) {
+            frame_contexts->Advance();
+            continue;
+        }
+        VkFence fence = context->in_flight_fence->fence();
+        device->ResetFences(1, &fence);
+        context->command_buffer->ResetCommandBuffer(0);
+        frame_contexts->BeginRecord(context);
+        particle.Draw(context->command_buffer, context);
+        context->command_buffer->EndCommandBuffer();
+        frame_contexts->EndRecord(context);
+
+        VkCommandBuffer vk_command_buffer = context->command_buffer->command_buffer();
+        VkSubmitInfo submit_info{};
+        submit_info.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+        submit_info.commandBufferCount = 1;
+        submit_info.pCommandBuffers = &vk_command_buffer;
+        ok = queue->QueueSubmit(1, &submit_info, fence) == VK_SUCCESS;
+        frame_contexts->Advance();
+    }
+    queue->QueueWaitIdle();
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - measure_begin).count();
+
+    if (ok) {
+        std::sort(gpu_ms.begin(), gpu_ms.end());
+        double gpu_median = gpu_ms.empty() ? 0 : gpu_ms[gpu_ms.size() / 2];
+        uint32_t particle_count = particle.particle_count();
+        double step_gib = 2.0 * particle_count * sizeof(particle_t) / (1024.0 * 1024.0 * 1024.0);
+        fprintf(file, "%s  {\n", first ? "" : ",\n");
+        fprintf(file, "    \"requested_count\": %u,\n", count);
+        fprintf(file, "    \"count\": %u,\n", particle_count);
+        fprintf(file, "    \"buffers\": %u,\n", frame_count + 1);
+        fprintf(file, "    \"buffer_mib\": %.2f,\n", particle_count * sizeof(particle_t) / (1024.0 * 1024.0));
+        fprintf(file, "    \"frames\": %u,\n", frames);
+        fprintf(file, "    \"steps_per_second\": %.2f,\n", seconds > 0 ? frames / seconds : 0);
+        fprintf(file, "    \"gpu_step_ms\": {\"median\": %.4f, \"min\": %.4f},\n",
+                gpu_median, gpu_ms.empty() ? 0 : gpu_ms.front());
+        fprintf(file, "    \"particles_per_second\": %.0f,\n",
+                gpu_median > 0 ? particle_count * 1000.0 / gpu_median : 0);
+        fprintf(file, "    \"gpu_gib_per_second\": %.2f\n", gpu_median > 0 ? step_gib * 1000.0 / gpu_median : 0);
+        fprintf(file, "  }");
+        fflush(file);
+    }
+    particle.DestroyPipeline();
+    return ok;
+}
+
+int main(int argc, char** argv) {
+    const char* asset_dir = "app/src/main/assets";
+    const char* output = nullptr;
+    uint32_t frames = 300;
+    uint32_t frames_in_flight = 2;
+    // 不是 GROUP_SIZE 整数倍的数检查最后一组的边界
+    std::vector<uint32_t> counts = {8192, 100000, 1000000, 4000000};
+    for (int i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "--assets") == 0 && i + 1 < argc) {
+            asset_dir = argv[++i];
+        } else if (strcmp(argv[i], "--frames") == 0 && i + 1 < argc) {
+            frames = static_cast<uint32_t>(atoi(argv[++i]));
+        } else if (strcmp(argv[i], "--frames-in-flight") == 0 && i + 1 < argc) {
+            frames_in_flight = static_cast<uint32_t>(atoi(argv[++i]));
+        } else if (strcmp(argv[i], "--counts") == 0 && i + 1 < argc) {
+            counts = ParseCounts(argv[++i]);
+        } else if (strcmp(argv[i], "--output") == 0 && i + 1 < argc) {
+            output = argv[++i];
+        } else {
+            fprintf(stderr, "usage: %s [--assets DIR] [--frames N] [--frames-in-flight F] [--counts N1,N2,...]"
+                            " [--output FILE]\n", argv[0]);
+            return 1;
+        }
+    }
+    frames = std::max(frames, 1u);
+    if (counts.empty()) {
+        LOG_E("particle_benchmark", "no valid particle count\n");
+        return 1;
+    }
+
+    AAssetManager* asset_manager = AAssetManager_fromDirectory(asset_dir);
+    ShaderArchive::Instance()->Open(asset_manager);
+
+    CreateInfoFactory create_info_factory;
+    VkInstanceCreateInfo instance_info = create_info_factory.GetInstanceCreateInfo(false,
+                                                                                   CreateInfoFactory::SURFACE_NONE);
+    VulkanInstance* instance = VulkanInstance::CreateInstance(&instance_info);
+    VulkanPhysicalDevice* physical_device = nullptr;
+    uint32_t graphic_family = 0;
+    for (auto& candidate : instance->EnumeratePhysicalDevices()) {
+        uint32_t count = 0;
+        GetGraphicQueueFamilyIndexes(candidate, &graphic_family, 1, &count);
+        if (count > 0) {
+            physical_device = new VulkanPhysicalDevice(candidate);
+            break;
+        }
+    }
+    if (physical_device == nullptr) {
+        LOG_E("particle_benchmark", "no suitable physical device\n");
+        VulkanInstance::DestroyInstance(&instance);
+        AAssetManager_delete(asset_manager);
+        return 1;
+    }
+    std::vector<VkQueueFamilyProperties> families = physical_device->GetQueueFamilyProperties();
+
+    std::vector<VkDeviceQueueCreateInfo> queue_infos = create_info_factory.GetDeviceQueueCreateInfos(
+            graphic_family, graphic_family, graphic_family);
+    VkDeviceCreateInfo device_info = create_info_factory.GetDeviceCreateInfo(false, queue_infos);
+    VulkanLogicDevice* device = physical_device->CreateDevice(&device_info);
+    VulkanQueue* queue = device->GetDeviceQueue(graphic_family, 0);
+    VkCommandPoolCreateInfo pool_info = CreateInfoFactory::GetCommandPoolCreateInfo(graphic_family);
+    VulkanCommandPool* command_pool = device->CreateCommandPool(&pool_info);
+    FrameContextRing* frame_contexts = command_pool ? new FrameContextRing(device, command_pool) : nullptr;
+    bool created = frame_contexts != nullptr &&
+                   frame_contexts->Create(frames_in_flight, sizeof(delta_time_t)) == 0 &&
+                   frame_contexts->EnableGpuTimestamps(families[graphic_family].timestampValidBits) == 0;
+    if (!created) {
+        LOG_E("particle_benchmark", "create frame contexts with timestamp query failed\n");
+    }
+
+    FILE* file = stdout;
+    if (created && output != nullptr) {
+        file = fopen(output, "w");
+        if (file == nullptr) {
+            LOG_E("particle_benchmark", "open %s failed\n", output);
+            created = false;
+        }
+    }
+    int failed = created ? 0 : 1;
+    if (created) {
+        bool first = true;
+        fprintf(file, "[\n");
+        for (uint32_t count : counts) {
+            if (!RunCount(device, queue, frame_contexts, count, frames, file, first)) {
+                LOG_E("particle_benchmark", "%u particles failed\n", count);
+                ++failed;
+                continue;
+            }
+            first = false;
+        }
+        fprintf(file, "\n]\n");
+    }
+    if (file != stdout && file != nullptr) {
+        fclose(file);
+    }
+
+    device->DeviceWaitIdle();
+    delete frame_contexts;
+    VulkanLogicDevice::DestroyCommandPool(&command_pool);
+    delete queue;
+    VulkanPhysicalDevice::DestroyDevice(&device);
+    delete physical_device;
+    VulkanInstance::DestroyInstance(&instance);
+    AAssetManager_delete(asset_manager);
+    return failed == 0 ? 0 : 1;
+}
@@ -0,0 +1,204 @@
+//
+// Created by hj6231 on 2024/2/14.
+//
+
+// 构建时运行: 从 vulkan_object/*.cpp 里取出 k{Vert,Frag,Compute}ShaderSource 的 GLSL,
+// 按下面声明的组合编译, 写成 ShaderArchive 读取的 shaders.spvpack
+// usage: shader_archiver <output> <source.cpp> ...
+#include <cctype>
+#include <cstdio>
+#include <cstring>
+#include <regex>
+#include <set>
+#include <string>
+#include <vector>
+#include "file_utils.h"
+#include "shader_archive.h"
+#include "spirv_cache.h"
+#include "log.h"
+
+typedef struct {
+    // 对应的 shader, 例如 "triangle.frag"
+    const char* name;
+    shader_macro_list_t macros;
+    bool optimize;
+} shader_permutation_t;
+
+// 每个 shader 都会编译一份默认组合 (没有宏, 不优化, 和 VulkanObject::CreateShaderModule 的默认参数一致).
+// 运行时用到的其他组合要在这里列出来, 否则发布版本里会创建失败
+static const std::vector<shader_permutation_t> kPermutations = {
+        // MipGenerator::macros()
+        {"mip_generator.comp", shader_macro_list_t{{"FILTER_KAISER", "1"}}, false},
+        {"mip_generator.comp", shader_macro_list_t{{"IMAGE_FORMAT", "rgba16f"}}, false},
+        {"mip_generator.comp", shader_macro_list_t{{"FILTER_KAISER", "1"}, {"IMAGE_FORMAT", "rgba16f"}}, false},
+        {"mip_generator.comp", shader_macro_list_t{{"IMAGE_FORMAT", "rgba32f"}}, false},
+        {"mip_generator.comp", shader_macro_list_t{{"FILTER_KAISER", "1"}, {"IMAGE_FORMAT", "rgba32f"}}, false},
+};
+
+typedef struct {
+    std::string name;
+    shaderc_shader_kind kind;
+    std::string source;
+} extracted_shader_t;
+
+// 去掉注释, 保留字符串里的内容
+static std::string StripComments(const std::string& text) {
+    std::string result;
+    result.reserve(text.size());
+    size_t i = 0;
+    while (i < text.size()) {
+        char c = text[i];
+        if (c == '"' || c == '\'') {
+            size_t end = i + 1;
+            while (end < text.size() && text[end] != c) {
+                end += text[end] == '\\' ? 2 : 1;
+            }
+            end = end < text.size() ? end + 1 : end;
+            result.append(text, i, end - i);
+            i = end;
+        } else if (text.compare(i, 2, "//") == 0) {
+            i = text.find('\n', i);
+            i = i == std::string::npos ? text.size() : i;
+        } else if (text.compare(i, 2, "/*") == 0) {
+            i = text.find("*/", i + 2);
+            i = i == std::string::npos ? text.size() : i + 2;
+            result += ' ';
+        } else {
+            result += c;
+            ++i;
+        }
+    }
+    return result;
+}
+
+// 从 pos 开始读相邻的字符串字面量直到 ';', 和编译器拼接的结果一致
+static bool ParseLiterals(const std::string& text, size_t pos, std::string* value) {
+    while (pos < text.size()) {
+        char c = text[pos];
+        if (isspace(static_cast<unsigned char>(c))) {
+            ++pos;
+            continue;
+        }
+        if (c == ';') {
+            return true;
+        }
+        if (c != '"') {
+            return false;
+        }
+        for (++pos; pos < text.size() && text[pos] != '"'; ++pos) {
+            if (text[pos] != '\\') {
+                *value += text[pos];
+                continue;
+            }
+            switch (text[++pos]) {
+                case 'n': *value += '\n'; break;
+                case 't': *value += '\t'; break;
+                case 'r': *value += '\r'; break;
+                case '\\': *value += '\\'; break;
+                case '"': *value += '"'; break;
+                case '\'': *value += '\''; break;
+                default: return false;
+            }
+        }
+        ++pos;
+    }
+    return false;
+}
+
+static bool ExtractShaders(const std::string& path, std::vector<extracted_shader_t>* shaders) {
+    std::vector<uint8_t> content;
+    if (!ReadFile(path, &content)) {
+        LOG_E("shader_archiver", "read %s failed\n", path.c_str());
+        return false;
+    }
+    std::string text = StripComments(std::string(content.begin(), content.end()));
+    size_t slash = path.find_last_of('/');
+    std::string stem = path.substr(slash == std::string::npos ? 0 : slash + 1);
+    stem = stem.substr(0, stem.find('.'));
+
+    static const std::regex kDefinition("k(Vert|Frag|Compute)ShaderSource\\s*\\[\\s*\\]\\s*=");
+    for (std::sregex_iterator it(text.begin(), text.end(), kDefinition), end; it != end; ++it) {
+        extracted_shader_t shader;
+        std::string stage = (*it)[1];
+        if (stage == "Vert") {
+            shader.name = stem + ".vert";
+            shader.kind = shaderc_vertex_shader;
+        } else if (stage == "Frag") {
+            shader.name = stem + ".frag";
+            shader.kind = shaderc_fragment_shader;
+        } else {
+            shader.name = stem + ".comp";
+            shader.kind = shaderc_compute_shader;
+        }
+        if (!ParseLiterals(text, it->position() + it->length(), &shader.source)) {
+            LOG_E("shader_archiver", "%s: %s is not a plain string literal\n", path.c_str(), shader.name.c_str());
+            return false;
+        }
+        shaders->push_back(shader);
+    }
+    return true;
+}
+
+int main(int argc, char** argv) {
+    if (argc < 3) {
+        fprintf(stderr, "usage: %s <output> <source.cpp> ...\n", argv[0]);
+        return 1;
+    }
+    std::vector<extracted_shader_t> shaders;
+    for (int i = 2; i < argc; ++i) {
+        if (!ExtractShaders(argv[i], &shaders)) {
+            return 1;
+        }
+    }
+    if (shaders.empty()) {
+        LOG_E("shader_archiver", "no shader found\n");
+        return 1;
+    }
+
+    std::vector<shader_archive_entry_t> entries;
+    std::vector<std::vector<uint32_t>> codes;
+    std::set<std::pair<uint64_t, uint64_t>> keys;
+    std::set<std::string> used_permutations;
+    for (const auto& shader : shaders) {
+        std::vector<shader_permutation_t> permutations = {{shader.name.c_str(), shader_macro_list_t(), false}};
+        for (const auto& permutation : kPermutations) {
+            if (shader.name == permutation.name) {
+                permutations.push_back(permutation);
+                used_permutations.insert(permutation.name);
+            }
+        }
+        for (const auto& permutation : permutations) {
+            shaderc_optimization_level level = permutation.optimize ? shaderc_optimization_level_size
+                                                                    : shaderc_optimization_level_zero;
+            shader_key_t key = MakeShaderKey(shader.kind, shader.source, permutation.macros, level);
+            // 不同 scene 里完全相同的 shader 只保留一份
+            if (!keys.insert(std::make_pair(key.high, key.low)).second) {
+                continue;
+            }
+            std::vector<uint32_t> code = SpirvCache::Instance()->Compile(
+                    shader.name, shader.kind, shader.source, permutation.macros, level);
+            if (code.empty()) {
+                return 1;
+            }
+            shader_archive_entry_t entry{};
+            entry.key_high = key.high;
+            entry.key_low = key.low;
+            strncpy(entry.name, shader.name.c_str(), sizeof(entry.name) - 1);
+            entries.push_back(entry);
+            codes.push_back(code);
+        }
+    }
+    for (const auto& permutation : kPermutations) {
+        if (used_permutations.count(permutation.name) == 0) {
+            LOG_E("shader_archiver", "permutation for unknown shader %s\n", permutation.name);
+            return 1;
+        }
+    }
+
+    if (!ShaderArchive::Write(argv[1], entries, codes)) {
+        return 1;
+    }
+    LOG_D("shader_archiver", "%u shaders from %u sources written to %s\n",
+          (unsigned) entries.size(), (unsigned) shaders.size(), argv[1]);
+    return 0;
+}
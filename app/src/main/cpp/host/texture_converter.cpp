@@ -0,0 +1,353 @@
+//
+// Created by hj6231 on 2024/2/16.
+//
+
+// 构建时运行: 解码 PNG/JPEG, 生成完整的 mip 链, 每种压缩格式写一个 TextureFile 读取的 <output_base>.<suffix>.ktx2.
+// 目前编码 BC1 (桌面 GPU) 和 ETC2 RGB (Android GPU, 只用 ETC1 兼容的 individual/differential 模式),
+// 只处理不透明的纹理. ASTC 没有内置编码器, 用其他工具导出的 <output_base>.astc4x4.ktx2 放进 assets 就会被优先使用
+// usage: texture_converter <input> <output_base>
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+#include "texture_file.h"
+#include "log.h"
+
+#define STB_IMAGE_IMPLEMENTATION
+#include <stb_image.h>
+
+// VkFormat 的值, host 工具不依赖 Vulkan 头文件
+const static uint32_t FORMAT_BC1_RGB_UNORM_BLOCK = 131;
+const static uint32_t FORMAT_ETC2_R8G8B8_UNORM_BLOCK = 147;
+
+typedef struct {
+    uint32_t width;
+    uint32_t height;
+    // RGBA8
+    std::vector<uint8_t> pixels;
+} image_level_t;
+
+// ETC1 的 8 组亮度调整, 每组是 {a, b}, 像素序号 0..3 分别对应 +a, +b, -a, -b
+const static int ETC_MODIFIERS[8][2] = {
+        {2, 8}, {5, 17}, {9, 29}, {13, 42}, {18, 60}, {24, 80}, {33, 106}, {47, 183}};
+
+static int Clamp255(int value) {
+    return value < 0 ? 0 : (value > 255 ? 255 : value);
+}
+
+// 2x2 box filter, 奇数边长时最后一行/列重复使用
+static image_level_t Downsample(const image_level_t& src) {
+    image_level_t dst;
+    dst.width = std::max(src.width / 2, 1u);
+    dst.height = std::max(src.height / 2, 1u);
+    dst.pixels.resize(static_cast<size_t>(dst.width) * dst.height * 4);
+    for (uint32_t y = 0; y < dst.height; ++y) {
+        for (uint32_t x = 0; x < dst.width; ++x) {
+            uint32_t x0 = std::min(x * 2, src.width - 1), x1 = std::min(x * 2 + 1, src.width - 1);
+            uint32_t y0 = std::min(y * 2, src.height - 1), y1 = std::min(y * 2 + 1, src.height - 1);
+            for (int c = 0; c < 4; ++c) {
+                int sum = src.pixels[(y0 * src.width + x0) * 4 + c] + src.pixels[(y0 * src.width + x1) * 4 + c] +
+                          src.pixels[(y1 * src.width + x0) * 4 + c] + src.pixels[(y1 * src.width + x1) * 4 + c];
+                dst.pixels[(y * dst.width + x) * 4 + c] = static_cast<uint8_t>((sum + 2) / 4);
+            }
+        }
+    }
+    return dst;
+}
+
+// 取出 4x4 block 的 RGB, 超出边界的像素重复边缘
+static void ReadBlock(const image_level_t& level, uint32_t block_x, uint32_t block_y, int block[16][3]) {
+    for (uint32_t y = 0; y < 4; ++y) {
+        for (uint32_t x = 0; x < 4; ++x) {
+            uint32_t px = std::min(block_x * 4 + x, level.width - 1);
+            uint32_t py = std::min(block_y * 4 + y, level.height - 1);
+            const uint8_t* pixel = &level.pixels[(static_cast<size_t>(py) * level.width + px) * 4];
+            for (int c = 0; c < 3; ++c) {
+                block[y * 4 + x][c] = pixel[c];
+            }
+        }
+    }
+}
+
+static uint16_t To565(const float color[3]) {
+    int r = static_cast<int>(std::lround(std::min(std::max(color[0], 0.0f), 255.0f) * 31.0f / 255.0f));
+    int g = static_cast<int>(std::lround(std::min(std::max(color[1], 0.0f), 255.0f) * 63.0f / 255.0f));
+    int b = static_cast<int>(std::lround(std::min(std::max(color[2], 0.0f), 255.0f) * 31.0f / 255.0f));
+    return static_cast<uint16_t>((r << 11) | (g << 5) | b);
+}
+
+static void From565(uint16_t value, int color[3]) {
+    int r = (value >> 11) & 31, g = (value >> 5) & 63, b = value & 31;
+    color[0] = (r << 3) | (r >> 2);
+    color[1] = (g << 2) | (g >> 4);
+    color[2] = (b << 3) | (b >> 2);
+}
+
+// 端点取 block 颜色在主方向 (协方差矩阵的最大特征向量) 上投影的两端
+static void EncodeBc1Block(const int block[16][3], uint8_t out[8]) {
+    float mean[3] = {0, 0, 0};
+    for (int i = 0; i < 16; ++i) {
+        for (int c = 0; c < 3; ++c) {
+            mean[c] += block[i][c] / 16.0f;
+        }
+    }
+    float covariance[3][3] = {};
+    for (int i = 0; i < 16; ++i) {
+        float d[3] = {block[i][0] - mean[0], block[i][1] - mean[1], block[i][2] - mean[2]};
+        for (int a = 0; a < 3; ++a) {
+            for (int b = 0; b < 3; ++b) {
+                covariance[a][b] += d[a] * d[b];
+            }
+        }
+    }
+    float axis[3] = {1, 1, 1};
+    for (int iteration = 0; iteration < 8; ++iteration) {
+        float next[3];
+        for (int a = 0; a < 3; ++a) {
+            next[a] = covariance[a][0] * axis[0] + covariance[a][1] * axis[1] + covariance[a][2] * axis[2];
+        }
+        float length = std::sqrt(next[0] * next[0] + next[1] * next[1] + next[2] * next[2]);
+        if (length < 1e-6f) {
+            break;
+        }
+        for (int a = 0; a < 3; ++a) {
+            axis[a] = next[a] / length;
+        }
+    }
+    float min_t = 0, max_t = 0;
+    for (int i = 0; i < 16; ++i) {
+        float t = (block[i][0] - mean[0]) * axis[0] + (block[i][1] - mean[1]) * axis[1] +
+                  (block[i][2] - mean[2]) * axis[2];
+        min_t = std::min(min_t, t);
+        max_t = std::max(max_t, t);
+    }
+    float end0[3], end1[3];
+    for (int c = 0; c < 3; ++c) {
+        end0[c] = mean[c] + axis[c] * max_t;
+        end1[c] = mean[c] + axis[c] * min_t;
+    }
+    uint16_t c0 = To565(end0);
+    uint16_t c1 = To565(end1);
+    // c0 > c1 是 4 色模式, 相等时只能是 3 色模式, 全部用序号 0
+    if (c0 < c1) {
+        std::swap(c0, c1);
+    }
+    uint32_t indices = 0;
+    if (c0 != c1) {
+        int palette[4][3];
+        From565(c0, palette[0]);
+        From565(c1, palette[1]);
+        for (int c = 0; c < 3; ++c) {
+            palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+            palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+        }
+        for (int i = 0; i < 16; ++i) {
+            int best = 0, best_error = INT32_MAX;
+            for (int p = 0; p < 4; ++p) {
+                int error = 0;
+                for (int c = 0; c < 3; ++c) {
+                    error += (block[i][c] - palette[p][c]) * (block[i][c] - palette[p][c]);
+                }
+                if (error < best_error) {
+                    best_error = error;
+                    best = p;
+                }
+            }
+            indices |= static_cast<uint32_t>(best) << (i * 2);
+        }
+    }
+    out[0] = static_cast<uint8_t>(c0 & 0xff);
+    out[1] = static_cast<uint8_t>(c0 >> 8);
+    out[2] = static_cast<uint8_t>(c1 & 0xff);
+    out[3] = static_cast<uint8_t>(c1 >> 8);
+    for (int i = 0; i < 4; ++i) {
+        out[4 + i] = static_cast<uint8_t>(indices >> (i * 8));
+    }
+}
+
+typedef struct {
+    int table;
+    // 每个像素的序号 0..3, 按 block 里的位置存放, 不属于这个子块的不用
+    int selectors[16];
+    int error;
+} etc_subblock_t;
+
+// base 是已经展开到 8 位的基色, 选误差最小的调整表和每个像素的序号
+static etc_subblock_t FitEtcSubblock(const int block[16][3], const bool mask[16], const int base[3]) {
+    etc_subblock_t best{};
+    best.error = INT32_MAX;
+    for (int table = 0; table < 8; ++table) {
+        etc_subblock_t fit{};
+        fit.table = table;
+        const int modifiers[4] = {ETC_MODIFIERS[table][0], ETC_MODIFIERS[table][1],
+                                  -ETC_MODIFIERS[table][0], -ETC_MODIFIERS[table][1]};
+        for (int i = 0; i < 16 && fit.error < best.error; ++i) {
+            if (!mask[i]) {
+                continue;
+            }
+            int best_pixel_error = INT32_MAX;
+            for (int s = 0; s < 4; ++s) {
+                int error = 0;
+                for (int c = 0; c < 3; ++c) {
+                    int d = block[i][c] - Clamp255(base[c] + modifiers[s]);
+                    error += d * d;
+                }
+                if (error < best_pixel_error) {
+                    best_pixel_error = error;
+                    fit.selectors[i] = s;
+                }
+            }
+            fit.error += best_pixel_error;
+        }
+        if (fit.error < best.error) {
+            best = fit;
+        }
+    }
+    return best;
+}
+
+// ETC1 兼容的 block: 两个 2x4 或 4x2 的子块, 基色是 555 + 333 差值 (differential) 或者两个 444 (individual).
+// differential 模式下基色加差值不会越界, ETC2 解码器不会把它当成 T/H 模式
+static void EncodeEtc2Block(const int block[16][3], uint8_t out[8]) {
+    uint64_t best_bits = 0;
+    int best_error = INT32_MAX;
+    for (int flip = 0; flip < 2; ++flip) {
+        bool masks[2][16];
+        int averages[2][3] = {};
+        for (int i = 0; i < 16; ++i) {
+            int x = i % 4, y = i / 4;
+            int sub = flip ? (y >= 2) : (x >= 2);
+            masks[0][i] = sub == 0;
+            masks[1][i] = sub == 1;
+            for (int c = 0; c < 3; ++c) {
+                averages[sub][c] += block[i][c];
+            }
+        }
+        for (int mode = 0; mode < 2; ++mode) {
+            bool differential = mode == 1;
+            int quantized[2][3];
+            int base[2][3];
+            bool valid = true;
+            for (int s = 0; s < 2; ++s) {
+                for (int c = 0; c < 3; ++c) {
+                    float average = averages[s][c] / 8.0f;
+                    if (differential) {
+                        quantized[s][c] = static_cast<int>(std::lround(average * 31.0f / 255.0f));
+                        base[s][c] = (quantized[s][c] << 3) | (quantized[s][c] >> 2);
+                    } else {
+                        quantized[s][c] = static_cast<int>(std::lround(average * 15.0f / 255.0f));
+                        base[s][c] = (quantized[s][c] << 4) | quantized[s][c];
+                    }
+                }
+            }
+            if (differential) {
+                for (int c = 0; c < 3; ++c) {
+                    int delta = quantized[1][c] - quantized[0][c];
+                    valid = valid && delta >= -4 && delta <= 3;
+                }
+            }
+            if (!valid) {
+                continue;
+            }
+            etc_subblock_t fits[2] = {FitEtcSubblock(block, masks[0], base[0]),
+                                      FitEtcSubblock(block, masks[1], base[1])};
+            int error = fits[0].error + fits[1].error;
+            if (error >= best_error) {
+                continue;
+            }
+            uint64_t bits = 0;
+            if (differential) {
+                for (int c = 0; c < 3; ++c) {
+                    int delta = quantized[1][c] - quantized[0][c];
+                    bits |= static_cast<uint64_t>(quantized[0][c]) << (59 - c * 8);
+                    bits |= static_cast<uint64_t>(delta & 7) << (56 - c * 8);
+                }
+                bits |= 1ull << 33;
+            } else {
+                for (int c = 0; c < 3; ++c) {
+                    bits |= static_cast<uint64_t>(quantized[0][c]) << (60 - c * 8);
+                    bits |= static_cast<uint64_t>(quantized[1][c]) << (56 - c * 8);
+                }
+            }
+            bits |= static_cast<uint64_t>(fits[0].table) << 37;
+            bits |= static_cast<uint64_t>(fits[1].table) << 34;
+            bits |= static_cast<uint64_t>(flip) << 32;
+            for (int i = 0; i < 16; ++i) {
+                int x = i % 4, y = i / 4;
+                // 像素按列排列: 第 x 列第 y 行是 x * 4 + y
+                int bit = x * 4 + y;
+                int selector = fits[masks[0][i] ? 0 : 1].selectors[i];
+                bits |= static_cast<uint64_t>(selector >> 1) << (16 + bit);
+                bits |= static_cast<uint64_t>(selector & 1) << bit;
+            }
+            best_error = error;
+            best_bits = bits;
+        }
+    }
+    // 大端存放
+    for (int i = 0; i < 8; ++i) {
+        out[i] = static_cast<uint8_t>(best_bits >> (56 - i * 8));
+    }
+}
+
+static std::vector<uint8_t> EncodeLevel(const image_level_t& level, uint32_t vk_format) {
+    uint32_t blocks_x = (level.width + 3) / 4;
+    uint32_t blocks_y = (level.height + 3) / 4;
+    std::vector<uint8_t> encoded(static_cast<size_t>(blocks_x) * blocks_y * 8);
+    int block[16][3];
+    for (uint32_t by = 0; by < blocks_y; ++by) {
+        for (uint32_t bx = 0; bx < blocks_x; ++bx) {
+            ReadBlock(level, bx, by, block);
+            uint8_t* out = &encoded[(static_cast<size_t>(by) * blocks_x + bx) * 8];
+            if (vk_format == FORMAT_BC1_RGB_UNORM_BLOCK) {
+                EncodeBc1Block(block, out);
+            } else {
+                EncodeEtc2Block(block, out);
+            }
+        }
+    }
+    return encoded;
+}
+
+int main(int argc, char** argv) {
+    if (argc < 3) {
+        fprintf(stderr, "usage: %s <input> <output_base>\n", argv[0]);
+        return 1;
+    }
+    int width = 0, height = 0, channels = 0;
+    stbi_uc* pixels = stbi_load(argv[1], &width, &height, &channels, STBI_rgb_alpha);
+    if (pixels == nullptr) {
+        LOG_E("texture_converter", "load %s failed: %s\n", argv[1], stbi_failure_reason());
+        return 1;
+    }
+    if (channels == 4) {
+        LOG_W("texture_converter", "%s has alpha, it is dropped by BC1/ETC2 RGB\n", argv[1]);
+    }
+    std::vector<image_level_t> levels(1);
+    levels[0].width = static_cast<uint32_t>(width);
+    levels[0].height = static_cast<uint32_t>(height);
+    levels[0].pixels.assign(pixels, pixels + static_cast<size_t>(width) * height * 4);
+    stbi_image_free(pixels);
+    while (levels.back().width > 1 || levels.back().height > 1) {
+        levels.push_back(Downsample(levels.back()));
+    }
+
+    for (uint32_t vk_format : {FORMAT_BC1_RGB_UNORM_BLOCK, FORMAT_ETC2_R8G8B8_UNORM_BLOCK}) {
+        std::vector<std::vector<uint8_t>> encoded;
+        size_t bytes = 0;
+        for (const auto& level : levels) {
+            encoded.push_back(EncodeLevel(level, vk_format));
+            bytes += encoded.back().size();
+        }
+        std::string path = std::string(argv[2]) + "." + TextureFile::FormatSuffix(vk_format) + ".ktx2";
+        if (!TextureFile::Write(path, vk_format, levels[0].width, levels[0].height, encoded)) {
+            LOG_E("texture_converter", "write %s failed\n", path.c_str());
+            return 1;
+        }
+        LOG_D("texture_converter", "%ux%u, %u levels, %u bytes written to %s\n", levels[0].width,
+              levels[0].height, (unsigned) levels.size(), (unsigned) bytes, path.c_str());
+    }
+    return 0;
+}
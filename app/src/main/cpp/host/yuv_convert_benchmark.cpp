@@ -0,0 +1,424 @@
+//
+// Created by hj6231 on 2024/2/16.
+//
+
+// 对比 YuvConverter (CPU 逐像素, SIMD 单线程, SIMD 多线程) 和 YuvComputeConverter (timestamp query) 转换一帧
+// YUV 4:2:0 到 RGBA 的耗时, 结果以 JSON 数组输出. 每个尺寸和排列先用所有矩阵和 range 的组合验证
+// SIMD 和 GPU 的结果与逐像素的参考实现逐字节一致, 计时用 BT.709 limited range. 有不一致时返回 1
+// usage: yuv_convert_benchmark [--assets DIR] [--iterations N] [--threads N] [--sizes WxH,WxH,...] [--output FILE]
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+#include "create_info_factory.h"
+#include "shader_archive.h"
+#include "vulkan_instance.h"
+#include "vulkan_physical_device.h"
+#include "vulkan_logic_device.h"
+#include "vulkan_utils.h"
+#include "yuv_compute_converter.h"
+#include "yuv_converter.h"
+#include "log.h"
+
+typedef struct {
+    VulkanLogicDevice* device;
+    VulkanQueue* queue;
+    VulkanCommandPool* command_pool;
+    VulkanQueryPool* query_pool;
+    YuvComputeConverter* converter;
+    double timestamp_period;
+} gpu_context_t;
+
+typedef struct {
+    double median_ms;
+    double min_ms;
+} timing_t;
+
+// 一个尺寸用到的 GPU 资源
+typedef struct {
+    VulkanBuffer* source;
+    VulkanMemory* source_memory;
+    void* source_data;
+    VulkanImage* image;
+    VulkanMemory* image_memory;
+    VulkanBuffer* readback;
+    VulkanMemory* readback_memory;
+    void* readback_data;
+} gpu_frame_t;
+
+static const YuvLayout kLayouts[] = {YUV_LAYOUT_NV12, YUV_LAYOUT_NV21, YUV_LAYOUT_I420};
+static const YuvMatrix kMatrices[] = {YUV_MATRIX_BT601, YUV_MATRIX_BT709, YUV_MATRIX_BT2020};
+static const YuvRange kRanges[] = {YUV_RANGE_LIMITED, YUV_RANGE_FULL};
+
+static timing_t Summarize(std::vector<double> samples) {
+    std::sort(samples.begin(), samples.end());
+    return timing_t{samples[samples.size() / 2], samples.front()};
+}
+
+static double ElapsedMs(std::chrono::steady_clock::time_point begin) {
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - begin).count();
+}
+
+static std::vector<VkExtent2D> ParseSizes(const char* text) {
+    std::vector<VkExtent2D> sizes;
+    for (const char* p = text; *p != '\0';) {
+        char* end = nullptr;
+        long width = strtol(p, &end, 10);
+        if (end == p || *end != 'x') {
+            break;
+        }
+        p = end + 1;
+        long height = strtol(p, &end, 10);
+        if (end == p) {
+            break;
+        }
+        // 4:2:0 的宽高必须是偶数
+        if (width > 0 && height > 0 && width % 2 == 0 && height % 2 == 0 &&
+                width <= static_cast<long>(YuvComputeConverter::MAX_SIZE) &&
+                height <= static_cast<long>(YuvComputeConverter::MAX_SIZE)) {
+            sizes.push_back(VkExtent2D{static_cast<uint32_t>(width), static_cast<uint32_t>(height)});
+        }
+        p = *end == ',' ? end + 1 : end;
+    }
+    return sizes;
+}
+
+static VulkanBuffer* CreateHostBuffer(VulkanLogicDevice* device, VkDeviceSize size, VkBufferUsageFlags usage,
+                                      VulkanMemoryUsage memory_usage, VulkanMemory** memory, void** mapped) {
+    VkBufferCreateInfo buffer_info{};
+    buffer_info.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+    buffer_info.size = size;
+    buffer_info.usage = usage;
+    buffer_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+    VulkanBuffer* buffer = device->CreateBuffer(&buffer_info);
+    *memory = device->AllocateBufferMemory(buffer, memory_usage);
+    (*memory)->BindBufferMemory(buffer->buffer(), 0);
+    (*memory)->MapMemory(0, size, mapped);
+    return buffer;
+}
+
+static void CreateGpuFrame(VulkanLogicDevice* device, VkExtent2D size, gpu_frame_t* frame) {
+    // shader 按 uint 读, 向上取整到 4 字节
+    VkDeviceSize source_size = (YuvConverter::FrameBytes(size.width, size.height) + 3) / 4 * 4;
+    frame->source = CreateHostBuffer(device, source_size, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+                                     MEMORY_USAGE_CPU_TO_GPU, &frame->source_memory, &frame->source_data);
+    VkImageCreateInfo image_info{};
+    image_info.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+    image_info.imageType = VK_IMAGE_TYPE_2D;
+    image_info.format = VK_FORMAT_R8G8B8A8_UNORM;
+    image_info.extent = {size.width, size.height, 1};
+    image_info.mipLevels = 1;
+    image_info.arrayLayers = 1;
+    image_info.samples = VK_SAMPLE_COUNT_1_BIT;
+    image_info.tiling = VK_IMAGE_TILING_OPTIMAL;
+    image_info.usage = VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+    image_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+    image_info.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    frame->image = device->CreateImage(&image_info);
+    frame->image_memory = device->AllocateImageMemory(frame->image, MEMORY_USAGE_GPU_ONLY);
+    frame->image_memory->BindImageMemory(frame->image->image(), 0);
+    frame->readback = CreateHostBuffer(device, static_cast<VkDeviceSize>(size.width) * size.height * 4,
+                                       VK_BUFFER_USAGE_TRANSFER_DST_BIT, MEMORY_USAGE_GPU_TO_CPU,
+                                       &frame->readback_memory, &frame->readback_data);
+}
+
+static void DestroyGpuFrame(gpu_frame_t* frame) {
+    VulkanLogicDevice::DestroyBuffer(&frame->readback);
+    VulkanLogicDevice::FreeMemory(&frame->readback_memory);
+    VulkanLogicDevice::DestroyImage(&frame->image);
+    VulkanLogicDevice::FreeMemory(&frame->image_memory);
+    VulkanLogicDevice::DestroyBuffer(&frame->source);
+    VulkanLogicDevice::FreeMemory(&frame->source_memory);
+}
+
+// 转换 source 里的帧, readback 为 true 时把结果读回 readback_data. 返回转换的 GPU 毫秒数, 失败返回 -1
+static double RunGpu(const gpu_context_t& context, const gpu_frame_t& frame, VkExtent2D size, YuvLayout layout,
+                     YuvMatrix matrix, YuvRange range, bool readback) {
+    VulkanCommandBuffer* command_buffer = context.command_pool->AllocateCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY);
+    VkCommandBufferBeginInfo begin_info{};
+    begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    begin_info.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+    command_buffer->BeginCommandBuffer(&begin_info);
+    command_buffer->CmdResetQueryPool(context.query_pool->query_pool(), 0, 2);
+    command_buffer->CmdWriteTimestamp(VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, context.query_pool->query_pool(), 0);
+    yuv_conversion_t conversion{};
+    conversion.buffer = frame.source->buffer();
+    conversion.offset = 0;
+    conversion.width = size.width;
+    conversion.height = size.height;
+    conversion.layout = layout;
+    conversion.matrix = matrix;
+    conversion.range = range;
+    conversion.image = frame.image->image();
+    conversion.final_layout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+    conversion.dst_stage_mask = VK_PIPELINE_STAGE_TRANSFER_BIT;
+    conversion.dst_access_mask = VK_ACCESS_TRANSFER_READ_BIT;
+    bool recorded = context.converter->CmdConvert(command_buffer, conversion);
+    command_buffer->CmdWriteTimestamp(VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, context.query_pool->query_pool(), 1);
+    if (readback) {
+        VkBufferImageCopy region{};
+        region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+        region.imageSubresource.layerCount = 1;
+        region.imageExtent = {size.width, size.height, 1};
+        command_buffer->CmdCopyImageToBuffer(frame.image->image(), VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+                                             frame.readback->buffer(), 1, &region);
+    }
+    command_buffer->EndCommandBuffer();
+
+    double ms = -1.0;
+    if (recorded) {
+        VkFenceCreateInfo fence_info{};
+        fence_info.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+        VulkanFence* fence = context.device->CreateFence(&fence_info);
+        VkCommandBuffer vk_command_buffer = command_buffer->command_buffer();
+        VkSubmitInfo submit_info{};
+        submit_info.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+        submit_info.commandBufferCount = 1;
+        submit_info.pCommandBuffers = &vk_command_buffer;
+        context.queue->QueueSubmit(1, &submit_info, fence->fence());
+        VkFence vk_fence = fence->fence();
+        context.device->WaitForFences(1, &vk_fence, VK_TRUE, UINT64_MAX);
+        VulkanLogicDevice::DestroyFence(&fence);
+
+        uint64_t timestamps[2] = {0, 0};
+        VkResult ret = context.query_pool->GetQueryPoolResults(0, 2, sizeof(timestamps), timestamps, sizeof(uint64_t),
+                                                               VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WAIT_BIT);
+        if (ret == VK_SUCCESS) {
+            ms = static_cast<double>(timestamps[1] - timestamps[0]) * context.timestamp_period / 1e6;
+        }
+    }
+    context.converter->ReleaseJobs();
+    VulkanCommandPool::FreeCommandBuffer(&command_buffer);
+    return ms;
+}
+
+static uint64_t CountMismatches(const std::vector<uint8_t>& expected, const uint8_t* actual) {
+    uint64_t mismatches = 0;
+    for (size_t i = 0; i < expected.size(); ++i) {
+        mismatches += expected[i] != actual[i] ? 1 : 0;
+    }
+    return mismatches;
+}
+
+// 一个尺寸的所有排列, 每个排列输出一个 JSON 对象. 返回失败的排列数
+static int RunSize(const gpu_context_t& context, YuvConverter* converter, VkExtent2D size, uint32_t iterations,
+                   FILE* file, bool* first) {
+    gpu_frame_t frame{};
+    CreateGpuFrame(context.device, size, &frame);
+    // 覆盖 [0, 255] 的伪随机值, limited range 之外的值也要和参考实现一致
+    auto* src = static_cast<uint8_t*>(frame.source_data);
+    size_t frame_bytes = YuvConverter::FrameBytes(size.width, size.height);
+    uint32_t state = 0x12345678u;
+    for (size_t i = 0; i < frame_bytes; ++i) {
+        state ^= state << 13;
+        state ^= state >> 17;
+        state ^= state << 5;
+        src[i] = static_cast<uint8_t>(state >> 24);
+    }
+    size_t rgba_bytes = static_cast<size_t>(size.width) * size.height * 4;
+    std::vector<uint8_t> expected(rgba_bytes);
+    std::vector<uint8_t> actual(rgba_bytes);
+
+    int failed = 0;
+    for (YuvLayout layout : kLayouts) {
+        uint64_t simd_mismatches = 0;
+        uint64_t gpu_mismatches = 0;
+        bool ok = true;
+        for (YuvMatrix matrix : kMatrices) {
+            for (YuvRange range : kRanges) {
+                yuv_coefficients_t coefficients = YuvConverter::GetCoefficients(matrix, range);
+                YuvConverter::ConvertRowsScalar(src, size.width, size.height, layout, coefficients, 0, size.height,
+                                                expected.data());
+                converter->Convert(src, size.width, size.height, layout, matrix, range, actual.data());
+                simd_mismatches += CountMismatches(expected, actual.data());
+                ok = ok && RunGpu(context, frame, size, layout, matrix, range, true) >= 0;
+                gpu_mismatches += CountMismatches(expected, static_cast<const uint8_t*>(frame.readback_data));
+            }
+        }
+
+        const YuvMatrix matrix = YUV_MATRIX_BT709;
+        const YuvRange range = YUV_RANGE_LIMITED;
+        yuv_coefficients_t coefficients = YuvConverter::GetCoefficients(matrix, range);
+        std::vector<double> scalar_ms;
+        std::vector<double> simd_ms;
+        std::vector<double> threaded_ms;
+        std::vector<double> gpu_ms;
+        for (uint32_t i = 0; ok && i < iterations; ++i) {
+            auto begin = std::chrono::steady_clock::now();
+            YuvConverter::ConvertRowsScalar(src, size.width, size.height, layout, coefficients, 0, size.height,
+                                            actual.data());
+            scalar_ms.push_back(ElapsedMs(begin));
+            begin = std::chrono::steady_clock::now();
+            YuvConverter::ConvertRows(src, size.width, size.height, layout, coefficients, 0, size.height,
+                                      actual.data());
+            simd_ms.push_back(ElapsedMs(begin));
+            begin = std::chrono::steady_clock::now();
+            converter->Convert(src, size.width, size.height, layout, matrix, range, actual.data());
+            threaded_ms.push_back(ElapsedMs(begin));
+            double ms = RunGpu(context, frame, size, layout, matrix, range, false);
+            ok = ms >= 0;
+            gpu_ms.push_back(ms);
+        }
+        if (!ok) {
+            LOG_E("yuv_convert_benchmark", "%s %ux%u: compute conversion failed\n",
+                  YuvConverter::LayoutName(layout), size.width, size.height);
+            ++failed;
+            continue;
+        }
+        if (simd_mismatches > 0 || gpu_mismatches > 0) {
+            LOG_E("yuv_convert_benchmark", "%s %ux%u: %llu SIMD and %llu GPU bytes differ from the reference\n",
+                  YuvConverter::LayoutName(layout), size.width, size.height,
+                  (long long unsigned int) simd_mismatches, (long long unsigned int) gpu_mismatches);
+            ++failed;
+        }
+        timing_t scalar = Summarize(scalar_ms);
+        timing_t simd = Summarize(simd_ms);
+        timing_t threaded = Summarize(threaded_ms);
+        timing_t gpu = Summarize(gpu_ms);
+        fprintf(file, "%s  {\n", *first ? "" : ",\n");
+        *first = false;
+        fprintf(file, "    \"width\": %u,\n", size.width);
+        fprintf(file, "    \"height\": %u,\n", size.height);
+        fprintf(file, "    \"layout\": \"%s\",\n", YuvConverter::LayoutName(layout));
+        fprintf(file, "    \"matrix\": \"%s\",\n", YuvConverter::MatrixName(matrix));
+        fprintf(file, "    \"range\": \"%s\",\n", YuvConverter::RangeName(range));
+        fprintf(file, "    \"iterations\": %u,\n", iterations);
+        fprintf(file, "    \"threads\": %u,\n", converter->thread_count());
+        fprintf(file, "    \"cpu_scalar_ms\": {\"median\": %.4f, \"min\": %.4f},\n", scalar.median_ms, scalar.min_ms);
+        fprintf(file, "    \"cpu_simd_ms\": {\"median\": %.4f, \"min\": %.4f},\n", simd.median_ms, simd.min_ms);
+        fprintf(file, "    \"cpu_threaded_ms\": {\"median\": %.4f, \"min\": %.4f},\n",
+                threaded.median_ms, threaded.min_ms);
+        fprintf(file, "    \"gpu_ms\": {\"median\": %.4f, \"min\": %.4f},\n", gpu.median_ms, gpu.min_ms);
+        fprintf(file, "    \"gpu_speedup_vs_cpu_threaded\": %.2f,\n",
+                gpu.median_ms > 0 ? threaded.median_ms / gpu.median_ms : 0);
+        fprintf(file, "    \"mismatched_bytes\": {\"cpu_simd\": %llu, \"gpu\": %llu}\n",
+                (long long unsigned int) simd_mismatches, (long long unsigned int) gpu_mismatches);
+        fprintf(file, "  }");
+        fflush(file);
+    }
+    DestroyGpuFrame(&frame);
+    return failed;
+}
+
+int main(int argc, char** argv) {
+    const char* asset_dir = "app/src/main/assets";
+    const char* output = nullptr;
+    uint32_t iterations = 20;
+    uint32_t threads = 0;
+    std::vector<VkExtent2D> sizes = {{1280, 720}, {1920, 1080}, {3840, 2160}};
+    for (int i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "--assets") == 0 && i + 1 < argc) {
+            asset_dir = argv[++i];
+        } else if (strcmp(argv[i], "--iterations") == 0 && i + 1 < argc) {
+            iterations = static_cast<uint32_t>(atoi(argv[++i]));
+        } else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+            threads = static_cast<uint32_t>(atoi(argv[++i]));
+        } else if (strcmp(argv[i], "--sizes") == 0 && i + 1 < argc) {
+            sizes = ParseSizes(argv[++i]);
+        } else if (strcmp(argv[i], "--output") == 0 && i + 1 < argc) {
+            output = argv[++i];
+        } else {
+            fprintf(stderr, "usage: %s [--assets DIR] [--iterations N] [--threads N] [--sizes WxH,WxH,...]"
+                            " [--output FILE]\n", argv[0]);
+            return 1;
+        }
+    }
+    iterations = std::max(iterations, 1u);
+    if (sizes.empty()) {
+        LOG_E("yuv_convert_benchmark", "no valid size, width and height must be even and at most %u\n",
+              YuvComputeConverter::MAX_SIZE);
+        return 1;
+    }
+
+    AAssetManager* asset_manager = AAssetManager_fromDirectory(asset_dir);
+    ShaderArchive::Instance()->Open(asset_manager);
+
+    CreateInfoFactory create_info_factory;
+    VkInstanceCreateInfo instance_info = create_info_factory.GetInstanceCreateInfo(false,
+                                                                                   CreateInfoFactory::SURFACE_NONE);
+    VulkanInstance* instance = VulkanInstance::CreateInstance(&instance_info);
+    VulkanPhysicalDevice* physical_device = nullptr;
+    uint32_t graphic_family = 0;
+    for (auto& candidate : instance->EnumeratePhysicalDevices()) {
+        uint32_t count = 0;
+        GetGraphicQueueFamilyIndexes(candidate, &graphic_family, 1, &count);
+        if (count > 0) {
+            physical_device = new VulkanPhysicalDevice(candidate);
+            break;
+        }
+    }
+    if (physical_device == nullptr) {
+        LOG_E("yuv_convert_benchmark", "no suitable physical device\n");
+        VulkanInstance::DestroyInstance(&instance);
+        AAssetManager_delete(asset_manager);
+        return 1;
+    }
+    VkPhysicalDeviceProperties properties{};
+    physical_device->GetProperties(&properties);
+    std::vector<VkQueueFamilyProperties> families = physical_device->GetQueueFamilyProperties();
+    if (properties.limits.timestampPeriod == 0 || families[graphic_family].timestampValidBits == 0) {
+        LOG_E("yuv_convert_benchmark", "timestamp query not supported\n");
+        delete physical_device;
+        VulkanInstance::DestroyInstance(&instance);
+        AAssetManager_delete(asset_manager);
+        return 1;
+    }
+
+    std::vector<VkDeviceQueueCreateInfo> queue_infos = create_info_factory.GetDeviceQueueCreateInfos(
+            graphic_family, graphic_family, graphic_family);
+    VkDeviceCreateInfo device_info = create_info_factory.GetDeviceCreateInfo(false, queue_infos);
+    VulkanLogicDevice* device = physical_device->CreateDevice(&device_info);
+    gpu_context_t context{};
+    context.device = device;
+    context.queue = device->GetDeviceQueue(graphic_family, 0);
+    VkCommandPoolCreateInfo pool_info = CreateInfoFactory::GetCommandPoolCreateInfo(graphic_family);
+    context.command_pool = device->CreateCommandPool(&pool_info);
+    VkQueryPoolCreateInfo query_info{};
+    query_info.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+    query_info.queryType = VK_QUERY_TYPE_TIMESTAMP;
+    query_info.queryCount = 2;
+    context.query_pool = device->CreateQueryPool(&query_info);
+    context.timestamp_period = properties.limits.timestampPeriod;
+    YuvComputeConverter compute_converter(device);
+    context.converter = &compute_converter;
+    YuvConverter cpu_converter(threads);
+
+    bool created = context.command_pool != nullptr && context.query_pool != nullptr &&
+                   compute_converter.Create() == 0 && compute_converter.IsSupported(2, 2);
+    if (!created) {
+        LOG_E("yuv_convert_benchmark", "create compute yuv converter failed\n");
+    }
+    FILE* file = stdout;
+    if (output != nullptr) {
+        file = fopen(output, "w");
+        if (file == nullptr) {
+            LOG_E("yuv_convert_benchmark", "open %s failed\n", output);
+            created = false;
+        }
+    }
+    int failed = created ? 0 : 1;
+    if (created) {
+        bool first = true;
+        fprintf(file, "[\n");
+        for (const auto& size : sizes) {
+            failed += RunSize(context, &cpu_converter, size, iterations, file, &first);
+        }
+        fprintf(file, "\n]\n");
+    }
+    if (file != stdout && file != nullptr) {
+        fclose(file);
+    }
+
+    device->DeviceWaitIdle();
+    compute_converter.Destroy();
+    VulkanLogicDevice::DestroyQueryPool(&context.query_pool);
+    VulkanLogicDevice::DestroyCommandPool(&context.command_pool);
+    delete context.queue;
+    VulkanPhysicalDevice::DestroyDevice(&device);
+    delete physical_device;
+    VulkanInstance::DestroyInstance(&instance);
+    AAssetManager_delete(asset_manager);
+    return failed == 0 ? 0 : 1;
+}
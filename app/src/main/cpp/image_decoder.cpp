@@ -0,0 +1,249 @@
+//
+// Created by hj6231 on 2024/2/16.
+//
+
+#include "image_decoder.h"
+
+#include <chrono>
+#include <cstring>
+#include "log.h"
+
+#define STB_IMAGE_IMPLEMENTATION
+#include <stb_image.h>
+
+#if defined(__ARM_NEON)
+#include <arm_neon.h>
+#elif defined(__SSSE3__)
+#include <tmmintrin.h>
+#endif
+
+static uint64_t NowNs() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+ImageDecoder* ImageDecoder::Instance() {
+    static ImageDecoder decoder;
+    return &decoder;
+}
+
+ImageDecoder::ImageDecoder() :
+        stopping_(false),
+        stats_{} {
+}
+
+ImageDecoder::~ImageDecoder() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    stopping_ = true;
+    lock.unlock();
+    queued_cv_.notify_all();
+    for (auto& worker : workers_) {
+        worker.join();
+    }
+    for (auto& it : jobs_) {
+        Free(&it.second->image);
+        delete it.second;
+    }
+}
+
+void ImageDecoder::Prefetch(AAssetManager* asset_manager, const std::string& name) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    if (jobs_.count(name) > 0) {
+        return;
+    }
+    auto* job = new job_t{asset_manager, name, JOB_QUEUED, false, decoded_image_t{}};
+    jobs_[name] = job;
+    queue_.push_back(job);
+    StartWorkers();
+    lock.unlock();
+    queued_cv_.notify_one();
+}
+
+bool ImageDecoder::Take(AAssetManager* asset_manager, const std::string& name, decoded_image_t* image) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    auto it = jobs_.find(name);
+    if (it == jobs_.end() || it->second->state == JOB_QUEUED) {
+        // 还没有 worker 开始解码, 在当前线程解码比等待更快
+        if (it != jobs_.end()) {
+            for (auto queued = queue_.begin(); queued != queue_.end(); ++queued) {
+                if (*queued == it->second) {
+                    queue_.erase(queued);
+                    break;
+                }
+            }
+            delete it->second;
+            jobs_.erase(it);
+        }
+        ++stats_.sync_decodes;
+        lock.unlock();
+        return Decode(asset_manager, name, image);
+    }
+    job_t* job = it->second;
+    uint64_t begin = NowNs();
+    done_cv_.wait(lock, [job]() { return job->state == JOB_DONE; });
+    stats_.wait_ns += NowNs() - begin;
+    jobs_.erase(name);
+    lock.unlock();
+    *image = job->image;
+    bool ok = job->ok;
+    delete job;
+    return ok;
+}
+
+void ImageDecoder::DiscardUnused() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    queue_.clear();
+    done_cv_.wait(lock, [this]() {
+        for (const auto& it : jobs_) {
+            if (it.second->state == JOB_DECODING) {
+                return false;
+            }
+        }
+        return true;
+    });
+    for (auto& it : jobs_) {
+        Free(&it.second->image);
+        delete it.second;
+    }
+    jobs_.clear();
+}
+
+void ImageDecoder::CopyToRgba(const decoded_image_t& image, void* dst) {
+    uint64_t begin = NowNs();
+    size_t pixel_count = static_cast<size_t>(image.width) * image.height;
+    if (image.channels == 4) {
+        memcpy(dst, image.pixels, pixel_count * 4);
+    } else {
+        ExpandRgbToRgba(image.pixels, static_cast<uint8_t*>(dst), pixel_count);
+    }
+    std::lock_guard<std::mutex> lock(mutex_);
+    stats_.expand_ns += NowNs() - begin;
+}
+
+void ImageDecoder::Free(decoded_image_t* image) {
+    if (image->pixels != nullptr) {
+        stbi_image_free(image->pixels);
+    }
+    *image = decoded_image_t{};
+}
+
+void ImageDecoder::ExpandRgbToRgba(const uint8_t* src, uint8_t* dst, size_t pixel_count) {
+    size_t i = 0;
+#if defined(__ARM_NEON)
+    // vld3q 按通道拆开 16 个像素, vst4q 交错写回
+    uint8x16x4_t rgba;
+    rgba.val[3] = vdupq_n_u8(0xff);
+    for (; i + 16 <= pixel_count; i += 16) {
+        uint8x16x3_t rgb = vld3q_u8(src + i * 3);
+        rgba.val[0] = rgb.val[0];
+        rgba.val[1] = rgb.val[1];
+        rgba.val[2] = rgb.val[2];
+        vst4q_u8(dst + i * 4, rgba);
+    }
+#elif defined(__SSSE3__)
+    // 48 字节的 16 个像素分成 4 组, 每组 12 字节用 pshufb 展开成 16 字节再补 alpha
+    const __m128i shuffle = _mm_setr_epi8(0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1);
+    const __m128i alpha = _mm_set1_epi32(static_cast<int>(0xff000000u));
+    for (; i + 16 <= pixel_count; i += 16) {
+        __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i * 3));
+        __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i * 3 + 16));
+        __m128i c = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i * 3 + 32));
+        __m128i p0 = _mm_shuffle_epi8(a, shuffle);
+        __m128i p1 = _mm_shuffle_epi8(_mm_alignr_epi8(b, a, 12), shuffle);
+        __m128i p2 = _mm_shuffle_epi8(_mm_alignr_epi8(c, b, 8), shuffle);
+        __m128i p3 = _mm_shuffle_epi8(_mm_srli_si128(c, 4), shuffle);
+        auto* out = reinterpret_cast<__m128i*>(dst + i * 4);
+        _mm_storeu_si128(out, _mm_or_si128(p0, alpha));
+        _mm_storeu_si128(out + 1, _mm_or_si128(p1, alpha));
+        _mm_storeu_si128(out + 2, _mm_or_si128(p2, alpha));
+        _mm_storeu_si128(out + 3, _mm_or_si128(p3, alpha));
+    }
+#endif
+    for (; i < pixel_count; ++i) {
+        dst[i * 4] = src[i * 3];
+        dst[i * 4 + 1] = src[i * 3 + 1];
+        dst[i * 4 + 2] = src[i * 3 + 2];
+        dst[i * 4 + 3] = 0xff;
+    }
+}
+
+image_decode_stats_t ImageDecoder::stats() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return stats_;
+}
+
+void ImageDecoder::LogStats(const char* tag) const {
+    image_decode_stats_t stats = this->stats();
+    LOG_D(tag, "image decode: %llu images, %.2f MiB, decode %.3f ms, expand %.3f ms, waited %.3f ms,"
+               " %llu decoded synchronously\n",
+          (long long unsigned int) stats.images, stats.decoded_bytes / (1024.0 * 1024.0),
+          stats.decode_ns / 1e6, stats.expand_ns / 1e6, stats.wait_ns / 1e6,
+          (long long unsigned int) stats.sync_decodes);
+}
+
+void ImageDecoder::StartWorkers() {
+    if (!workers_.empty()) {
+        return;
+    }
+    uint32_t count = std::thread::hardware_concurrency();
+    count = count == 0 ? 1 : (count > MAX_WORKERS ? MAX_WORKERS : count);
+    for (uint32_t i = 0; i < count; ++i) {
+        workers_.emplace_back(&ImageDecoder::WorkerLoop, this);
+    }
+}
+
+void ImageDecoder::WorkerLoop() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (true) {
+        queued_cv_.wait(lock, [this]() { return stopping_ || !queue_.empty(); });
+        if (stopping_) {
+            return;
+        }
+        job_t* job = queue_.front();
+        queue_.pop_front();
+        job->state = JOB_DECODING;
+        lock.unlock();
+        decoded_image_t image{};
+        bool ok = Decode(job->asset_manager, job->name, &image);
+        lock.lock();
+        job->image = image;
+        job->ok = ok;
+        job->state = JOB_DONE;
+        done_cv_.notify_all();
+    }
+}
+
+bool ImageDecoder::Decode(AAssetManager* asset_manager, const std::string& name, decoded_image_t* image) {
+    uint64_t begin = NowNs();
+    AAsset* file = AAssetManager_open(asset_manager, name.c_str(), AASSET_MODE_BUFFER);
+    if (file == nullptr) {
+        return false;
+    }
+    // 直接从 map 的 asset 解码, 不复制文件内容
+    auto length = static_cast<int>(AAsset_getLength(file));
+    auto* data = static_cast<const stbi_uc*>(AAsset_getBuffer(file));
+    int width = 0;
+    int height = 0;
+    int channels = 0;
+    stbi_uc* pixels = nullptr;
+    if (data != nullptr && stbi_info_from_memory(data, length, &width, &height, &channels)) {
+        // RGB 保持 3 通道, 少写 1/4 的内存, 之后再展开. 灰度和灰度 + alpha 由 stb_image 直接转换
+        channels = channels == 3 ? 3 : 4;
+        pixels = stbi_load_from_memory(data, length, &width, &height, nullptr, channels);
+    }
+    AAsset_close(file);
+    if (pixels == nullptr) {
+        LOG_E("ImageDecoder", "decode %s failed\n", name.c_str());
+        return false;
+    }
+    image->pixels = pixels;
+    image->width = static_cast<uint32_t>(width);
+    image->height = static_cast<uint32_t>(height);
+    image->channels = static_cast<uint32_t>(channels);
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    ++stats_.images;
+    stats_.decoded_bytes += static_cast<uint64_t>(width) * height * channels;
+    stats_.decode_ns += NowNs() - begin;
+    return true;
+}
@@ -0,0 +1,99 @@
+//
+// Created by hj6231 on 2024/2/16.
+//
+
+#pragma once
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "android_compat.h"
+
+// 解码后的像素, channels 是 3 (RGB) 或 4 (RGBA), 由 stb_image 分配
+typedef struct {
+    uint8_t* pixels;
+    uint32_t width;
+    uint32_t height;
+    uint32_t channels;
+} decoded_image_t;
+
+typedef struct {
+    uint64_t images;
+    // 展开成 RGBA 之前的字节数
+    uint64_t decoded_bytes;
+    // worker 和调用线程解码耗时之和
+    uint64_t decode_ns;
+    // CopyToRgba 的耗时之和
+    uint64_t expand_ns;
+    // Take 等待 worker 解码完成的时间, 这部分没有和其他 setup 重叠
+    uint64_t wait_ns;
+    // Take 时还没有开始解码, 在调用线程解码的次数
+    uint64_t sync_decodes;
+} image_decode_stats_t;
+
+// PNG/JPG 解码服务. Prefetch 把图片交给 worker 线程解码, 之后 Take 取走结果, 调用者在这期间编译 shader,
+// 创建 pipeline. 解码时 RGB 图片保持 3 通道, 由 CopyToRgba 用 SIMD 展开后直接写进 staging, 不需要
+// stb_image 再分配一份 RGBA. 进程内共用一个, 可以在多个线程调用
+class ImageDecoder {
+public:
+    static ImageDecoder* Instance();
+
+    // 同一个 name 已经在队列里或者已经解码完还没取走时不重复解码
+    void Prefetch(AAssetManager* asset_manager, const std::string& name);
+    // 取走解码结果, 用完后调用 Free. 没有 Prefetch 或者还在队列里时在当前线程解码, 正在解码时等待.
+    // asset 不存在或者解码失败返回 false
+    bool Take(AAssetManager* asset_manager, const std::string& name, decoded_image_t* image);
+    // 释放没有被 Take 的结果, 队列里的不再解码, 正在解码的等待完成后释放
+    void DiscardUnused();
+
+    // dst 有 width * height * 4 字节, 例如 staging 内存
+    void CopyToRgba(const decoded_image_t& image, void* dst);
+    static void Free(decoded_image_t* image);
+    // 每个像素补上 alpha 0xff. NEON 和 SSSE3 一次处理 16 个像素, 其他平台逐个像素
+    static void ExpandRgbToRgba(const uint8_t* src, uint8_t* dst, size_t pixel_count);
+
+    image_decode_stats_t stats() const;
+    void LogStats(const char* tag) const;
+
+    const static uint32_t MAX_WORKERS = 4;
+private:
+    enum JobState {
+        JOB_QUEUED = 0,
+        JOB_DECODING,
+        JOB_DONE,
+    };
+
+    typedef struct {
+        AAssetManager* asset_manager;
+        std::string name;
+        JobState state;
+        bool ok;
+        decoded_image_t image;
+    } job_t;
+
+    ImageDecoder();
+    ~ImageDecoder();
+    ImageDecoder(const ImageDecoder&) = delete;
+    ImageDecoder& operator = (const ImageDecoder&) = delete;
+
+    // 第一次 Prefetch 时启动, 调用时持有 mutex_
+    void StartWorkers();
+    void WorkerLoop();
+    // 在调用线程解码, 不持有 mutex_
+    bool Decode(AAssetManager* asset_manager, const std::string& name, decoded_image_t* image);
+
+    mutable std::mutex mutex_;
+    std::condition_variable queued_cv_;
+    std::condition_variable done_cv_;
+    // 没有被 Take 的 job, 包括队列里的
+    std::map<std::string, job_t*> jobs_;
+    std::deque<job_t*> queue_;
+    std::vector<std::thread> workers_;
+    bool stopping_;
+
+    image_decode_stats_t stats_;
+};
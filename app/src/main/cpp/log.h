@@ -4,7 +4,16 @@
 
 #ifndef MY_APPLICATION_LOG_H
 #define MY_APPLICATION_LOG_H
+#ifdef __ANDROID__
 #include <android/log.h>
+#else
+// 非 Android 平台 (headless 运行) 输出到 stderr
+#include <cstdio>
+#define ANDROID_LOG_DEBUG 3
+#define ANDROID_LOG_WARN 5
+#define ANDROID_LOG_ERROR 6
+#define __android_log_print(PRIO, TAG, FMT, ...) fprintf(stderr, "%s: " FMT, TAG, ##__VA_ARGS__)
+#endif
 #define LOG_OUTPUT
 #define COMMON_TAG
 #ifdef LOG_OUTPUT
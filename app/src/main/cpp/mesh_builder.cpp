@@ -0,0 +1,268 @@
+//
+// Created by hj6231 on 2024/2/15.
+//
+
+#include "mesh_builder.h"
+
+#include <cassert>
+#include <chrono>
+#include <cstring>
+#include "file_utils.h"
+#include "log.h"
+
+const static uint32_t INVALID_INDEX = 0xffffffffu;
+
+static uint64_t NowNs() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+MeshBuilder::MeshBuilder(uint32_t vertex_size, bool optimize) :
+        vertex_size_(vertex_size),
+        optimize_(optimize),
+        stats_{} {
+    assert(vertex_size_ > 0);
+}
+
+void MeshBuilder::Reserve(size_t count) {
+    input_.reserve(count * vertex_size_);
+}
+
+void MeshBuilder::AddVertex(const void* vertex) {
+    const auto* bytes = static_cast<const uint8_t*>(vertex);
+    input_.insert(input_.end(), bytes, bytes + vertex_size_);
+}
+
+void MeshBuilder::Build() {
+    uint64_t begin = NowNs();
+    uint32_t input_count = static_cast<uint32_t>(input_.size() / vertex_size_);
+    stats_.input_vertices = input_count;
+
+    std::vector<uint32_t> sequential(input_count);
+    for (uint32_t i = 0; i < input_count; ++i) {
+        sequential[i] = i;
+    }
+    stats_.input_acmr = Acmr(sequential, input_count, VERTEX_CACHE_SIZE);
+
+    if (optimize_) {
+        Weld();
+        stats_.welded_acmr = Acmr(indices_, vertex_count(), VERTEX_CACHE_SIZE);
+        indices_ = OptimizeVertexCache(indices_, vertex_count(), VERTEX_CACHE_SIZE);
+        OptimizeVertexFetch();
+    } else {
+        vertices_.swap(input_);
+        indices_.swap(sequential);
+        stats_.welded_acmr = stats_.input_acmr;
+    }
+    std::vector<uint8_t>().swap(input_);
+    stats_.optimized_acmr = Acmr(indices_, vertex_count(), VERTEX_CACHE_SIZE);
+    FillIndices16();
+
+    stats_.vertices = vertex_count();
+    stats_.indices = index_count();
+    stats_.build_ns = NowNs() - begin;
+}
+
+uint32_t MeshBuilder::vertex_count() const {
+    return static_cast<uint32_t>(vertices_.size() / vertex_size_);
+}
+
+uint32_t MeshBuilder::index_count() const {
+    return static_cast<uint32_t>(indices_.size());
+}
+
+const std::vector<uint8_t>& MeshBuilder::vertices() const {
+    return vertices_;
+}
+
+bool MeshBuilder::uint16_indices() const {
+    return !indices16_.empty() || indices_.empty();
+}
+
+const void* MeshBuilder::index_data() const {
+    if (!indices16_.empty()) {
+        return indices16_.data();
+    }
+    return indices_.data();
+}
+
+size_t MeshBuilder::index_data_size() const {
+    if (!indices16_.empty()) {
+        return indices16_.size() * sizeof(uint16_t);
+    }
+    return indices_.size() * sizeof(uint32_t);
+}
+
+const mesh_build_stats_t& MeshBuilder::stats() const {
+    return stats_;
+}
+
+void MeshBuilder::LogStats(const char* tag) const {
+    LOG_D(tag, "mesh: %u -> %u vertices, %u %s indices, ACMR %.3f -> %.3f (welded) -> %.3f, built in %.3f ms\n",
+          stats_.input_vertices, stats_.vertices, stats_.indices, uint16_indices() ? "uint16" : "uint32",
+          stats_.input_acmr, stats_.welded_acmr, stats_.optimized_acmr, stats_.build_ns / 1e6);
+}
+
+double MeshBuilder::Acmr(const std::vector<uint32_t>& indices, uint32_t vertex_count, uint32_t cache_size) {
+    if (indices.size() < 3) {
+        return 0.0;
+    }
+    // 第 n 次 miss 时放进 cache, 之后再有 cache_size 次 miss 就被挤出去
+    std::vector<int64_t> inserted(vertex_count, -static_cast<int64_t>(cache_size) - 1);
+    int64_t misses = 0;
+    for (uint32_t index : indices) {
+        if (misses - inserted[index] >= cache_size) {
+            inserted[index] = misses;
+            ++misses;
+        }
+    }
+    return static_cast<double>(misses) / static_cast<double>(indices.size() / 3);
+}
+
+std::vector<uint32_t> MeshBuilder::OptimizeVertexCache(const std::vector<uint32_t>& indices,
+                                                       uint32_t vertex_count,
+                                                       uint32_t cache_size) {
+    size_t triangle_count = indices.size() / 3;
+    // 每个 vertex 还没有输出的三角形数
+    std::vector<uint32_t> live(vertex_count, 0);
+    for (size_t i = 0; i < triangle_count * 3; ++i) {
+        ++live[indices[i]];
+    }
+    // vertex -> 三角形, offsets[v] 到 offsets[v + 1] 是 vertex v 的三角形
+    std::vector<uint32_t> offsets(vertex_count + 1, 0);
+    for (uint32_t v = 0; v < vertex_count; ++v) {
+        offsets[v + 1] = offsets[v] + live[v];
+    }
+    std::vector<uint32_t> adjacency(triangle_count * 3);
+    std::vector<uint32_t> fill(offsets.begin(), offsets.end() - 1);
+    for (size_t t = 0; t < triangle_count; ++t) {
+        for (size_t k = 0; k < 3; ++k) {
+            adjacency[fill[indices[t * 3 + k]]++] = static_cast<uint32_t>(t);
+        }
+    }
+
+    // cache_time[v] 是 v 最后一次进入 cache 的时间, time - cache_time[v] > cache_size 表示已经被挤出
+    std::vector<uint32_t> cache_time(vertex_count, 0);
+    std::vector<bool> emitted(triangle_count, false);
+    std::vector<uint32_t> dead_end;
+    std::vector<uint32_t> candidates;
+    std::vector<uint32_t> result;
+    result.reserve(triangle_count * 3);
+    dead_end.reserve(triangle_count * 3);
+    uint32_t time = cache_size + 1;
+    uint32_t cursor = 0;
+
+    // 没有候选时先从最近输出的 vertex 里找还有三角形的, 再按序号找
+    auto skip_dead_end = [&]() -> uint32_t {
+        while (!dead_end.empty()) {
+            uint32_t v = dead_end.back();
+            dead_end.pop_back();
+            if (live[v] > 0) {
+                return v;
+            }
+        }
+        for (; cursor < vertex_count; ++cursor) {
+            if (live[cursor] > 0) {
+                return cursor;
+            }
+        }
+        return INVALID_INDEX;
+    };
+
+    uint32_t fanning = skip_dead_end();
+    while (fanning != INVALID_INDEX) {
+        // 输出 fanning 周围所有还没输出的三角形
+        candidates.clear();
+        for (uint32_t i = offsets[fanning]; i < offsets[fanning + 1]; ++i) {
+            uint32_t t = adjacency[i];
+            if (emitted[t]) {
+                continue;
+            }
+            for (size_t k = 0; k < 3; ++k) {
+                uint32_t v = indices[t * 3 + k];
+                result.push_back(v);
+                dead_end.push_back(v);
+                candidates.push_back(v);
+                --live[v];
+                if (time - cache_time[v] > cache_size) {
+                    cache_time[v] = time;
+                    ++time;
+                }
+            }
+            emitted[t] = true;
+        }
+
+        // 下一个 fanning vertex 选还在 cache 里的, 并且它剩下的三角形输出之后自己仍然在 cache 里,
+        // 满足条件的选进入 cache 最早的那个
+        uint32_t next = INVALID_INDEX;
+        int64_t best_priority = -1;
+        for (uint32_t v : candidates) {
+            if (live[v] == 0) {
+                continue;
+            }
+            int64_t priority = 0;
+            if (time - cache_time[v] + 2 * live[v] <= cache_size) {
+                priority = time - cache_time[v];
+            }
+            if (priority > best_priority) {
+                best_priority = priority;
+                next = v;
+            }
+        }
+        fanning = next != INVALID_INDEX ? next : skip_dead_end();
+    }
+    return result;
+}
+
+void MeshBuilder::Weld() {
+    uint32_t input_count = static_cast<uint32_t>(input_.size() / vertex_size_);
+    size_t table_size = 1;
+    while (table_size < static_cast<size_t>(input_count) * 2) {
+        table_size <<= 1;
+    }
+    // open addressing, 每个 slot 存 vertex 序号. 最多 input_count 个 vertex, 负载不超过一半
+    std::vector<uint32_t> table(table_size, INVALID_INDEX);
+    vertices_.clear();
+    vertices_.reserve(input_.size());
+    indices_.resize(input_count);
+    for (uint32_t i = 0; i < input_count; ++i) {
+        const uint8_t* vertex = input_.data() + static_cast<size_t>(i) * vertex_size_;
+        size_t slot = static_cast<size_t>(Fnv1a64(vertex, vertex_size_)) & (table_size - 1);
+        while (table[slot] != INVALID_INDEX &&
+                memcmp(vertices_.data() + static_cast<size_t>(table[slot]) * vertex_size_, vertex, vertex_size_) != 0) {
+            slot = (slot + 1) & (table_size - 1);
+        }
+        if (table[slot] == INVALID_INDEX) {
+            table[slot] = vertex_count();
+            vertices_.insert(vertices_.end(), vertex, vertex + vertex_size_);
+        }
+        indices_[i] = table[slot];
+    }
+    vertices_.shrink_to_fit();
+}
+
+void MeshBuilder::OptimizeVertexFetch() {
+    // 按第一次被引用的顺序重新编号
+    std::vector<uint32_t> remap(vertex_count(), INVALID_INDEX);
+    std::vector<uint8_t> vertices(vertices_.size());
+    uint32_t next = 0;
+    for (auto& index : indices_) {
+        if (remap[index] == INVALID_INDEX) {
+            memcpy(vertices.data() + static_cast<size_t>(next) * vertex_size_,
+                   vertices_.data() + static_cast<size_t>(index) * vertex_size_, vertex_size_);
+            remap[index] = next++;
+        }
+        index = remap[index];
+    }
+    // 焊接之后每个 vertex 都被引用, 不会有剩下的
+    vertices.resize(static_cast<size_t>(next) * vertex_size_);
+    vertices_.swap(vertices);
+}
+
+void MeshBuilder::FillIndices16() {
+    indices16_.clear();
+    if (vertex_count() > 65536) {
+        return;
+    }
+    indices16_.assign(indices_.begin(), indices_.end());
+}
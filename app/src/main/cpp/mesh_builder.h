@@ -0,0 +1,74 @@
+//
+// Created by hj6231 on 2024/2/15.
+//
+
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+typedef struct {
+    // AddVertex 的次数, 也就是不用 index buffer 时 vertex shader 的执行次数
+    uint32_t input_vertices;
+    uint32_t vertices;
+    uint32_t indices;
+    // 平均每个三角形 vertex shader 的执行次数, 按 VERTEX_CACHE_SIZE 的 FIFO cache 模拟.
+    // 不用 index buffer 时是 3
+    double input_acmr;
+    // 焊接之后, 重排之前
+    double welded_acmr;
+    double optimized_acmr;
+    uint64_t build_ns;
+} mesh_build_stats_t;
+
+// 把逐个三角形顶点 (每 3 个一个三角形) 整理成 vertex buffer + index buffer:
+// 1. 内容完全相同的 vertex 只保留一份 (hash 焊接)
+// 2. 按 post-transform vertex cache 重排三角形 (Tipsify, Sander et al. 2007)
+// 3. 按第一次被 index 引用的顺序重排 vertex, 让 vertex fetch 顺序访问
+// vertex 按字节比较, 结构体里的 padding 要先清零
+class MeshBuilder {
+public:
+    // optimize 为 false 时不焊接也不重排, index 就是 0..n-1, 用于和优化前对比
+    MeshBuilder(uint32_t vertex_size, bool optimize);
+    ~MeshBuilder() = default;
+
+    // 预计的 AddVertex 次数
+    void Reserve(size_t count);
+    void AddVertex(const void* vertex);
+    // 所有 AddVertex 之后调用一次, 焊接和重排都在这里
+    void Build();
+
+    uint32_t vertex_count() const;
+    uint32_t index_count() const;
+    const std::vector<uint8_t>& vertices() const;
+    // vertex 不超过 65536 个时用 uint16 index
+    bool uint16_indices() const;
+    const void* index_data() const;
+    size_t index_data_size() const;
+
+    const mesh_build_stats_t& stats() const;
+    void LogStats(const char* tag) const;
+
+    // 按 cache_size 的 FIFO cache 计算 ACMR
+    static double Acmr(const std::vector<uint32_t>& indices, uint32_t vertex_count, uint32_t cache_size);
+    // 返回重排之后的 index, 三角形不变, 只改变顺序
+    static std::vector<uint32_t> OptimizeVertexCache(const std::vector<uint32_t>& indices,
+                                                     uint32_t vertex_count,
+                                                     uint32_t cache_size);
+
+    // 移动 GPU 的 post-transform cache 一般在 16 到 32 之间, 取小的一边
+    const static uint32_t VERTEX_CACHE_SIZE = 16;
+private:
+    void Weld();
+    void OptimizeVertexFetch();
+    void FillIndices16();
+
+    const uint32_t vertex_size_;
+    const bool optimize_;
+    // AddVertex 的原始数据, Build 之后释放
+    std::vector<uint8_t> input_;
+    std::vector<uint8_t> vertices_;
+    std::vector<uint32_t> indices_;
+    std::vector<uint16_t> indices16_;
+    mesh_build_stats_t stats_;
+};
@@ -0,0 +1,159 @@
+//
+// Created by hj6231 on 2024/2/15.
+//
+
+#include "mesh_file.h"
+
+#include <cstring>
+#include "file_utils.h"
+#include "log.h"
+
+static size_t AlignUp(size_t value, size_t alignment) {
+    return (value + alignment - 1) / alignment * alignment;
+}
+
+MeshFile::MeshFile() :
+        asset_(nullptr),
+        data_(nullptr),
+        header_{} {
+}
+
+MeshFile::~MeshFile() {
+    Close();
+}
+
+bool MeshFile::Open(AAssetManager* asset_manager, const char* name) {
+    Close();
+    asset_ = AAssetManager_open(asset_manager, name, AASSET_MODE_BUFFER);
+    if (asset_ == nullptr) {
+        return false;
+    }
+    size_t size = static_cast<size_t>(AAsset_getLength(asset_));
+    auto* data = static_cast<const uint8_t*>(AAsset_getBuffer(asset_));
+    if (data == nullptr || !Validate(data, size)) {
+        LOG_E("MeshFile", "invalid %s\n", name);
+        Close();
+        return false;
+    }
+    data_ = data;
+    return true;
+}
+
+void MeshFile::Close() {
+    if (asset_ != nullptr) {
+        AAsset_close(asset_);
+        asset_ = nullptr;
+    }
+    data_ = nullptr;
+    header_ = mesh_file_header_t{};
+}
+
+bool MeshFile::is_open() const {
+    return data_ != nullptr;
+}
+
+bool MeshFile::MatchLayout(uint32_t stride, const std::vector<mesh_attribute_t>& attributes) const {
+    if (!is_open() || header_.vertex_stride != stride || header_.attribute_count != attributes.size()) {
+        return false;
+    }
+    for (size_t i = 0; i < attributes.size(); ++i) {
+        // map 的地址不保证对齐, 复制出来再比较
+        mesh_attribute_t attribute{};
+        memcpy(&attribute, data_ + sizeof(mesh_file_header_t) + i * sizeof(mesh_attribute_t), sizeof(attribute));
+        if (attribute.location != attributes[i].location ||
+                attribute.format != attributes[i].format ||
+                attribute.offset != attributes[i].offset) {
+            return false;
+        }
+    }
+    return true;
+}
+
+const mesh_file_header_t& MeshFile::header() const {
+    return header_;
+}
+
+const mesh_attribute_t* MeshFile::attributes() const {
+    return reinterpret_cast<const mesh_attribute_t*>(data_ + sizeof(mesh_file_header_t));
+}
+
+const void* MeshFile::vertex_data() const {
+    return data_ + header_.vertex_offset;
+}
+
+size_t MeshFile::vertex_data_size() const {
+    return static_cast<size_t>(header_.vertex_count) * header_.vertex_stride;
+}
+
+const void* MeshFile::index_data() const {
+    return data_ + header_.index_offset;
+}
+
+size_t MeshFile::index_data_size() const {
+    return static_cast<size_t>(header_.index_count) * header_.index_size;
+}
+
+bool MeshFile::Write(const std::string& path,
+                     uint32_t vertex_stride,
+                     const std::vector<mesh_attribute_t>& attributes,
+                     const std::vector<uint8_t>& vertices,
+                     uint32_t index_size,
+                     const void* indices,
+                     uint32_t index_count,
+                     const float bounds_min[3],
+                     const float bounds_max[3]) {
+    if (vertex_stride == 0 || vertices.size() % vertex_stride != 0 || (index_size != 2 && index_size != 4)) {
+        return false;
+    }
+    mesh_file_header_t header{};
+    header.magic = FILE_MAGIC;
+    header.version = FILE_VERSION;
+    header.vertex_count = static_cast<uint32_t>(vertices.size() / vertex_stride);
+    header.vertex_stride = vertex_stride;
+    header.index_count = index_count;
+    header.index_size = index_size;
+    header.attribute_count = static_cast<uint32_t>(attributes.size());
+    header.vertex_offset = AlignUp(sizeof(header) + attributes.size() * sizeof(mesh_attribute_t), STREAM_ALIGNMENT);
+    header.index_offset = AlignUp(header.vertex_offset + vertices.size(), STREAM_ALIGNMENT);
+    memcpy(header.bounds_min, bounds_min, sizeof(header.bounds_min));
+    memcpy(header.bounds_max, bounds_max, sizeof(header.bounds_max));
+
+    size_t index_bytes = static_cast<size_t>(index_count) * index_size;
+    std::vector<uint8_t> content(header.index_offset + index_bytes, 0);
+    memcpy(content.data(), &header, sizeof(header));
+    if (!attributes.empty()) {
+        memcpy(content.data() + sizeof(header), attributes.data(), attributes.size() * sizeof(mesh_attribute_t));
+    }
+    if (!vertices.empty()) {
+        memcpy(content.data() + header.vertex_offset, vertices.data(), vertices.size());
+    }
+    if (index_bytes > 0) {
+        memcpy(content.data() + header.index_offset, indices, index_bytes);
+    }
+    return WriteFileAtomic(path, content);
+}
+
+bool MeshFile::Validate(const uint8_t* data, size_t size) {
+    if (size < sizeof(mesh_file_header_t)) {
+        return false;
+    }
+    memcpy(&header_, data, sizeof(header_));
+    // 只检查结构, 不算校验和, 加载时间应该只有 memcpy
+    size_t vertex_bytes = static_cast<size_t>(header_.vertex_count) * header_.vertex_stride;
+    size_t index_bytes = static_cast<size_t>(header_.index_count) * header_.index_size;
+    bool valid = header_.magic == FILE_MAGIC &&
+                 header_.version == FILE_VERSION &&
+                 header_.vertex_stride > 0 &&
+                 (header_.index_size == 2 || header_.index_size == 4) &&
+                 header_.vertex_offset % STREAM_ALIGNMENT == 0 &&
+                 header_.index_offset % STREAM_ALIGNMENT == 0 &&
+                 header_.vertex_offset >= sizeof(mesh_file_header_t) +
+                                          header_.attribute_count * sizeof(mesh_attribute_t) &&
+                 header_.vertex_offset <= size && vertex_bytes <= size - header_.vertex_offset &&
+                 header_.index_offset >= header_.vertex_offset + vertex_bytes &&
+                 header_.index_offset <= size && index_bytes <= size - header_.index_offset;
+    if (!valid) {
+        header_ = mesh_file_header_t{};
+    }
+    return valid;
+}
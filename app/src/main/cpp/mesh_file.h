@@ -0,0 +1,83 @@
+//
+// Created by hj6231 on 2024/2/15.
+//
+
+#pragma once
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "android_compat.h"
+
+// 一个 vertex 属性, 和 VkVertexInputAttributeDescription 对应, binding 固定为 0
+typedef struct {
+    uint32_t location;
+    // VkFormat 的值
+    uint32_t format;
+    uint32_t offset;
+    uint32_t reserved;
+} mesh_attribute_t;
+
+// 文件开头, 后面依次是 attribute_count 个 mesh_attribute_t, vertex 数据, index 数据.
+// 两段数据都按 STREAM_ALIGNMENT 对齐, 可以直接 memcpy 进 buffer
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t vertex_count;
+    uint32_t vertex_stride;
+    uint32_t index_count;
+    // 2 或 4
+    uint32_t index_size;
+    uint32_t attribute_count;
+    uint32_t reserved;
+    uint64_t vertex_offset;
+    uint64_t index_offset;
+    // location 0 (position) 的包围盒
+    float bounds_min[3];
+    float bounds_max[3];
+} mesh_file_header_t;
+
+// 离线由 host/mesh_converter 从 OBJ 生成的 .mesh 文件 (已经焊接和重排过).
+// 运行时整个文件 map 进来 (设备上 AAsset_getBuffer, Linux 上 mmap), 不解析也不复制,
+// vertex_data/index_data 直接 memcpy 到 buffer
+class MeshFile {
+public:
+    MeshFile();
+    ~MeshFile();
+    MeshFile(const MeshFile&) = delete;
+    MeshFile& operator = (const MeshFile&) = delete;
+
+    // 文件不存在或者格式不对时返回 false
+    bool Open(AAssetManager* asset_manager, const char* name);
+    void Close();
+    bool is_open() const;
+
+    // stride 和每个属性都一致时返回 true, 用来确认文件和 pipeline 的 vertex layout 匹配
+    bool MatchLayout(uint32_t stride, const std::vector<mesh_attribute_t>& attributes) const;
+
+    const mesh_file_header_t& header() const;
+    const mesh_attribute_t* attributes() const;
+    const void* vertex_data() const;
+    size_t vertex_data_size() const;
+    const void* index_data() const;
+    size_t index_data_size() const;
+
+    static bool Write(const std::string& path,
+                      uint32_t vertex_stride,
+                      const std::vector<mesh_attribute_t>& attributes,
+                      const std::vector<uint8_t>& vertices,
+                      uint32_t index_size,
+                      const void* indices,
+                      uint32_t index_count,
+                      const float bounds_min[3],
+                      const float bounds_max[3]);
+
+    const static uint32_t FILE_MAGIC = 0x4853454d; // "MESH"
+    const static uint32_t FILE_VERSION = 1;
+    const static uint32_t STREAM_ALIGNMENT = 16;
+private:
+    bool Validate(const uint8_t* data, size_t size);
+
+    AAsset* asset_;
+    const uint8_t* data_;
+    mesh_file_header_t header_;
+};
@@ -11,9 +11,13 @@ extern "C" JNIEXPORT jlong JNICALL
 Java_com_arcsoft_myapplication_VulkanTutorial_create (
         JNIEnv* env,
         jobject,
-        jobject asset_manager) {
+        jobject asset_manager,
+        jstring cache_directory) {
     AAssetManager * a_asset_manager = AAssetManager_fromJava(env, asset_manager);
     auto* tutorial = new ComputerShader(a_asset_manager);
+    const char* cache_dir = env->GetStringUTFChars(cache_directory, nullptr);
+    tutorial->SetCacheDirectory(cache_dir);
+    env->ReleaseStringUTFChars(cache_directory, cache_dir);
     tutorial->CreateInstance();
     tutorial->PickPhysicalDevice();
     return  (jlong)tutorial;
@@ -51,6 +55,8 @@ Java_com_arcsoft_myapplication_VulkanTutorial_surfaceChanged (
         jobject /* this */,
         jlong handle) {
     (void)env;
+    auto* tutorial = (TutorialBase*)handle;
+    tutorial->SurfaceChanged();
 }
 
 extern "C" JNIEXPORT void JNICALL
@@ -0,0 +1,438 @@
+//
+// Created by hj6231 on 2024/2/16.
+//
+
+#include "obj_parser.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <thread>
+#include "log.h"
+
+enum Statement {
+    STATEMENT_OTHER,
+    STATEMENT_POSITION,
+    STATEMENT_TEXCOORD,
+    STATEMENT_NORMAL,
+    STATEMENT_FACE,
+};
+
+// 1e0 到 1e22 都可以用 double 精确表示
+const static double POW10[] = {
+        1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+        1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22};
+const static int MAX_EXACT_POW10 = 22;
+const static uint64_t MAX_MANTISSA = 1000000000000000000ull;
+// 超出 double 范围的指数, 绝对值更大的结果都是 0 或者 inf. 饱和在这里, 累加不会溢出 int
+const static int MAX_EXPONENT = 400;
+
+static uint64_t NowNs() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static bool IsSpace(char c) {
+    return c == ' ' || c == '\t' || c == '\r';
+}
+
+static bool IsDigit(char c) {
+    return c >= '0' && c <= '9';
+}
+
+static const char* SkipSpaces(const char* p, const char* end) {
+    while (p < end && IsSpace(*p)) {
+        ++p;
+    }
+    return p;
+}
+
+static const char* LineEnd(const char* p, const char* end) {
+    const auto* newline = static_cast<const char*>(memchr(p, '\n', end - p));
+    return newline != nullptr ? newline : end;
+}
+
+// p 指向行首第一个非空白字符, 返回语句类型, *args 指向关键字之后
+static Statement ReadStatement(const char* p, const char* end, const char** args) {
+    size_t length = end - p;
+    if (length >= 2 && p[0] == 'v' && IsSpace(p[1])) {
+        *args = p + 2;
+        return STATEMENT_POSITION;
+    }
+    if (length >= 3 && p[0] == 'v' && p[1] == 't' && IsSpace(p[2])) {
+        *args = p + 3;
+        return STATEMENT_TEXCOORD;
+    }
+    if (length >= 3 && p[0] == 'v' && p[1] == 'n' && IsSpace(p[2])) {
+        *args = p + 3;
+        return STATEMENT_NORMAL;
+    }
+    if (length >= 2 && p[0] == 'f' && IsSpace(p[1])) {
+        *args = p + 2;
+        return STATEMENT_FACE;
+    }
+    return STATEMENT_OTHER;
+}
+
+static const char* ParseInt(const char* p, const char* end, int32_t* value) {
+    bool negative = false;
+    if (p < end && (*p == '-' || *p == '+')) {
+        negative = *p == '-';
+        ++p;
+    }
+    if (p == end || !IsDigit(*p)) {
+        return nullptr;
+    }
+    int64_t result = 0;
+    while (p < end && IsDigit(*p)) {
+        result = result * 10 + (*p - '0');
+        if (result > INT32_MAX) {
+            return nullptr;
+        }
+        ++p;
+    }
+    *value = static_cast<int32_t>(negative ? -result : result);
+    return p;
+}
+
+// OBJ 序号从 1 开始, 负数表示从当前已经出现的数量往回数
+static bool ResolveIndex(int32_t value, uint32_t count_before, uint32_t total, int32_t* index) {
+    int64_t result;
+    if (value > 0) {
+        result = static_cast<int64_t>(value) - 1;
+    } else if (value < 0) {
+        result = static_cast<int64_t>(count_before) + value;
+    } else {
+        return false;
+    }
+    if (result < 0 || result >= total) {
+        return false;
+    }
+    *index = static_cast<int32_t>(result);
+    return true;
+}
+
+ObjParser::ObjParser(uint32_t max_threads) :
+        max_threads_(max_threads),
+        stats_{} {
+    if (max_threads_ == 0) {
+        max_threads_ = std::thread::hardware_concurrency();
+    }
+    if (max_threads_ == 0) {
+        max_threads_ = 1;
+    }
+}
+
+bool ObjParser::Parse(const char* data, size_t size) {
+    stats_ = obj_parse_stats_t{};
+    stats_.bytes = size;
+    uint64_t begin = NowNs();
+    SplitChunks(data, size);
+    stats_.threads = static_cast<uint32_t>(chunks_.size());
+    RunChunks(CountChunk);
+
+    // 前缀和, offsets[i] 是 chunk i 之前所有 chunk 的数量
+    std::vector<chunk_t> offsets(chunks_.size(), chunk_t{});
+    for (size_t i = 0; i < chunks_.size(); ++i) {
+        if (i > 0) {
+            offsets[i].positions = offsets[i - 1].positions + chunks_[i - 1].positions;
+            offsets[i].texcoords = offsets[i - 1].texcoords + chunks_[i - 1].texcoords;
+            offsets[i].normals = offsets[i - 1].normals + chunks_[i - 1].normals;
+            offsets[i].triangles = offsets[i - 1].triangles + chunks_[i - 1].triangles;
+        }
+        stats_.positions += chunks_[i].positions;
+        stats_.texcoords += chunks_[i].texcoords;
+        stats_.normals += chunks_[i].normals;
+        stats_.triangles += chunks_[i].triangles;
+    }
+    positions_.resize(static_cast<size_t>(stats_.positions) * 3);
+    texcoords_.resize(static_cast<size_t>(stats_.texcoords) * 2);
+    normals_.resize(static_cast<size_t>(stats_.normals) * 3);
+    indices_.resize(static_cast<size_t>(stats_.triangles) * 3);
+    uint64_t counted = NowNs();
+    stats_.count_ns = counted - begin;
+
+    RunChunks([this, &offsets](chunk_t* chunk) {
+        ParseChunk(chunk, offsets[chunk - chunks_.data()]);
+    });
+    stats_.parse_ns = NowNs() - counted;
+
+    for (const auto& chunk : chunks_) {
+        if (chunk.failed) {
+            positions_.clear();
+            texcoords_.clear();
+            normals_.clear();
+            indices_.clear();
+            return false;
+        }
+    }
+    return true;
+}
+
+const std::vector<float>& ObjParser::positions() const {
+    return positions_;
+}
+
+const std::vector<float>& ObjParser::texcoords() const {
+    return texcoords_;
+}
+
+const std::vector<float>& ObjParser::normals() const {
+    return normals_;
+}
+
+const std::vector<obj_index_t>& ObjParser::indices() const {
+    return indices_;
+}
+
+const obj_parse_stats_t& ObjParser::stats() const {
+    return stats_;
+}
+
+void ObjParser::LogStats(const char* tag) const {
+    LOG_D(tag, "obj: %llu bytes on %u threads, %u positions, %u texcoords, %u normals, %u triangles, "
+               "count %.3f ms, parse %.3f ms\n",
+          (unsigned long long) stats_.bytes, stats_.threads, stats_.positions, stats_.texcoords,
+          stats_.normals, stats_.triangles, stats_.count_ns / 1e6, stats_.parse_ns / 1e6);
+}
+
+const char* ObjParser::ParseFloat(const char* begin, const char* end, float* value) {
+    const char* p = begin;
+    bool negative = false;
+    if (p < end && (*p == '-' || *p == '+')) {
+        negative = *p == '-';
+        ++p;
+    }
+    // 最多保留 18 位有效数字, 再多的整数位只增加指数, 小数位直接丢掉
+    uint64_t mantissa = 0;
+    int exponent = 0;
+    int digits = 0;
+    for (; p < end && IsDigit(*p); ++p, ++digits) {
+        if (mantissa < MAX_MANTISSA) {
+            mantissa = mantissa * 10 + (*p - '0');
+        } else if (exponent < MAX_EXPONENT) {
+            ++exponent;
+        }
+    }
+    if (p < end && *p == '.') {
+        for (++p; p < end && IsDigit(*p); ++p, ++digits) {
+            if (mantissa < MAX_MANTISSA) {
+                mantissa = mantissa * 10 + (*p - '0');
+                --exponent;
+            }
+        }
+    }
+    if (digits == 0) {
+        return nullptr;
+    }
+    if (p < end && (*p == 'e' || *p == 'E')) {
+        const char* q = p + 1;
+        bool exponent_negative = false;
+        if (q < end && (*q == '-' || *q == '+')) {
+            exponent_negative = *q == '-';
+            ++q;
+        }
+        if (q == end || !IsDigit(*q)) {
+            return nullptr;
+        }
+        int exponent_value = 0;
+        for (; q < end && IsDigit(*q); ++q) {
+            if (exponent_value < MAX_EXPONENT) {
+                exponent_value = exponent_value * 10 + (*q - '0');
+            }
+        }
+        exponent += exponent_negative ? -exponent_value : exponent_value;
+        exponent = std::max(-MAX_EXPONENT, std::min(exponent, MAX_EXPONENT));
+        p = q;
+    }
+    double result = static_cast<double>(mantissa);
+    if (mantissa == 0) {
+        result = 0.0;
+    } else if (exponent >= 0 && exponent <= MAX_EXACT_POW10) {
+        result *= POW10[exponent];
+    } else if (exponent < 0 && exponent >= -MAX_EXACT_POW10) {
+        result /= POW10[-exponent];
+    } else {
+        result *= std::pow(10.0, exponent);
+    }
+    *value = static_cast<float>(negative ? -result : result);
+    return p;
+}
+
+void ObjParser::SplitChunks(const char* data, size_t size) {
+    size_t count = size / MIN_CHUNK_SIZE;
+    if (count > max_threads_) {
+        count = max_threads_;
+    }
+    if (count == 0) {
+        count = 1;
+    }
+    chunks_.clear();
+    const char* end = data + size;
+    const char* begin = data;
+    // 每段在目标位置之后的第一个换行处结束, 一行不会被切开
+    for (size_t i = 1; i <= count && begin < end; ++i) {
+        const char* chunk_end = end;
+        if (i < count) {
+            const char* target = data + size / count * i;
+            chunk_end = target <= begin ? begin : target;
+            chunk_end = LineEnd(chunk_end, end);
+            chunk_end = chunk_end < end ? chunk_end + 1 : end;
+        }
+        chunks_.push_back(chunk_t{begin, chunk_end, 0, 0, 0, 0, false});
+        begin = chunk_end;
+    }
+    if (chunks_.empty()) {
+        chunks_.push_back(chunk_t{data, data, 0, 0, 0, 0, false});
+    }
+}
+
+void ObjParser::RunChunks(const std::function<void(chunk_t*)>& job) {
+    std::vector<std::thread> threads;
+    threads.reserve(chunks_.size() - 1);
+    for (size_t i = 1; i < chunks_.size(); ++i) {
+        threads.emplace_back(job, &chunks_[i]);
+    }
+    job(&chunks_[0]);
+    for (auto& thread : threads) {
+        thread.join();
+    }
+}
+
+void ObjParser::CountChunk(chunk_t* chunk) {
+    const char* end = chunk->end;
+    for (const char* line = chunk->begin; line < end;) {
+        const char* line_end = LineEnd(line, end);
+        const char* args = nullptr;
+        switch (ReadStatement(SkipSpaces(line, line_end), line_end, &args)) {
+            case STATEMENT_POSITION:
+                ++chunk->positions;
+                break;
+            case STATEMENT_TEXCOORD:
+                ++chunk->texcoords;
+                break;
+            case STATEMENT_NORMAL:
+                ++chunk->normals;
+                break;
+            case STATEMENT_FACE: {
+                uint32_t corners = 0;
+                for (const char* p = SkipSpaces(args, line_end); p < line_end; p = SkipSpaces(p, line_end)) {
+                    ++corners;
+                    while (p < line_end && !IsSpace(*p)) {
+                        ++p;
+                    }
+                }
+                chunk->triangles += corners >= 3 ? corners - 2 : 0;
+                break;
+            }
+            default:
+                break;
+        }
+        // 最后一行没有换行时 line_end 就是 end
+        line = line_end < end ? line_end + 1 : end;
+    }
+}
+
+void ObjParser::ParseChunk(chunk_t* chunk, const chunk_t& offset) {
+    float* position = positions_.data() + static_cast<size_t>(offset.positions) * 3;
+    float* texcoord = texcoords_.data() + static_cast<size_t>(offset.texcoords) * 2;
+    float* normal = normals_.data() + static_cast<size_t>(offset.normals) * 3;
+    obj_index_t* index = indices_.data() + static_cast<size_t>(offset.triangles) * 3;
+    // 到当前行为止出现过的数量, 负数序号相对于它
+    chunk_t seen = offset;
+    const char* end = chunk->end;
+    for (const char* line = chunk->begin; line < end && !chunk->failed;) {
+        const char* line_end = LineEnd(line, end);
+        const char* args = nullptr;
+        const char* p = nullptr;
+        switch (ReadStatement(SkipSpaces(line, line_end), line_end, &args)) {
+            case STATEMENT_POSITION:
+                p = args;
+                for (int k = 0; k < 3 && p != nullptr; ++k) {
+                    p = ParseFloat(SkipSpaces(p, line_end), line_end, position++);
+                }
+                ++seen.positions;
+                break;
+            case STATEMENT_TEXCOORD:
+                // v 可以省略, 和 tinyobj 一样当成 0
+                p = ParseFloat(SkipSpaces(args, line_end), line_end, texcoord++);
+                if (p != nullptr) {
+                    const char* v = ParseFloat(SkipSpaces(p, line_end), line_end, texcoord);
+                    if (v == nullptr) {
+                        *texcoord = 0.0f;
+                    }
+                    ++texcoord;
+                }
+                ++seen.texcoords;
+                break;
+            case STATEMENT_NORMAL:
+                p = args;
+                for (int k = 0; k < 3 && p != nullptr; ++k) {
+                    p = ParseFloat(SkipSpaces(p, line_end), line_end, normal++);
+                }
+                ++seen.normals;
+                break;
+            case STATEMENT_FACE: {
+                // v, v/vt, v//vn, v/vt/vn, 按扇形拆: (0, i - 1, i)
+                obj_index_t first{}, previous{};
+                uint32_t corners = 0;
+                p = SkipSpaces(args, line_end);
+                while (p != nullptr && p < line_end) {
+                    obj_index_t corner{-1, -1, -1};
+                    int32_t value = 0;
+                    p = ParseInt(p, line_end, &value);
+                    if (p == nullptr ||
+                            !ResolveIndex(value, seen.positions, stats_.positions, &corner.position)) {
+                        p = nullptr;
+                        break;
+                    }
+                    if (p < line_end && *p == '/') {
+                        ++p;
+                        if (p < line_end && *p != '/') {
+                            p = ParseInt(p, line_end, &value);
+                            if (p == nullptr ||
+                                    !ResolveIndex(value, seen.texcoords, stats_.texcoords, &corner.texcoord)) {
+                                p = nullptr;
+                                break;
+                            }
+                        }
+                        if (p < line_end && *p == '/') {
+                            p = ParseInt(p + 1, line_end, &value);
+                            if (p == nullptr ||
+                                    !ResolveIndex(value, seen.normals, stats_.normals, &corner.normal)) {
+                                p = nullptr;
+                                break;
+                            }
+                        }
+                    }
+                    if (p < line_end && !IsSpace(*p)) {
+                        p = nullptr;
+                        break;
+                    }
+                    if (corners == 0) {
+                        first = corner;
+                    } else if (corners >= 2) {
+                        *index++ = first;
+                        *index++ = previous;
+                        *index++ = corner;
+                    }
+                    previous = corner;
+                    ++corners;
+                    p = SkipSpaces(p, line_end);
+                }
+                break;
+            }
+            default:
+                // 其他语句不关心参数
+                p = line;
+                break;
+        }
+        if (p == nullptr) {
+            LOG_E("ObjParser", "bad line: %.*s\n", static_cast<int>(line_end - line), line);
+            chunk->failed = true;
+        }
+        // 最后一行没有换行时 line_end 就是 end
+        line = line_end < end ? line_end + 1 : end;
+    }
+}
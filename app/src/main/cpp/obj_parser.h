@@ -0,0 +1,84 @@
+//
+// Created by hj6231 on 2024/2/16.
+//
+
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+// 三角形的一个角, 都已经转成从 0 开始的绝对序号, 没有时是 -1
+typedef struct {
+    int32_t position;
+    int32_t texcoord;
+    int32_t normal;
+} obj_index_t;
+
+typedef struct {
+    uint64_t bytes;
+    uint32_t threads;
+    uint32_t positions;
+    uint32_t texcoords;
+    uint32_t normals;
+    uint32_t triangles;
+    // 第一遍只数每段有多少个 v/vt/vn/f, 用来算每段写到数组的哪里
+    uint64_t count_ns;
+    uint64_t parse_ns;
+} obj_parse_stats_t;
+
+// 只处理 v/vt/vn/f 的 OBJ 解析, 其他语句 (o/g/s/usemtl/mtllib) 忽略, 多边形按扇形拆成三角形.
+// 文本按行切成几段, 每段一个线程:
+// 1. 每段数出 v/vt/vn/三角形的个数, 前缀和就是这一段在结果数组里的起始位置
+// 2. 数组一次分配到最终大小, 每段直接解析到自己的区间, 结果和单线程解析完全一样, 不需要合并
+// 数组在多次 Parse 之间复用, 解析同样大小的文件不再分配内存
+class ObjParser {
+public:
+    // max_threads 为 0 时用 hardware_concurrency
+    explicit ObjParser(uint32_t max_threads = 0);
+    ~ObjParser() = default;
+
+    // data 不需要以 0 结尾, 格式错误时返回 false
+    bool Parse(const char* data, size_t size);
+
+    // 每个 3 个 float
+    const std::vector<float>& positions() const;
+    // 每个 2 个 float, 没有翻转 v
+    const std::vector<float>& texcoords() const;
+    const std::vector<float>& normals() const;
+    // 每 3 个一个三角形
+    const std::vector<obj_index_t>& indices() const;
+
+    const obj_parse_stats_t& stats() const;
+    void LogStats(const char* tag) const;
+
+    // 不依赖 locale 的 float 解析, 成功时返回解析结束的位置, 失败返回 nullptr
+    static const char* ParseFloat(const char* begin, const char* end, float* value);
+
+    // 小于这个大小的段不值得开线程
+    const static size_t MIN_CHUNK_SIZE = 64 * 1024;
+private:
+    typedef struct {
+        const char* begin;
+        const char* end;
+        uint32_t positions;
+        uint32_t texcoords;
+        uint32_t normals;
+        uint32_t triangles;
+        bool failed;
+    } chunk_t;
+
+    void SplitChunks(const char* data, size_t size);
+    // chunk 0 在调用线程上执行
+    void RunChunks(const std::function<void(chunk_t*)>& job);
+    static void CountChunk(chunk_t* chunk);
+    void ParseChunk(chunk_t* chunk, const chunk_t& offset);
+
+    uint32_t max_threads_;
+    std::vector<chunk_t> chunks_;
+    std::vector<float> positions_;
+    std::vector<float> texcoords_;
+    std::vector<float> normals_;
+    std::vector<obj_index_t> indices_;
+    obj_parse_stats_t stats_;
+};
@@ -0,0 +1,120 @@
+//
+// Created by hj6231 on 2024/2/15.
+//
+
+#include "parallel_setup.h"
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include "log.h"
+
+static uint64_t NowNs() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+ParallelSetup::ParallelSetup(uint32_t max_threads) :
+        max_threads_(max_threads),
+        pending_begin_(0),
+        wall_ns_(0) {
+    if (max_threads_ == 0) {
+        max_threads_ = std::thread::hardware_concurrency();
+    }
+    if (max_threads_ == 0) {
+        max_threads_ = 1;
+    }
+}
+
+void ParallelSetup::Add(const std::string& object, Phase phase, std::function<int()> task) {
+    tasks_.push_back(task_t{object, phase, std::move(task), 0, 0});
+}
+
+int ParallelSetup::Run() {
+    size_t begin = pending_begin_;
+    size_t count = tasks_.size() - begin;
+    pending_begin_ = tasks_.size();
+    if (count == 0) {
+        return 0;
+    }
+    uint64_t run_begin = NowNs();
+    // 任务数很少, 每个线程按顺序领下一个, 不需要更复杂的调度
+    std::atomic<size_t> next(begin);
+    auto worker = [this, &next]() {
+        for (size_t i = next++; i < tasks_.size(); i = next++) {
+            RunTask(&tasks_[i]);
+        }
+    };
+    size_t thread_count = count < max_threads_ ? count : max_threads_;
+    std::vector<std::thread> threads;
+    threads.reserve(thread_count - 1);
+    for (size_t i = 1; i < thread_count; ++i) {
+        threads.emplace_back(worker);
+    }
+    worker();
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    wall_ns_ += NowNs() - run_begin;
+
+    int failures = 0;
+    for (size_t i = begin; i < tasks_.size(); ++i) {
+        if (tasks_[i].result != 0) {
+            LOG_E("ParallelSetup", "%s phase %d failed %d\n", tasks_[i].object.c_str(),
+                  tasks_[i].phase, tasks_[i].result);
+            ++failures;
+        }
+    }
+    return failures;
+}
+
+std::vector<object_setup_timing_t> ParallelSetup::object_timings() const {
+    std::vector<object_setup_timing_t> timings;
+    for (const auto& task : tasks_) {
+        object_setup_timing_t* timing = nullptr;
+        for (auto& it : timings) {
+            if (it.object == task.object) {
+                timing = &it;
+                break;
+            }
+        }
+        if (timing == nullptr) {
+            timings.push_back(object_setup_timing_t{task.object, 0, 0, 0, 0});
+            timing = &timings.back();
+        }
+        if (task.phase == PHASE_SHADER) {
+            ++timing->shader_count;
+            timing->shader_ns += task.ns;
+        } else {
+            timing->pipeline_ns += task.ns;
+        }
+        if (task.result != 0) {
+            ++timing->failures;
+        }
+    }
+    return timings;
+}
+
+uint64_t ParallelSetup::wall_ns() const {
+    return wall_ns_;
+}
+
+void ParallelSetup::LogStats(const char* tag) const {
+    uint64_t busy_ns = 0;
+    for (const auto& task : tasks_) {
+        busy_ns += task.ns;
+    }
+    LOG_D(tag, "setup: %u tasks on up to %u threads, %.3f ms wall, %.3f ms busy\n",
+          (unsigned) tasks_.size(), max_threads_, wall_ns_ / 1e6, busy_ns / 1e6);
+    for (const auto& timing : object_timings()) {
+        LOG_D(tag, "setup %s: %u shaders %.3f ms, pipeline %.3f ms%s\n", timing.object.c_str(),
+              timing.shader_count, timing.shader_ns / 1e6, timing.pipeline_ns / 1e6,
+              timing.failures > 0 ? ", FAILED" : "");
+    }
+}
+
+void ParallelSetup::RunTask(task_t* task) {
+    uint64_t begin = NowNs();
+    task->result = task->run();
+    task->ns = NowNs() - begin;
+}
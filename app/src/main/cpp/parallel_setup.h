@@ -0,0 +1,62 @@
+//
+// Created by hj6231 on 2024/2/15.
+//
+
+#pragma once
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+// 每个 object 在 setup 各个阶段的耗时, 同一阶段多个任务的耗时相加
+typedef struct {
+    std::string object;
+    uint32_t shader_count;
+    uint64_t shader_ns;
+    uint64_t pipeline_ns;
+    // 返回非 0 的任务数
+    uint32_t failures;
+} object_setup_timing_t;
+
+// 第一帧之前的 setup 任务池. Add 的任务在 Run 时分给若干线程 (包括调用 Run 的线程) 执行,
+// Run 返回时全部完成. 可以分几批 Add/Run, 后一批依赖前一批的结果.
+// 任务之间没有顺序保证, 同一批里的任务不能互相依赖
+class ParallelSetup {
+public:
+    enum Phase {
+        PHASE_SHADER = 0,
+        PHASE_PIPELINE,
+    };
+
+    // max_threads 为 0 时用 CPU 核数
+    explicit ParallelSetup(uint32_t max_threads = 0);
+    ~ParallelSetup() = default;
+
+    // task 返回 0 表示成功
+    void Add(const std::string& object, Phase phase, std::function<int()> task);
+    // 执行上次 Run 之后 Add 的任务, 返回这一批失败的任务数
+    int Run();
+
+    // 按第一次 Add 的顺序
+    std::vector<object_setup_timing_t> object_timings() const;
+    // 所有 Run 的墙钟时间之和
+    uint64_t wall_ns() const;
+    void LogStats(const char* tag) const;
+
+private:
+    typedef struct {
+        std::string object;
+        Phase phase;
+        std::function<int()> run;
+        int result;
+        uint64_t ns;
+    } task_t;
+
+    void RunTask(task_t* task);
+
+    uint32_t max_threads_;
+    std::vector<task_t> tasks_;
+    // 之前的任务都已经执行过
+    size_t pending_begin_;
+    uint64_t wall_ns_;
+};
@@ -0,0 +1,150 @@
+//
+// Created by hj6231 on 2024/2/7.
+//
+
+#include "present_backend.h"
+
+#include <cassert>
+#include "log.h"
+
+PresentBackend::PresentBackend(VkFormat format, VkExtent2D extent) :
+        format_(format),
+        extent_(extent) {
+}
+
+VkFormat PresentBackend::format() const {
+    return format_;
+}
+
+VkExtent2D PresentBackend::extent() const {
+    return extent_;
+}
+
+SwapChainPresentBackend::SwapChainPresentBackend(VulkanLogicDevice* device, VulkanSwapChain* swap_chain,
+                                                 VkFormat format, VkExtent2D extent) :
+        PresentBackend(format, extent),
+        device_(device),
+        swap_chain_(swap_chain) {
+}
+
+SwapChainPresentBackend::~SwapChainPresentBackend() {
+    VulkanLogicDevice::DestroySwapChain(&swap_chain_);
+}
+
+VkResult SwapChainPresentBackend::AcquireNextImage(VkSemaphore signal_semaphore, uint32_t* image_index) {
+    return device_->AcquireNextImageKHR(swap_chain_->swap_chain(), UINT64_MAX,
+                                        signal_semaphore, VK_NULL_HANDLE, image_index);
+}
+
+VkResult SwapChainPresentBackend::Present(const VulkanQueue* queue, VkSemaphore wait_semaphore, uint32_t image_index) {
+    VkSwapchainKHR swap_chains[] = {swap_chain_->swap_chain()};
+    VkPresentInfoKHR present_info{};
+    present_info.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
+    present_info.waitSemaphoreCount = 1;
+    present_info.pWaitSemaphores = &wait_semaphore;
+    present_info.swapchainCount = 1;
+    present_info.pSwapchains = swap_chains;
+    present_info.pImageIndices = &image_index;
+    return queue->QueuePresentKHR(&present_info);
+}
+
+bool SwapChainPresentBackend::needs_semaphores() const {
+    return true;
+}
+
+std::vector<VkImage> SwapChainPresentBackend::GetImages() const {
+    return swap_chain_->GetImages();
+}
+
+VkSwapchainKHR SwapChainPresentBackend::swap_chain() const {
+    return swap_chain_->swap_chain();
+}
+
+OffscreenPresentBackend::OffscreenPresentBackend(VulkanLogicDevice* device, VkFormat format, VkExtent2D extent) :
+        PresentBackend(format, extent),
+        device_(device),
+        next_(0) {
+}
+
+OffscreenPresentBackend::~OffscreenPresentBackend() {
+    Destroy();
+}
+
+int OffscreenPresentBackend::Create(uint32_t image_count) {
+    assert(images_.empty());
+    for (uint32_t i = 0; i < image_count; ++i) {
+        VkImageCreateInfo image_info{};
+        image_info.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+        image_info.imageType = VK_IMAGE_TYPE_2D;
+        image_info.extent.width = extent_.width;
+        image_info.extent.height = extent_.height;
+        image_info.extent.depth = 1;
+        image_info.mipLevels = 1;
+        image_info.arrayLayers = 1;
+        image_info.format = format_;
+        image_info.tiling = VK_IMAGE_TILING_OPTIMAL;
+        image_info.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+        // TRANSFER_SRC 留给读回结果用
+        image_info.usage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+        image_info.samples = VK_SAMPLE_COUNT_1_BIT;
+        image_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+        VulkanImage* image = device_->CreateImage(&image_info);
+        if (image == nullptr) {
+            LOG_E("OffscreenPresentBackend", "create image %u failed\n", i);
+            Destroy();
+            return -1;
+        }
+        images_.push_back(image);
+
+        VulkanMemory* memory = device_->AllocateImageMemory(image, MEMORY_USAGE_GPU_ONLY);
+        if (memory == nullptr) {
+            LOG_E("OffscreenPresentBackend", "allocate image memory %u failed\n", i);
+            Destroy();
+            return -1;
+        }
+        memories_.push_back(memory);
+        memory->BindImageMemory(image->image(), 0);
+    }
+    next_ = 0;
+    LOG_D("OffscreenPresentBackend", "%u off-screen images %ux%u format %d\n",
+          image_count, extent_.width, extent_.height, format_);
+    return 0;
+}
+
+void OffscreenPresentBackend::Destroy() {
+    for (auto& image : images_) {
+        VulkanLogicDevice::DestroyImage(&image);
+    }
+    images_.clear();
+    for (auto& memory : memories_) {
+        VulkanLogicDevice::FreeMemory(&memory);
+    }
+    memories_.clear();
+}
+
+VkResult OffscreenPresentBackend::AcquireNextImage(VkSemaphore signal_semaphore, uint32_t* image_index) {
+    (void) signal_semaphore;
+    // image 数量等于 frames in flight 时, WaitCurrent 等待的正好是上一次使用这个 image 的那一帧
+    *image_index = next_;
+    next_ = (next_ + 1) % static_cast<uint32_t>(images_.size());
+    return VK_SUCCESS;
+}
+
+VkResult OffscreenPresentBackend::Present(const VulkanQueue* queue, VkSemaphore wait_semaphore, uint32_t image_index) {
+    (void) queue;
+    (void) wait_semaphore;
+    (void) image_index;
+    return VK_SUCCESS;
+}
+
+bool OffscreenPresentBackend::needs_semaphores() const {
+    return false;
+}
+
+std::vector<VkImage> OffscreenPresentBackend::GetImages() const {
+    std::vector<VkImage> images;
+    for (auto image : images_) {
+        images.push_back(image->image());
+    }
+    return images;
+}
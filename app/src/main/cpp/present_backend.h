@@ -0,0 +1,68 @@
+//
+// Created by hj6231 on 2024/2/7.
+//
+
+#pragma once
+#include <vector>
+#include <vulkan/vulkan.h>
+#include "vulkan_logic_device.h"
+
+// render loop 通过这个接口拿到要渲染的 image 并把它交出去,
+// 不关心后面是 swap chain 还是没有窗口的 off-screen image
+class PresentBackend {
+public:
+    PresentBackend(VkFormat format, VkExtent2D extent);
+    virtual ~PresentBackend() = default;
+
+    // signal_semaphore 只在 needs_semaphores() 为 true 时使用
+    virtual VkResult AcquireNextImage(VkSemaphore signal_semaphore, uint32_t* image_index) = 0;
+    virtual VkResult Present(const VulkanQueue* queue, VkSemaphore wait_semaphore, uint32_t image_index) = 0;
+    // false 表示 acquire/present 不经过 semaphore, submit 不需要等待和 signal
+    virtual bool needs_semaphores() const = 0;
+    virtual std::vector<VkImage> GetImages() const = 0;
+
+    VkFormat format() const;
+    VkExtent2D extent() const;
+protected:
+    VkFormat format_;
+    VkExtent2D extent_;
+};
+
+class SwapChainPresentBackend : public PresentBackend {
+public:
+    // 接管 swap_chain, 析构时销毁
+    SwapChainPresentBackend(VulkanLogicDevice* device, VulkanSwapChain* swap_chain,
+                            VkFormat format, VkExtent2D extent);
+    ~SwapChainPresentBackend() override;
+
+    VkResult AcquireNextImage(VkSemaphore signal_semaphore, uint32_t* image_index) override;
+    VkResult Present(const VulkanQueue* queue, VkSemaphore wait_semaphore, uint32_t image_index) override;
+    bool needs_semaphores() const override;
+    std::vector<VkImage> GetImages() const override;
+
+    VkSwapchainKHR swap_chain() const;
+private:
+    VulkanLogicDevice* device_;
+    VulkanSwapChain* swap_chain_;
+};
+
+// 没有 surface 时使用: 一组 device local 的 color image 轮流作为 render target,
+// present 什么都不做, 每帧的同步只靠 frame context 的 fence
+class OffscreenPresentBackend : public PresentBackend {
+public:
+    OffscreenPresentBackend(VulkanLogicDevice* device, VkFormat format, VkExtent2D extent);
+    ~OffscreenPresentBackend() override;
+
+    int Create(uint32_t image_count);
+    void Destroy();
+
+    VkResult AcquireNextImage(VkSemaphore signal_semaphore, uint32_t* image_index) override;
+    VkResult Present(const VulkanQueue* queue, VkSemaphore wait_semaphore, uint32_t image_index) override;
+    bool needs_semaphores() const override;
+    std::vector<VkImage> GetImages() const override;
+private:
+    VulkanLogicDevice* device_;
+    std::vector<VulkanImage*> images_;
+    std::vector<VulkanMemory*> memories_;
+    uint32_t next_;
+};
@@ -0,0 +1,179 @@
+//
+// Created by hj6231 on 2024/2/14.
+//
+
+#include "shader_archive.h"
+
+#include <algorithm>
+#include <cstring>
+#include "file_utils.h"
+#include "log.h"
+
+const static uint32_t SPIRV_MAGIC = 0x07230203;
+
+const char ShaderArchive::ASSET_NAME[] = "shaders.spvpack";
+
+static bool KeyLess(const shader_archive_entry_t& entry, const shader_key_t& key) {
+    return entry.key_high < key.high || (entry.key_high == key.high && entry.key_low < key.low);
+}
+
+shader_key_t MakeShaderKey(shaderc_shader_kind kind,
+                           const std::string& source,
+                           const shader_macro_list_t& macros,
+                           shaderc_optimization_level level) {
+    // 各个字段之间用 '\0' 分隔, 避免拼接之后相同
+    std::string content;
+    content.reserve(source.size() + 64);
+    content += std::to_string(kind) + ":" + std::to_string(level);
+    content += '\0';
+    for (const auto& macro : macros) {
+        content += macro.first;
+        content += '=';
+        content += macro.second;
+        content += '\0';
+    }
+    content += source;
+
+    // 两个不同初值的 FNV-1a 拼成 128 bit
+    shader_key_t key{};
+    key.high = Fnv1a64(content.data(), content.size());
+    key.low = Fnv1a64(content.data(), content.size(), 0x84222325cbf29ce4ull);
+    return key;
+}
+
+ShaderArchive* ShaderArchive::Instance() {
+    static ShaderArchive archive;
+    return &archive;
+}
+
+ShaderArchive::ShaderArchive() :
+        opened_(false),
+        asset_(nullptr),
+        data_(nullptr),
+        hits_(0),
+        misses_(0) {
+}
+
+bool ShaderArchive::Open(AAssetManager* asset_manager) {
+    std::lock_guard<std::mutex> lock(open_mutex_);
+    if (opened_) {
+        return true;
+    }
+    // 不关闭, 和进程同生命周期
+    asset_ = AAssetManager_open(asset_manager, ASSET_NAME, AASSET_MODE_BUFFER);
+    if (asset_ == nullptr) {
+        LOG_W("ShaderArchive", "%s not found\n", ASSET_NAME);
+        return false;
+    }
+    size_t size = static_cast<size_t>(AAsset_getLength(asset_));
+    auto* data = static_cast<const uint8_t*>(AAsset_getBuffer(asset_));
+    if (data != nullptr && reinterpret_cast<uintptr_t>(data) % sizeof(uint32_t) != 0) {
+        LOG_W("ShaderArchive", "%s is not 4-byte aligned, copying\n", ASSET_NAME);
+        aligned_copy_.resize((size + sizeof(uint32_t) - 1) / sizeof(uint32_t));
+        memcpy(aligned_copy_.data(), data, size);
+        data = reinterpret_cast<const uint8_t*>(aligned_copy_.data());
+    }
+    if (data == nullptr || !Validate(data, size)) {
+        LOG_E("ShaderArchive", "invalid %s\n", ASSET_NAME);
+        entries_.clear();
+        aligned_copy_.clear();
+        AAsset_close(asset_);
+        asset_ = nullptr;
+        return false;
+    }
+    data_ = data;
+    opened_ = true;
+    LOG_D("ShaderArchive", "%s: %u shaders, %llu bytes\n", ASSET_NAME,
+          (unsigned) entries_.size(), (long long unsigned int) size);
+    return true;
+}
+
+bool ShaderArchive::Find(shaderc_shader_kind kind,
+                         const std::string& source,
+                         const shader_macro_list_t& macros,
+                         shaderc_optimization_level level,
+                         const uint32_t** code,
+                         size_t* code_size) {
+    if (!opened_) {
+        ++misses_;
+        return false;
+    }
+    shader_key_t key = MakeShaderKey(kind, source, macros, level);
+    auto it = std::lower_bound(entries_.begin(), entries_.end(), key, KeyLess);
+    if (it == entries_.end() || it->key_high != key.high || it->key_low != key.low) {
+        ++misses_;
+        return false;
+    }
+    *code = reinterpret_cast<const uint32_t*>(data_ + it->offset);
+    *code_size = it->word_count * sizeof(uint32_t);
+    ++hits_;
+    return true;
+}
+
+uint32_t ShaderArchive::entry_count() const {
+    return static_cast<uint32_t>(entries_.size());
+}
+
+void ShaderArchive::LogStats(const char* tag) const {
+    LOG_D(tag, "shader archive: %u shaders, %llu hits, %llu misses\n", entry_count(),
+          (long long unsigned int) hits_.load(), (long long unsigned int) misses_.load());
+}
+
+bool ShaderArchive::Write(const std::string& path,
+                          std::vector<shader_archive_entry_t> entries,
+                          const std::vector<std::vector<uint32_t>>& codes) {
+    std::vector<uint8_t> content(sizeof(shader_archive_header_t) + entries.size() * sizeof(shader_archive_entry_t));
+    for (size_t i = 0; i < entries.size(); ++i) {
+        size_t offset = (content.size() + BLOB_ALIGNMENT - 1) / BLOB_ALIGNMENT * BLOB_ALIGNMENT;
+        size_t code_size = codes[i].size() * sizeof(uint32_t);
+        content.resize(offset + code_size);
+        memcpy(content.data() + offset, codes[i].data(), code_size);
+        entries[i].offset = static_cast<uint32_t>(offset);
+        entries[i].word_count = static_cast<uint32_t>(codes[i].size());
+    }
+    std::sort(entries.begin(), entries.end(), [](const shader_archive_entry_t& a, const shader_archive_entry_t& b) {
+        return KeyLess(a, shader_key_t{b.key_high, b.key_low});
+    });
+
+    shader_archive_header_t header{};
+    header.magic = FILE_MAGIC;
+    header.version = FILE_VERSION;
+    header.entry_count = static_cast<uint32_t>(entries.size());
+    memcpy(content.data(), &header, sizeof(header));
+    if (!entries.empty()) {
+        memcpy(content.data() + sizeof(header), entries.data(), entries.size() * sizeof(shader_archive_entry_t));
+    }
+    return WriteFileAtomic(path, content);
+}
+
+bool ShaderArchive::Validate(const uint8_t* data, size_t size) {
+    shader_archive_header_t header{};
+    if (size < sizeof(header)) {
+        return false;
+    }
+    memcpy(&header, data, sizeof(header));
+    if (header.magic != FILE_MAGIC || header.version != FILE_VERSION ||
+            header.entry_count > (size - sizeof(header)) / sizeof(shader_archive_entry_t)) {
+        return false;
+    }
+    entries_.resize(header.entry_count);
+    if (header.entry_count > 0) {
+        memcpy(entries_.data(), data + sizeof(header), header.entry_count * sizeof(shader_archive_entry_t));
+    }
+    for (size_t i = 0; i < entries_.size(); ++i) {
+        const shader_archive_entry_t& entry = entries_[i];
+        if (entry.offset % BLOB_ALIGNMENT != 0 || entry.word_count == 0 ||
+                entry.offset > size || entry.word_count > (size - entry.offset) / sizeof(uint32_t)) {
+            return false;
+        }
+        uint32_t magic = 0;
+        memcpy(&magic, data + entry.offset, sizeof(magic));
+        if (magic != SPIRV_MAGIC) {
+            return false;
+        }
+        if (i > 0 && !KeyLess(entries_[i - 1], shader_key_t{entry.key_high, entry.key_low})) {
+            return false;
+        }
+    }
+    return true;
+}
@@ -0,0 +1,95 @@
+//
+// Created by hj6231 on 2024/2/14.
+//
+
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+// 只用到 shader kind 和优化级别的枚举, 不需要链接 libshaderc
+#include "shaderc.hpp"
+#include "android_compat.h"
+
+// 编译时的宏定义, 例如 {"MY_DEFINE", "1"} 相当于 -DMY_DEFINE=1
+typedef std::vector<std::pair<std::string, std::string>> shader_macro_list_t;
+
+// source, shader kind, 宏定义和优化级别的 128 bit hash
+typedef struct {
+    uint64_t high;
+    uint64_t low;
+} shader_key_t;
+
+shader_key_t MakeShaderKey(shaderc_shader_kind kind,
+                           const std::string& source,
+                           const shader_macro_list_t& macros,
+                           shaderc_optimization_level level);
+
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t entry_count;
+    uint32_t reserved;
+} shader_archive_header_t;
+
+// 按 key 排序, 紧跟在 header 后面
+typedef struct {
+    uint64_t key_high;
+    uint64_t key_low;
+    // 相对文件开头, 按 BLOB_ALIGNMENT 对齐
+    uint32_t offset;
+    uint32_t word_count;
+    // 例如 triangle.vert, 只用于日志
+    char name[40];
+} shader_archive_entry_t;
+
+// 构建时由 host/shader_archiver 从 vulkan_object 里的 GLSL 生成的 SPIR-V 包, 作为 asset 发布.
+// 运行时整个文件 map 进来, Find 返回的指针直接给 VkShaderModuleCreateInfo::pCode, 不复制.
+// 进程内共用一个, Open 之后可以在多个线程同时 Find
+class ShaderArchive {
+public:
+    static ShaderArchive* Instance();
+
+    // 只有第一次成功的调用生效, 没有这个 asset 或者格式不对时返回 false
+    bool Open(AAssetManager* asset_manager);
+    // 返回的指针在进程退出之前有效
+    bool Find(shaderc_shader_kind kind,
+              const std::string& source,
+              const shader_macro_list_t& macros,
+              shaderc_optimization_level level,
+              const uint32_t** code,
+              size_t* code_size);
+
+    uint32_t entry_count() const;
+    void LogStats(const char* tag) const;
+
+    // entries 的 offset 和 word_count 由 Write 填写
+    static bool Write(const std::string& path,
+                      std::vector<shader_archive_entry_t> entries,
+                      const std::vector<std::vector<uint32_t>>& codes);
+
+    static const char ASSET_NAME[];
+    const static uint32_t FILE_MAGIC = 0x41565053; // "SPVA"
+    const static uint32_t FILE_VERSION = 1;
+    const static uint32_t BLOB_ALIGNMENT = 16;
+private:
+    ShaderArchive();
+    ShaderArchive(const ShaderArchive&) = delete;
+    ShaderArchive& operator = (const ShaderArchive&) = delete;
+
+    bool Validate(const uint8_t* data, size_t size);
+
+    std::mutex open_mutex_;
+    std::atomic<bool> opened_;
+    AAsset* asset_;
+    const uint8_t* data_;
+    // asset 的地址不满足 pCode 的 4 字节对齐时复制到这里, 正常打包 (zipalign, noCompress) 不会发生
+    std::vector<uint32_t> aligned_copy_;
+    // index 很小, 复制出来避免非对齐访问
+    std::vector<shader_archive_entry_t> entries_;
+
+    std::atomic<uint64_t> hits_;
+    std::atomic<uint64_t> misses_;
+};
@@ -0,0 +1,239 @@
+//
+// Created by hj6231 on 2024/2/13.
+//
+
+#include "spirv_cache.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <dlfcn.h>
+#include <sys/stat.h>
+#include "file_utils.h"
+#include "log.h"
+
+static int64_t NowNs() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+const static uint32_t SPIRV_MAGIC = 0x07230203;
+
+SpirvCache* SpirvCache::Instance() {
+    static SpirvCache cache;
+    return &cache;
+}
+
+SpirvCache::SpirvCache() :
+        compiler_fingerprint_(CompilerFingerprint()),
+        memory_budget_(DEFAULT_MEMORY_BUDGET),
+        memory_bytes_(0),
+        stats_{} {
+}
+
+void SpirvCache::SetDirectory(const std::string& directory) {
+    std::string spirv_directory;
+    if (!directory.empty()) {
+        spirv_directory = directory + "/spirv";
+        if (!MakeDirectory(spirv_directory)) {
+            LOG_W("SpirvCache", "create %s failed, disk cache disabled\n", spirv_directory.c_str());
+            spirv_directory.clear();
+        }
+    }
+    std::lock_guard<std::mutex> lock(mutex_);
+    directory_ = spirv_directory;
+}
+
+void SpirvCache::SetMemoryBudget(size_t bytes) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    memory_budget_ = bytes;
+}
+
+std::vector<uint32_t> SpirvCache::Compile(const std::string& source_name,
+                                          shaderc_shader_kind kind,
+                                          const std::string& source,
+                                          const shader_macro_list_t& macros,
+                                          shaderc_optimization_level level) {
+    std::string key = MakeKey(kind, source, macros, level);
+    std::vector<uint32_t> code;
+    std::string path;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (FindInMemory(key, &code)) {
+            ++stats_.memory_hits;
+            return code;
+        }
+        if (!directory_.empty()) {
+            path = directory_ + "/" + key + ".spv";
+        }
+    }
+
+    // 读文件和编译都不持有锁, 不同的 shader 可以并行. 同一个 key 同时 miss 时会编译两次, 结果一样
+    if (!path.empty()) {
+        int64_t begin = NowNs();
+        bool loaded = LoadFile(path, &code);
+        int64_t end = NowNs();
+        std::lock_guard<std::mutex> lock(mutex_);
+        stats_.disk_read_ns += end - begin;
+        if (loaded) {
+            ++stats_.disk_hits;
+            InsertInMemory(key, code);
+            return code;
+        }
+    }
+
+    int64_t begin = NowNs();
+    code = CompileGlsl(source_name, kind, source, macros, level);
+    int64_t end = NowNs();
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        ++stats_.misses;
+        stats_.compile_ns += end - begin;
+        if (!code.empty()) {
+            InsertInMemory(key, code);
+        }
+    }
+    if (!code.empty() && !path.empty()) {
+        StoreFile(path, code);
+    }
+    return code;
+}
+
+spirv_cache_stats_t SpirvCache::stats() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return stats_;
+}
+
+void SpirvCache::LogStats(const char* tag) const {
+    spirv_cache_stats_t stats = this->stats();
+    LOG_D(tag, "spirv cache: %llu memory hits, %llu disk hits (%.3f ms), %llu misses (%.3f ms compile), "
+               "%llu evictions\n",
+          (long long unsigned int) stats.memory_hits,
+          (long long unsigned int) stats.disk_hits, stats.disk_read_ns / 1e6,
+          (long long unsigned int) stats.misses, stats.compile_ns / 1e6,
+          (long long unsigned int) stats.evictions);
+}
+
+std::string SpirvCache::MakeKey(shaderc_shader_kind kind,
+                                const std::string& source,
+                                const shader_macro_list_t& macros,
+                                shaderc_optimization_level level) const {
+    // shader key 再混入编译器, 换了 shaderc 之后旧文件不会再被用到
+    shader_key_t shader_key = MakeShaderKey(kind, source, macros, level);
+    uint64_t high = Fnv1a64(compiler_fingerprint_.data(), compiler_fingerprint_.size(), shader_key.high);
+    uint64_t low = Fnv1a64(compiler_fingerprint_.data(), compiler_fingerprint_.size(), shader_key.low);
+    char key[33];
+    snprintf(key, sizeof(key), "%016llx%016llx", (long long unsigned int) high, (long long unsigned int) low);
+    return key;
+}
+
+bool SpirvCache::FindInMemory(const std::string& key, std::vector<uint32_t>* code) {
+    auto it = index_.find(key);
+    if (it == index_.end()) {
+        return false;
+    }
+    entries_.splice(entries_.begin(), entries_, it->second);
+    *code = it->second->code;
+    return true;
+}
+
+void SpirvCache::InsertInMemory(const std::string& key, const std::vector<uint32_t>& code) {
+    if (index_.find(key) != index_.end()) {
+        return;
+    }
+    entries_.push_front(entry_t{key, code});
+    index_[key] = entries_.begin();
+    memory_bytes_ += code.size() * sizeof(uint32_t);
+    // 至少保留刚插入的这一个
+    while (memory_bytes_ > memory_budget_ && entries_.size() > 1) {
+        const entry_t& victim = entries_.back();
+        memory_bytes_ -= victim.code.size() * sizeof(uint32_t);
+        index_.erase(victim.key);
+        entries_.pop_back();
+        ++stats_.evictions;
+    }
+}
+
+bool SpirvCache::LoadFile(const std::string& path, std::vector<uint32_t>* code) const {
+    std::vector<uint8_t> content;
+    if (!ReadFile(path, &content)) {
+        return false;
+    }
+    file_header_t header{};
+    bool valid = content.size() > sizeof(header);
+    if (valid) {
+        memcpy(&header, content.data(), sizeof(header));
+        valid = header.magic == FILE_MAGIC &&
+                header.version == FILE_VERSION &&
+                header.word_count > 0 &&
+                content.size() - sizeof(header) == header.word_count * sizeof(uint32_t) &&
+                Fnv1a64(content.data() + sizeof(header), content.size() - sizeof(header)) == header.checksum;
+    }
+    if (valid) {
+        code->resize(header.word_count);
+        memcpy(code->data(), content.data() + sizeof(header), header.word_count * sizeof(uint32_t));
+        valid = (*code)[0] == SPIRV_MAGIC;
+    }
+    if (!valid) {
+        LOG_W("SpirvCache", "ignore corrupted %s\n", path.c_str());
+        code->clear();
+        return false;
+    }
+    return true;
+}
+
+bool SpirvCache::StoreFile(const std::string& path, const std::vector<uint32_t>& code) const {
+    size_t code_size = code.size() * sizeof(uint32_t);
+    file_header_t header{};
+    header.magic = FILE_MAGIC;
+    header.version = FILE_VERSION;
+    header.word_count = static_cast<uint32_t>(code.size());
+    header.checksum = Fnv1a64(code.data(), code_size);
+
+    std::vector<uint8_t> content(sizeof(header) + code_size);
+    memcpy(content.data(), &header, sizeof(header));
+    memcpy(content.data() + sizeof(header), code.data(), code_size);
+    return WriteFileAtomic(path, content);
+}
+
+std::string SpirvCache::CompilerFingerprint() {
+    // shaderc 没有版本号接口, 用库文件的路径, 大小和修改时间代替. 静态链接时就是可执行文件本身,
+    // 每次重新编译都会失效, 只是多编译一次
+    Dl_info info{};
+    struct stat st{};
+    if (dladdr(reinterpret_cast<void*>(&shaderc_compiler_initialize), &info) == 0 ||
+            info.dli_fname == nullptr || stat(info.dli_fname, &st) != 0) {
+        LOG_W("SpirvCache", "shaderc library not found, cached spirv never expires\n");
+        return "unknown";
+    }
+    char fingerprint[64];
+    snprintf(fingerprint, sizeof(fingerprint), ":%lld:%lld",
+             (long long) st.st_size, (long long) st.st_mtime);
+    return std::string(info.dli_fname) + fingerprint;
+}
+
+std::vector<uint32_t> SpirvCache::CompileGlsl(const std::string& source_name,
+                                              shaderc_shader_kind kind,
+                                              const std::string& source,
+                                              const shader_macro_list_t& macros,
+                                              shaderc_optimization_level level) {
+    // shaderc::Compiler 不能在线程之间共用, 每个线程一个, 不用每次都重新创建
+    thread_local shaderc::Compiler compiler;
+    shaderc::CompileOptions options;
+
+    for (const auto& macro : macros) {
+        options.AddMacroDefinition(macro.first, macro.second);
+    }
+    options.SetOptimizationLevel(level);
+
+    shaderc::SpvCompilationResult module =
+            compiler.CompileGlslToSpv(source, kind, source_name.c_str(), options);
+
+    if (module.GetCompilationStatus() != shaderc_compilation_status_success) {
+        LOG_E("SpirvCache", "compile %s failed %d: %s\n", source_name.c_str(),
+              module.GetCompilationStatus(), module.GetErrorMessage().c_str());
+        return {};
+    }
+
+    return {module.cbegin(), module.cend()};
+}
@@ -0,0 +1,95 @@
+//
+// Created by hj6231 on 2024/2/13.
+//
+
+#pragma once
+#include <cstdint>
+#include <list>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "shaderc.hpp"
+#include "shader_archive.h"
+
+typedef struct {
+    uint64_t memory_hits;
+    uint64_t disk_hits;
+    uint64_t misses;
+    uint64_t evictions;
+    // shaderc 编译的耗时, 不包括读写文件
+    uint64_t compile_ns;
+    uint64_t disk_read_ns;
+} spirv_cache_stats_t;
+
+// GLSL 编译结果的缓存, key 是 MakeShaderKey 再加上 shaderc 库的 hash.
+// 先查内存里的 LRU, 再查 SetDirectory 目录下的文件, 都没有才调用 shaderc, 结果同时写回两层.
+// 只在打开 VULKAN_RUNTIME_SHADERC 的开发版本里编译, 发布版本的 shader 都来自 ShaderArchive.
+// 进程内共用一个, 可以在多个线程同时调用 Compile
+class SpirvCache {
+public:
+    static SpirvCache* Instance();
+
+    // 为空时只用内存这一层
+    void SetDirectory(const std::string& directory);
+    void SetMemoryBudget(size_t bytes);
+
+    // 编译失败返回空
+    std::vector<uint32_t> Compile(const std::string& source_name,
+                                  shaderc_shader_kind kind,
+                                  const std::string& source,
+                                  const shader_macro_list_t& macros,
+                                  shaderc_optimization_level level);
+
+    spirv_cache_stats_t stats() const;
+    void LogStats(const char* tag) const;
+
+    const static size_t DEFAULT_MEMORY_BUDGET = 4 * 1024 * 1024;
+    const static uint32_t FILE_MAGIC = 0x43565053; // "SPVC"
+    const static uint32_t FILE_VERSION = 1;
+private:
+    typedef struct {
+        std::string key;
+        std::vector<uint32_t> code;
+    } entry_t;
+
+    typedef struct {
+        uint32_t magic;
+        uint32_t version;
+        uint32_t word_count;
+        uint32_t reserved;
+        uint64_t checksum;
+    } file_header_t;
+
+    SpirvCache();
+    SpirvCache(const SpirvCache&) = delete;
+    SpirvCache& operator = (const SpirvCache&) = delete;
+
+    std::string MakeKey(shaderc_shader_kind kind,
+                        const std::string& source,
+                        const shader_macro_list_t& macros,
+                        shaderc_optimization_level level) const;
+    // 调用时持有 mutex_
+    bool FindInMemory(const std::string& key, std::vector<uint32_t>* code);
+    void InsertInMemory(const std::string& key, const std::vector<uint32_t>& code);
+    bool LoadFile(const std::string& path, std::vector<uint32_t>* code) const;
+    bool StoreFile(const std::string& path, const std::vector<uint32_t>& code) const;
+    static std::string CompilerFingerprint();
+    static std::vector<uint32_t> CompileGlsl(const std::string& source_name,
+                                             shaderc_shader_kind kind,
+                                             const std::string& source,
+                                             const shader_macro_list_t& macros,
+                                             shaderc_optimization_level level);
+
+    // 换了 shaderc 库之后旧的结果自动失效
+    const std::string compiler_fingerprint_;
+
+    mutable std::mutex mutex_;
+    std::string directory_;
+    size_t memory_budget_;
+    size_t memory_bytes_;
+    // 最近使用的在前面
+    std::list<entry_t> entries_;
+    std::unordered_map<std::string, std::list<entry_t>::iterator> index_;
+    spirv_cache_stats_t stats_;
+};
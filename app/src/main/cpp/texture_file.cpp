@@ -0,0 +1,247 @@
+//
+// Created by hj6231 on 2024/2/16.
+//
+
+#include "texture_file.h"
+
+#include <cstring>
+#include "file_utils.h"
+#include "log.h"
+
+typedef struct {
+    // VkFormat 的值, 这个文件不依赖 Vulkan 头文件
+    uint32_t vk_format;
+    const char* suffix;
+    uint32_t block_width;
+    uint32_t block_height;
+    uint32_t block_bytes;
+} texture_format_t;
+
+// OpenBest 按这个顺序尝试
+const static texture_format_t FORMATS[] = {
+        {157, "astc4x4", 4, 4, 16}, // VK_FORMAT_ASTC_4x4_UNORM_BLOCK
+        {145, "bc7", 4, 4, 16},     // VK_FORMAT_BC7_UNORM_BLOCK
+        {147, "etc2", 4, 4, 8},     // VK_FORMAT_ETC2_R8G8B8_UNORM_BLOCK
+        {131, "bc1", 4, 4, 8},      // VK_FORMAT_BC1_RGB_UNORM_BLOCK
+        {37, "rgba8", 1, 1, 4},     // VK_FORMAT_R8G8B8A8_UNORM
+};
+
+const static uint8_t KTX2_IDENTIFIER[12] = {0xab, 'K', 'T', 'X', ' ', '2', '0', 0xbb, '\r', '\n', 0x1a, '\n'};
+
+static const texture_format_t* FindFormat(uint32_t vk_format) {
+    for (const auto& format : FORMATS) {
+        if (format.vk_format == vk_format) {
+            return &format;
+        }
+    }
+    return nullptr;
+}
+
+static size_t AlignUp(size_t value, size_t alignment) {
+    return (value + alignment - 1) / alignment * alignment;
+}
+
+TextureFile::TextureFile() :
+        asset_(nullptr),
+        data_(nullptr),
+        header_{},
+        levels_begin_(0),
+        levels_end_(0) {
+}
+
+TextureFile::~TextureFile() {
+    Close();
+}
+
+bool TextureFile::Open(AAssetManager* asset_manager, const char* name) {
+    Close();
+    asset_ = AAssetManager_open(asset_manager, name, AASSET_MODE_BUFFER);
+    if (asset_ == nullptr) {
+        return false;
+    }
+    size_t size = static_cast<size_t>(AAsset_getLength(asset_));
+    auto* data = static_cast<const uint8_t*>(AAsset_getBuffer(asset_));
+    if (data == nullptr || !Validate(data, size)) {
+        LOG_E("TextureFile", "invalid %s\n", name);
+        Close();
+        return false;
+    }
+    data_ = data;
+    return true;
+}
+
+bool TextureFile::OpenBest(AAssetManager* asset_manager, const std::string& base_name,
+                           const std::function<bool(uint32_t vk_format)>& supported) {
+    for (const auto& format : FORMATS) {
+        if (!supported(format.vk_format)) {
+            continue;
+        }
+        std::string name = base_name + "." + format.suffix + ".ktx2";
+        if (Open(asset_manager, name.c_str())) {
+            if (header_.vk_format == format.vk_format) {
+                return true;
+            }
+            LOG_W("TextureFile", "%s is not %s\n", name.c_str(), format.suffix);
+            Close();
+        }
+    }
+    return false;
+}
+
+void TextureFile::Close() {
+    if (asset_ != nullptr) {
+        AAsset_close(asset_);
+        asset_ = nullptr;
+    }
+    data_ = nullptr;
+    header_ = ktx2_header_t{};
+    levels_.clear();
+    levels_begin_ = 0;
+    levels_end_ = 0;
+}
+
+bool TextureFile::is_open() const {
+    return data_ != nullptr;
+}
+
+uint32_t TextureFile::vk_format() const {
+    return header_.vk_format;
+}
+
+uint32_t TextureFile::width() const {
+    return header_.pixel_width;
+}
+
+uint32_t TextureFile::height() const {
+    return header_.pixel_height;
+}
+
+uint32_t TextureFile::level_count() const {
+    return static_cast<uint32_t>(levels_.size());
+}
+
+const void* TextureFile::level_data(uint32_t level) const {
+    return data_ + levels_[level].byte_offset;
+}
+
+size_t TextureFile::level_size(uint32_t level) const {
+    return static_cast<size_t>(levels_[level].byte_length);
+}
+
+const void* TextureFile::levels_data() const {
+    return data_ + levels_begin_;
+}
+
+size_t TextureFile::levels_size() const {
+    return static_cast<size_t>(levels_end_ - levels_begin_);
+}
+
+size_t TextureFile::level_offset(uint32_t level) const {
+    return static_cast<size_t>(levels_[level].byte_offset - levels_begin_);
+}
+
+bool TextureFile::Write(const std::string& path, uint32_t vk_format, uint32_t width, uint32_t height,
+                        const std::vector<std::vector<uint8_t>>& levels) {
+    if (FindFormat(vk_format) == nullptr || levels.empty()) {
+        return false;
+    }
+    ktx2_header_t header{};
+    memcpy(header.identifier, KTX2_IDENTIFIER, sizeof(header.identifier));
+    header.vk_format = vk_format;
+    header.type_size = 1;
+    header.pixel_width = width;
+    header.pixel_height = height;
+    header.face_count = 1;
+    header.level_count = static_cast<uint32_t>(levels.size());
+
+    // KTX2 里数据从最小的 level 开始存放, level 索引仍然是 level 0 在前
+    std::vector<ktx2_level_t> index(levels.size());
+    size_t offset = sizeof(header) + sizeof(ktx2_level_t) * levels.size();
+    for (size_t i = levels.size(); i-- > 0;) {
+        uint32_t level_width = width >> i > 0 ? width >> i : 1;
+        uint32_t level_height = height >> i > 0 ? height >> i : 1;
+        if (levels[i].size() != LevelSize(vk_format, level_width, level_height)) {
+            LOG_E("TextureFile", "level %u has %u bytes\n", (unsigned) i, (unsigned) levels[i].size());
+            return false;
+        }
+        offset = AlignUp(offset, LEVEL_ALIGNMENT);
+        index[i].byte_offset = offset;
+        index[i].byte_length = levels[i].size();
+        index[i].uncompressed_byte_length = levels[i].size();
+        offset += levels[i].size();
+    }
+    std::vector<uint8_t> content(offset, 0);
+    memcpy(content.data(), &header, sizeof(header));
+    memcpy(content.data() + sizeof(header), index.data(), sizeof(ktx2_level_t) * index.size());
+    for (size_t i = 0; i < levels.size(); ++i) {
+        memcpy(content.data() + index[i].byte_offset, levels[i].data(), levels[i].size());
+    }
+    return WriteFileAtomic(path, content);
+}
+
+bool TextureFile::GetBlockInfo(uint32_t vk_format, uint32_t* block_width, uint32_t* block_height,
+                               uint32_t* block_bytes) {
+    const texture_format_t* format = FindFormat(vk_format);
+    if (format == nullptr) {
+        return false;
+    }
+    *block_width = format->block_width;
+    *block_height = format->block_height;
+    *block_bytes = format->block_bytes;
+    return true;
+}
+
+size_t TextureFile::LevelSize(uint32_t vk_format, uint32_t width, uint32_t height) {
+    const texture_format_t* format = FindFormat(vk_format);
+    if (format == nullptr) {
+        return 0;
+    }
+    size_t blocks_x = (width + format->block_width - 1) / format->block_width;
+    size_t blocks_y = (height + format->block_height - 1) / format->block_height;
+    return blocks_x * blocks_y * format->block_bytes;
+}
+
+const char* TextureFile::FormatSuffix(uint32_t vk_format) {
+    const texture_format_t* format = FindFormat(vk_format);
+    return format != nullptr ? format->suffix : nullptr;
+}
+
+bool TextureFile::Validate(const uint8_t* data, size_t size) {
+    if (size < sizeof(ktx2_header_t)) {
+        return false;
+    }
+    memcpy(&header_, data, sizeof(header_));
+    // 只接受这里能直接上传的情况: 2D, 单层, 单面, 没有 supercompression
+    bool valid = memcmp(header_.identifier, KTX2_IDENTIFIER, sizeof(KTX2_IDENTIFIER)) == 0 &&
+                 FindFormat(header_.vk_format) != nullptr &&
+                 header_.pixel_width > 0 && header_.pixel_height > 0 && header_.pixel_depth == 0 &&
+                 header_.layer_count == 0 && header_.face_count == 1 &&
+                 header_.supercompression_scheme == 0 &&
+                 header_.level_count > 0 && header_.level_count <= 32 &&
+                 sizeof(ktx2_header_t) + sizeof(ktx2_level_t) * header_.level_count <= size;
+    if (!valid) {
+        header_ = ktx2_header_t{};
+        return false;
+    }
+    levels_.resize(header_.level_count);
+    memcpy(levels_.data(), data + sizeof(ktx2_header_t), sizeof(ktx2_level_t) * levels_.size());
+    levels_begin_ = UINT64_MAX;
+    levels_end_ = 0;
+    for (uint32_t i = 0; i < header_.level_count; ++i) {
+        uint32_t level_width = header_.pixel_width >> i > 0 ? header_.pixel_width >> i : 1;
+        uint32_t level_height = header_.pixel_height >> i > 0 ? header_.pixel_height >> i : 1;
+        const ktx2_level_t& level = levels_[i];
+        // 其他工具导出的文件只保证 level 按 block 大小对齐, 不足 4 字节对齐的不接受
+        if (level.byte_offset % 4 != 0 ||
+                level.byte_length != LevelSize(header_.vk_format, level_width, level_height) ||
+                level.byte_offset > size || level.byte_length > size - level.byte_offset) {
+            header_ = ktx2_header_t{};
+            levels_.clear();
+            return false;
+        }
+        levels_begin_ = level.byte_offset < levels_begin_ ? level.byte_offset : levels_begin_;
+        levels_end_ = level.byte_offset + level.byte_length > levels_end_ ?
+                      level.byte_offset + level.byte_length : levels_end_;
+    }
+    return true;
+}
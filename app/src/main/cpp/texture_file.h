@@ -0,0 +1,91 @@
+//
+// Created by hj6231 on 2024/2/16.
+//
+
+#pragma once
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+#include "android_compat.h"
+
+// KTX2 文件头, 字段和顺序与 KTX 2.0 规范一致, 后面紧跟 level_count 个 ktx2_level_t
+typedef struct {
+    uint8_t identifier[12];
+    // VkFormat 的值
+    uint32_t vk_format;
+    uint32_t type_size;
+    uint32_t pixel_width;
+    uint32_t pixel_height;
+    uint32_t pixel_depth;
+    uint32_t layer_count;
+    uint32_t face_count;
+    uint32_t level_count;
+    uint32_t supercompression_scheme;
+    uint32_t dfd_byte_offset;
+    uint32_t dfd_byte_length;
+    uint32_t kvd_byte_offset;
+    uint32_t kvd_byte_length;
+    uint64_t sgd_byte_offset;
+    uint64_t sgd_byte_length;
+} ktx2_header_t;
+
+typedef struct {
+    uint64_t byte_offset;
+    uint64_t byte_length;
+    uint64_t uncompressed_byte_length;
+} ktx2_level_t;
+
+// 只支持 2D, 单层, 不做 supercompression 的 KTX2: host/texture_converter 离线生成, 或者其他工具导出的同类文件.
+// 和 MeshFile 一样整个文件 map 进来, 每个 mip level 直接从 map 的内存复制到 staging buffer.
+// data format descriptor 和 key/value 数据不读取, 格式只看 vk_format
+class TextureFile {
+public:
+    TextureFile();
+    ~TextureFile();
+    TextureFile(const TextureFile&) = delete;
+    TextureFile& operator = (const TextureFile&) = delete;
+
+    bool Open(AAssetManager* asset_manager, const char* name);
+    // 依次尝试 <base_name>.<suffix>.ktx2, 按 ASTC 4x4, BC7, ETC2, BC1, RGBA8 的顺序 (同样大小下质量高的在前),
+    // 只打开 supported 返回 true 的格式. 都不行时返回 false, 调用者退回原来的解码路径
+    bool OpenBest(AAssetManager* asset_manager, const std::string& base_name,
+                  const std::function<bool(uint32_t vk_format)>& supported);
+    void Close();
+    bool is_open() const;
+
+    uint32_t vk_format() const;
+    uint32_t width() const;
+    uint32_t height() const;
+    uint32_t level_count() const;
+    // level 0 是最大的一层
+    const void* level_data(uint32_t level) const;
+    size_t level_size(uint32_t level) const;
+    // 所有 level 在文件里是连续的一段 (中间可能有对齐的空隙), 整段复制到 staging buffer,
+    // level_offset 就是 VkBufferImageCopy 的 bufferOffset (相对于 levels_data)
+    const void* levels_data() const;
+    size_t levels_size() const;
+    size_t level_offset(uint32_t level) const;
+
+    // levels[0] 是最大的一层, 每一层的大小必须和 LevelSize 一致
+    static bool Write(const std::string& path, uint32_t vk_format, uint32_t width, uint32_t height,
+                      const std::vector<std::vector<uint8_t>>& levels);
+    // 支持的格式返回 true 和 block 的大小, 非压缩格式的 block 是 1x1
+    static bool GetBlockInfo(uint32_t vk_format, uint32_t* block_width, uint32_t* block_height,
+                             uint32_t* block_bytes);
+    static size_t LevelSize(uint32_t vk_format, uint32_t width, uint32_t height);
+    // 文件名里的格式后缀, 不支持的格式返回 nullptr
+    static const char* FormatSuffix(uint32_t vk_format);
+
+    // 每个 level 的数据按 16 字节对齐, 满足所有 block 大小和 bufferOffset 的要求
+    const static uint32_t LEVEL_ALIGNMENT = 16;
+private:
+    bool Validate(const uint8_t* data, size_t size);
+
+    AAsset* asset_;
+    const uint8_t* data_;
+    ktx2_header_t header_;
+    std::vector<ktx2_level_t> levels_;
+    uint64_t levels_begin_;
+    uint64_t levels_end_;
+};
@@ -4,11 +4,19 @@
 
 #include "tutorial.h"
 
+#include <algorithm>
 #include <cassert>
+#include <cstdint>
 #include <vector>
-#include <unistd.h>
+#include <chrono>
+#include "image_decoder.h"
 #include "log.h"
+#include "shader_archive.h"
+#ifdef VULKAN_RUNTIME_SHADERC
+#include "spirv_cache.h"
+#endif
 #include "vulkan_utils.h"
+#include "triangle.h"
 #include "rectangle.h"
 #include "rotate_rectangle.h"
 #include "rgba_image_texture.h"
@@ -26,21 +34,32 @@ Tutorial::Tutorial(AAssetManager* asset_manager) :
         logic_device_(nullptr),
         graphic_queue_(nullptr),
         present_queue_(nullptr),
-        swap_chain_(nullptr),
+        transfer_queue_(nullptr),
+        present_backend_(nullptr),
         graphic_command_pool_(nullptr),
-        graphic_command_buffer_(nullptr),
-        frame_available_semaphore_(nullptr),
-        render_finished_semaphore_(nullptr),
-        cpu_wait_(nullptr),
+        loader_command_pool_(nullptr),
+        frame_contexts_(nullptr),
+        upload_context_(nullptr),
+        upload_ticket_(0),
+        scene_ready_(false),
+        placeholder_render_pass_(nullptr),
+        scene_format_(VK_FORMAT_UNDEFINED),
+        scene_extent_{},
+        full_quality_frame_(0),
+        first_frame_ns_(0),
+        full_quality_ns_(0),
         support_validation_(false),
         physical_device_vulkan_11_features_{},
         physical_device_features_{},
         physical_device_properties_{},
         graphic_queue_family_index_(0),
         present_queue_family_index_(0),
+        transfer_queue_family_index_(0),
         surface_format_{},
         swap_chain_extent_{},
         callback_{},
+        surface_type_(CreateInfoFactory::SURFACE_PLATFORM),
+        scene_(SCENE_RECTANGLE_MULTISAMPLE),
         obj_(nullptr) {
     physical_device_vulkan_11_features_.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_1_FEATURES;
     physical_device_features_.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
@@ -48,33 +67,67 @@ Tutorial::Tutorial(AAssetManager* asset_manager) :
 }
 
 void Tutorial::Run() {
+    setup_begin_ = std::chrono::steady_clock::now();
     CreateSurface(window_);
     CreateLogicalDevice();
-    CreateSwapChain(window_);
-    CreateImageViews();
-
+    if (!cache_directory_.empty()) {
+        logic_device_->pipeline_cache()->Open(cache_directory_);
+    }
     CreateCommandPool();
-    CreateCommandBuffer();
-    CreateSyncObjects();
+    CreateUploadContext();
+    CreateFrameContexts();
 
-    CreateGraphicPipeline();
-    CreateFrameBuffers();
-    int thread_state;
-    std::unique_lock<std::mutex> lock(thread_state_mutex_);
-    thread_state = thread_state_;
-    lock.unlock();
-    while (thread_state == 1) {
+    CreateSwapChain(window_, VK_NULL_HANDLE);
+    CreateImageViews();
+
+    upload_begin_ = std::chrono::steady_clock::now();
+    scene_format_ = surface_format_.format;
+    scene_extent_ = swap_chain_extent_;
+    if (async_loading_) {
+        StartSceneLoading();
+        CreateFrameBuffers();
+    } else {
+        CreateGraphicPipeline();
+        // scene 录制的所有上传一次提交, 不在这里等待
+        upload_ticket_ = upload_context_->Submit();
+        CreateFrameBuffers();
+        benchmark_stats_.SetPipelineCacheStats(logic_device_->pipeline_cache()->stats());
+        // 第一帧之前就写回, 之后崩溃也不用重新编译
+        logic_device_->pipeline_cache()->Save();
+    }
+    // 异步加载时只到 render loop 开始, 之后的加载和渲染重叠
+    benchmark_stats_.AddSetupTime(std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now() - setup_begin_).count());
+    frame_pacer_.ResetStats();
+    while (IsRunning()) {
+        frame_pacer_.BeginFrame();
         DrawFrame();
-        usleep(33000);
-        lock.lock();
-        thread_state = thread_state_;
-        lock.unlock();
+        frame_pacer_.EndFrame();
+    }
+    if (scene_loading()) {
+        // 加载完成之前退出, 等 loader 线程结束后和正常退出一样销毁
+        loader_thread_.join();
     }
     logic_device_->DeviceWaitIdle();
+    frame_pacer_.LogStats("Tutorial");
+    logic_device_->memory_allocator()->LogStats("Tutorial");
+    upload_context_->LogStats("Tutorial");
+    logic_device_->pipeline_cache()->LogStats("Tutorial");
+    ShaderArchive::Instance()->LogStats("Tutorial");
+#ifdef VULKAN_RUNTIME_SHADERC
+    SpirvCache::Instance()->LogStats("Tutorial");
+#endif
+    if (frame_contexts_->frames() > 0) {
+        LOG_D("Tutorial", "%llu frames, %u frames in flight, avg fence wait %.3f ms\n",
+              (long long unsigned int) frame_contexts_->frames(), frame_contexts_->frame_count(),
+              frame_contexts_->fence_wait_ns() / 1e6 / frame_contexts_->frames());
+    }
+    LogGpuProfile("Tutorial");
     DestroyFrameBuffers();
+    DestroyPlaceholderRenderPass();
     DestroyGraphicPipeline();
-    DestroySyncObjects();
-    DestroyCommandBuffer();
+    DestroyFrameContexts();
+    DestroyUploadContext();
     DestroyCommandPool();
     DestroyImageViews();
     DestroySwapChain();
@@ -82,11 +135,30 @@ void Tutorial::Run() {
     DestroySurface();
 }
 
+void Tutorial::SetScene(SceneType scene) {
+    scene_ = scene;
+}
+
+const char* Tutorial::SceneName(SceneType scene) {
+    switch (scene) {
+        case SCENE_TRIANGLE: return "triangle";
+        case SCENE_RECTANGLE: return "rectangle";
+        case SCENE_ROTATE_RECTANGLE: return "rotate_rectangle";
+        case SCENE_NV12_IMAGE_TEXTURE: return "nv12_image_texture";
+        case SCENE_DEPTH_TRIANGLE: return "depth_triangle";
+        case SCENE_VIKING_ROOM: return "viking_room";
+        case SCENE_VIKING_ROOM_MIPMAP: return "viking_room_mipmap";
+        case SCENE_RECTANGLE_MULTISAMPLE: return "rectangle_multisample";
+        default: return "unknown";
+    }
+}
+
 void Tutorial::CreateInstance() {
     std::vector<VkLayerProperties> layer_properties =
             VulkanInstance::EnumerateInstanceLayerProperties();
     support_validation_ = CheckValidationLayerSupport(layer_properties);
-    VkInstanceCreateInfo instance_create_info = create_info_factory_.GetInstanceCreateInfo(support_validation_);
+    surface_type_ = CreateInfoFactory::ChooseSurfaceType(headless_, use_headless_surface_);
+    VkInstanceCreateInfo instance_create_info = create_info_factory_.GetInstanceCreateInfo(support_validation_, surface_type_);
     instance_ = VulkanInstance::CreateInstance(&instance_create_info);
     if (support_validation_) {
         VkDebugReportCallbackCreateInfoEXT debug_report_callback_create_info = create_info_factory_.GetDebugReportCallbackCreateInfo();
@@ -130,12 +202,24 @@ void Tutorial::QueryPhysicalDeviceInfo() {
 }
 
 void Tutorial::CreateSurface(ANativeWindow* window) {
-    VkAndroidSurfaceCreateInfoKHR info = create_info_factory_.GetAndroidSurfaceCreateInfo(window);
-    surface_ = instance_->CreateAndroidSurface(&info);
+    if (surface_type_ == CreateInfoFactory::SURFACE_HEADLESS) {
+        VkHeadlessSurfaceCreateInfoEXT info = create_info_factory_.GetHeadlessSurfaceCreateInfo();
+        surface_ = instance_->CreateHeadlessSurface(&info);
+        assert(surface_);
+    } else if (surface_type_ == CreateInfoFactory::SURFACE_PLATFORM) {
+#ifdef VK_USE_PLATFORM_ANDROID_KHR
+        VkAndroidSurfaceCreateInfoKHR info = create_info_factory_.GetAndroidSurfaceCreateInfo(window);
+        surface_ = instance_->CreateAndroidSurface(&info);
+#else
+        (void) window;
+        LOG_E("Tutorial", "no platform surface, call SetHeadless before CreateInstance\n");
+#endif
+    }
+    // SURFACE_NONE 不创建 surface, 渲染到 off-screen image
 }
 
 void Tutorial::DestroySurface() {
-    VulkanInstance::DestroyAndroidSurface(&surface_);
+    VulkanInstance::DestroySurface(&surface_);
 }
 
 void Tutorial::CreateLogicalDevice() {
@@ -144,29 +228,62 @@ void Tutorial::CreateLogicalDevice() {
     GetGraphicQueueFamilyIndexes(*physical_device_, indexes, 10, &family_index_num);
     assert(family_index_num > 0);
     graphic_queue_family_index_ = indexes[0];
-    bool is_graphic_queue_support_present =
+    present_queue_family_index_ = graphic_queue_family_index_;
+    bool is_graphic_queue_support_present = surface_ == nullptr ||
         physical_device_->GetSurfaceSupport(graphic_queue_family_index_,
                                            surface_->surface());
-    present_queue_family_index_ = graphic_queue_family_index_;
     if (!is_graphic_queue_support_present) {
         GetPresentQueueFamilyIndexes(*physical_device_, surface_->surface(), indexes, 10, &family_index_num);
         assert(family_index_num > 0);
         present_queue_family_index_ = indexes[0];
     }
-    std::vector<VkDeviceQueueCreateInfo> device_queue_create_infos = create_info_factory_.GetDeviceQueueCreateInfos(graphic_queue_family_index_, present_queue_family_index_);
+    bool has_transfer_queue = GetTransferQueueFamilyIndex(*physical_device_, &transfer_queue_family_index_);
+    if (!has_transfer_queue) {
+        transfer_queue_family_index_ = graphic_queue_family_index_;
+    }
+    std::vector<VkDeviceQueueCreateInfo> device_queue_create_infos = create_info_factory_.GetDeviceQueueCreateInfos(
+            graphic_queue_family_index_, present_queue_family_index_, transfer_queue_family_index_);
+    VkPhysicalDeviceFeatures supported_features{};
+    physical_device_->GetFeatures(&supported_features);
+    create_info_factory_.EnableTextureCompression(supported_features);
+    // 支持时纹理直接从 map 的 asset 里 copy, 不经过 staging
+    VkDeviceSize host_import_alignment = GetMinImportedHostPointerAlignment(*physical_device_);
+    if (host_import_alignment > 0) {
+        create_info_factory_.EnableExternalMemoryHost();
+    }
     VkDeviceCreateInfo device_create_info = create_info_factory_.GetDeviceCreateInfo(support_validation_, device_queue_create_infos);
     device_create_info.pNext = &physical_device_vulkan_11_features_;
 
     logic_device_ = physical_device_->CreateDevice(&device_create_info);
+    if (host_import_alignment > 0) {
+        logic_device_->EnableHostImport(host_import_alignment);
+    }
     graphic_queue_ = logic_device_->GetDeviceQueue(graphic_queue_family_index_, 0);
-    present_queue_ = logic_device_->GetDeviceQueue(present_queue_family_index_, 0);
+    // 同一个 family 时共用一个 VulkanQueue, 它的 mutex 才能保护 loader 线程的提交
+    present_queue_ = present_queue_family_index_ == graphic_queue_family_index_ ? graphic_queue_ :
+            logic_device_->GetDeviceQueue(present_queue_family_index_, 0);
+    if (has_transfer_queue) {
+        transfer_queue_ = logic_device_->GetDeviceQueue(transfer_queue_family_index_, 0);
+    }
 }
 
 void Tutorial::DestroyLogicalDevice() {
     VulkanPhysicalDevice::DestroyDevice(&logic_device_);
 }
 
-void Tutorial::CreateSwapChain(ANativeWindow* window) {
+void Tutorial::CreateSwapChain(ANativeWindow* window, VkSwapchainKHR old_swap_chain) {
+    if (surface_ == nullptr) {
+        surface_format_.format = VK_FORMAT_B8G8R8A8_SRGB;
+        surface_format_.colorSpace = VK_COLOR_SPACE_SRGB_NONLINEAR_KHR;
+        swap_chain_extent_.width = headless_width_;
+        swap_chain_extent_.height = headless_height_;
+        auto* backend = new OffscreenPresentBackend(logic_device_, surface_format_.format, swap_chain_extent_);
+        int ret = backend->Create(frame_contexts_->frame_count());
+        assert(ret == 0);
+        present_backend_ = backend;
+        swap_chain_images_ = present_backend_->GetImages();
+        return;
+    }
     VkSurfaceCapabilitiesKHR capabilities{};
     physical_device_->GetSurfaceCapabilities(surface_->surface(), &capabilities);
     uint32_t image_count = capabilities.minImageCount + 1;
@@ -183,13 +300,57 @@ void Tutorial::CreateSwapChain(ANativeWindow* window) {
 
     VkSwapchainCreateInfoKHR create_info = create_info_factory_.GetSwapChainCreateInfo(
             surface_->surface(), image_count, surface_format_, swap_chain_extent_,
-            queue_family_indices, present_mode, VK_NULL_HANDLE);
-    swap_chain_ = logic_device_->CreateSwapChain(&create_info);
-    swap_chain_images_ = swap_chain_->GetImages();
+            queue_family_indices, present_mode, old_swap_chain);
+    VulkanSwapChain* swap_chain = logic_device_->CreateSwapChain(&create_info);
+    assert(swap_chain);
+    present_backend_ = new SwapChainPresentBackend(logic_device_, swap_chain, surface_format_.format, swap_chain_extent_);
+    swap_chain_images_ = present_backend_->GetImages();
 }
 
 void Tutorial::DestroySwapChain() {
-    VulkanLogicDevice::DestroySwapChain(&swap_chain_);
+    delete present_backend_;
+    present_backend_ = nullptr;
+    swap_chain_images_.clear();
+}
+
+void Tutorial::RecreateSwapChain(bool out_of_date) {
+    if (surface_ == nullptr) {
+        // off-screen image 大小固定
+        return;
+    }
+    if (!out_of_date) {
+        VkSurfaceCapabilitiesKHR capabilities{};
+        physical_device_->GetSurfaceCapabilities(surface_->surface(), &capabilities);
+        VkExtent2D extent = ChooseSwapExtent(capabilities, window_);
+        if (extent.width == swap_chain_extent_.width && extent.height == swap_chain_extent_.height) {
+            return;
+        }
+    }
+    auto begin = std::chrono::steady_clock::now();
+    // device, pipeline 和已经上传的资源都保留, 只重建 swap chain 相关的部分
+    if (scene_loading()) {
+        // loader 线程可能正在提交, vkDeviceWaitIdle 要求所有 queue 都由调用者同步, 只等 render 线程用的 queue
+        graphic_queue_->QueueWaitIdle();
+        present_queue_->QueueWaitIdle();
+    } else {
+        logic_device_->DeviceWaitIdle();
+    }
+    DestroyFrameBuffers();
+    DestroyImageViews();
+
+    auto* old_backend = static_cast<SwapChainPresentBackend*>(present_backend_);
+    CreateSwapChain(window_, old_backend->swap_chain());
+    delete old_backend;
+
+    CreateImageViews();
+    if (!scene_loading()) {
+        obj_->Resize(swap_chain_extent_);
+    }
+    CreateFrameBuffers();
+    LOG_D("Tutorial", "swap chain recreated %ux%u in %.3f ms, %.3f ms after surfaceChanged\n",
+          swap_chain_extent_.width, swap_chain_extent_.height,
+          std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - begin).count(),
+          MillisecondsSinceSurfaceChanged());
 }
 
 void Tutorial::CreateImageViews() {
@@ -208,11 +369,60 @@ void Tutorial::DestroyImageViews() {
 }
 
 void Tutorial::CreateGraphicPipeline() {
-    obj_ = new RectangleMultisample(
-                             logic_device_,
-                             surface_format_.format,
-                             swap_chain_extent_);
-    obj_->CreatePipeline();
+    switch (scene_) {
+        case SCENE_TRIANGLE:
+            obj_ = new Triangle(logic_device_, scene_format_, scene_extent_);
+            break;
+        case SCENE_RECTANGLE:
+            obj_ = new Rectangle(logic_device_, scene_format_, scene_extent_);
+            break;
+        case SCENE_ROTATE_RECTANGLE:
+            obj_ = new RotateRectangle(logic_device_, scene_format_, scene_extent_, frame_contexts_);
+            break;
+        case SCENE_NV12_IMAGE_TEXTURE:
+            // 每个 frame context 一个 slot, 写 staging 时这个 slot 上次的使用已经被 frame fence 等待过
+            obj_ = new Nv12ImageTexture(asset_manager_, upload_context_,
+                                        logic_device_, scene_format_, scene_extent_,
+                                        VkExtent2D{nv12_stream_width_, nv12_stream_height_},
+                                        nv12_stream_width_ > 0 ? frame_contexts_->frame_count() : 0);
+            break;
+        case SCENE_DEPTH_TRIANGLE:
+            obj_ = new DepthTriangle(loader_command_pool_ ? loader_command_pool_ : graphic_command_pool_, graphic_queue_,
+                                     logic_device_, scene_format_, scene_extent_);
+            break;
+        case SCENE_VIKING_ROOM:
+            obj_ = new VikingRoom(asset_manager_, upload_context_,
+                                  logic_device_, scene_format_, scene_extent_, frame_contexts_,
+                                  optimize_mesh_, quantize_vertices_);
+            break;
+        case SCENE_VIKING_ROOM_MIPMAP:
+            obj_ = new VikingRoomMipmap(asset_manager_, upload_context_,
+                                        logic_device_, scene_format_, scene_extent_, frame_contexts_,
+                                        optimize_mesh_, quantize_vertices_, compute_mipmaps_,
+                                        kaiser_mipmaps_ ? MIP_FILTER_KAISER : MIP_FILTER_BOX);
+            break;
+        case SCENE_RECTANGLE_MULTISAMPLE:
+        default:
+            obj_ = new RectangleMultisample(logic_device_, scene_format_, scene_extent_);
+            break;
+    }
+    // 图片先交给 ImageDecoder 的 worker 解码, 和下面的 shader 编译, pipeline 创建同时进行
+    for (const auto& name : obj_->image_assets()) {
+        ImageDecoder::Instance()->Prefetch(asset_manager_, name);
+    }
+    // 先并行编译所有 shader stage, 再创建 pipeline. 只有一个 object, pipeline 在当前线程创建,
+    // upload_context_ 等资源只在这个线程使用. 异步加载时当前线程是 loader 线程
+    ParallelSetup setup;
+    VulkanObject::AddShaderTasks(&setup, SceneName(scene_), obj_->shader_sources());
+    setup.Run();
+    setup.Add(SceneName(scene_), ParallelSetup::PHASE_PIPELINE, [this]() {
+        return obj_->CreatePipeline();
+    });
+    setup.Run();
+    setup.LogStats("Tutorial");
+    benchmark_stats_.AddSetupObjects(setup.object_timings());
+    ImageDecoder::Instance()->DiscardUnused();
+    ImageDecoder::Instance()->LogStats("Tutorial");
 }
 
 void Tutorial::DestroyGraphicPipeline() {
@@ -221,19 +431,98 @@ void Tutorial::DestroyGraphicPipeline() {
     obj_ = nullptr;
 }
 
+void Tutorial::StartSceneLoading() {
+    VkCommandPoolCreateInfo pool_create_info = CreateInfoFactory::GetCommandPoolCreateInfo(graphic_queue_family_index_);
+    loader_command_pool_ = logic_device_->CreateCommandPool(&pool_create_info);
+    CreatePlaceholderRenderPass();
+    // 加载完成之前的帧都不计入 benchmark, loader 线程也会写 benchmark_stats_
+    full_quality_frame_ = UINT64_MAX;
+    scene_ready_.store(false);
+    loader_thread_ = std::thread([this]() {
+        CreateGraphicPipeline();
+        scene_ready_.store(true, std::memory_order_release);
+    });
+}
+
+void Tutorial::FinishSceneLoading() {
+    auto begin = std::chrono::steady_clock::now();
+    loader_thread_.join();
+    // 还在 flight 的清屏帧引用 placeholder 的 framebuffer, 只切换一次, 等它们完成再销毁
+    graphic_queue_->QueueWaitIdle();
+    upload_ticket_ = upload_context_->Submit();
+    DestroyFrameBuffers();
+    DestroyPlaceholderRenderPass();
+    if (scene_extent_.width != swap_chain_extent_.width || scene_extent_.height != swap_chain_extent_.height) {
+        obj_->Resize(swap_chain_extent_);
+    }
+    CreateFrameBuffers();
+    full_quality_frame_ = frame_contexts_->frames() + frame_contexts_->frame_count();
+    benchmark_stats_.SetPipelineCacheStats(logic_device_->pipeline_cache()->stats());
+    logic_device_->pipeline_cache()->Save();
+    LOG_D("Tutorial", "scene loaded in %.3f ms, %llu placeholder frames, switch took %.3f ms\n",
+          std::chrono::duration<double, std::milli>(begin - upload_begin_).count(),
+          (long long unsigned int) frame_contexts_->frames(),
+          std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - begin).count());
+}
+
+bool Tutorial::scene_loading() const {
+    return loader_thread_.joinable();
+}
+
+void Tutorial::CreatePlaceholderRenderPass() {
+    std::vector<VkAttachmentDescription> attachments;
+    attachments.push_back(CreateInfoFactory::GetAttachmentDescription(surface_format_.format));
+    VkAttachmentReference color_attachment_ref = CreateInfoFactory::GetAttachmentReference(0);
+    std::vector<VkSubpassDescription> subpasses;
+    subpasses.push_back(CreateInfoFactory::GetSubpassDescription(color_attachment_ref));
+    std::vector<VkSubpassDependency> dependencies;
+    dependencies.push_back(CreateInfoFactory::GetSubpassDependency());
+    VkRenderPassCreateInfo render_pass_info =
+            CreateInfoFactory::GetRenderPassCreateInfo(attachments, subpasses, dependencies);
+    placeholder_render_pass_ = logic_device_->CreateRenderPass(&render_pass_info);
+    assert(placeholder_render_pass_);
+}
+
+void Tutorial::DestroyPlaceholderRenderPass() {
+    VulkanLogicDevice::DestroyRenderPass(&placeholder_render_pass_);
+}
+
+void Tutorial::RecordPlaceholder(const VulkanCommandBuffer* command_buffer,
+                                 const VulkanFrameBuffer* frame_buffer) const {
+    VkCommandBufferBeginInfo begin_info{};
+    begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    VkResult ret = command_buffer->BeginCommandBuffer(&begin_info);
+    assert(ret == VK_SUCCESS);
+    VkRenderPassBeginInfo render_pass_info{};
+    render_pass_info.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+    render_pass_info.renderPass = placeholder_render_pass_->render_pass();
+    render_pass_info.framebuffer = frame_buffer->frame_buffer();
+    render_pass_info.renderArea.offset = {0, 0};
+    render_pass_info.renderArea.extent = swap_chain_extent_;
+    // 和 scene 的背景区分开
+    VkClearValue clear_color = {{{0.1f, 0.1f, 0.1f, 1.0f}}};
+    render_pass_info.clearValueCount = 1;
+    render_pass_info.pClearValues = &clear_color;
+    command_buffer->CmdBeginRenderPass(&render_pass_info, VK_SUBPASS_CONTENTS_INLINE);
+    command_buffer->CmdEndRenderPass();
+    command_buffer->EndCommandBuffer();
+}
+
 void Tutorial::CreateFrameBuffers() {
     frame_buffers_.resize(swap_chain_image_views_.size());
+    bool placeholder = scene_loading();
     for (size_t i = 0; i < swap_chain_image_views_.size(); i++) {
         std::vector<VkImageView> attachments;
         attachments.push_back(swap_chain_image_views_[i]->image_view());
-        if (obj_->color_attachment_image_view()) {
+        if (!placeholder && obj_->color_attachment_image_view()) {
             attachments.push_back(obj_->color_attachment_image_view()->image_view());
         }
-        if (obj_->depth_attachment_image_view()) {
+        if (!placeholder && obj_->depth_attachment_image_view()) {
             attachments.push_back(obj_->depth_attachment_image_view()->image_view());
         }
+        const VulkanRenderPass* render_pass = placeholder ? placeholder_render_pass_ : obj_->render_pass();
         VkFramebufferCreateInfo frame_buffer_create_info =
-                CreateInfoFactory::GetFramebufferCreateInfo(obj_->render_pass(), attachments, swap_chain_extent_.width, swap_chain_extent_.height);
+                CreateInfoFactory::GetFramebufferCreateInfo(render_pass, attachments, swap_chain_extent_.width, swap_chain_extent_.height);
         VulkanFrameBuffer* frame_buffer = logic_device_->CreateFrameBuffer(&frame_buffer_create_info);
         if (frame_buffer != nullptr) {
             frame_buffers_[i] = frame_buffer;
@@ -247,6 +536,7 @@ void Tutorial::DestroyFrameBuffers() {
     for (auto& it : frame_buffers_) {
         VulkanLogicDevice::DestroyFrameBuffer(&it);
     }
+    frame_buffers_.clear();
 }
 
 void Tutorial::CreateCommandPool() {
@@ -255,56 +545,89 @@ void Tutorial::CreateCommandPool() {
 }
 
 void Tutorial::DestroyCommandPool() {
+    // DepthTriangle Resize 时还会用到 loader_command_pool_, 和 graphic_command_pool_ 一起销毁
+    VulkanLogicDevice::DestroyCommandPool(&loader_command_pool_);
     VulkanLogicDevice::DestroyCommandPool(&graphic_command_pool_);
 }
 
-void Tutorial::CreateCommandBuffer() {
-    graphic_command_buffer_ = graphic_command_pool_->AllocateCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY);
+void Tutorial::RecordLoadTimes() {
+    uint64_t now = std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now() - setup_begin_).count();
+    if (first_frame_ns_ == 0) {
+        first_frame_ns_ = now;
+    }
+    if (full_quality_ns_ == 0 && !scene_loading()) {
+        full_quality_ns_ = now;
+        LOG_D("Tutorial", "time to first frame %.3f ms, time to full quality %.3f ms\n",
+              first_frame_ns_ / 1e6, full_quality_ns_ / 1e6);
+        benchmark_stats_.SetLoadTimes(first_frame_ns_, full_quality_ns_);
+    }
+}
+
+void Tutorial::CreateUploadContext() {
+    upload_context_ = new VulkanUploadContext(logic_device_, graphic_queue_, graphic_queue_family_index_,
+                                              transfer_queue_, transfer_queue_family_index_);
+    int ret = upload_context_->Create();
+    assert(ret == 0);
 }
 
-void Tutorial::DestroyCommandBuffer() {
-    VulkanCommandPool::FreeCommandBuffer(&graphic_command_buffer_);
+void Tutorial::DestroyUploadContext() {
+    delete upload_context_;
+    upload_context_ = nullptr;
 }
 
-void Tutorial::CreateSyncObjects() {
-    /* typedef struct VkSemaphoreCreateInfo {
-        VkStructureType           sType;
-        const void*               pNext;
-        VkSemaphoreCreateFlags    flags;
-    } VkSemaphoreCreateInfo; */
-    VkSemaphoreCreateInfo semaphore_info{};
-    semaphore_info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
-    /* typedef struct VkFenceCreateInfo {
-        VkStructureType       sType;
-        const void*           pNext;
-        VkFenceCreateFlags    flags;
-    } VkFenceCreateInfo; */
-    VkFenceCreateInfo fence_info{};
-    fence_info.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
-    frame_available_semaphore_ = logic_device_->CreateSemaphore(&semaphore_info);
-    assert(frame_available_semaphore_);
-    render_finished_semaphore_ = logic_device_->CreateSemaphore(&semaphore_info);
-    assert(render_finished_semaphore_);
-    cpu_wait_ = logic_device_->CreateFence(&fence_info);
-    assert(cpu_wait_);
+void Tutorial::CreateFrameContexts() {
+    frame_contexts_ = new FrameContextRing(logic_device_, graphic_command_pool_);
+    // scene 每帧的 mvp 写在当前 frame context 的 uniform slice 里, slice 在 Create 里按
+    // minUniformBufferOffsetAlignment 对齐
+    VkDeviceSize uniform_slice_size = std::max({sizeof(RotateRectangle::mvp_t), sizeof(VikingRoom::mvp_t),
+                                                sizeof(VikingRoomMipmap::mvp_t)});
+    int ret = frame_contexts_->Create(frames_in_flight_, uniform_slice_size);
+    assert(ret == 0);
+    if (GpuTimestampsRequested()) {
+        std::vector<VkQueueFamilyProperties> family_properties = physical_device_->GetQueueFamilyProperties();
+        frame_contexts_->EnableGpuTimestamps(family_properties[graphic_queue_family_index_].timestampValidBits);
+    }
 }
 
-void Tutorial::DestroySyncObjects() {
-    VulkanLogicDevice::DestroySemaphore(&frame_available_semaphore_);
-    VulkanLogicDevice::DestroySemaphore(&render_finished_semaphore_);
-    VulkanLogicDevice::DestroyFence(&cpu_wait_);
+void Tutorial::DestroyFrameContexts() {
+    delete frame_contexts_;
+    frame_contexts_ = nullptr;
 }
 
 void Tutorial::DrawFrame() {
+    // 只等待 frames_in_flight_ 帧之前用这个 context 的提交, 而不是上一帧
+    frame_context_t* frame = frame_contexts_->WaitCurrent();
+    if (scene_loading() && scene_ready_.load(std::memory_order_acquire)) {
+        FinishSceneLoading();
+    }
+    if (frame_contexts_->frames() >= full_quality_frame_) {
+        AddFrameTiming(frame->timing);
+    }
+    VkFence fence = frame->in_flight_fence->fence();
+    if (upload_ticket_ != 0 && upload_context_->IsComplete(upload_ticket_)) {
+        LOG_D("Tutorial", "scene upload done within %.3f ms, %llu frames submitted meanwhile\n",
+              std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - upload_begin_).count(),
+              (long long unsigned int) frame_contexts_->frames());
+        upload_ticket_ = 0;
+    }
+
     uint32_t image_index;
-    logic_device_->AcquireNextImageKHR(swap_chain_->swap_chain(),
-                                       UINT64_MAX,
-                                       frame_available_semaphore_->semaphore(), VK_NULL_HANDLE, &image_index);
-    VkFence fence = cpu_wait_->fence();
-    logic_device_->WaitForFences( 1, &fence, VK_TRUE, UINT64_MAX);
-
-    graphic_command_buffer_->ResetCommandBuffer(0);
-    obj_->Draw(graphic_command_buffer_, frame_buffers_[image_index]);
+    VkResult ret = present_backend_->AcquireNextImage(frame->image_available_semaphore->semaphore(), &image_index);
+    if (ret == VK_ERROR_OUT_OF_DATE_KHR) {
+        // semaphore 没有被 signal, fence 也还没有 reset, 这个 context 可以直接在下一帧复用
+        RecreateSwapChain(true);
+        return;
+    }
+    assert(ret == VK_SUCCESS || ret == VK_SUBOPTIMAL_KHR);
+
+    frame->command_buffer->ResetCommandBuffer(0);
+    frame_contexts_->BeginRecord(frame);
+    if (scene_loading()) {
+        RecordPlaceholder(frame->command_buffer, frame_buffers_[image_index]);
+    } else {
+        obj_->Draw(frame->command_buffer, frame_buffers_[image_index], frame);
+    }
     /* typedef struct VkSubmitInfo {
         VkStructureType                sType;
         const void*                    pNext;
@@ -316,44 +639,37 @@ void Tutorial::DrawFrame() {
         uint32_t                       signalSemaphoreCount;
         const VkSemaphore*             pSignalSemaphores;
     } VkSubmitInfo; */
-    VkSemaphore wait_semaphores[] = {frame_available_semaphore_->semaphore()};
+    VkSemaphore wait_semaphores[] = {frame->image_available_semaphore->semaphore()};
     VkPipelineStageFlags wait_stages[] = {VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT};
-    VkSemaphore signal_semaphores[] = {render_finished_semaphore_->semaphore()};
-    VkCommandBuffer command_buffer = graphic_command_buffer_->command_buffer();
+    VkSemaphore signal_semaphores[] = {frame->render_finished_semaphore->semaphore()};
+    VkCommandBuffer command_buffer = frame->command_buffer->command_buffer();
     VkSubmitInfo submit_info{};
     submit_info.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
-    submit_info.waitSemaphoreCount = 1;
-    submit_info.pWaitSemaphores = wait_semaphores;
-    submit_info.pWaitDstStageMask = wait_stages;
+    if (present_backend_->needs_semaphores()) {
+        submit_info.waitSemaphoreCount = 1;
+        submit_info.pWaitSemaphores = wait_semaphores;
+        submit_info.pWaitDstStageMask = wait_stages;
+        submit_info.signalSemaphoreCount = 1;
+        submit_info.pSignalSemaphores = signal_semaphores;
+    }
     submit_info.commandBufferCount = 1;
     submit_info.pCommandBuffers = &command_buffer;
-    submit_info.signalSemaphoreCount = 1;
-    submit_info.pSignalSemaphores = signal_semaphores;
 
     logic_device_->ResetFences(1, &fence);
-    VkResult ret = graphic_queue_->QueueSubmit(1, &submit_info, fence);
+    frame_contexts_->EndRecord(frame);
+    ret = graphic_queue_->QueueSubmit(1, &submit_info, fence);
     assert(ret == VK_SUCCESS);
-    /* typedef struct VkPresentInfoKHR {
-        VkStructureType          sType;
-        const void*              pNext;
-        uint32_t                 waitSemaphoreCount;
-        const VkSemaphore*       pWaitSemaphores;
-        uint32_t                 swapchainCount;
-        const VkSwapchainKHR*    pSwapchains;
-        const uint32_t*          pImageIndices;
-        VkResult*                pResults;
-    } VkPresentInfoKHR; */
-    VkPresentInfoKHR present_info{};
-    present_info.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
-
-    present_info.waitSemaphoreCount = 1;
-    present_info.pWaitSemaphores = signal_semaphores;
-
-    VkSwapchainKHR swap_chains[] = {swap_chain_->swap_chain()};
-    present_info.swapchainCount = 1;
-    present_info.pSwapchains = swap_chains;
-    present_info.pImageIndices = &image_index;
-    present_queue_->QueuePresentKHR(&present_info);
+    ret = present_backend_->Present(present_queue_, signal_semaphores[0], image_index);
+    frame_contexts_->Advance();
+    if (full_quality_ns_ == 0) {
+        RecordLoadTimes();
+    }
+    bool surface_changed = ConsumeSurfaceChanged();
+    if (ret == VK_ERROR_OUT_OF_DATE_KHR || ret == VK_SUBOPTIMAL_KHR) {
+        RecreateSwapChain(true);
+    } else if (surface_changed) {
+        RecreateSwapChain(false);
+    }
 }
 
 VkSurfaceFormatKHR Tutorial::ChooseSwapSurfaceFormat() {
@@ -368,6 +684,10 @@ VkSurfaceFormatKHR Tutorial::ChooseSwapSurfaceFormat() {
 }
 
 VkPresentModeKHR Tutorial::ChooseSwapPresentMode() {
+    if (frame_pacer_.present_bound()) {
+        // FIFO 是唯一保证支持的模式, 由 vsync 决定节奏
+        return VK_PRESENT_MODE_FIFO_KHR;
+    }
     std::vector<VkPresentModeKHR> present_modes =
             physical_device_->GetSurfacePresentModes(surface_->surface());
     for (const auto& present_mode : present_modes) {
@@ -381,6 +701,10 @@ VkPresentModeKHR Tutorial::ChooseSwapPresentMode() {
 VkExtent2D Tutorial::ChooseSwapExtent(const VkSurfaceCapabilitiesKHR& capabilities, ANativeWindow* window) {
     if (capabilities.currentExtent.width != std::numeric_limits<uint32_t>::max()) {
         return capabilities.currentExtent;
+    } else if (window == nullptr) {
+        // headless surface 没有 currentExtent, 由 SetHeadless 指定
+        VkExtent2D extent = {headless_width_, headless_height_};
+        return extent;
     } else {
         int width = ANativeWindow_getWidth(window);
         int height = ANativeWindow_getHeight(window);
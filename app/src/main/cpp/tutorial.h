@@ -3,21 +3,43 @@
 //
 
 #pragma once
+#include <atomic>
+#include <chrono>
+#include <thread>
 #include "create_info_factory.h"
 #include "vulkan_instance.h"
 #include "vulkan_physical_device.h"
 #include "vulkan_surface.h"
 #include "vulkan_swap_chain.h"
 #include "tutorial_base.h"
+#include "frame_context.h"
+#include "present_backend.h"
+#include "vulkan_upload_context.h"
 
 #include "vulkan_object.h"
 
 class Tutorial : public TutorialBase {
 public:
+    enum SceneType {
+        SCENE_TRIANGLE = 0,
+        SCENE_RECTANGLE,
+        SCENE_ROTATE_RECTANGLE,
+        SCENE_NV12_IMAGE_TEXTURE,
+        SCENE_DEPTH_TRIANGLE,
+        SCENE_VIKING_ROOM,
+        SCENE_VIKING_ROOM_MIPMAP,
+        SCENE_RECTANGLE_MULTISAMPLE,
+        SCENE_COUNT,
+    };
+
     Tutorial(AAssetManager * asset_manager);
     ~Tutorial() = default;
     void Run() override;
 
+    // 在 StartThread 之前设置, 默认 SCENE_RECTANGLE_MULTISAMPLE
+    void SetScene(SceneType scene);
+    static const char* SceneName(SceneType scene);
+
     void CreateInstance() override;
     void DestroyInstance() override;
     bool PickPhysicalDevice() override;
@@ -30,21 +52,33 @@ private:
     void DestroySurface();
     void CreateLogicalDevice();
     void DestroyLogicalDevice();
-    void CreateSwapChain(ANativeWindow* window);
+    void CreateSwapChain(ANativeWindow* window, VkSwapchainKHR old_swap_chain);
     void DestroySwapChain();
+    // out_of_date 为 false 时, surface 大小没有变化就不重建
+    void RecreateSwapChain(bool out_of_date);
     void CreateImageViews();
     void DestroyImageViews();
     void CreateGraphicPipeline();
     void DestroyGraphicPipeline();
+    // 异步加载: loader 线程创建 scene, render 线程在 scene_ready_ 之后调用 FinishSceneLoading 切换过去
+    void StartSceneLoading();
+    void FinishSceneLoading();
+    bool scene_loading() const;
+    void CreatePlaceholderRenderPass();
+    void DestroyPlaceholderRenderPass();
+    void RecordPlaceholder(const VulkanCommandBuffer* command_buffer, const VulkanFrameBuffer* frame_buffer) const;
+    // scene 加载中时用 placeholder render pass, 只有 swap chain image 一个 attachment
     void CreateFrameBuffers();
     void DestroyFrameBuffers();
 
     void CreateCommandPool();
     void DestroyCommandPool();
-    void CreateCommandBuffer();
-    void DestroyCommandBuffer();
-    void CreateSyncObjects();
-    void DestroySyncObjects();
+    // 第一帧或者第一个完整画面 present 之后记录时间
+    void RecordLoadTimes();
+    void CreateUploadContext();
+    void DestroyUploadContext();
+    void CreateFrameContexts();
+    void DestroyFrameContexts();
 
     void DrawFrame();
 
@@ -60,15 +94,35 @@ private:
     VulkanLogicDevice* logic_device_;
     VulkanQueue* graphic_queue_;
     VulkanQueue* present_queue_;
-    VulkanSwapChain* swap_chain_;
+    // 没有独立的 transfer queue family 时为 nullptr
+    VulkanQueue* transfer_queue_;
+    PresentBackend* present_backend_;
     std::vector<VulkanFrameBuffer*> frame_buffers_;
     std::vector<VkImage> swap_chain_images_;
     std::vector<VulkanImageView*> swap_chain_image_views_;
     VulkanCommandPool* graphic_command_pool_;
-    VulkanCommandBuffer* graphic_command_buffer_;
-    VulkanSemaphore* frame_available_semaphore_;
-    VulkanSemaphore* render_finished_semaphore_;
-    VulkanFence* cpu_wait_;
+    // 只在异步加载时创建, loader 线程里 scene 用的 command pool, 不和 frame context 共用
+    VulkanCommandPool* loader_command_pool_;
+    FrameContextRing* frame_contexts_;
+    VulkanUploadContext* upload_context_;
+    // 创建 scene 时提交的上传, 完成之前渲染已经开始
+    uint64_t upload_ticket_;
+    std::chrono::steady_clock::time_point upload_begin_;
+    std::chrono::steady_clock::time_point setup_begin_;
+
+    // loader 线程在 FinishSceneLoading 里 join, 在这之前 obj_ 和 upload_context_ 只由 loader 线程使用
+    std::thread loader_thread_;
+    std::atomic<bool> scene_ready_;
+    // 加载中只清屏, 不需要 pipeline
+    VulkanRenderPass* placeholder_render_pass_;
+    // 创建 obj_ 时用的格式和大小, loader 线程不读 render 线程会改的 surface_format_/swap_chain_extent_.
+    // 加载中重建了 swap chain 时在切换之前 Resize
+    VkFormat scene_format_;
+    VkExtent2D scene_extent_;
+    // 这一帧之后的 frame timing 才是完整画面的, 之前的不计入 benchmark
+    uint64_t full_quality_frame_;
+    uint64_t first_frame_ns_;
+    uint64_t full_quality_ns_;
 
     bool support_validation_;
     VkPhysicalDeviceVulkan11Features physical_device_vulkan_11_features_;
@@ -76,10 +130,13 @@ private:
     VkPhysicalDeviceProperties physical_device_properties_;
     uint32_t graphic_queue_family_index_;
     uint32_t present_queue_family_index_;
+    uint32_t transfer_queue_family_index_;
     VkSurfaceFormatKHR surface_format_;
     VkExtent2D swap_chain_extent_;
     VkDebugReportCallbackEXT callback_;
+    CreateInfoFactory::SurfaceType surface_type_;
 
+    SceneType scene_;
     VulkanObject* obj_;
 };
 
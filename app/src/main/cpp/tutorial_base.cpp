@@ -3,6 +3,14 @@
 //
 #include "tutorial_base.h"
 
+#include <chrono>
+#include <cstring>
+#include "log.h"
+#include "shader_archive.h"
+#ifdef VULKAN_RUNTIME_SHADERC
+#include "spirv_cache.h"
+#endif
+
 
 void* thread_run(void* param) {
     auto* tutorial = (TutorialBase*)param;
@@ -14,8 +22,26 @@ TutorialBase::TutorialBase(AAssetManager * asset_manager) :
         asset_manager_(asset_manager),
         thread_(0),
         thread_state_(0),
-        window_(nullptr) {
-
+        window_(nullptr),
+        frames_in_flight_(2),
+        headless_(false),
+        use_headless_surface_(false),
+        headless_width_(0),
+        headless_height_(0),
+        optimize_mesh_(true),
+        quantize_vertices_(false),
+        compute_mipmaps_(false),
+        kaiser_mipmaps_(false),
+        async_loading_(false),
+        nv12_stream_width_(0),
+        nv12_stream_height_(0),
+        particle_count_(0),
+        gpu_profiling_(false),
+        last_frame_timing_(),
+        surface_changed_(false),
+        surface_changed_ns_(0) {
+    // 进程内只 map 一次, 之后的 TutorialBase 直接复用
+    ShaderArchive::Instance()->Open(asset_manager);
 }
 
 void TutorialBase::StartThread(ANativeWindow* window) {
@@ -33,4 +59,143 @@ void TutorialBase::StopThread() {
     lock.unlock();
     void* ret = nullptr;
     pthread_join(thread_, &ret);
-}
\ No newline at end of file
+}
+
+void TutorialBase::WaitThread() {
+    void* ret = nullptr;
+    pthread_join(thread_, &ret);
+    std::unique_lock<std::mutex> lock(thread_state_mutex_);
+    thread_state_ = 0;
+}
+
+void TutorialBase::SetFramesInFlight(uint32_t frames_in_flight) {
+    frames_in_flight_ = frames_in_flight;
+}
+
+void TutorialBase::SetFramePacing(FramePacer::Mode mode, uint32_t target_fps) {
+    frame_pacer_.SetMode(mode, target_fps);
+}
+
+void TutorialBase::SetHeadless(uint32_t width, uint32_t height, bool use_headless_surface) {
+    headless_ = true;
+    use_headless_surface_ = use_headless_surface;
+    headless_width_ = width;
+    headless_height_ = height;
+    frame_pacer_.SetMode(FramePacer::MODE_UNCAPPED, 0);
+}
+
+void TutorialBase::SetBenchmark(uint32_t warmup_frames, uint32_t measured_frames) {
+    benchmark_stats_.Configure(warmup_frames, measured_frames);
+}
+
+void TutorialBase::SetCacheDirectory(const std::string& directory) {
+    cache_directory_ = directory;
+#ifdef VULKAN_RUNTIME_SHADERC
+    SpirvCache::Instance()->SetDirectory(directory);
+#endif
+}
+
+void TutorialBase::SetMeshOptimization(bool enabled) {
+    optimize_mesh_ = enabled;
+}
+
+void TutorialBase::SetVertexQuantization(bool enabled) {
+    quantize_vertices_ = enabled;
+}
+
+void TutorialBase::SetComputeMipmaps(bool enabled, bool kaiser_filter) {
+    compute_mipmaps_ = enabled;
+    kaiser_mipmaps_ = kaiser_filter;
+}
+
+void TutorialBase::SetAsyncLoading(bool enabled) {
+    async_loading_ = enabled;
+}
+
+void TutorialBase::SetNv12Stream(uint32_t width, uint32_t height) {
+    nv12_stream_width_ = width;
+    nv12_stream_height_ = height;
+}
+
+void TutorialBase::SetParticleCount(uint32_t count) {
+    particle_count_ = count;
+}
+
+void TutorialBase::SetGpuProfiling(bool enabled) {
+    gpu_profiling_ = enabled;
+}
+
+frame_timing_t TutorialBase::last_frame_timing() const {
+    std::lock_guard<std::mutex> lock(frame_timing_mutex_);
+    return last_frame_timing_;
+}
+
+const BenchmarkStats& TutorialBase::benchmark_stats() const {
+    return benchmark_stats_;
+}
+
+void TutorialBase::AddBenchmarkSetupTime(uint64_t ns) {
+    benchmark_stats_.AddSetupTime(ns);
+}
+
+bool TutorialBase::IsRunning() const {
+    if (benchmark_stats_.enabled() && benchmark_stats_.complete()) {
+        return false;
+    }
+    return thread_state_.load(std::memory_order_acquire) == 1;
+}
+
+void TutorialBase::SurfaceChanged() {
+    surface_changed_ns_.store(std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count());
+    surface_changed_.store(true, std::memory_order_release);
+}
+
+bool TutorialBase::ConsumeSurfaceChanged() {
+    return surface_changed_.exchange(false, std::memory_order_acq_rel);
+}
+
+double TutorialBase::MillisecondsSinceSurfaceChanged() const {
+    int64_t changed_ns = surface_changed_ns_.load();
+    if (changed_ns == 0) {
+        return 0.0;
+    }
+    int64_t now_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+    return (now_ns - changed_ns) / 1e6;
+}
+
+bool TutorialBase::GpuTimestampsRequested() const {
+    return gpu_profiling_ || benchmark_stats_.enabled();
+}
+
+void TutorialBase::AddFrameTiming(const frame_timing_t& timing) {
+    benchmark_stats_.Add(timing);
+    if (!gpu_profiling_ || !timing.valid) {
+        return;
+    }
+    for (const auto& scope : timing.gpu_scopes) {
+        gpu_scope_total_t* total = nullptr;
+        for (auto& candidate : gpu_scope_totals_) {
+            if (strcmp(candidate.name, scope.name) == 0) {
+                total = &candidate;
+                break;
+            }
+        }
+        if (total == nullptr) {
+            gpu_scope_totals_.push_back(gpu_scope_total_t{scope.name, 0, 0});
+            total = &gpu_scope_totals_.back();
+        }
+        total->ns += scope.ns;
+        ++total->frames;
+    }
+    std::lock_guard<std::mutex> lock(frame_timing_mutex_);
+    last_frame_timing_ = timing;
+}
+
+void TutorialBase::LogGpuProfile(const char* tag) const {
+    for (const auto& total : gpu_scope_totals_) {
+        LOG_D(tag, "gpu scope %s: avg %.3f ms over %llu frames\n", total.name,
+              total.ns / 1e6 / total.frames, (long long unsigned int) total.frames);
+    }
+}
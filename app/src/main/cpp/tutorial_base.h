@@ -5,9 +5,20 @@
 #pragma once
 #include <pthread.h>
 #include <mutex>
-#include <android/asset_manager.h>
-#include <android/asset_manager_jni.h>
-#include <android/native_window_jni.h>
+#include <atomic>
+#include <string>
+#include <vector>
+#include "android_compat.h"
+#include "frame_pacer.h"
+#include "frame_context.h"
+#include "benchmark_stats.h"
+
+// 一个 timestamp scope 在所有帧里的累计耗时
+typedef struct {
+    const char* name;
+    uint64_t ns;
+    uint64_t frames;
+} gpu_scope_total_t;
 
 class TutorialBase {
 public:
@@ -15,6 +26,42 @@ public:
     virtual ~TutorialBase() = default;
     void StartThread(ANativeWindow* window);
     void StopThread();
+    // 等待 render loop 自己退出, 只在 SetBenchmark 之后使用
+    void WaitThread();
+    // 在 StartThread 之前设置, 会被限制在 [1, 4]
+    void SetFramesInFlight(uint32_t frames_in_flight);
+    void SetFramePacing(FramePacer::Mode mode, uint32_t target_fps);
+    // 在 CreateInstance 之前调用, 之后 StartThread(nullptr) 不需要窗口, 帧率不做限制.
+    // use_headless_surface 为 true 时优先用 VK_EXT_headless_surface + swap chain, 否则渲染到 off-screen image
+    void SetHeadless(uint32_t width, uint32_t height, bool use_headless_surface);
+    // 在 StartThread 之前设置, render loop 跑完 warmup + measured 帧后退出, 结果在 benchmark_stats()
+    void SetBenchmark(uint32_t warmup_frames, uint32_t measured_frames);
+    const BenchmarkStats& benchmark_stats() const;
+    // 在 StartThread 之前设置, pipeline cache (和开发版本的 SPIR-V cache) 的文件放在这个目录下, 为空时不读写文件
+    void SetCacheDirectory(const std::string& directory);
+    // 在 StartThread 之前设置, false 时 OBJ 模型不做 vertex 焊接和 cache 重排, 用于对比优化前后的绘制耗时
+    void SetMeshOptimization(bool enabled);
+    // 在 StartThread 之前设置, true 时 OBJ 模型的 position/texcoord 用 16 位量化格式上传, vertex 数据减少约一半
+    void SetVertexQuantization(bool enabled);
+    // 在 StartThread 之前设置, true 时 mipmap 场景的 PNG 纹理用一次 compute dispatch 生成 mip 链, 不支持时退回 blit.
+    // kaiser_filter 为 true 时 mip 1 用 Kaiser 窗滤波, 否则和 blit 一样是 2x2 平均
+    void SetComputeMipmaps(bool enabled, bool kaiser_filter);
+    // 在 StartThread 之前设置, true 时 scene 的资源在 loader 线程创建, 完成之前 render loop 只清屏.
+    // 第一帧和完整画面的时间分开统计
+    void SetAsyncLoading(bool enabled);
+    // 在 StartThread 之前设置, 宽高不为 0 时 nv12_image_texture 每帧上传一帧这个大小的合成 NV12 画面,
+    // 代替静态的 texture_512x512.NV12. 宽高必须是偶数
+    void SetNv12Stream(uint32_t width, uint32_t height);
+    // 在 StartThread 之前设置, 粒子场景的粒子数, 0 时使用 Particle::DEFAULT_PARTICLE_COUNT
+    void SetParticleCount(uint32_t count);
+    // 在 StartThread 之前设置, true 时不开 benchmark 也打开 GPU timestamp, 退出时 log 每个 scope 的平均耗时
+    void SetGpuProfiling(bool enabled);
+    // 最近读回的一帧的耗时, 可以在其他线程调用. 没有打开 GPU profiling 时 valid 为 false
+    frame_timing_t last_frame_timing() const;
+    // CreateInstance/PickPhysicalDevice 在 render 线程之外, 由调用者计时后加进 setup 时间
+    void AddBenchmarkSetupTime(uint64_t ns);
+    // surfaceChanged 回调, render 线程在下一帧 present 之后重建 swap chain
+    void SurfaceChanged();
     virtual void Run() = 0;
 
     virtual void CreateInstance() = 0;
@@ -22,12 +69,51 @@ public:
     virtual bool PickPhysicalDevice() = 0;
 
 protected:
+    // render 线程每帧调用, 不需要加锁
+    bool IsRunning() const;
+    // 返回 true 表示 SurfaceChanged 之后还没有处理过, 同时清除标记
+    bool ConsumeSurfaceChanged();
+    // 从 SurfaceChanged 到现在的时间, 没有收到过 SurfaceChanged 返回 0
+    double MillisecondsSinceSurfaceChanged() const;
+    // 打开了 GPU profiling 或者 benchmark, 创建 FrameContextRing 之后据此 EnableGpuTimestamps
+    bool GpuTimestampsRequested() const;
+    // render 线程对每次 WaitCurrent 返回的 timing 调用, 交给 benchmark_stats_ 并累计 GPU profiling
+    void AddFrameTiming(const frame_timing_t& timing);
+    // render 线程退出时调用, 没有打开 GPU profiling 时不输出
+    void LogGpuProfile(const char* tag) const;
+
     AAssetManager * asset_manager_;
     ANativeWindow* window_;
 
     pthread_t thread_;
     std::mutex thread_state_mutex_;
-    int thread_state_;
+    std::atomic<int> thread_state_;
+
+    uint32_t frames_in_flight_;
+    FramePacer frame_pacer_;
+    BenchmarkStats benchmark_stats_;
+
+    bool headless_;
+    bool use_headless_surface_;
+    uint32_t headless_width_;
+    uint32_t headless_height_;
+    std::string cache_directory_;
+    bool optimize_mesh_;
+    bool quantize_vertices_;
+    bool compute_mipmaps_;
+    bool kaiser_mipmaps_;
+    bool async_loading_;
+    uint32_t nv12_stream_width_;
+    uint32_t nv12_stream_height_;
+    uint32_t particle_count_;
+    bool gpu_profiling_;
+    // 只在 render 线程访问
+    std::vector<gpu_scope_total_t> gpu_scope_totals_;
+    mutable std::mutex frame_timing_mutex_;
+    frame_timing_t last_frame_timing_;
+
+    std::atomic<bool> surface_changed_;
+    std::atomic<int64_t> surface_changed_ns_;
 };
 
 
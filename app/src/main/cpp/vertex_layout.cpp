@@ -0,0 +1,163 @@
+//
+// Created by hj6231 on 2024/2/16.
+//
+
+#include "vertex_layout.h"
+
+#include <cmath>
+#include <cstring>
+
+static uint16_t ToUnorm16(float value) {
+    value = value < 0.0f ? 0.0f : (value > 1.0f ? 1.0f : value);
+    return static_cast<uint16_t>(std::lround(value * 65535.0f));
+}
+
+static int16_t ToSnorm16(float value) {
+    value = value < -1.0f ? -1.0f : (value > 1.0f ? 1.0f : value);
+    return static_cast<int16_t>(std::lround(value * 32767.0f));
+}
+
+static uint32_t FormatSize(VkFormat format) {
+    switch (format) {
+        case VK_FORMAT_R32G32B32_SFLOAT:
+            return 12;
+        case VK_FORMAT_R32G32_SFLOAT:
+        case VK_FORMAT_R16G16B16A16_UNORM:
+            return 8;
+        case VK_FORMAT_R16G16_UNORM:
+        case VK_FORMAT_R16G16_SNORM:
+            return 4;
+        default:
+            return 0;
+    }
+}
+
+VertexLayout::VertexLayout(bool quantized, bool has_normal) :
+        quantized_(quantized),
+        has_normal_(has_normal),
+        stride_(0),
+        bounds_min_{0.0f, 0.0f, 0.0f},
+        bounds_extent_{1.0f, 1.0f, 1.0f} {
+    elements_.push_back({VERTEX_ATTRIBUTE_POSITION, 0,
+                         quantized_ ? VK_FORMAT_R16G16B16A16_UNORM : VK_FORMAT_R32G32B32_SFLOAT, 0});
+    elements_.push_back({VERTEX_ATTRIBUTE_TEXCOORD, 1,
+                         quantized_ ? VK_FORMAT_R16G16_UNORM : VK_FORMAT_R32G32_SFLOAT, 0});
+    if (has_normal_) {
+        elements_.push_back({VERTEX_ATTRIBUTE_NORMAL, 2,
+                             quantized_ ? VK_FORMAT_R16G16_SNORM : VK_FORMAT_R32G32B32_SFLOAT, 0});
+    }
+    for (auto& element : elements_) {
+        element.offset = stride_;
+        stride_ += FormatSize(element.format);
+    }
+}
+
+bool VertexLayout::quantized() const {
+    return quantized_;
+}
+
+bool VertexLayout::has_normal() const {
+    return has_normal_;
+}
+
+uint32_t VertexLayout::stride() const {
+    return stride_;
+}
+
+const std::vector<vertex_element_t>& VertexLayout::elements() const {
+    return elements_;
+}
+
+VkVertexInputBindingDescription VertexLayout::binding_description(uint32_t binding) const {
+    return VkVertexInputBindingDescription{binding, stride_, VK_VERTEX_INPUT_RATE_VERTEX};
+}
+
+std::vector<VkVertexInputAttributeDescription> VertexLayout::attribute_descriptions(uint32_t binding) const {
+    std::vector<VkVertexInputAttributeDescription> descriptions;
+    for (const auto& element : elements_) {
+        descriptions.push_back({element.location, binding, element.format, element.offset});
+    }
+    return descriptions;
+}
+
+std::vector<mesh_attribute_t> VertexLayout::mesh_attributes() const {
+    std::vector<mesh_attribute_t> attributes;
+    for (const auto& element : elements_) {
+        attributes.push_back({element.location, static_cast<uint32_t>(element.format), element.offset, 0});
+    }
+    return attributes;
+}
+
+void VertexLayout::SetBounds(const float bounds_min[3], const float bounds_max[3]) {
+    for (int k = 0; k < 3; ++k) {
+        bounds_min_[k] = bounds_min[k];
+        // 扁平的方向也要能除
+        bounds_extent_[k] = bounds_max[k] > bounds_min[k] ? bounds_max[k] - bounds_min[k] : 1.0f;
+    }
+}
+
+void VertexLayout::GetDequantizeMatrix(float matrix[16]) const {
+    memset(matrix, 0, sizeof(float) * 16);
+    matrix[15] = 1.0f;
+    for (int k = 0; k < 3; ++k) {
+        matrix[k * 4 + k] = quantized_ ? bounds_extent_[k] : 1.0f;
+        matrix[12 + k] = quantized_ ? bounds_min_[k] : 0.0f;
+    }
+}
+
+bool VertexLayout::EncodeVertex(const float* position, const float* texcoord, const float* normal,
+                                uint8_t* out) const {
+    for (const auto& element : elements_) {
+        uint8_t* dst = out + element.offset;
+        switch (element.attribute) {
+            case VERTEX_ATTRIBUTE_POSITION:
+                if (quantized_) {
+                    uint16_t value[4];
+                    for (int k = 0; k < 3; ++k) {
+                        value[k] = ToUnorm16((position[k] - bounds_min_[k]) / bounds_extent_[k]);
+                    }
+                    value[3] = 0;
+                    memcpy(dst, value, sizeof(value));
+                } else {
+                    memcpy(dst, position, sizeof(float) * 3);
+                }
+                break;
+            case VERTEX_ATTRIBUTE_TEXCOORD:
+                if (quantized_) {
+                    if (texcoord[0] < 0.0f || texcoord[0] > 1.0f || texcoord[1] < 0.0f || texcoord[1] > 1.0f) {
+                        return false;
+                    }
+                    uint16_t value[2] = {ToUnorm16(texcoord[0]), ToUnorm16(texcoord[1])};
+                    memcpy(dst, value, sizeof(value));
+                } else {
+                    memcpy(dst, texcoord, sizeof(float) * 2);
+                }
+                break;
+            case VERTEX_ATTRIBUTE_NORMAL:
+                if (quantized_) {
+                    int16_t value[2];
+                    OctEncode(normal, value);
+                    memcpy(dst, value, sizeof(value));
+                } else {
+                    memcpy(dst, normal, sizeof(float) * 3);
+                }
+                break;
+        }
+    }
+    return true;
+}
+
+void VertexLayout::OctEncode(const float normal[3], int16_t encoded[2]) {
+    // 投影到 |x| + |y| + |z| = 1 的八面体, 下半部分折到外面的三角形
+    float sum = std::fabs(normal[0]) + std::fabs(normal[1]) + std::fabs(normal[2]);
+    float x = sum > 0.0f ? normal[0] / sum : 0.0f;
+    float y = sum > 0.0f ? normal[1] / sum : 0.0f;
+    if (normal[2] < 0.0f) {
+        float folded_x = (1.0f - std::fabs(y)) * (x >= 0.0f ? 1.0f : -1.0f);
+        float folded_y = (1.0f - std::fabs(x)) * (y >= 0.0f ? 1.0f : -1.0f);
+        x = folded_x;
+        y = folded_y;
+    }
+    encoded[0] = ToSnorm16(x);
+    encoded[1] = ToSnorm16(y);
+}
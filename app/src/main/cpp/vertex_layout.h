@@ -0,0 +1,68 @@
+//
+// Created by hj6231 on 2024/2/16.
+//
+
+#pragma once
+#include <cstdint>
+#include <vector>
+#include <vulkan/vulkan.h>
+#include "mesh_file.h"
+
+enum VertexAttribute {
+    VERTEX_ATTRIBUTE_POSITION,
+    VERTEX_ATTRIBUTE_TEXCOORD,
+    VERTEX_ATTRIBUTE_NORMAL,
+};
+
+typedef struct {
+    VertexAttribute attribute;
+    uint32_t location;
+    VkFormat format;
+    uint32_t offset;
+} vertex_element_t;
+
+// 一份 vertex 格式描述, 同时生成 pipeline 的 vertex input 和 vertex 数据的编码, 两边不会不一致.
+// location 依次是 position 0, texcoord 1, normal 2
+// float:     position R32G32B32_SFLOAT, texcoord R32G32_SFLOAT, normal R32G32B32_SFLOAT (20 或 32 字节)
+// quantized: position R16G16B16A16_UNORM, 在包围盒内归一化 (R16G16B16 作为 vertex 格式不保证支持, w 不用);
+//            texcoord R16G16_UNORM, 要求在 [0, 1] 内;
+//            normal R16G16_SNORM 八面体编码 (12 或 16 字节).
+// 量化的 position 在 vertex shader 里是 [0, 1], 乘以 dequantize 矩阵还原, 一般直接乘到 model 矩阵右边.
+// normal 在 shader 里这样还原:
+//   vec3 n = vec3(e.xy, 1.0 - abs(e.x) - abs(e.y));
+//   n.xy = n.z < 0.0 ? (1.0 - abs(n.yx)) * sign(n.xy) : n.xy;
+//   n = normalize(n);
+class VertexLayout {
+public:
+    VertexLayout(bool quantized, bool has_normal);
+    ~VertexLayout() = default;
+
+    bool quantized() const;
+    bool has_normal() const;
+    uint32_t stride() const;
+    const std::vector<vertex_element_t>& elements() const;
+
+    VkVertexInputBindingDescription binding_description(uint32_t binding) const;
+    std::vector<VkVertexInputAttributeDescription> attribute_descriptions(uint32_t binding) const;
+    // 用于和 MeshFile 里的 layout 比较
+    std::vector<mesh_attribute_t> mesh_attributes() const;
+
+    // 量化格式在编码之前设置, position 按这个包围盒归一化
+    void SetBounds(const float bounds_min[3], const float bounds_max[3]);
+    // 列主序 4x4, 把 [0, 1] 的 position 还原到包围盒, float 格式时是单位矩阵
+    void GetDequantizeMatrix(float matrix[16]) const;
+
+    // 编码一个 vertex 到 out (stride() 字节), 没有 normal 时 normal 为 nullptr.
+    // 量化格式的 texcoord 不在 [0, 1] 内时返回 false
+    bool EncodeVertex(const float* position, const float* texcoord, const float* normal, uint8_t* out) const;
+
+    // 单位向量的八面体编码, 结果是 snorm16
+    static void OctEncode(const float normal[3], int16_t encoded[2]);
+private:
+    bool quantized_;
+    bool has_normal_;
+    uint32_t stride_;
+    std::vector<vertex_element_t> elements_;
+    float bounds_min_[3];
+    float bounds_extent_[3];
+};
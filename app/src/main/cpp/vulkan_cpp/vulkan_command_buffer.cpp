@@ -4,10 +4,13 @@
 
 #include "vulkan_command_buffer.h"
 
+const char* const VulkanCommandBuffer::FRAME_TIMESTAMP_SCOPE = "frame";
+
 VulkanCommandBuffer::VulkanCommandBuffer(VkDevice device,
                                          VkCommandPool command_pool,
                                          VkCommandBuffer command_buffer) :
-        device_(device), command_pool_(command_pool), command_buffer_(command_buffer){
+        device_(device), command_pool_(command_pool), command_buffer_(command_buffer),
+        timestamp_query_pool_(VK_NULL_HANDLE), timestamp_query_count_(0), frame_scope_(-1) {
 
 }
 
@@ -23,14 +26,54 @@ VkResult VulkanCommandBuffer::ResetCommandBuffer(VkCommandBufferResetFlags flags
     return vkResetCommandBuffer(command_buffer_, flags);
 }
 
+void VulkanCommandBuffer::SetTimestampQueryPool(VkQueryPool query_pool, uint32_t query_count) {
+    timestamp_query_pool_ = query_pool;
+    timestamp_query_count_ = query_pool != VK_NULL_HANDLE ? query_count : 0;
+    timestamp_scopes_.clear();
+    timestamp_scopes_.reserve(timestamp_query_count_ / 2);
+}
+
 VkResult VulkanCommandBuffer::BeginCommandBuffer(const VkCommandBufferBeginInfo* info) const {
-    return vkBeginCommandBuffer(command_buffer_, info);
+    VkResult ret = vkBeginCommandBuffer(command_buffer_, info);
+    timestamp_scopes_.clear();
+    frame_scope_ = -1;
+    if (ret == VK_SUCCESS && timestamp_query_pool_ != VK_NULL_HANDLE) {
+        vkCmdResetQueryPool(command_buffer_, timestamp_query_pool_, 0, timestamp_query_count_);
+        frame_scope_ = CmdBeginTimestampScope(FRAME_TIMESTAMP_SCOPE);
+    }
+    return ret;
 }
 
 VkResult VulkanCommandBuffer::EndCommandBuffer() const {
+    CmdEndTimestampScope(frame_scope_);
+    frame_scope_ = -1;
     return vkEndCommandBuffer(command_buffer_);
 }
 
+int VulkanCommandBuffer::CmdBeginTimestampScope(const char* name) const {
+    uint32_t begin_query = static_cast<uint32_t>(timestamp_scopes_.size()) * 2;
+    if (timestamp_query_pool_ == VK_NULL_HANDLE || begin_query + 2 > timestamp_query_count_) {
+        return -1;
+    }
+    vkCmdWriteTimestamp(command_buffer_, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, timestamp_query_pool_, begin_query);
+    timestamp_scopes_.push_back(timestamp_scope_t{name, begin_query, false});
+    return static_cast<int>(timestamp_scopes_.size()) - 1;
+}
+
+void VulkanCommandBuffer::CmdEndTimestampScope(int scope) const {
+    if (scope < 0 || scope >= static_cast<int>(timestamp_scopes_.size()) || timestamp_scopes_[scope].ended) {
+        return;
+    }
+    // BOTTOM_OF_PIPE: 前面录制的命令全部执行完才写入
+    vkCmdWriteTimestamp(command_buffer_, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
+                        timestamp_query_pool_, timestamp_scopes_[scope].begin_query + 1);
+    timestamp_scopes_[scope].ended = true;
+}
+
+const std::vector<timestamp_scope_t>& VulkanCommandBuffer::timestamp_scopes() const {
+    return timestamp_scopes_;
+}
+
 void VulkanCommandBuffer::CmdBeginRenderPass(const VkRenderPassBeginInfo* info, VkSubpassContents contents) const {
     vkCmdBeginRenderPass(command_buffer_, info, contents);
 }
@@ -83,10 +126,15 @@ void VulkanCommandBuffer::CmdPipelineBarrier(VkPipelineStageFlags src_stage_mask
                          image_memory_barrier_count, image_memory_barriers);
 }
 
+void VulkanCommandBuffer::CmdCopyBuffer(VkBuffer src_buffer, VkBuffer dst_buffer,
+                                        uint32_t region_count, const VkBufferCopy* regions) const {
+    vkCmdCopyBuffer(command_buffer_, src_buffer, dst_buffer, region_count, regions);
+}
+
 void VulkanCommandBuffer::CmdCopyBufferToImage(VkBuffer src_buffer, VkImage dst_image,
                                                VkImageLayout dst_image_layout,
                                                uint32_t region_count,
-                                               const VkBufferImageCopy* regions) {
+                                               const VkBufferImageCopy* regions) const {
     vkCmdCopyBufferToImage(command_buffer_, src_buffer, dst_image,
                            dst_image_layout, region_count, regions);
 }
@@ -96,6 +144,16 @@ void VulkanCommandBuffer::CmdBlitImage(VkImage src, VkImageLayout src_layout, Vk
     vkCmdBlitImage(command_buffer_, src, src_layout, dst, dst_layout, region_count, regions, filter);
 }
 
+void VulkanCommandBuffer::CmdCopyImageToBuffer(VkImage src_image, VkImageLayout src_image_layout, VkBuffer dst_buffer,
+                                               uint32_t region_count, const VkBufferImageCopy* regions) const {
+    vkCmdCopyImageToBuffer(command_buffer_, src_image, src_image_layout, dst_buffer, region_count, regions);
+}
+
+void VulkanCommandBuffer::CmdPushConstants(VkPipelineLayout layout, VkShaderStageFlags stage_flags,
+                                           uint32_t offset, uint32_t size, const void* values) const {
+    vkCmdPushConstants(command_buffer_, layout, stage_flags, offset, size, values);
+}
+
 void VulkanCommandBuffer::CmdDispatch(uint32_t group_count_x, uint32_t group_count_y, uint32_t group_count_z) const {
     vkCmdDispatch(command_buffer_, group_count_x, group_count_y, group_count_z);
 }
@@ -115,4 +173,11 @@ void VulkanCommandBuffer::CmdDraw(uint32_t vertex_count, uint32_t instance_count
 void VulkanCommandBuffer::CmdDrawIndexed(uint32_t index_count, uint32_t instance_count, uint32_t first_index,
                                          int32_t vertex_offset, uint32_t first_instance) const {
     vkCmdDrawIndexed(command_buffer_, index_count, instance_count, first_index, vertex_offset, first_instance);
-}
\ No newline at end of file
+}
+void VulkanCommandBuffer::CmdResetQueryPool(VkQueryPool query_pool, uint32_t first_query, uint32_t query_count) const {
+    vkCmdResetQueryPool(command_buffer_, query_pool, first_query, query_count);
+}
+
+void VulkanCommandBuffer::CmdWriteTimestamp(VkPipelineStageFlagBits pipeline_stage, VkQueryPool query_pool, uint32_t query) const {
+    vkCmdWriteTimestamp(command_buffer_, pipeline_stage, query_pool, query);
+}
@@ -3,8 +3,17 @@
 //
 
 #pragma once
+#include <vector>
 #include <vulkan/vulkan.h>
 
+// 一段 GPU 计时区间, 占用 query pool 里 begin_query 和 begin_query + 1 两个 timestamp
+typedef struct {
+    // 只保存指针, 需要是字符串常量
+    const char* name;
+    uint32_t begin_query;
+    bool ended;
+} timestamp_scope_t;
+
 class VulkanCommandBuffer {
 public:
     VulkanCommandBuffer(VkDevice device, VkCommandPool command_pool, VkCommandBuffer command_buffer);
@@ -15,6 +24,16 @@ public:
 
     VkResult ResetCommandBuffer(VkCommandBufferResetFlags flags);
 
+    // 设置后 BeginCommandBuffer 会 reset 整个 query pool, 并打开名为 FRAME_TIMESTAMP_SCOPE 的
+    // 第 0 个 scope, EndCommandBuffer 关闭它. query_pool 为 VK_NULL_HANDLE 时关闭计时
+    void SetTimestampQueryPool(VkQueryPool query_pool, uint32_t query_count);
+    // 在当前位置写一个 timestamp, 返回 scope id. 没有设置 query pool 或者 query 用完时返回 -1,
+    // CmdEndTimestampScope 会忽略 -1, 调用的地方不需要判断
+    int CmdBeginTimestampScope(const char* name) const;
+    void CmdEndTimestampScope(int scope) const;
+    // 上一次录制的 scope, 下一次 BeginCommandBuffer 时清空
+    const std::vector<timestamp_scope_t>& timestamp_scopes() const;
+
     VkResult BeginCommandBuffer(const VkCommandBufferBeginInfo* info) const;
     VkResult EndCommandBuffer() const;
     void CmdBeginRenderPass(const VkRenderPassBeginInfo* info, VkSubpassContents contents) const;
@@ -47,19 +66,37 @@ public:
                             uint32_t image_memory_barrier_count,
                             const VkImageMemoryBarrier* image_memory_barriers) const;
 
+    void CmdCopyBuffer(VkBuffer src_buffer, VkBuffer dst_buffer,
+                       uint32_t region_count, const VkBufferCopy* regions) const;
     void CmdCopyBufferToImage(VkBuffer src_buffer, VkImage dst_image,
                               VkImageLayout dst_image_layout,
                               uint32_t region_count,
-                              const VkBufferImageCopy* regions);
+                              const VkBufferImageCopy* regions) const;
     void CmdBlitImage(VkImage src, VkImageLayout src_layout, VkImage dst, VkImageLayout dst_layout,
                       uint32_t region_count, const VkImageBlit* regions, VkFilter filter);
+    void CmdCopyImageToBuffer(VkImage src_image, VkImageLayout src_image_layout, VkBuffer dst_buffer,
+                              uint32_t region_count, const VkBufferImageCopy* regions) const;
+
+    void CmdPushConstants(VkPipelineLayout layout, VkShaderStageFlags stage_flags,
+                          uint32_t offset, uint32_t size, const void* values) const;
 
     void CmdDispatch(uint32_t group_count_x, uint32_t group_count_y, uint32_t group_count_z) const;
+
+    void CmdResetQueryPool(VkQueryPool query_pool, uint32_t first_query, uint32_t query_count) const;
+    void CmdWriteTimestamp(VkPipelineStageFlagBits pipeline_stage, VkQueryPool query_pool, uint32_t query) const;
     VulkanCommandBuffer& operator = (const VulkanCommandBuffer&) = delete;
+
+    static const char* const FRAME_TIMESTAMP_SCOPE;
 private:
     VkDevice device_;
     VkCommandPool command_pool_;
     VkCommandBuffer command_buffer_;
+
+    VkQueryPool timestamp_query_pool_;
+    uint32_t timestamp_query_count_;
+    // Draw 拿到的是 const VulkanCommandBuffer*, 录制时也要能记录 scope
+    mutable std::vector<timestamp_scope_t> timestamp_scopes_;
+    mutable int frame_scope_;
 };
 
 
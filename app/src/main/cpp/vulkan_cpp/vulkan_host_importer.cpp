@@ -0,0 +1,118 @@
+//
+// Created by hj6231 on 2024/2/16.
+//
+
+#include "vulkan_host_importer.h"
+
+#include <unistd.h>
+#include "log.h"
+#include "vulkan_logic_device.h"
+
+VulkanHostImporter::VulkanHostImporter(VulkanLogicDevice* device, VkDeviceSize alignment) :
+        device_(device),
+        alignment_(alignment),
+        page_size_(static_cast<VkDeviceSize>(sysconf(_SC_PAGESIZE))),
+        stats_{} {
+}
+
+bool VulkanHostImporter::Import(const void* data, VkDeviceSize size, VkBufferUsageFlags usage,
+                                host_import_t* import) {
+    *import = host_import_t{};
+    // alignment 比页大时扩展出来的部分可能没有 map, import 会失败或者读到别的映射
+    if (data == nullptr || size == 0 || alignment_ == 0 || alignment_ > page_size_) {
+        Reject();
+        return false;
+    }
+    auto address = reinterpret_cast<uintptr_t>(data);
+    uintptr_t begin = address / alignment_ * alignment_;
+    uintptr_t end = (address + size + alignment_ - 1) / alignment_ * alignment_;
+    void* host_pointer = reinterpret_cast<void*>(begin);
+    VkDeviceSize import_size = end - begin;
+
+    VkMemoryHostPointerPropertiesEXT pointer_properties{};
+    pointer_properties.sType = VK_STRUCTURE_TYPE_MEMORY_HOST_POINTER_PROPERTIES_EXT;
+    if (device_->GetMemoryHostPointerProperties(host_pointer, &pointer_properties) != VK_SUCCESS) {
+        Reject();
+        return false;
+    }
+    VkExternalMemoryBufferCreateInfo external_info{};
+    external_info.sType = VK_STRUCTURE_TYPE_EXTERNAL_MEMORY_BUFFER_CREATE_INFO;
+    external_info.handleTypes = VK_EXTERNAL_MEMORY_HANDLE_TYPE_HOST_ALLOCATION_BIT_EXT;
+    VkBufferCreateInfo buffer_info{};
+    buffer_info.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+    buffer_info.pNext = &external_info;
+    buffer_info.size = import_size;
+    buffer_info.usage = usage;
+    buffer_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+    VulkanBuffer* buffer = device_->CreateBuffer(&buffer_info);
+    if (buffer == nullptr) {
+        Reject();
+        return false;
+    }
+    VkMemoryRequirements requirements{};
+    buffer->GetBufferMemoryRequirements(&requirements);
+    // 只用 coherent 的类型, CPU 之后写进来的内容在 submit 时自动可见, 不需要 flush
+    VkPhysicalDeviceMemoryProperties memory_properties{};
+    device_->GetPhysicalDeviceMemoryProperties(&memory_properties);
+    uint32_t type_index = 0;
+    if (requirements.size > import_size ||
+            VulkanLogicDevice::GetMemoryType(&memory_properties,
+                                             requirements.memoryTypeBits & pointer_properties.memoryTypeBits,
+                                             VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, &type_index) != VK_SUCCESS) {
+        VulkanLogicDevice::DestroyBuffer(&buffer);
+        Reject();
+        return false;
+    }
+    VkImportMemoryHostPointerInfoEXT import_info{};
+    import_info.sType = VK_STRUCTURE_TYPE_IMPORT_MEMORY_HOST_POINTER_INFO_EXT;
+    import_info.handleType = VK_EXTERNAL_MEMORY_HANDLE_TYPE_HOST_ALLOCATION_BIT_EXT;
+    import_info.pHostPointer = host_pointer;
+    VkMemoryAllocateInfo allocate_info{};
+    allocate_info.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+    allocate_info.pNext = &import_info;
+    allocate_info.allocationSize = import_size;
+    allocate_info.memoryTypeIndex = type_index;
+    VulkanMemory* memory = device_->AllocateMemory(&allocate_info);
+    if (memory == nullptr || memory->BindBufferMemory(buffer->buffer(), 0) != VK_SUCCESS) {
+        VulkanLogicDevice::FreeMemory(&memory);
+        VulkanLogicDevice::DestroyBuffer(&buffer);
+        Reject();
+        return false;
+    }
+    import->buffer = buffer;
+    import->memory = memory;
+    import->offset = address - begin;
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    ++stats_.imports;
+    stats_.imported_bytes += import_size;
+    return true;
+}
+
+void VulkanHostImporter::Release(host_import_t* import) {
+    // buffer 先于它绑定的内存销毁
+    VulkanLogicDevice::DestroyBuffer(&import->buffer);
+    VulkanLogicDevice::FreeMemory(&import->memory);
+    import->offset = 0;
+}
+
+VkDeviceSize VulkanHostImporter::alignment() const {
+    return alignment_;
+}
+
+host_import_stats_t VulkanHostImporter::stats() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return stats_;
+}
+
+void VulkanHostImporter::LogStats(const char* tag) const {
+    host_import_stats_t stats = this->stats();
+    LOG_D(tag, "host import: %llu imports, %.2f MiB, %llu rejected, alignment %llu\n",
+          (long long unsigned int) stats.imports, stats.imported_bytes / (1024.0 * 1024.0),
+          (long long unsigned int) stats.rejected, (long long unsigned int) alignment_);
+}
+
+void VulkanHostImporter::Reject() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    ++stats_.rejected;
+}
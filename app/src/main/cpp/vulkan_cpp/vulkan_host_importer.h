@@ -0,0 +1,57 @@
+//
+// Created by hj6231 on 2024/2/16.
+//
+
+#pragma once
+#include <mutex>
+#include <vulkan/vulkan.h>
+#include "vulkan_buffer.h"
+#include "vulkan_memory.h"
+
+class VulkanLogicDevice;
+
+// import 进来的一段 host 内存. buffer 覆盖按 minImportedHostPointerAlignment 扩展之后的整段,
+// 调用者传入的 data 在 buffer 里的偏移是 offset
+typedef struct {
+    VulkanBuffer* buffer;
+    VulkanMemory* memory;
+    VkDeviceSize offset;
+} host_import_t;
+
+typedef struct {
+    uint64_t imports;
+    uint64_t imported_bytes;
+    // 对齐扩展超出 data 所在的页, 没有兼容的 memory type, 或者 driver 拒绝, 调用者退回复制的次数
+    uint64_t rejected;
+} host_import_stats_t;
+
+// VK_EXT_external_memory_host: 把已经在 CPU 上的内存 (mmap 的文件, 解码器的输出 buffer) 直接 import 成
+// transfer src buffer, copy 到 image 时 GPU 直接读这段内存, 省掉复制到 staging 的一次 memcpy.
+// 由 VulkanLogicDevice::EnableHostImport 创建, 可以在多个线程调用
+class VulkanHostImporter {
+public:
+    VulkanHostImporter(VulkanLogicDevice* device, VkDeviceSize alignment);
+    VulkanHostImporter(const VulkanHostImporter&) = delete;
+    ~VulkanHostImporter() = default;
+
+    // [data, data + size) 在 import 的整个生命期内必须保持 map, 内容可以继续由 CPU 写.
+    // 起点和结尾按 alignment 向外扩展, alignment 不超过页大小时扩展的部分和 data 在同一页, 一定是 map 的.
+    // 失败时返回 false, 调用者退回复制到 staging
+    bool Import(const void* data, VkDeviceSize size, VkBufferUsageFlags usage, host_import_t* import);
+    // 调用者保证使用这个 buffer 的命令都已经执行完
+    static void Release(host_import_t* import);
+
+    VkDeviceSize alignment() const;
+    host_import_stats_t stats() const;
+    void LogStats(const char* tag) const;
+
+    VulkanHostImporter& operator = (const VulkanHostImporter&) = delete;
+private:
+    void Reject();
+
+    VulkanLogicDevice* device_;
+    VkDeviceSize alignment_;
+    VkDeviceSize page_size_;
+    mutable std::mutex mutex_;
+    host_import_stats_t stats_;
+};
@@ -117,6 +117,7 @@ void VulkanInstance::DestroyDebugReportCallbackEXT(VkDebugReportCallbackEXT call
     }
 }
 
+#ifdef VK_USE_PLATFORM_ANDROID_KHR
 VulkanSurface* VulkanInstance::CreateAndroidSurface(const VkAndroidSurfaceCreateInfoKHR* info) const {
     VkSurfaceKHR surface;
     VkResult ret = vkCreateAndroidSurfaceKHR(vk_instance_, info, nullptr, &surface);
@@ -125,8 +126,25 @@ VulkanSurface* VulkanInstance::CreateAndroidSurface(const VkAndroidSurfaceCreate
     }
     return nullptr;
 }
+#endif
 
-void VulkanInstance::DestroyAndroidSurface(VulkanSurface** surface) {
+VulkanSurface* VulkanInstance::CreateHeadlessSurface(const VkHeadlessSurfaceCreateInfoEXT* info) const {
+    auto func = (PFN_vkCreateHeadlessSurfaceEXT) vkGetInstanceProcAddr(vk_instance_,
+                                                                       "vkCreateHeadlessSurfaceEXT");
+    if (func == nullptr) {
+        LOG_E("VulkanInstance", "vkCreateHeadlessSurfaceEXT not present\n");
+        return nullptr;
+    }
+    VkSurfaceKHR surface;
+    VkResult ret = func(vk_instance_, info, nullptr, &surface);
+    if (ret == VK_SUCCESS) {
+        return new VulkanSurface(vk_instance_, surface);
+    }
+    LOG_E("VulkanInstance", "vkCreateHeadlessSurfaceEXT failed, ret = %d\n", ret);
+    return nullptr;
+}
+
+void VulkanInstance::DestroySurface(VulkanSurface** surface) {
     if (*surface) {
         delete *surface;
         *surface = nullptr;
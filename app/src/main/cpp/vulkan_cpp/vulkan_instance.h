@@ -28,8 +28,12 @@ public:
                                            VkDebugReportCallbackEXT* callback) const;
     void DestroyDebugReportCallbackEXT(VkDebugReportCallbackEXT callback) const;
 
+#ifdef VK_USE_PLATFORM_ANDROID_KHR
     VulkanSurface* CreateAndroidSurface(const VkAndroidSurfaceCreateInfoKHR* info) const;
-    static void DestroyAndroidSurface(VulkanSurface** surface);
+#endif
+    // VK_EXT_headless_surface, 没有窗口时也能创建 swap chain
+    VulkanSurface* CreateHeadlessSurface(const VkHeadlessSurfaceCreateInfoEXT* info) const;
+    static void DestroySurface(VulkanSurface** surface);
 private:
     VulkanInstance();
     VulkanInstance(const VulkanInstance&) = delete;
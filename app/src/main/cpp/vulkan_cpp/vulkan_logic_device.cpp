@@ -4,12 +4,37 @@
 
 #include "vulkan_logic_device.h"
 
-VulkanLogicDevice::VulkanLogicDevice(VkPhysicalDevice physical_device, VkDevice device) :
-        physical_device_(physical_device), device_(device) {
+#include <cassert>
 
+VulkanLogicDevice::VulkanLogicDevice(VkPhysicalDevice physical_device, VkDevice device) :
+        physical_device_(physical_device), device_(device),
+        memory_allocator_(new VulkanMemoryAllocator(physical_device, device)),
+        staging_ring_(nullptr),
+        host_importer_(nullptr),
+        pipeline_cache_(new VulkanPipelineCache(physical_device, device)) {
+    int ret = pipeline_cache_->Create();
+    assert(ret == 0);
+    (void)ret;
 }
 
 VulkanLogicDevice::~VulkanLogicDevice() {
+    // staging ring 的内存也来自 allocator
+    if (staging_ring_ != nullptr) {
+        staging_ring_->LogStats("VulkanLogicDevice");
+    }
+    delete staging_ring_;
+    staging_ring_ = nullptr;
+    // import 的内存不来自 allocator, 但也要在 device 之前释放
+    if (host_importer_ != nullptr) {
+        host_importer_->LogStats("VulkanLogicDevice");
+    }
+    delete host_importer_;
+    host_importer_ = nullptr;
+    delete pipeline_cache_;
+    pipeline_cache_ = nullptr;
+    // 所有 VulkanMemory 都要在这之前释放
+    delete memory_allocator_;
+    memory_allocator_ = nullptr;
     if (device_ != nullptr) {
         vkDestroyDevice(device_, nullptr);
         device_ = nullptr;
@@ -184,8 +209,7 @@ void VulkanLogicDevice::DestroyPipelineLayout(VulkanPipelineLayout** pipeline_la
 
 VulkanPipeline* VulkanLogicDevice::CreateGraphicPipeline(const VkGraphicsPipelineCreateInfo *info) const {
     VkPipeline pipeline;
-    VkResult ret = vkCreateGraphicsPipelines(device_, VK_NULL_HANDLE, 1,
-                                     info, nullptr, &pipeline);
+    VkResult ret = pipeline_cache_->CreateGraphicsPipeline(info, &pipeline);
     if (ret == VK_SUCCESS) {
         return new VulkanPipeline(device_, pipeline);
     }
@@ -194,12 +218,7 @@ VulkanPipeline* VulkanLogicDevice::CreateGraphicPipeline(const VkGraphicsPipelin
 
 VulkanPipeline* VulkanLogicDevice::CreateComputePipeline(const VkComputePipelineCreateInfo *info) const {
     VkPipeline pipeline;
-    VkResult ret = vkCreateComputePipelines(device_,
-                                            VK_NULL_HANDLE,
-                                            1,
-                                            info,
-                                            nullptr,
-                                            &pipeline);
+    VkResult ret = pipeline_cache_->CreateComputePipeline(info, &pipeline);
     if (ret == VK_SUCCESS) {
         return new VulkanPipeline(device_, pipeline);
     }
@@ -213,6 +232,10 @@ void VulkanLogicDevice::DestroyPipelines(VulkanPipeline** pipeline) {
     }
 }
 
+VulkanPipelineCache* VulkanLogicDevice::pipeline_cache() const {
+    return pipeline_cache_;
+}
+
 VulkanFrameBuffer*  VulkanLogicDevice::CreateFrameBuffer(const VkFramebufferCreateInfo *info) const {
     VkFramebuffer framebuffer;
     VkResult ret = vkCreateFramebuffer(device_, info, nullptr, &framebuffer);
@@ -285,6 +308,26 @@ VkResult VulkanLogicDevice::ResetFences(uint32_t fence_count, const VkFence* fen
     return vkResetFences(device_, fence_count, fences);
 }
 
+VkResult VulkanLogicDevice::GetFenceStatus(VkFence fence) const {
+    return vkGetFenceStatus(device_, fence);
+}
+
+VulkanQueryPool* VulkanLogicDevice::CreateQueryPool(const VkQueryPoolCreateInfo* info) const {
+    VkQueryPool query_pool;
+    VkResult ret = vkCreateQueryPool(device_, info, nullptr, &query_pool);
+    if (ret == VK_SUCCESS) {
+        return new VulkanQueryPool(device_, query_pool, info->queryCount);
+    }
+    return nullptr;
+}
+
+void VulkanLogicDevice::DestroyQueryPool(VulkanQueryPool** query_pool) {
+    if (*query_pool) {
+        delete *query_pool;
+        *query_pool = nullptr;
+    }
+}
+
 VulkanBuffer* VulkanLogicDevice::CreateBuffer(const VkBufferCreateInfo *info) const {
     VkBuffer vertex_buffer;
     VkResult ret = vkCreateBuffer(device_, info, nullptr, &vertex_buffer);
@@ -310,6 +353,49 @@ VulkanMemory* VulkanLogicDevice::AllocateMemory(const VkMemoryAllocateInfo *info
     return nullptr;
 }
 
+VulkanMemory* VulkanLogicDevice::AllocateBufferMemory(const VulkanBuffer* buffer, VulkanMemoryUsage usage) const {
+    return memory_allocator_->AllocateBufferMemory(buffer->buffer(), usage);
+}
+
+VulkanMemory* VulkanLogicDevice::AllocateImageMemory(const VulkanImage* image, VulkanMemoryUsage usage) const {
+    return memory_allocator_->AllocateImageMemory(image->image(), usage);
+}
+
+VulkanMemoryAllocator* VulkanLogicDevice::memory_allocator() const {
+    return memory_allocator_;
+}
+
+VulkanStagingRing* VulkanLogicDevice::staging_ring() {
+    if (staging_ring_ == nullptr) {
+        staging_ring_ = new VulkanStagingRing(this, VulkanStagingRing::DEFAULT_SIZE);
+        if (staging_ring_->Create() < 0) {
+            delete staging_ring_;
+            staging_ring_ = nullptr;
+        }
+    }
+    assert(staging_ring_);
+    return staging_ring_;
+}
+
+void VulkanLogicDevice::EnableHostImport(VkDeviceSize alignment) {
+    assert(host_importer_ == nullptr);
+    host_importer_ = new VulkanHostImporter(this, alignment);
+}
+
+VulkanHostImporter* VulkanLogicDevice::host_importer() const {
+    return host_importer_;
+}
+
+VkResult VulkanLogicDevice::GetMemoryHostPointerProperties(const void* host_pointer,
+                                                           VkMemoryHostPointerPropertiesEXT* properties) const {
+    auto func = (PFN_vkGetMemoryHostPointerPropertiesEXT) vkGetDeviceProcAddr(device_,
+                                                                                "vkGetMemoryHostPointerPropertiesEXT");
+    if (func == nullptr) {
+        return VK_ERROR_EXTENSION_NOT_PRESENT;
+    }
+    return func(device_, VK_EXTERNAL_MEMORY_HANDLE_TYPE_HOST_ALLOCATION_BIT_EXT, host_pointer, properties);
+}
+
 void VulkanLogicDevice::FreeMemory(VulkanMemory** memory) {
     if (*memory) {
         delete *memory;
@@ -321,10 +407,18 @@ VkResult VulkanLogicDevice::DeviceWaitIdle() const {
     return vkDeviceWaitIdle(device_);
 }
 
+void VulkanLogicDevice::GetPhysicalDeviceProperties(VkPhysicalDeviceProperties* properties) const {
+    vkGetPhysicalDeviceProperties(physical_device_, properties);
+}
+
 void VulkanLogicDevice::GetPhysicalDeviceMemoryProperties(VkPhysicalDeviceMemoryProperties* mem_properties) const {
     vkGetPhysicalDeviceMemoryProperties(physical_device_, mem_properties);
 }
 
+void VulkanLogicDevice::GetPhysicalDeviceFormatProperties(VkFormat format, VkFormatProperties* format_properties) const {
+    vkGetPhysicalDeviceFormatProperties(physical_device_, format, format_properties);
+}
+
 VkResult VulkanLogicDevice::GetMemoryType(const VkPhysicalDeviceMemoryProperties* mem_properties, uint32_t type_filter, VkMemoryPropertyFlags property_flags, uint32_t* type_index) {
     for (uint32_t i = 0; i < mem_properties->memoryTypeCount; i++) {
         if ((type_filter & (1 << i)) && (mem_properties->memoryTypes[i].propertyFlags & property_flags) == property_flags) {
@@ -16,14 +16,19 @@
 #include "vulkan_pipeline_layout.h"
 #include "vulkan_render_pass.h"
 #include "vulkan_pipeline.h"
+#include "vulkan_pipeline_cache.h"
 #include "vulkan_semaphore.h"
 #include "vulkan_fence.h"
 #include "vulkan_buffer.h"
 #include "vulkan_memory.h"
+#include "vulkan_memory_allocator.h"
+#include "vulkan_staging_ring.h"
+#include "vulkan_host_importer.h"
 #include "vulkan_descriptor_set_layout.h"
 #include "vulkan_descriptor_pool.h"
 #include "vulkan_sampler.h"
 #include "vulkan_sampler_ycbcr_conversion.h"
+#include "vulkan_query_pool.h"
 
 class VulkanLogicDevice {
 public:
@@ -61,9 +66,12 @@ public:
 
     VulkanPipelineLayout* CreatePipelineLayout(const VkPipelineLayoutCreateInfo *info) const;
     static void DestroyPipelineLayout(VulkanPipelineLayout** pipeline_layout);
+    // 都经过 pipeline_cache(), 可以在多个线程同时调用
     VulkanPipeline* CreateGraphicPipeline(const VkGraphicsPipelineCreateInfo *info) const;
     VulkanPipeline* CreateComputePipeline(const VkComputePipelineCreateInfo *info) const;
     static void DestroyPipelines(VulkanPipeline** pipeline);
+    // 设备销毁时如果 Open 过文件会写回去
+    VulkanPipelineCache* pipeline_cache() const;
 
     VulkanFrameBuffer* CreateFrameBuffer(const VkFramebufferCreateInfo *info) const;
     static void DestroyFrameBuffer(VulkanFrameBuffer** framebuffer);
@@ -76,15 +84,32 @@ public:
     static void DestroyFence(VulkanFence** fence);
     VkResult WaitForFences(uint32_t fence_count, const VkFence* fences, VkBool32 wait_all, uint64_t timeout_ns) const;
     VkResult ResetFences(uint32_t fence_count, const VkFence* fences) const;
+    VkResult GetFenceStatus(VkFence fence) const;
+    VulkanQueryPool* CreateQueryPool(const VkQueryPoolCreateInfo* info) const;
+    static void DestroyQueryPool(VulkanQueryPool** query_pool);
 
     VulkanBuffer* CreateBuffer(const VkBufferCreateInfo *info) const;
     static void DestroyBuffer(VulkanBuffer** buffer);
+    // 单独一次 vkAllocateMemory, 只给 import 之类需要自己填 pNext 的情况用
     VulkanMemory* AllocateMemory(const VkMemoryAllocateInfo *info) const;
+    // 按用途从 memory allocator 里分配, 返回后再 BindBufferMemory/BindImageMemory(..., 0)
+    VulkanMemory* AllocateBufferMemory(const VulkanBuffer* buffer, VulkanMemoryUsage usage) const;
+    VulkanMemory* AllocateImageMemory(const VulkanImage* image, VulkanMemoryUsage usage) const;
     static void FreeMemory(VulkanMemory** memory);
+    VulkanMemoryAllocator* memory_allocator() const;
+    // 第一次使用时创建, 纹理和 buffer 上传都从这里拿 staging 内存
+    VulkanStagingRing* staging_ring();
+    // 设备创建时打开了 VK_EXT_external_memory_host 才调用, alignment 是 minImportedHostPointerAlignment
+    void EnableHostImport(VkDeviceSize alignment);
+    // 没有 EnableHostImport 时返回 nullptr, 调用者退回复制到 staging
+    VulkanHostImporter* host_importer() const;
+    VkResult GetMemoryHostPointerProperties(const void* host_pointer, VkMemoryHostPointerPropertiesEXT* properties) const;
 
     VkResult DeviceWaitIdle() const;
 
+    void GetPhysicalDeviceProperties(VkPhysicalDeviceProperties* properties) const;
     void GetPhysicalDeviceMemoryProperties(VkPhysicalDeviceMemoryProperties* mem_properties) const;
+    void GetPhysicalDeviceFormatProperties(VkFormat format, VkFormatProperties* format_properties) const;
     static VkResult GetMemoryType(const VkPhysicalDeviceMemoryProperties* mem_properties, uint32_t type_filter, VkMemoryPropertyFlags property_flags, uint32_t* type_index);
 
     VulkanImage* CreateImage(const VkImageCreateInfo* info);
@@ -99,4 +124,8 @@ public:
 private:
     VkPhysicalDevice physical_device_;
     VkDevice device_;
+    VulkanMemoryAllocator* memory_allocator_;
+    VulkanStagingRing* staging_ring_;
+    VulkanHostImporter* host_importer_;
+    VulkanPipelineCache* pipeline_cache_;
 };
@@ -3,32 +3,66 @@
 //
 
 #include "vulkan_memory.h"
+#include "vulkan_memory_allocator.h"
 
 
 VulkanMemory::VulkanMemory(VkDevice device, VkDeviceMemory device_memory) :
-        device_(device), device_memory_(device_memory) {
+        device_(device), device_memory_(device_memory), offset_(0), size_(VK_WHOLE_SIZE),
+        mapped_(nullptr), allocator_(nullptr), block_(nullptr) {
+}
+
+VulkanMemory::VulkanMemory(VkDevice device, VkDeviceMemory device_memory, VkDeviceSize offset, VkDeviceSize size,
+                           void* mapped, VulkanMemoryAllocator* allocator, VulkanMemoryBlock* block) :
+        device_(device), device_memory_(device_memory), offset_(offset), size_(size),
+        mapped_(mapped), allocator_(allocator), block_(block) {
 }
 
 VulkanMemory::~VulkanMemory() {
-    vkFreeMemory(device_, device_memory_, nullptr);
+    if (allocator_ != nullptr) {
+        allocator_->Free(this);
+    } else {
+        vkFreeMemory(device_, device_memory_, nullptr);
+    }
 }
 
 VkDeviceMemory VulkanMemory::device_memory() const {
     return device_memory_;
 }
 
+VkDeviceSize VulkanMemory::offset() const {
+    return offset_;
+}
+
+VkDeviceSize VulkanMemory::size() const {
+    return size_;
+}
+
+VulkanMemoryBlock* VulkanMemory::block() const {
+    return block_;
+}
+
+void* VulkanMemory::mapped() const {
+    return mapped_;
+}
+
 VkResult VulkanMemory::BindBufferMemory(VkBuffer buffer, VkDeviceSize memory_offset) const {
-    return vkBindBufferMemory(device_, buffer, device_memory_, memory_offset);
+    return vkBindBufferMemory(device_, buffer, device_memory_, offset_ + memory_offset);
 }
 
 VkResult VulkanMemory::BindImageMemory(VkImage image, VkDeviceSize memory_offset) const {
-    return vkBindImageMemory(device_, image, device_memory_, memory_offset);
+    return vkBindImageMemory(device_, image, device_memory_, offset_ + memory_offset);
 }
 
 VkResult VulkanMemory::MapMemory(VkDeviceSize offset, VkDeviceSize size, void** data) {
-    return vkMapMemory(device_, device_memory_, offset, size, 0, data);
+    if (mapped_ != nullptr) {
+        *data = static_cast<char*>(mapped_) + offset;
+        return VK_SUCCESS;
+    }
+    return vkMapMemory(device_, device_memory_, offset_ + offset, size, 0, data);
 }
 
 void VulkanMemory::UnmapMemory() {
-    vkUnmapMemory(device_, device_memory_);
-}
\ No newline at end of file
+    if (mapped_ == nullptr) {
+        vkUnmapMemory(device_, device_memory_);
+    }
+}
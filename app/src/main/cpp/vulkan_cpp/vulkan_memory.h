@@ -5,22 +5,39 @@
 #pragma once
 #include <vulkan/vulkan.h>
 
+class VulkanMemoryAllocator;
+class VulkanMemoryBlock;
 
 class VulkanMemory {
 public:
     VulkanMemory(VkDevice device, VkDeviceMemory device_memory);
+    // VulkanMemoryAllocator 分出来的一段 [offset, offset + size), 析构时还给 allocator.
+    // block 为 nullptr 表示 dedicated allocation. mapped 是这一段在 CPU 上的地址, 不可 map 时为 nullptr
+    VulkanMemory(VkDevice device, VkDeviceMemory device_memory, VkDeviceSize offset, VkDeviceSize size,
+                 void* mapped, VulkanMemoryAllocator* allocator, VulkanMemoryBlock* block);
     VulkanMemory(const VulkanMemory&) = delete;
     ~VulkanMemory();
 
     VkDeviceMemory device_memory() const;
+    VkDeviceSize offset() const;
+    VkDeviceSize size() const;
+    VulkanMemoryBlock* block() const;
+    void* mapped() const;
+    // memory_offset 都是相对于这一段的开头
     VkResult BindBufferMemory(VkBuffer buffer, VkDeviceSize memory_offset) const;
     VkResult BindImageMemory(VkImage image, VkDeviceSize memory_offset) const;
+    // 持久 map 的内存直接返回地址, UnmapMemory 什么都不做
     VkResult MapMemory(VkDeviceSize offset, VkDeviceSize size, void** data);
     void UnmapMemory();
     VulkanMemory& operator = (const VulkanMemory&) = delete;
 private:
     VkDevice device_;
     VkDeviceMemory device_memory_;
+    VkDeviceSize offset_;
+    VkDeviceSize size_;
+    void* mapped_;
+    VulkanMemoryAllocator* allocator_;
+    VulkanMemoryBlock* block_;
 };
 
 
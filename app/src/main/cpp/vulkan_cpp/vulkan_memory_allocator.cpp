@@ -0,0 +1,450 @@
+//
+// Created by hj6231 on 2024/2/9.
+//
+
+#include "vulkan_memory_allocator.h"
+
+#include <cassert>
+#include "log.h"
+
+// heap 至少这么大时 block 用 DEFAULT_BLOCK_SIZE, 小的 heap 用 heap 的 1/8
+static const VkDeviceSize LARGE_HEAP_SIZE = 1024ull * 1024 * 1024;
+static const VkDeviceSize DEFAULT_BLOCK_SIZE = 64ull * 1024 * 1024;
+static const VkDeviceSize MIN_BLOCK_SIZE = 1024ull * 1024;
+
+static VkDeviceSize RoundDownPowerOfTwo(VkDeviceSize value) {
+    VkDeviceSize result = 1;
+    while (result <= value / 2) {
+        result <<= 1;
+    }
+    return result;
+}
+
+static double ToMiB(VkDeviceSize bytes) {
+    return bytes / (1024.0 * 1024.0);
+}
+
+VulkanMemoryBlock::VulkanMemoryBlock(uint32_t pool, VkDeviceMemory device_memory, VkDeviceSize size, void* mapped) :
+        pool_(pool),
+        device_memory_(device_memory),
+        size_(size),
+        mapped_(mapped),
+        max_order_(0),
+        used_(0) {
+    assert(size >= MIN_ALLOCATION_SIZE && (size & (size - 1)) == 0);
+    while (OrderSize(max_order_) < size_) {
+        ++max_order_;
+    }
+    free_lists_.resize(max_order_ + 1);
+    free_lists_[max_order_].push_back(0);
+}
+
+bool VulkanMemoryBlock::Allocate(VkDeviceSize size, VkDeviceSize alignment,
+                                 VkDeviceSize* offset, VkDeviceSize* allocated_size) {
+    // buddy 块的 offset 是块大小的整数倍, 块不小于 alignment 就满足对齐
+    VkDeviceSize need = size > alignment ? size : alignment;
+    uint32_t order = 0;
+    while (order <= max_order_ && OrderSize(order) < need) {
+        ++order;
+    }
+    if (order > max_order_) {
+        return false;
+    }
+    uint32_t k = order;
+    while (k <= max_order_ && free_lists_[k].empty()) {
+        ++k;
+    }
+    if (k > max_order_) {
+        return false;
+    }
+    VkDeviceSize block_offset = free_lists_[k].back();
+    free_lists_[k].pop_back();
+    // 多出来的一半放回低一级的 free list
+    while (k > order) {
+        --k;
+        free_lists_[k].push_back(block_offset + OrderSize(k));
+    }
+    allocated_orders_[block_offset] = order;
+    used_ += OrderSize(order);
+    *offset = block_offset;
+    *allocated_size = OrderSize(order);
+    return true;
+}
+
+VkDeviceSize VulkanMemoryBlock::Free(VkDeviceSize offset) {
+    auto it = allocated_orders_.find(offset);
+    assert(it != allocated_orders_.end());
+    if (it == allocated_orders_.end()) {
+        return 0;
+    }
+    uint32_t order = it->second;
+    allocated_orders_.erase(it);
+    VkDeviceSize freed = OrderSize(order);
+    used_ -= freed;
+    // buddy 也是空闲的就合并成上一级
+    while (order < max_order_) {
+        VkDeviceSize buddy = offset ^ OrderSize(order);
+        std::vector<VkDeviceSize>& free_list = free_lists_[order];
+        size_t i = 0;
+        while (i < free_list.size() && free_list[i] != buddy) {
+            ++i;
+        }
+        if (i == free_list.size()) {
+            break;
+        }
+        free_list[i] = free_list.back();
+        free_list.pop_back();
+        offset = offset < buddy ? offset : buddy;
+        ++order;
+    }
+    free_lists_[order].push_back(offset);
+    return freed;
+}
+
+bool VulkanMemoryBlock::empty() const {
+    return used_ == 0;
+}
+
+uint32_t VulkanMemoryBlock::pool() const {
+    return pool_;
+}
+
+VkDeviceMemory VulkanMemoryBlock::device_memory() const {
+    return device_memory_;
+}
+
+VkDeviceSize VulkanMemoryBlock::size() const {
+    return size_;
+}
+
+void* VulkanMemoryBlock::mapped() const {
+    return mapped_;
+}
+
+VkDeviceSize VulkanMemoryBlock::OrderSize(uint32_t order) const {
+    return MIN_ALLOCATION_SIZE << order;
+}
+
+VulkanMemoryAllocator::VulkanMemoryAllocator(VkPhysicalDevice physical_device, VkDevice device) :
+        device_(device),
+        memory_properties_{},
+        buffer_image_granularity_(1),
+        max_memory_allocation_count_(0),
+        dedicated_allocation_(false),
+        get_buffer_memory_requirements2_(nullptr),
+        get_image_memory_requirements2_(nullptr),
+        block_sizes_{},
+        stats_{} {
+    vkGetPhysicalDeviceMemoryProperties(physical_device, &memory_properties_);
+    VkPhysicalDeviceProperties properties{};
+    vkGetPhysicalDeviceProperties(physical_device, &properties);
+    buffer_image_granularity_ = properties.limits.bufferImageGranularity;
+    max_memory_allocation_count_ = properties.limits.maxMemoryAllocationCount;
+
+    if (properties.apiVersion >= VK_API_VERSION_1_1) {
+        get_buffer_memory_requirements2_ = (PFN_vkGetBufferMemoryRequirements2) vkGetDeviceProcAddr(device_,
+                "vkGetBufferMemoryRequirements2");
+        get_image_memory_requirements2_ = (PFN_vkGetImageMemoryRequirements2) vkGetDeviceProcAddr(device_,
+                "vkGetImageMemoryRequirements2");
+        dedicated_allocation_ = get_buffer_memory_requirements2_ != nullptr && get_image_memory_requirements2_ != nullptr;
+    }
+
+    for (uint32_t i = 0; i < memory_properties_.memoryTypeCount; ++i) {
+        VkDeviceSize heap_size = memory_properties_.memoryHeaps[memory_properties_.memoryTypes[i].heapIndex].size;
+        VkDeviceSize block_size = heap_size >= LARGE_HEAP_SIZE ? DEFAULT_BLOCK_SIZE : RoundDownPowerOfTwo(heap_size / 8);
+        block_sizes_[i] = block_size < MIN_BLOCK_SIZE ? MIN_BLOCK_SIZE : block_size;
+    }
+    pools_.resize(memory_properties_.memoryTypeCount * RESOURCE_KIND_COUNT);
+}
+
+VulkanMemoryAllocator::~VulkanMemoryAllocator() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (auto& pool : pools_) {
+        for (auto block : pool) {
+            if (!block->empty()) {
+                LOG_W("VulkanMemoryAllocator", "block %p destroyed with live allocations\n", block);
+            }
+            DestroyBlock(block);
+        }
+        pool.clear();
+    }
+    if (stats_.dedicated_count > 0) {
+        LOG_W("VulkanMemoryAllocator", "%u dedicated allocations leaked\n", stats_.dedicated_count);
+    }
+}
+
+VulkanMemory* VulkanMemoryAllocator::AllocateBufferMemory(VkBuffer buffer, VulkanMemoryUsage usage) {
+    VkMemoryRequirements requirements{};
+    bool dedicated = false;
+    if (dedicated_allocation_) {
+        VkBufferMemoryRequirementsInfo2 info{};
+        info.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_REQUIREMENTS_INFO_2;
+        info.buffer = buffer;
+        VkMemoryDedicatedRequirements dedicated_requirements{};
+        dedicated_requirements.sType = VK_STRUCTURE_TYPE_MEMORY_DEDICATED_REQUIREMENTS;
+        VkMemoryRequirements2 requirements2{};
+        requirements2.sType = VK_STRUCTURE_TYPE_MEMORY_REQUIREMENTS_2;
+        requirements2.pNext = &dedicated_requirements;
+        get_buffer_memory_requirements2_(device_, &info, &requirements2);
+        requirements = requirements2.memoryRequirements;
+        dedicated = dedicated_requirements.prefersDedicatedAllocation || dedicated_requirements.requiresDedicatedAllocation;
+    } else {
+        vkGetBufferMemoryRequirements(device_, buffer, &requirements);
+    }
+    return Allocate(requirements, usage, RESOURCE_LINEAR, dedicated, buffer, VK_NULL_HANDLE);
+}
+
+VulkanMemory* VulkanMemoryAllocator::AllocateImageMemory(VkImage image, VulkanMemoryUsage usage) {
+    VkMemoryRequirements requirements{};
+    bool dedicated = false;
+    if (dedicated_allocation_) {
+        VkImageMemoryRequirementsInfo2 info{};
+        info.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_REQUIREMENTS_INFO_2;
+        info.image = image;
+        VkMemoryDedicatedRequirements dedicated_requirements{};
+        dedicated_requirements.sType = VK_STRUCTURE_TYPE_MEMORY_DEDICATED_REQUIREMENTS;
+        VkMemoryRequirements2 requirements2{};
+        requirements2.sType = VK_STRUCTURE_TYPE_MEMORY_REQUIREMENTS_2;
+        requirements2.pNext = &dedicated_requirements;
+        get_image_memory_requirements2_(device_, &info, &requirements2);
+        requirements = requirements2.memoryRequirements;
+        dedicated = dedicated_requirements.prefersDedicatedAllocation || dedicated_requirements.requiresDedicatedAllocation;
+    } else {
+        vkGetImageMemoryRequirements(device_, image, &requirements);
+    }
+    return Allocate(requirements, usage, RESOURCE_OPTIMAL, dedicated, VK_NULL_HANDLE, image);
+}
+
+VulkanMemory* VulkanMemoryAllocator::Allocate(const VkMemoryRequirements& requirements, VulkanMemoryUsage usage,
+                                              ResourceKind kind, bool dedicated, VkBuffer buffer, VkImage image) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    // granularity 为 1 时 buffer 和 image 可以相邻, 不需要分开
+    if (buffer_image_granularity_ <= 1) {
+        kind = RESOURCE_LINEAR;
+    }
+    uint32_t type_bits = requirements.memoryTypeBits;
+    // 首选的 memory type 所在 heap 用完时 (例如 256MB 的 DEVICE_LOCAL | HOST_VISIBLE) 换下一个
+    for (int type = FindMemoryType(type_bits, usage); type >= 0; type = FindMemoryType(type_bits, usage)) {
+        uint32_t memory_type_index = static_cast<uint32_t>(type);
+        type_bits &= ~(1u << memory_type_index);
+        VkDeviceSize block_size = block_sizes_[memory_type_index];
+        if (dedicated || requirements.size > block_size / 2 || requirements.alignment > block_size) {
+            VulkanMemory* memory = AllocateDedicated(requirements, memory_type_index, buffer, image);
+            if (memory != nullptr) {
+                return memory;
+            }
+            continue;
+        }
+
+        uint32_t pool = memory_type_index * RESOURCE_KIND_COUNT + kind;
+        VulkanMemoryBlock* block = nullptr;
+        VkDeviceSize offset = 0;
+        VkDeviceSize allocated_size = 0;
+        for (auto candidate : pools_[pool]) {
+            if (candidate->Allocate(requirements.size, requirements.alignment, &offset, &allocated_size)) {
+                block = candidate;
+                break;
+            }
+        }
+        if (block == nullptr) {
+            block = CreateBlock(pool, memory_type_index);
+            if (block == nullptr ||
+                    !block->Allocate(requirements.size, requirements.alignment, &offset, &allocated_size)) {
+                continue;
+            }
+        }
+        ++stats_.allocation_count;
+        stats_.used_bytes += allocated_size;
+        if (stats_.used_bytes > stats_.peak_used_bytes) {
+            stats_.peak_used_bytes = stats_.used_bytes;
+        }
+        void* mapped = block->mapped() ? static_cast<char*>(block->mapped()) + offset : nullptr;
+        return new VulkanMemory(device_, block->device_memory(), offset, requirements.size, mapped, this, block);
+    }
+    LOG_E("VulkanMemoryAllocator", "allocate %llu bytes usage %d type bits 0x%x failed\n",
+          (long long unsigned int) requirements.size, usage, requirements.memoryTypeBits);
+    return nullptr;
+}
+
+VulkanMemory* VulkanMemoryAllocator::AllocateDedicated(const VkMemoryRequirements& requirements,
+                                                       uint32_t memory_type_index, VkBuffer buffer, VkImage image) {
+    VkMemoryDedicatedAllocateInfo dedicated_info{};
+    dedicated_info.sType = VK_STRUCTURE_TYPE_MEMORY_DEDICATED_ALLOCATE_INFO;
+    dedicated_info.buffer = buffer;
+    dedicated_info.image = image;
+    VkDeviceMemory device_memory = VK_NULL_HANDLE;
+    void* mapped = nullptr;
+    VkResult ret = AllocateDeviceMemory(memory_type_index, requirements.size,
+                                        dedicated_allocation_ ? &dedicated_info : nullptr,
+                                        &device_memory, &mapped);
+    if (ret != VK_SUCCESS) {
+        return nullptr;
+    }
+    ++stats_.dedicated_count;
+    ++stats_.allocation_count;
+    stats_.dedicated_bytes += requirements.size;
+    stats_.used_bytes += requirements.size;
+    if (stats_.used_bytes > stats_.peak_used_bytes) {
+        stats_.peak_used_bytes = stats_.used_bytes;
+    }
+    return new VulkanMemory(device_, device_memory, 0, requirements.size, mapped, this, nullptr);
+}
+
+void VulkanMemoryAllocator::Free(VulkanMemory* memory) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    --stats_.allocation_count;
+    VulkanMemoryBlock* block = memory->block();
+    if (block == nullptr) {
+        FreeDeviceMemory(memory->device_memory(), memory->mapped());
+        --stats_.dedicated_count;
+        stats_.dedicated_bytes -= memory->size();
+        stats_.used_bytes -= memory->size();
+        return;
+    }
+    stats_.used_bytes -= block->Free(memory->offset());
+    // 每个 pool 留一个空的 block, 避免 scene 切换时反复分配
+    std::vector<VulkanMemoryBlock*>& pool = pools_[block->pool()];
+    if (block->empty() && pool.size() > 1) {
+        for (size_t i = 0; i < pool.size(); ++i) {
+            if (pool[i] == block) {
+                pool.erase(pool.begin() + i);
+                break;
+            }
+        }
+        DestroyBlock(block);
+    }
+}
+
+vulkan_memory_stats_t VulkanMemoryAllocator::stats() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return stats_;
+}
+
+void VulkanMemoryAllocator::LogStats(const char* tag) const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    LOG_D(tag, "device memory %u / %u, blocks %u (%.2f MiB), dedicated %u (%.2f MiB)\n",
+          stats_.device_memory_count, max_memory_allocation_count_,
+          stats_.block_count, ToMiB(stats_.block_bytes),
+          stats_.dedicated_count, ToMiB(stats_.dedicated_bytes));
+    LOG_D(tag, "allocations %u, used %.2f MiB, peak %.2f MiB\n",
+          stats_.allocation_count, ToMiB(stats_.used_bytes), ToMiB(stats_.peak_used_bytes));
+    for (uint32_t i = 0; i < memory_properties_.memoryTypeCount; ++i) {
+        size_t blocks = pools_[i * RESOURCE_KIND_COUNT + RESOURCE_LINEAR].size() +
+                        pools_[i * RESOURCE_KIND_COUNT + RESOURCE_OPTIMAL].size();
+        if (blocks > 0) {
+            LOG_D(tag, "\t memory type %u flags 0x%x: %zu blocks of %.2f MiB\n",
+                  i, memory_properties_.memoryTypes[i].propertyFlags, blocks, ToMiB(block_sizes_[i]));
+        }
+    }
+}
+
+VulkanMemoryBlock* VulkanMemoryAllocator::CreateBlock(uint32_t pool, uint32_t memory_type_index) {
+    VkDeviceSize size = block_sizes_[memory_type_index];
+    VkDeviceMemory device_memory = VK_NULL_HANDLE;
+    void* mapped = nullptr;
+    if (AllocateDeviceMemory(memory_type_index, size, nullptr, &device_memory, &mapped) != VK_SUCCESS) {
+        return nullptr;
+    }
+    auto* block = new VulkanMemoryBlock(pool, device_memory, size, mapped);
+    pools_[pool].push_back(block);
+    ++stats_.block_count;
+    stats_.block_bytes += size;
+    LOG_D("VulkanMemoryAllocator", "new %.2f MiB block in memory type %u\n", ToMiB(size), memory_type_index);
+    return block;
+}
+
+void VulkanMemoryAllocator::DestroyBlock(VulkanMemoryBlock* block) {
+    FreeDeviceMemory(block->device_memory(), block->mapped());
+    --stats_.block_count;
+    stats_.block_bytes -= block->size();
+    delete block;
+}
+
+int VulkanMemoryAllocator::FindMemoryType(uint32_t type_bits, VulkanMemoryUsage usage) const {
+    VkMemoryPropertyFlags required = 0;
+    VkMemoryPropertyFlags preferred = 0;
+    VkMemoryPropertyFlags not_preferred = 0;
+    switch (usage) {
+        case MEMORY_USAGE_GPU_ONLY:
+            preferred = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
+            not_preferred = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT;
+            break;
+        case MEMORY_USAGE_CPU_TO_GPU:
+            // 代码里 map 之后没有 flush, host 访问的内存都要求 coherent
+            required = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+            preferred = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
+            break;
+        case MEMORY_USAGE_CPU_ONLY:
+            required = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+            not_preferred = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
+            break;
+        case MEMORY_USAGE_GPU_TO_CPU:
+            required = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+            preferred = VK_MEMORY_PROPERTY_HOST_CACHED_BIT;
+            break;
+        default:
+            assert(false);
+            return -1;
+    }
+    int best = -1;
+    int best_score = -1;
+    for (uint32_t i = 0; i < memory_properties_.memoryTypeCount; ++i) {
+        VkMemoryPropertyFlags flags = memory_properties_.memoryTypes[i].propertyFlags;
+        if ((type_bits & (1u << i)) == 0 || (flags & required) != required) {
+            continue;
+        }
+        // lazily allocated 只能给 transient attachment 用, protected 需要 protected queue
+        if (flags & (VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT | VK_MEMORY_PROPERTY_PROTECTED_BIT)) {
+            continue;
+        }
+        int score = ((flags & preferred) == preferred ? 2 : 0) + ((flags & not_preferred) == 0 ? 1 : 0);
+        // 分数相同时保留下标小的, 驱动按性能从高到低排列 memory type
+        if (score > best_score) {
+            best = static_cast<int>(i);
+            best_score = score;
+        }
+    }
+    return best;
+}
+
+VkResult VulkanMemoryAllocator::AllocateDeviceMemory(uint32_t memory_type_index, VkDeviceSize size, const void* next,
+                                                     VkDeviceMemory* device_memory, void** mapped) {
+    if (max_memory_allocation_count_ > 0 && stats_.device_memory_count >= max_memory_allocation_count_) {
+        LOG_E("VulkanMemoryAllocator", "maxMemoryAllocationCount %u reached\n", max_memory_allocation_count_);
+        return VK_ERROR_TOO_MANY_OBJECTS;
+    }
+    VkMemoryAllocateInfo alloc_info{};
+    alloc_info.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+    alloc_info.pNext = next;
+    alloc_info.allocationSize = size;
+    alloc_info.memoryTypeIndex = memory_type_index;
+    VkResult ret = vkAllocateMemory(device_, &alloc_info, nullptr, device_memory);
+    if (ret != VK_SUCCESS) {
+        LOG_W("VulkanMemoryAllocator", "vkAllocateMemory %llu bytes in memory type %u failed %d\n",
+              (long long unsigned int) size, memory_type_index, ret);
+        return ret;
+    }
+    *mapped = nullptr;
+    if (IsHostVisible(memory_type_index)) {
+        ret = vkMapMemory(device_, *device_memory, 0, VK_WHOLE_SIZE, 0, mapped);
+        if (ret != VK_SUCCESS) {
+            vkFreeMemory(device_, *device_memory, nullptr);
+            *device_memory = VK_NULL_HANDLE;
+            return ret;
+        }
+    }
+    ++stats_.device_memory_count;
+    return VK_SUCCESS;
+}
+
+void VulkanMemoryAllocator::FreeDeviceMemory(VkDeviceMemory device_memory, void* mapped) {
+    if (mapped != nullptr) {
+        vkUnmapMemory(device_, device_memory);
+    }
+    vkFreeMemory(device_, device_memory, nullptr);
+    --stats_.device_memory_count;
+}
+
+bool VulkanMemoryAllocator::IsHostVisible(uint32_t memory_type_index) const {
+    return (memory_properties_.memoryTypes[memory_type_index].propertyFlags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT) != 0;
+}
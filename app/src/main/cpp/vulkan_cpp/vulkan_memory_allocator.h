@@ -0,0 +1,131 @@
+//
+// Created by hj6231 on 2024/2/9.
+//
+
+#pragma once
+#include <mutex>
+#include <vector>
+#include <unordered_map>
+#include <vulkan/vulkan.h>
+#include "vulkan_memory.h"
+
+// 按用途申请内存, 由 allocator 选择 memory type
+typedef enum {
+    // 只有 GPU 访问: render target, texture, 通过 staging 上传的 buffer
+    MEMORY_USAGE_GPU_ONLY = 0,
+    // CPU 每帧写, GPU 读: uniform, 动态 vertex. 优先 DEVICE_LOCAL | HOST_VISIBLE
+    MEMORY_USAGE_CPU_TO_GPU,
+    // staging buffer, 优先不是 DEVICE_LOCAL 的 system memory
+    MEMORY_USAGE_CPU_ONLY,
+    // GPU 写, CPU 读回, 优先 HOST_CACHED
+    MEMORY_USAGE_GPU_TO_CPU,
+    MEMORY_USAGE_COUNT
+} VulkanMemoryUsage;
+
+typedef struct {
+    // vkAllocateMemory 的次数 (block + dedicated), 和 maxMemoryAllocationCount 比较
+    uint32_t device_memory_count;
+    uint32_t block_count;
+    uint32_t dedicated_count;
+    uint32_t allocation_count;
+    VkDeviceSize block_bytes;
+    VkDeviceSize dedicated_bytes;
+    // 分配出去的大小, 包括 buddy 向上取整的部分
+    VkDeviceSize used_bytes;
+    VkDeviceSize peak_used_bytes;
+} vulkan_memory_stats_t;
+
+// 一次 vkAllocateMemory 得到的大块内存, 用 buddy 算法切分.
+// 每一块的 offset 都是自己大小的整数倍, 所以 alignment 不超过块大小时自然满足
+class VulkanMemoryBlock {
+public:
+    // pool 是 VulkanMemoryAllocator 里的下标, block 空了以后用来找回所在的 pool
+    VulkanMemoryBlock(uint32_t pool, VkDeviceMemory device_memory, VkDeviceSize size, void* mapped);
+    VulkanMemoryBlock(const VulkanMemoryBlock&) = delete;
+    ~VulkanMemoryBlock() = default;
+
+    // 成功返回 true, offset 和实际占用的大小写到 offset/allocated_size
+    bool Allocate(VkDeviceSize size, VkDeviceSize alignment, VkDeviceSize* offset, VkDeviceSize* allocated_size);
+    // 返回释放的大小
+    VkDeviceSize Free(VkDeviceSize offset);
+    bool empty() const;
+
+    uint32_t pool() const;
+    VkDeviceMemory device_memory() const;
+    VkDeviceSize size() const;
+    void* mapped() const;
+
+    VulkanMemoryBlock& operator = (const VulkanMemoryBlock&) = delete;
+
+    const static VkDeviceSize MIN_ALLOCATION_SIZE = 256;
+private:
+    VkDeviceSize OrderSize(uint32_t order) const;
+
+    uint32_t pool_;
+    VkDeviceMemory device_memory_;
+    VkDeviceSize size_;
+    void* mapped_;
+    uint32_t max_order_;
+    // free_lists_[order] 是大小为 MIN_ALLOCATION_SIZE << order 的空闲块的 offset
+    std::vector<std::vector<VkDeviceSize>> free_lists_;
+    std::unordered_map<VkDeviceSize, uint32_t> allocated_orders_;
+    VkDeviceSize used_;
+};
+
+// 每个 memory type 一组 block, 小的 buffer/image 都从 block 里切,
+// 大的 image 或者驱动要求 dedicated 的资源单独 vkAllocateMemory.
+// HOST_VISIBLE 的内存在分配时就 map, 直到释放, VulkanMemory::MapMemory 只是返回指针
+class VulkanMemoryAllocator {
+public:
+    VulkanMemoryAllocator(VkPhysicalDevice physical_device, VkDevice device);
+    VulkanMemoryAllocator(const VulkanMemoryAllocator&) = delete;
+    ~VulkanMemoryAllocator();
+
+    // image 按 VK_IMAGE_TILING_OPTIMAL 处理. 返回的内存从 offset 0 开始绑定
+    VulkanMemory* AllocateBufferMemory(VkBuffer buffer, VulkanMemoryUsage usage);
+    VulkanMemory* AllocateImageMemory(VkImage image, VulkanMemoryUsage usage);
+    // 由 VulkanMemory 的析构函数调用
+    void Free(VulkanMemory* memory);
+
+    vulkan_memory_stats_t stats() const;
+    void LogStats(const char* tag) const;
+
+    VulkanMemoryAllocator& operator = (const VulkanMemoryAllocator&) = delete;
+private:
+    // 同一个 memory type 里 buffer 和 optimal image 分开放, 不需要处理 bufferImageGranularity
+    typedef enum {
+        RESOURCE_LINEAR = 0,
+        RESOURCE_OPTIMAL,
+        RESOURCE_KIND_COUNT
+    } ResourceKind;
+
+    VulkanMemory* Allocate(const VkMemoryRequirements& requirements, VulkanMemoryUsage usage,
+                           ResourceKind kind, bool dedicated, VkBuffer buffer, VkImage image);
+    VulkanMemory* AllocateDedicated(const VkMemoryRequirements& requirements, uint32_t memory_type_index,
+                                    VkBuffer buffer, VkImage image);
+    VulkanMemoryBlock* CreateBlock(uint32_t pool, uint32_t memory_type_index);
+    void DestroyBlock(VulkanMemoryBlock* block);
+    // 没有满足 required flags 的 memory type 时返回 -1
+    int FindMemoryType(uint32_t type_bits, VulkanMemoryUsage usage) const;
+    VkResult AllocateDeviceMemory(uint32_t memory_type_index, VkDeviceSize size, const void* next,
+                                  VkDeviceMemory* device_memory, void** mapped);
+    void FreeDeviceMemory(VkDeviceMemory device_memory, void* mapped);
+    bool IsHostVisible(uint32_t memory_type_index) const;
+
+    VkDevice device_;
+    VkPhysicalDeviceMemoryProperties memory_properties_;
+    VkDeviceSize buffer_image_granularity_;
+    uint32_t max_memory_allocation_count_;
+    // device 支持 Vulkan 1.1 时才查询 prefersDedicatedAllocation, 否则只按大小决定
+    bool dedicated_allocation_;
+    PFN_vkGetBufferMemoryRequirements2 get_buffer_memory_requirements2_;
+    PFN_vkGetImageMemoryRequirements2 get_image_memory_requirements2_;
+
+    // 每个 memory type 的 block 大小, 由所在 heap 的大小决定
+    VkDeviceSize block_sizes_[VK_MAX_MEMORY_TYPES];
+    // 下标是 memory_type_index * RESOURCE_KIND_COUNT + kind
+    std::vector<std::vector<VulkanMemoryBlock*>> pools_;
+
+    mutable std::mutex mutex_;
+    vulkan_memory_stats_t stats_;
+};
@@ -0,0 +1,276 @@
+//
+// Created by hj6231 on 2024/2/12.
+//
+
+#include "vulkan_pipeline_cache.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include "file_utils.h"
+#include "log.h"
+
+static int64_t NowNs() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+VulkanPipelineCache::VulkanPipelineCache(VkPhysicalDevice physical_device, VkDevice device) :
+        physical_device_(physical_device),
+        device_(device),
+        properties_{},
+        support_feedback_(false),
+        pipeline_cache_(VK_NULL_HANDLE),
+        file_checksum_(0),
+        dirty_(false),
+        stats_{} {
+}
+
+VulkanPipelineCache::~VulkanPipelineCache() {
+    Destroy();
+}
+
+int VulkanPipelineCache::Create() {
+    vkGetPhysicalDeviceProperties(physical_device_, &properties_);
+    support_feedback_ = properties_.apiVersion >= VK_API_VERSION_1_3;
+    pipeline_cache_ = CreateCache(std::vector<uint8_t>());
+    if (pipeline_cache_ == VK_NULL_HANDLE) {
+        LOG_E("VulkanPipelineCache", "create pipeline cache failed\n");
+        return -1;
+    }
+    return 0;
+}
+
+void VulkanPipelineCache::Destroy() {
+    if (pipeline_cache_ == VK_NULL_HANDLE) {
+        return;
+    }
+    Save();
+    vkDestroyPipelineCache(device_, pipeline_cache_, nullptr);
+    pipeline_cache_ = VK_NULL_HANDLE;
+}
+
+bool VulkanPipelineCache::Open(const std::string& directory) {
+    char name[64];
+    snprintf(name, sizeof(name), "/pipeline_cache_%08x_%08x.bin", properties_.vendorID, properties_.deviceID);
+    path_ = directory + name;
+
+    std::vector<uint8_t> data;
+    uint64_t checksum = 0;
+    if (!LoadFile(&data, &checksum)) {
+        return false;
+    }
+    VkPipelineCache loaded = CreateCache(data);
+    if (loaded == VK_NULL_HANDLE) {
+        LOG_W("VulkanPipelineCache", "driver rejected %s\n", path_.c_str());
+        return false;
+    }
+    // Open 之前创建的 pipeline 也要保留
+    vkMergePipelineCaches(device_, loaded, 1, &pipeline_cache_);
+    vkDestroyPipelineCache(device_, pipeline_cache_, nullptr);
+    pipeline_cache_ = loaded;
+    file_checksum_ = checksum;
+
+    std::lock_guard<std::mutex> lock(stats_mutex_);
+    stats_.loaded_bytes = data.size();
+    LOG_D("VulkanPipelineCache", "loaded %llu bytes from %s\n",
+          (long long unsigned int) data.size(), path_.c_str());
+    return true;
+}
+
+bool VulkanPipelineCache::Save() {
+    {
+        std::lock_guard<std::mutex> lock(stats_mutex_);
+        if (path_.empty() || !dirty_) {
+            return true;
+        }
+    }
+    // 别的进程在 Open 之后写过文件时, 先把它的内容合并进来再覆盖
+    std::vector<uint8_t> data;
+    uint64_t checksum = 0;
+    if (LoadFile(&data, &checksum) && checksum != file_checksum_) {
+        VkPipelineCache other = CreateCache(data);
+        if (other != VK_NULL_HANDLE) {
+            Merge(other);
+            vkDestroyPipelineCache(device_, other, nullptr);
+        }
+    }
+
+    size_t size = 0;
+    if (vkGetPipelineCacheData(device_, pipeline_cache_, &size, nullptr) != VK_SUCCESS) {
+        return false;
+    }
+    data.resize(size);
+    if (vkGetPipelineCacheData(device_, pipeline_cache_, &size, data.data()) != VK_SUCCESS) {
+        return false;
+    }
+    data.resize(size);
+    checksum = Fnv1a64(data.data(), data.size());
+    if (!StoreFile(data, checksum)) {
+        return false;
+    }
+    file_checksum_ = checksum;
+
+    std::lock_guard<std::mutex> lock(stats_mutex_);
+    dirty_ = false;
+    stats_.saved_bytes = data.size();
+    LOG_D("VulkanPipelineCache", "saved %llu bytes to %s\n", (long long unsigned int) data.size(), path_.c_str());
+    return true;
+}
+
+bool VulkanPipelineCache::Merge(VkPipelineCache src) {
+    VkResult ret = vkMergePipelineCaches(device_, pipeline_cache_, 1, &src);
+    if (ret != VK_SUCCESS) {
+        LOG_E("VulkanPipelineCache", "merge pipeline cache failed %d\n", ret);
+        return false;
+    }
+    std::lock_guard<std::mutex> lock(stats_mutex_);
+    dirty_ = true;
+    return true;
+}
+
+VkResult VulkanPipelineCache::CreateGraphicsPipeline(const VkGraphicsPipelineCreateInfo* info, VkPipeline* pipeline) {
+    VkGraphicsPipelineCreateInfo create_info = *info;
+    VkPipelineCreationFeedback feedback{};
+    VkPipelineCreationFeedbackCreateInfo feedback_info{};
+    if (support_feedback_) {
+        feedback_info.sType = VK_STRUCTURE_TYPE_PIPELINE_CREATION_FEEDBACK_CREATE_INFO;
+        feedback_info.pNext = create_info.pNext;
+        feedback_info.pPipelineCreationFeedback = &feedback;
+        create_info.pNext = &feedback_info;
+    }
+    int64_t begin = NowNs();
+    VkResult ret = vkCreateGraphicsPipelines(device_, pipeline_cache_, 1, &create_info, nullptr, pipeline);
+    if (ret == VK_SUCCESS) {
+        AddFeedback(feedback, NowNs() - begin);
+    }
+    return ret;
+}
+
+VkResult VulkanPipelineCache::CreateComputePipeline(const VkComputePipelineCreateInfo* info, VkPipeline* pipeline) {
+    VkComputePipelineCreateInfo create_info = *info;
+    VkPipelineCreationFeedback feedback{};
+    VkPipelineCreationFeedbackCreateInfo feedback_info{};
+    if (support_feedback_) {
+        feedback_info.sType = VK_STRUCTURE_TYPE_PIPELINE_CREATION_FEEDBACK_CREATE_INFO;
+        feedback_info.pNext = create_info.pNext;
+        feedback_info.pPipelineCreationFeedback = &feedback;
+        create_info.pNext = &feedback_info;
+    }
+    int64_t begin = NowNs();
+    VkResult ret = vkCreateComputePipelines(device_, pipeline_cache_, 1, &create_info, nullptr, pipeline);
+    if (ret == VK_SUCCESS) {
+        AddFeedback(feedback, NowNs() - begin);
+    }
+    return ret;
+}
+
+VkPipelineCache VulkanPipelineCache::pipeline_cache() const {
+    return pipeline_cache_;
+}
+
+pipeline_cache_stats_t VulkanPipelineCache::stats() const {
+    std::lock_guard<std::mutex> lock(stats_mutex_);
+    return stats_;
+}
+
+void VulkanPipelineCache::LogStats(const char* tag) const {
+    pipeline_cache_stats_t stats = this->stats();
+    LOG_D(tag, "pipeline cache: %llu pipelines in %.3f ms, %llu hits, %llu misses, %llu unknown, "
+               "loaded %llu bytes, saved %llu bytes\n",
+          (long long unsigned int) stats.pipelines, stats.create_ns / 1e6,
+          (long long unsigned int) stats.hits, (long long unsigned int) stats.misses,
+          (long long unsigned int) stats.unknown,
+          (long long unsigned int) stats.loaded_bytes, (long long unsigned int) stats.saved_bytes);
+}
+
+bool VulkanPipelineCache::LoadFile(std::vector<uint8_t>* data, uint64_t* checksum) const {
+    std::vector<uint8_t> content;
+    if (!ReadFile(path_, &content)) {
+        return false;
+    }
+    file_header_t header{};
+    bool valid = content.size() >= sizeof(header);
+    if (valid) {
+        memcpy(&header, content.data(), sizeof(header));
+        valid = header.magic == FILE_MAGIC &&
+                header.version == FILE_VERSION &&
+                header.header_size == sizeof(header) &&
+                header.vendor_id == properties_.vendorID &&
+                header.device_id == properties_.deviceID &&
+                header.driver_version == properties_.driverVersion &&
+                memcmp(header.pipeline_cache_uuid, properties_.pipelineCacheUUID, VK_UUID_SIZE) == 0 &&
+                header.data_size > 0 &&
+                header.data_size == content.size() - sizeof(header);
+    }
+    if (valid) {
+        data->assign(content.begin() + sizeof(header), content.end());
+        valid = Fnv1a64(data->data(), data->size()) == header.checksum && ValidateData(*data);
+    }
+    if (!valid) {
+        LOG_W("VulkanPipelineCache", "ignore stale or corrupted %s\n", path_.c_str());
+        data->clear();
+        return false;
+    }
+    *checksum = header.checksum;
+    return true;
+}
+
+bool VulkanPipelineCache::StoreFile(const std::vector<uint8_t>& data, uint64_t checksum) const {
+    file_header_t header{};
+    header.magic = FILE_MAGIC;
+    header.version = FILE_VERSION;
+    header.header_size = sizeof(header);
+    header.vendor_id = properties_.vendorID;
+    header.device_id = properties_.deviceID;
+    header.driver_version = properties_.driverVersion;
+    memcpy(header.pipeline_cache_uuid, properties_.pipelineCacheUUID, VK_UUID_SIZE);
+    header.data_size = data.size();
+    header.checksum = checksum;
+
+    std::vector<uint8_t> content(sizeof(header) + data.size());
+    memcpy(content.data(), &header, sizeof(header));
+    memcpy(content.data() + sizeof(header), data.data(), data.size());
+    return WriteFileAtomic(path_, content);
+}
+
+bool VulkanPipelineCache::ValidateData(const std::vector<uint8_t>& data) const {
+    // 驱动自己也会检查, 这里提前发现别的设备或者别的驱动版本写的数据
+    VkPipelineCacheHeaderVersionOne header{};
+    if (data.size() < sizeof(header)) {
+        return false;
+    }
+    memcpy(&header, data.data(), sizeof(header));
+    return header.headerSize >= sizeof(header) &&
+            header.headerVersion == VK_PIPELINE_CACHE_HEADER_VERSION_ONE &&
+            header.vendorID == properties_.vendorID &&
+            header.deviceID == properties_.deviceID &&
+            memcmp(header.pipelineCacheUUID, properties_.pipelineCacheUUID, VK_UUID_SIZE) == 0;
+}
+
+VkPipelineCache VulkanPipelineCache::CreateCache(const std::vector<uint8_t>& data) const {
+    VkPipelineCacheCreateInfo info{};
+    info.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+    info.initialDataSize = data.size();
+    info.pInitialData = data.empty() ? nullptr : data.data();
+    VkPipelineCache pipeline_cache = VK_NULL_HANDLE;
+    if (vkCreatePipelineCache(device_, &info, nullptr, &pipeline_cache) != VK_SUCCESS) {
+        return VK_NULL_HANDLE;
+    }
+    return pipeline_cache;
+}
+
+void VulkanPipelineCache::AddFeedback(const VkPipelineCreationFeedback& feedback, uint64_t ns) {
+    std::lock_guard<std::mutex> lock(stats_mutex_);
+    ++stats_.pipelines;
+    stats_.create_ns += ns;
+    if ((feedback.flags & VK_PIPELINE_CREATION_FEEDBACK_VALID_BIT) == 0) {
+        ++stats_.unknown;
+        dirty_ = true;
+    } else if ((feedback.flags & VK_PIPELINE_CREATION_FEEDBACK_APPLICATION_PIPELINE_CACHE_HIT_BIT) != 0) {
+        ++stats_.hits;
+    } else {
+        ++stats_.misses;
+        dirty_ = true;
+    }
+}
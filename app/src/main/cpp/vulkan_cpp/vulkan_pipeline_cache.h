@@ -0,0 +1,91 @@
+//
+// Created by hj6231 on 2024/2/12.
+//
+
+#pragma once
+#include <mutex>
+#include <string>
+#include <vector>
+#include <vulkan/vulkan.h>
+
+typedef struct {
+    // Open 时从文件加载的数据大小, 0 表示没有文件或者校验没通过
+    uint64_t loaded_bytes;
+    uint64_t saved_bytes;
+    uint64_t pipelines;
+    // 来自 VkPipelineCreationFeedback, 设备低于 1.3 或者驱动没有报告时计入 unknown
+    uint64_t hits;
+    uint64_t misses;
+    uint64_t unknown;
+    // 所有 vkCreate*Pipelines 的耗时之和
+    uint64_t create_ns;
+} pipeline_cache_stats_t;
+
+// 进程内所有 pipeline 共用的 VkPipelineCache, 由 VulkanLogicDevice 持有.
+// 文件开头是自己的 header (vendor, device, driver version, pipelineCacheUUID, 数据长度和校验和),
+// 任何一项对不上就当作没有文件, 从空的 cache 开始. 写文件时先和磁盘上别的进程写的内容 merge,
+// 通过 WriteFileAtomic 写入, 中途崩溃只会留下旧文件.
+// Create*Pipeline 可以在多个线程同时调用, Open/Save/Merge 不能和它们同时调用
+class VulkanPipelineCache {
+public:
+    VulkanPipelineCache(VkPhysicalDevice physical_device, VkDevice device);
+    VulkanPipelineCache(const VulkanPipelineCache&) = delete;
+    ~VulkanPipelineCache();
+
+    // 创建空的 cache, 没有 Open 时只在进程内复用
+    int Create();
+    // 有 Open 过的文件并且有新的 pipeline 时先 Save
+    void Destroy();
+
+    // 从 directory 下和当前设备对应的文件加载, 之后 Save 写回同一个文件
+    bool Open(const std::string& directory);
+    // 没有新的 pipeline 时不写文件
+    bool Save();
+    // src 的内容合并进来, src 仍然由调用者销毁
+    bool Merge(VkPipelineCache src);
+
+    VkResult CreateGraphicsPipeline(const VkGraphicsPipelineCreateInfo* info, VkPipeline* pipeline);
+    VkResult CreateComputePipeline(const VkComputePipelineCreateInfo* info, VkPipeline* pipeline);
+
+    VkPipelineCache pipeline_cache() const;
+    pipeline_cache_stats_t stats() const;
+    void LogStats(const char* tag) const;
+
+    VulkanPipelineCache& operator = (const VulkanPipelineCache&) = delete;
+
+    const static uint32_t FILE_MAGIC = 0x43504b56; // "VKPC"
+    const static uint32_t FILE_VERSION = 1;
+private:
+    typedef struct {
+        uint32_t magic;
+        uint32_t version;
+        uint32_t header_size;
+        uint32_t vendor_id;
+        uint32_t device_id;
+        uint32_t driver_version;
+        uint8_t pipeline_cache_uuid[VK_UUID_SIZE];
+        uint64_t data_size;
+        uint64_t checksum;
+    } file_header_t;
+
+    // 读出 header 之后的数据, 文件不存在或者和当前设备不匹配时返回 false
+    bool LoadFile(std::vector<uint8_t>* data, uint64_t* checksum) const;
+    bool StoreFile(const std::vector<uint8_t>& data, uint64_t checksum) const;
+    bool ValidateData(const std::vector<uint8_t>& data) const;
+    VkPipelineCache CreateCache(const std::vector<uint8_t>& data) const;
+    void AddFeedback(const VkPipelineCreationFeedback& feedback, uint64_t ns);
+
+    VkPhysicalDevice physical_device_;
+    VkDevice device_;
+    VkPhysicalDeviceProperties properties_;
+    // 1.3 core 才有 VkPipelineCreationFeedbackCreateInfo
+    bool support_feedback_;
+    VkPipelineCache pipeline_cache_;
+    std::string path_;
+    // 最近一次读到或者写入的文件内容, Save 时磁盘上的校验和不一样说明别的进程写过
+    uint64_t file_checksum_;
+    bool dirty_;
+
+    mutable std::mutex stats_mutex_;
+    pipeline_cache_stats_t stats_;
+};
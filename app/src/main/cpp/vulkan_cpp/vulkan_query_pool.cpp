@@ -0,0 +1,28 @@
+//
+// Created by hj6231 on 2024/2/8.
+//
+
+#include "vulkan_query_pool.h"
+
+VulkanQueryPool::VulkanQueryPool(VkDevice device, VkQueryPool query_pool, uint32_t query_count) :
+        device_(device), query_pool_(query_pool), query_count_(query_count) {
+
+}
+
+VulkanQueryPool::~VulkanQueryPool() {
+    vkDestroyQueryPool(device_, query_pool_, nullptr);
+}
+
+VkQueryPool VulkanQueryPool::query_pool() const {
+    return query_pool_;
+}
+
+uint32_t VulkanQueryPool::query_count() const {
+    return query_count_;
+}
+
+VkResult VulkanQueryPool::GetQueryPoolResults(uint32_t first_query, uint32_t query_count,
+                                              size_t data_size, void* data,
+                                              VkDeviceSize stride, VkQueryResultFlags flags) const {
+    return vkGetQueryPoolResults(device_, query_pool_, first_query, query_count, data_size, data, stride, flags);
+}
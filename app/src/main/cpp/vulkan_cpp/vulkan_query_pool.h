@@ -0,0 +1,25 @@
+//
+// Created by hj6231 on 2024/2/8.
+//
+
+#pragma once
+#include <vulkan/vulkan.h>
+
+class VulkanQueryPool {
+public:
+    VulkanQueryPool(VkDevice device, VkQueryPool query_pool, uint32_t query_count);
+    VulkanQueryPool(const VulkanQueryPool&) = delete;
+    ~VulkanQueryPool();
+
+    VkQueryPool query_pool() const;
+    uint32_t query_count() const;
+    VkResult GetQueryPoolResults(uint32_t first_query, uint32_t query_count,
+                                 size_t data_size, void* data,
+                                 VkDeviceSize stride, VkQueryResultFlags flags) const;
+
+    VulkanQueryPool& operator = (const VulkanQueryPool&) = delete;
+private:
+    VkDevice device_;
+    VkQueryPool query_pool_;
+    uint32_t query_count_;
+};
@@ -14,13 +14,16 @@ VulkanQueue::~VulkanQueue() {
 }
 
 VkResult VulkanQueue::QueueSubmit(uint32_t submitCount, const VkSubmitInfo* submits, VkFence fence) const {
+    std::lock_guard<std::mutex> lock(mutex_);
     return vkQueueSubmit(queue_, submitCount, submits, fence);
 }
 
 VkResult VulkanQueue::QueuePresentKHR(const VkPresentInfoKHR* present_info) const {
+    std::lock_guard<std::mutex> lock(mutex_);
     return vkQueuePresentKHR(queue_, present_info);
 }
 
 VkResult VulkanQueue::QueueWaitIdle() const {
+    std::lock_guard<std::mutex> lock(mutex_);
     return vkQueueWaitIdle(queue_);
 }
\ No newline at end of file
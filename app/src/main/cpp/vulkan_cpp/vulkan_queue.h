@@ -3,8 +3,10 @@
 //
 
 #pragma once
+#include <mutex>
 #include <vulkan/vulkan.h>
 
+// VkQueue 要求调用者同步, 这里用 mutex 串行化, 异步加载的线程和 render 线程可以共用一个 queue
 class VulkanQueue {
 public:
     VulkanQueue(VkQueue queue);
@@ -15,4 +17,5 @@ public:
     VkResult QueueWaitIdle() const;
 private:
     VkQueue queue_;
+    mutable std::mutex mutex_;
 };
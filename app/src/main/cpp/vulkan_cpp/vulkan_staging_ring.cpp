@@ -0,0 +1,263 @@
+//
+// Created by hj6231 on 2024/2/10.
+//
+
+#include "vulkan_staging_ring.h"
+
+#include <cassert>
+#include <chrono>
+#include "log.h"
+#include "vulkan_logic_device.h"
+
+static int64_t NowNs() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static VkDeviceSize AlignUp(VkDeviceSize value, VkDeviceSize alignment) {
+    return (value + alignment - 1) / alignment * alignment;
+}
+
+VulkanStagingRing::VulkanStagingRing(VulkanLogicDevice* device, VkDeviceSize size) :
+        device_(device),
+        size_(size),
+        min_alignment_(1),
+        buffer_(nullptr),
+        memory_(nullptr),
+        mapped_(nullptr),
+        head_(0),
+        tail_(0),
+        open_(false),
+        open_batch_{},
+        ring_batches_(0),
+        stats_{},
+        first_reserve_ns_(0),
+        last_complete_ns_(0) {
+}
+
+VulkanStagingRing::~VulkanStagingRing() {
+    Destroy();
+}
+
+int VulkanStagingRing::Create() {
+    assert(buffer_ == nullptr);
+    VkPhysicalDeviceProperties properties{};
+    device_->GetPhysicalDeviceProperties(&properties);
+    min_alignment_ = properties.limits.optimalBufferCopyOffsetAlignment;
+    if (min_alignment_ == 0) {
+        min_alignment_ = 1;
+    }
+
+    VkBufferCreateInfo buffer_info{};
+    buffer_info.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+    buffer_info.size = size_;
+    buffer_info.usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
+    buffer_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+    buffer_ = device_->CreateBuffer(&buffer_info);
+    if (buffer_ == nullptr) {
+        LOG_E("VulkanStagingRing", "create staging buffer failed\n");
+        return -1;
+    }
+    memory_ = device_->AllocateBufferMemory(buffer_, MEMORY_USAGE_CPU_ONLY);
+    if (memory_ == nullptr || memory_->BindBufferMemory(buffer_->buffer(), 0) != VK_SUCCESS ||
+            memory_->MapMemory(0, size_, &mapped_) != VK_SUCCESS) {
+        LOG_E("VulkanStagingRing", "allocate %llu bytes staging memory failed\n", (long long unsigned int) size_);
+        Destroy();
+        return -1;
+    }
+    head_ = 0;
+    tail_ = 0;
+    LOG_D("VulkanStagingRing", "staging ring %.2f MiB\n", size_ / (1024.0 * 1024.0));
+    return 0;
+}
+
+void VulkanStagingRing::Destroy() {
+    // 没有 Commit 的区域不会被提交, fence 不会 signal, 直接回收
+    for (auto& memory : open_batch_.fallback_memories) {
+        VulkanLogicDevice::FreeMemory(&memory);
+    }
+    for (auto& buffer : open_batch_.fallback_buffers) {
+        VulkanLogicDevice::DestroyBuffer(&buffer);
+    }
+    open_batch_ = staging_batch_t{};
+    open_ = false;
+    for (auto& batch : batches_) {
+        VkFence fence = batch.fence->fence();
+        device_->WaitForFences(1, &fence, VK_TRUE, UINT64_MAX);
+    }
+    while (!batches_.empty()) {
+        RetireFront();
+    }
+    for (auto& fence : free_fences_) {
+        VulkanLogicDevice::DestroyFence(&fence);
+    }
+    free_fences_.clear();
+    if (memory_ != nullptr && mapped_ != nullptr) {
+        memory_->UnmapMemory();
+    }
+    mapped_ = nullptr;
+    VulkanLogicDevice::FreeMemory(&memory_);
+    VulkanLogicDevice::DestroyBuffer(&buffer_);
+}
+
+bool VulkanStagingRing::Reserve(VkDeviceSize size, VkDeviceSize alignment, staging_region_t* region) {
+    assert(buffer_ != nullptr && size > 0);
+    if (first_reserve_ns_ == 0) {
+        first_reserve_ns_ = NowNs();
+    }
+    Retire();
+    if (size > size_) {
+        return ReserveFallback(size, region);
+    }
+    VkDeviceSize align = alignment > min_alignment_ ? alignment : min_alignment_;
+    while (true) {
+        // 只有 fallback buffer 在使用时 ring 是空的
+        if (!ring_in_use()) {
+            head_ = 0;
+            tail_ = 0;
+        }
+        // head_ == tail_ 并且有 ring 区域在使用表示 ring 满了
+        bool full = ring_in_use() && head_ == tail_;
+        if (!full) {
+            VkDeviceSize offset = AlignUp(head_, align);
+            if (head_ >= tail_) {
+                if (offset + size <= size_) {
+                    TakeRegion(offset, size, region);
+                    return true;
+                }
+                // 尾部放不下, 绕回开头, [head_, size_) 空着直到这一批完成
+                if (size <= tail_) {
+                    TakeRegion(0, size, region);
+                    return true;
+                }
+            } else if (offset + size <= tail_) {
+                TakeRegion(offset, size, region);
+                return true;
+            }
+        }
+        if (ring_batches_ == 0) {
+            // 剩下的空间都被还没有 Commit 的区域占着, 等不到
+            return ReserveFallback(size, region);
+        }
+        int64_t begin = NowNs();
+        VkFence fence = batches_.front().fence->fence();
+        device_->WaitForFences(1, &fence, VK_TRUE, UINT64_MAX);
+        ++stats_.stall_count;
+        stats_.stall_ns += NowNs() - begin;
+        RetireFront();
+    }
+}
+
+VkFence VulkanStagingRing::Commit() {
+    if (!open_) {
+        return VK_NULL_HANDLE;
+    }
+    VulkanFence* fence = nullptr;
+    if (!free_fences_.empty()) {
+        fence = free_fences_.back();
+        free_fences_.pop_back();
+        VkFence handle = fence->fence();
+        device_->ResetFences(1, &handle);
+    } else {
+        VkFenceCreateInfo fence_info{};
+        fence_info.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+        fence = device_->CreateFence(&fence_info);
+        assert(fence);
+    }
+    open_batch_.fence = fence;
+    open_batch_.end = head_;
+    if (open_batch_.uses_ring) {
+        ++ring_batches_;
+    }
+    batches_.push_back(open_batch_);
+    open_batch_ = staging_batch_t{};
+    open_ = false;
+    return fence->fence();
+}
+
+void VulkanStagingRing::Retire() {
+    while (!batches_.empty() && device_->GetFenceStatus(batches_.front().fence->fence()) == VK_SUCCESS) {
+        RetireFront();
+    }
+}
+
+staging_stats_t VulkanStagingRing::stats() const {
+    return stats_;
+}
+
+double VulkanStagingRing::bytes_per_second() const {
+    if (last_complete_ns_ <= first_reserve_ns_) {
+        return 0.0;
+    }
+    return stats_.bytes * 1e9 / (last_complete_ns_ - first_reserve_ns_);
+}
+
+void VulkanStagingRing::LogStats(const char* tag) const {
+    LOG_D(tag, "staging: %llu uploads, %.2f MiB, %.2f MiB/s, %llu stalls (%.3f ms), %llu fallbacks (%.2f MiB)\n",
+          (long long unsigned int) stats_.uploads, stats_.bytes / (1024.0 * 1024.0),
+          bytes_per_second() / (1024.0 * 1024.0),
+          (long long unsigned int) stats_.stall_count, stats_.stall_ns / 1e6,
+          (long long unsigned int) stats_.fallback_count, stats_.fallback_bytes / (1024.0 * 1024.0));
+}
+
+bool VulkanStagingRing::ReserveFallback(VkDeviceSize size, staging_region_t* region) {
+    VkBufferCreateInfo buffer_info{};
+    buffer_info.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+    buffer_info.size = size;
+    buffer_info.usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
+    buffer_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+    VulkanBuffer* buffer = device_->CreateBuffer(&buffer_info);
+    VulkanMemory* memory = buffer ? device_->AllocateBufferMemory(buffer, MEMORY_USAGE_CPU_ONLY) : nullptr;
+    void* data = nullptr;
+    if (memory == nullptr || memory->BindBufferMemory(buffer->buffer(), 0) != VK_SUCCESS ||
+            memory->MapMemory(0, size, &data) != VK_SUCCESS) {
+        LOG_E("VulkanStagingRing", "fallback staging buffer %llu bytes failed\n", (long long unsigned int) size);
+        VulkanLogicDevice::FreeMemory(&memory);
+        VulkanLogicDevice::DestroyBuffer(&buffer);
+        return false;
+    }
+    // 和 ring 里的区域一样, 跟着这一批的 fence 释放
+    open_batch_.fallback_buffers.push_back(buffer);
+    open_batch_.fallback_memories.push_back(memory);
+    open_ = true;
+    region->buffer = buffer->buffer();
+    region->offset = 0;
+    region->data = data;
+    ++stats_.uploads;
+    stats_.bytes += size;
+    ++stats_.fallback_count;
+    stats_.fallback_bytes += size;
+    return true;
+}
+
+void VulkanStagingRing::RetireFront() {
+    staging_batch_t& batch = batches_.front();
+    if (batch.uses_ring) {
+        tail_ = batch.end;
+        --ring_batches_;
+    }
+    for (auto& memory : batch.fallback_memories) {
+        VulkanLogicDevice::FreeMemory(&memory);
+    }
+    for (auto& buffer : batch.fallback_buffers) {
+        VulkanLogicDevice::DestroyBuffer(&buffer);
+    }
+    free_fences_.push_back(batch.fence);
+    batches_.pop_front();
+    last_complete_ns_ = NowNs();
+}
+
+void VulkanStagingRing::TakeRegion(VkDeviceSize offset, VkDeviceSize size, staging_region_t* region) {
+    head_ = offset + size;
+    open_ = true;
+    open_batch_.uses_ring = true;
+    region->buffer = buffer_->buffer();
+    region->offset = offset;
+    region->data = static_cast<char*>(mapped_) + offset;
+    ++stats_.uploads;
+    stats_.bytes += size;
+}
+
+bool VulkanStagingRing::ring_in_use() const {
+    return open_batch_.uses_ring || ring_batches_ > 0;
+}
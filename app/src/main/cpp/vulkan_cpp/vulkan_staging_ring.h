@@ -0,0 +1,99 @@
+//
+// Created by hj6231 on 2024/2/10.
+//
+
+#pragma once
+#include <deque>
+#include <vector>
+#include <vulkan/vulkan.h>
+#include "vulkan_buffer.h"
+#include "vulkan_fence.h"
+#include "vulkan_memory.h"
+
+class VulkanLogicDevice;
+
+// Reserve 得到的一段 staging 内存, data 已经 map, 写完后从 buffer + offset 开始 copy
+typedef struct {
+    VkBuffer buffer;
+    VkDeviceSize offset;
+    void* data;
+} staging_region_t;
+
+typedef struct {
+    uint64_t uploads;
+    uint64_t bytes;
+    // Reserve 时 ring 满了, 等待最老一批 copy 完成的次数和时间
+    uint64_t stall_count;
+    uint64_t stall_ns;
+    // 比 ring 大或者等不到空间时单独创建的临时 buffer
+    uint64_t fallback_count;
+    uint64_t fallback_bytes;
+} staging_stats_t;
+
+// 一个持久 map 的 staging buffer, 按环形分配. 每次 Commit 把之前 Reserve 的区域交给一个 fence,
+// fence signal 之后这些区域才会被复用, 上传过程中没有 buffer/memory 的创建和销毁.
+// 只在一个线程使用
+class VulkanStagingRing {
+public:
+    VulkanStagingRing(VulkanLogicDevice* device, VkDeviceSize size);
+    VulkanStagingRing(const VulkanStagingRing&) = delete;
+    ~VulkanStagingRing();
+
+    int Create();
+    // 等待所有提交完成后释放
+    void Destroy();
+
+    // alignment 是 copy 的 bufferOffset 要求, 例如 texel 大小, 至少按 optimalBufferCopyOffsetAlignment 对齐
+    bool Reserve(VkDeviceSize size, VkDeviceSize alignment, staging_region_t* region);
+    // 返回的 fence 必须传给使用这些区域的 QueueSubmit. 上次 Commit 之后没有 Reserve 时返回 VK_NULL_HANDLE
+    VkFence Commit();
+    // 回收已经完成的区域, 不会阻塞
+    void Retire();
+
+    staging_stats_t stats() const;
+    // 从第一次 Reserve 到最近一次观察到 copy 完成的平均速度
+    double bytes_per_second() const;
+    void LogStats(const char* tag) const;
+
+    VulkanStagingRing& operator = (const VulkanStagingRing&) = delete;
+
+    const static VkDeviceSize DEFAULT_SIZE = 16 * 1024 * 1024;
+private:
+    typedef struct {
+        VulkanFence* fence;
+        // 这一批最后一个区域的结尾, 完成后 tail_ 移到这里
+        VkDeviceSize end;
+        // 有 ring 里的区域. 只有 fallback buffer 的批次完成时不移动 tail_
+        bool uses_ring;
+        std::vector<VulkanBuffer*> fallback_buffers;
+        std::vector<VulkanMemory*> fallback_memories;
+    } staging_batch_t;
+
+    bool ReserveFallback(VkDeviceSize size, staging_region_t* region);
+    void RetireFront();
+    void TakeRegion(VkDeviceSize offset, VkDeviceSize size, staging_region_t* region);
+    // 有还没有完成的 ring 区域, fallback buffer 不算
+    bool ring_in_use() const;
+
+    VulkanLogicDevice* device_;
+    VkDeviceSize size_;
+    VkDeviceSize min_alignment_;
+    VulkanBuffer* buffer_;
+    VulkanMemory* memory_;
+    void* mapped_;
+
+    // [tail_, head_) 环形地被还没有完成的 copy 占用
+    VkDeviceSize head_;
+    VkDeviceSize tail_;
+    // 上次 Commit 之后有新的 Reserve
+    bool open_;
+    staging_batch_t open_batch_;
+    std::deque<staging_batch_t> batches_;
+    // batches_ 里 uses_ring 的批次数
+    uint32_t ring_batches_;
+    std::vector<VulkanFence*> free_fences_;
+
+    staging_stats_t stats_;
+    int64_t first_reserve_ns_;
+    int64_t last_complete_ns_;
+};
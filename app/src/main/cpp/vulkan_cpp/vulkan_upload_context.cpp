@@ -0,0 +1,431 @@
+//
+// Created by hj6231 on 2024/2/11.
+//
+
+#include "vulkan_upload_context.h"
+
+#include <cassert>
+#include <cstring>
+#include "log.h"
+#include "vulkan_logic_device.h"
+
+VulkanUploadContext::VulkanUploadContext(VulkanLogicDevice* device,
+                                         VulkanQueue* graphic_queue, uint32_t graphic_queue_family_index,
+                                         VulkanQueue* transfer_queue, uint32_t transfer_queue_family_index) :
+        device_(device),
+        graphic_queue_(graphic_queue),
+        graphic_queue_family_index_(graphic_queue_family_index),
+        transfer_queue_(transfer_queue_family_index != graphic_queue_family_index ? transfer_queue : nullptr),
+        transfer_queue_family_index_(transfer_queue_family_index),
+        graphic_command_pool_(nullptr),
+        transfer_command_pool_(nullptr),
+        recording_(false),
+        open_batch_{},
+        submitted_ticket_(0),
+        completed_ticket_(0),
+        stats_{} {
+}
+
+VulkanUploadContext::~VulkanUploadContext() {
+    Destroy();
+}
+
+int VulkanUploadContext::Create() {
+    VkCommandPoolCreateInfo pool_info{};
+    pool_info.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+    pool_info.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT | VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
+    pool_info.queueFamilyIndex = graphic_queue_family_index_;
+    graphic_command_pool_ = device_->CreateCommandPool(&pool_info);
+    if (graphic_command_pool_ == nullptr) {
+        return -1;
+    }
+    if (transfer_queue_ != nullptr) {
+        pool_info.queueFamilyIndex = transfer_queue_family_index_;
+        transfer_command_pool_ = device_->CreateCommandPool(&pool_info);
+        if (transfer_command_pool_ == nullptr) {
+            return -1;
+        }
+    }
+    LOG_D("VulkanUploadContext", "upload on %s queue family %u\n",
+          transfer_queue_ ? "transfer" : "graphic",
+          transfer_queue_ ? transfer_queue_family_index_ : graphic_queue_family_index_);
+    return 0;
+}
+
+void VulkanUploadContext::Destroy() {
+    if (graphic_command_pool_ == nullptr) {
+        return;
+    }
+    if (recording_) {
+        Submit();
+    }
+    Wait(submitted_ticket_);
+    for (auto& batch : free_batches_) {
+        VulkanCommandPool::FreeCommandBuffer(&batch.transfer_command_buffer);
+        VulkanLogicDevice::DestroySemaphore(&batch.transfer_semaphore);
+        VulkanCommandPool::FreeCommandBuffer(&batch.graphic_command_buffer);
+        VulkanLogicDevice::DestroyFence(&batch.fence);
+    }
+    free_batches_.clear();
+    VulkanLogicDevice::DestroyCommandPool(&transfer_command_pool_);
+    VulkanLogicDevice::DestroyCommandPool(&graphic_command_pool_);
+}
+
+bool VulkanUploadContext::UploadImage(const image_upload_t& upload, const void* data, VkDeviceSize size,
+                                      uint32_t region_count, const VkBufferImageCopy* regions) {
+    return UploadImage(upload, size, [data, size](void* staging) {
+        memcpy(staging, data, size);
+    }, region_count, regions);
+}
+
+bool VulkanUploadContext::UploadImage(const image_upload_t& upload, VkDeviceSize size,
+                                      const std::function<void(void* staging)>& write,
+                                      uint32_t region_count, const VkBufferImageCopy* regions) {
+    if (!ValidateImageUpload(upload, region_count, regions)) {
+        return false;
+    }
+    staging_region_t staging{};
+    // bufferOffset 要是 texel block 大小的倍数, 16 满足所有 color format, 压缩格式 (8 或 16 字节的 block)
+    // 和多平面 format 每个平面的要求
+    if (!device_->staging_ring()->Reserve(size, 16, &staging)) {
+        return false;
+    }
+    write(staging.data);
+    std::vector<VkBufferImageCopy> copies(regions, regions + region_count);
+    for (auto& copy : copies) {
+        copy.bufferOffset += staging.offset;
+    }
+    stats_.copied_bytes += size;
+    RecordImageUpload(upload, staging.buffer, size, static_cast<uint32_t>(copies.size()), copies.data());
+    return true;
+}
+
+bool VulkanUploadContext::UploadImageFromHost(const image_upload_t& upload, const void* data, VkDeviceSize size,
+                                              uint32_t region_count, const VkBufferImageCopy* regions) {
+    if (!ValidateImageUpload(upload, region_count, regions)) {
+        return false;
+    }
+    VulkanHostImporter* importer = device_->host_importer();
+    host_import_t import{};
+    if (importer == nullptr || size < HOST_IMPORT_MIN_SIZE ||
+            !importer->Import(data, size, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, &import)) {
+        return UploadImage(upload, data, size, region_count, regions);
+    }
+    // 和 staging 一样要求 bufferOffset 是 16 的倍数, data 本身没有对齐时只能复制
+    if (import.offset % 16 != 0) {
+        VulkanHostImporter::Release(&import);
+        return UploadImage(upload, data, size, region_count, regions);
+    }
+    std::vector<VkBufferImageCopy> copies(regions, regions + region_count);
+    for (auto& copy : copies) {
+        copy.bufferOffset += import.offset;
+    }
+    BeginBatch();
+    // 命令录进去之后无论成败都要等这一批完成才能释放
+    open_batch_.imports.push_back(import);
+    stats_.imported_bytes += size;
+    RecordImageUpload(upload, import.buffer->buffer(), size, static_cast<uint32_t>(copies.size()), copies.data());
+    return true;
+}
+
+bool VulkanUploadContext::ValidateImageUpload(const image_upload_t& upload, uint32_t region_count,
+                                              const VkBufferImageCopy* regions) {
+    if (upload.image == VK_NULL_HANDLE || upload.mip_levels == 0 || region_count == 0 || regions == nullptr) {
+        LOG_E("VulkanUploadContext", "invalid image upload\n");
+        return false;
+    }
+    if (upload.generate_mipmaps && upload.mipmap_generator != nullptr &&
+            !upload.mipmap_generator->CanGenerateMipmaps(upload)) {
+        LOG_E("VulkanUploadContext", "generate %u mip levels not supported\n", upload.mip_levels);
+        return false;
+    }
+    return true;
+}
+
+void VulkanUploadContext::RecordImageUpload(const image_upload_t& upload, VkBuffer buffer, VkDeviceSize size,
+                                            uint32_t region_count, const VkBufferImageCopy* regions) {
+    BeginBatch();
+    VulkanCommandBuffer* copy_command_buffer = transfer_queue_ ?
+            open_batch_.transfer_command_buffer : open_batch_.graphic_command_buffer;
+    CmdImageBarrier(copy_command_buffer, upload.image, upload.mip_levels,
+                    VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+                    VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, 0,
+                    VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT,
+                    VK_QUEUE_FAMILY_IGNORED, VK_QUEUE_FAMILY_IGNORED);
+    copy_command_buffer->CmdCopyBufferToImage(buffer, upload.image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+                                              region_count, regions);
+
+    // 生成 mipmap 时先停在 TRANSFER_DST, 由 CmdGenerateMipmaps 转换到 final_layout
+    VkImageLayout copied_layout = upload.generate_mipmaps ? VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL : upload.final_layout;
+    VkPipelineStageFlags acquire_stage_mask = upload.generate_mipmaps ? VK_PIPELINE_STAGE_TRANSFER_BIT : upload.dst_stage_mask;
+    VkAccessFlags acquire_access_mask = upload.generate_mipmaps ?
+            VK_ACCESS_TRANSFER_READ_BIT | VK_ACCESS_TRANSFER_WRITE_BIT : upload.dst_access_mask;
+    if (transfer_queue_) {
+        // release 和 acquire 两个 barrier 的 layout 和 queue family 必须一致
+        CmdImageBarrier(open_batch_.transfer_command_buffer, upload.image, upload.mip_levels,
+                        VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, copied_layout,
+                        VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT,
+                        VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0,
+                        transfer_queue_family_index_, graphic_queue_family_index_);
+        CmdImageBarrier(open_batch_.graphic_command_buffer, upload.image, upload.mip_levels,
+                        VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, copied_layout,
+                        VK_PIPELINE_STAGE_TRANSFER_BIT, 0,
+                        acquire_stage_mask, acquire_access_mask,
+                        transfer_queue_family_index_, graphic_queue_family_index_);
+    } else if (!upload.generate_mipmaps) {
+        CmdImageBarrier(open_batch_.graphic_command_buffer, upload.image, upload.mip_levels,
+                        VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, upload.final_layout,
+                        VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT,
+                        upload.dst_stage_mask, upload.dst_access_mask,
+                        VK_QUEUE_FAMILY_IGNORED, VK_QUEUE_FAMILY_IGNORED);
+    }
+    if (upload.generate_mipmaps && upload.mipmap_generator != nullptr) {
+        // copy 已经录制, 不能再返回 false 让调用者丢掉 ticket. 创建资源失败时退回 blit, image 同样到达 final_layout
+        if (!upload.mipmap_generator->CmdGenerateMipmaps(open_batch_.graphic_command_buffer, upload)) {
+            LOG_W("VulkanUploadContext", "generate %u mip levels failed, fall back to blit\n", upload.mip_levels);
+            CmdGenerateMipmaps(open_batch_.graphic_command_buffer, upload);
+        }
+    } else if (upload.generate_mipmaps) {
+        CmdGenerateMipmaps(open_batch_.graphic_command_buffer, upload);
+    }
+    ++stats_.images;
+    stats_.bytes += size;
+}
+
+uint64_t VulkanUploadContext::Submit() {
+    if (!recording_) {
+        return submitted_ticket_;
+    }
+    recording_ = false;
+    VkFence staging_fence = device_->staging_ring()->Commit();
+    /* typedef struct VkSubmitInfo {
+        VkStructureType                sType;
+        const void*                    pNext;
+        uint32_t                       waitSemaphoreCount;
+        const VkSemaphore*             pWaitSemaphores;
+        const VkPipelineStageFlags*    pWaitDstStageMask;
+        uint32_t                       commandBufferCount;
+        const VkCommandBuffer*         pCommandBuffers;
+        uint32_t                       signalSemaphoreCount;
+        const VkSemaphore*             pSignalSemaphores;
+    } VkSubmitInfo; */
+    VkSemaphore transfer_semaphore = VK_NULL_HANDLE;
+    VkPipelineStageFlags wait_stage = VK_PIPELINE_STAGE_TRANSFER_BIT;
+    if (transfer_queue_) {
+        open_batch_.transfer_command_buffer->EndCommandBuffer();
+        VkCommandBuffer command_buffer = open_batch_.transfer_command_buffer->command_buffer();
+        transfer_semaphore = open_batch_.transfer_semaphore->semaphore();
+        VkSubmitInfo submit_info{};
+        submit_info.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+        submit_info.commandBufferCount = 1;
+        submit_info.pCommandBuffers = &command_buffer;
+        submit_info.signalSemaphoreCount = 1;
+        submit_info.pSignalSemaphores = &transfer_semaphore;
+        // staging 区域只被 transfer queue 读取, 这次提交完成就可以复用
+        VkResult ret = transfer_queue_->QueueSubmit(1, &submit_info, staging_fence);
+        assert(ret == VK_SUCCESS);
+        ++stats_.submits;
+        staging_fence = VK_NULL_HANDLE;
+    }
+
+    open_batch_.graphic_command_buffer->EndCommandBuffer();
+    VkCommandBuffer command_buffer = open_batch_.graphic_command_buffer->command_buffer();
+    VkSubmitInfo submit_info{};
+    submit_info.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+    if (transfer_semaphore != VK_NULL_HANDLE) {
+        submit_info.waitSemaphoreCount = 1;
+        submit_info.pWaitSemaphores = &transfer_semaphore;
+        submit_info.pWaitDstStageMask = &wait_stage;
+    }
+    submit_info.commandBufferCount = 1;
+    submit_info.pCommandBuffers = &command_buffer;
+    VkResult ret = graphic_queue_->QueueSubmit(1, &submit_info, open_batch_.fence->fence());
+    assert(ret == VK_SUCCESS);
+    ++stats_.submits;
+    if (staging_fence != VK_NULL_HANDLE) {
+        // 一次提交只能带一个 fence, 空提交在之前的提交都完成后 signal
+        ret = graphic_queue_->QueueSubmit(0, nullptr, staging_fence);
+        assert(ret == VK_SUCCESS);
+        ++stats_.submits;
+    }
+
+    open_batch_.ticket = ++submitted_ticket_;
+    batches_.push_back(open_batch_);
+    open_batch_ = upload_batch_t{};
+    ++stats_.batches;
+    return submitted_ticket_;
+}
+
+bool VulkanUploadContext::IsComplete(uint64_t ticket) {
+    RecycleCompleted();
+    return ticket <= completed_ticket_;
+}
+
+void VulkanUploadContext::Wait(uint64_t ticket) {
+    while (!batches_.empty() && batches_.front().ticket <= ticket) {
+        VkFence fence = batches_.front().fence->fence();
+        device_->WaitForFences(1, &fence, VK_TRUE, UINT64_MAX);
+        RecycleFront();
+    }
+}
+
+bool VulkanUploadContext::dedicated_transfer_queue() const {
+    return transfer_queue_ != nullptr;
+}
+
+upload_stats_t VulkanUploadContext::stats() const {
+    return stats_;
+}
+
+void VulkanUploadContext::LogStats(const char* tag) const {
+    LOG_D(tag, "upload: %llu images, %.2f MiB (%.2f MiB copied, %.2f MiB imported) in %llu batches, "
+               "%llu submits, %s queue\n",
+          (long long unsigned int) stats_.images, stats_.bytes / (1024.0 * 1024.0),
+          stats_.copied_bytes / (1024.0 * 1024.0), stats_.imported_bytes / (1024.0 * 1024.0),
+          (long long unsigned int) stats_.batches, (long long unsigned int) stats_.submits,
+          transfer_queue_ ? "transfer" : "graphic");
+}
+
+void VulkanUploadContext::BeginBatch() {
+    if (recording_) {
+        return;
+    }
+    RecycleCompleted();
+    if (!free_batches_.empty()) {
+        open_batch_ = free_batches_.back();
+        free_batches_.pop_back();
+    } else {
+        open_batch_ = upload_batch_t{};
+        if (transfer_queue_) {
+            open_batch_.transfer_command_buffer = transfer_command_pool_->AllocateCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY);
+            VkSemaphoreCreateInfo semaphore_info{};
+            semaphore_info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+            open_batch_.transfer_semaphore = device_->CreateSemaphore(&semaphore_info);
+            assert(open_batch_.transfer_command_buffer && open_batch_.transfer_semaphore);
+        }
+        open_batch_.graphic_command_buffer = graphic_command_pool_->AllocateCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY);
+        VkFenceCreateInfo fence_info{};
+        fence_info.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+        open_batch_.fence = device_->CreateFence(&fence_info);
+        assert(open_batch_.graphic_command_buffer && open_batch_.fence);
+    }
+    VkCommandBufferBeginInfo begin_info{};
+    begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    begin_info.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+    if (open_batch_.transfer_command_buffer) {
+        open_batch_.transfer_command_buffer->BeginCommandBuffer(&begin_info);
+    }
+    open_batch_.graphic_command_buffer->BeginCommandBuffer(&begin_info);
+    recording_ = true;
+}
+
+void VulkanUploadContext::RecycleCompleted() {
+    while (!batches_.empty() && device_->GetFenceStatus(batches_.front().fence->fence()) == VK_SUCCESS) {
+        RecycleFront();
+    }
+}
+
+void VulkanUploadContext::RecycleFront() {
+    upload_batch_t batch = batches_.front();
+    batches_.pop_front();
+    completed_ticket_ = batch.ticket;
+    VkFence fence = batch.fence->fence();
+    device_->ResetFences(1, &fence);
+    for (auto& import : batch.imports) {
+        VulkanHostImporter::Release(&import);
+    }
+    batch.imports.clear();
+    free_batches_.push_back(batch);
+    // staging ring 的 fence 在这之前已经 signal
+    device_->staging_ring()->Retire();
+}
+
+void VulkanUploadContext::CmdGenerateMipmaps(VulkanCommandBuffer* command_buffer, const image_upload_t& upload) {
+    int32_t mip_width = static_cast<int32_t>(upload.width);
+    int32_t mip_height = static_cast<int32_t>(upload.height);
+    for (uint32_t i = 1; i < upload.mip_levels; i++) {
+        VkImageMemoryBarrier barrier{};
+        barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+        barrier.image = upload.image;
+        barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+        barrier.subresourceRange.baseMipLevel = i - 1;
+        barrier.subresourceRange.levelCount = 1;
+        barrier.subresourceRange.baseArrayLayer = 0;
+        barrier.subresourceRange.layerCount = 1;
+        barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+        barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+        barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        barrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+        command_buffer->CmdPipelineBarrier(VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0,
+                                           0, nullptr, 0, nullptr, 1, &barrier);
+
+        VkImageBlit blit{};
+        blit.srcOffsets[0] = {0, 0, 0};
+        blit.srcOffsets[1] = {mip_width, mip_height, 1};
+        blit.srcSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+        blit.srcSubresource.mipLevel = i - 1;
+        blit.srcSubresource.baseArrayLayer = 0;
+        blit.srcSubresource.layerCount = 1;
+        blit.dstOffsets[0] = {0, 0, 0};
+        blit.dstOffsets[1] = {mip_width > 1 ? mip_width / 2 : 1, mip_height > 1 ? mip_height / 2 : 1, 1};
+        blit.dstSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+        blit.dstSubresource.mipLevel = i;
+        blit.dstSubresource.baseArrayLayer = 0;
+        blit.dstSubresource.layerCount = 1;
+        command_buffer->CmdBlitImage(upload.image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+                                     upload.image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+                                     1, &blit, VK_FILTER_LINEAR);
+
+        barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+        barrier.newLayout = upload.final_layout;
+        barrier.srcAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+        barrier.dstAccessMask = upload.dst_access_mask;
+        command_buffer->CmdPipelineBarrier(VK_PIPELINE_STAGE_TRANSFER_BIT, upload.dst_stage_mask, 0,
+                                           0, nullptr, 0, nullptr, 1, &barrier);
+
+        if (mip_width > 1) mip_width /= 2;
+        if (mip_height > 1) mip_height /= 2;
+    }
+    VkImageMemoryBarrier barrier{};
+    barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+    barrier.image = upload.image;
+    barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    barrier.subresourceRange.baseMipLevel = upload.mip_levels - 1;
+    barrier.subresourceRange.levelCount = 1;
+    barrier.subresourceRange.baseArrayLayer = 0;
+    barrier.subresourceRange.layerCount = 1;
+    barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+    barrier.newLayout = upload.final_layout;
+    barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    barrier.dstAccessMask = upload.dst_access_mask;
+    command_buffer->CmdPipelineBarrier(VK_PIPELINE_STAGE_TRANSFER_BIT, upload.dst_stage_mask, 0,
+                                       0, nullptr, 0, nullptr, 1, &barrier);
+}
+
+void VulkanUploadContext::CmdImageBarrier(const VulkanCommandBuffer* command_buffer, VkImage image, uint32_t mip_levels,
+                                          VkImageLayout old_layout, VkImageLayout new_layout,
+                                          VkPipelineStageFlags src_stage_mask, VkAccessFlags src_access_mask,
+                                          VkPipelineStageFlags dst_stage_mask, VkAccessFlags dst_access_mask,
+                                          uint32_t src_queue_family_index, uint32_t dst_queue_family_index) {
+    VkImageMemoryBarrier barrier{};
+    barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+    barrier.oldLayout = old_layout;
+    barrier.newLayout = new_layout;
+    barrier.srcQueueFamilyIndex = src_queue_family_index;
+    barrier.dstQueueFamilyIndex = dst_queue_family_index;
+    barrier.image = image;
+    // 多平面 image 不是 disjoint 时用 COLOR 表示所有平面
+    barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    barrier.subresourceRange.baseMipLevel = 0;
+    barrier.subresourceRange.levelCount = mip_levels;
+    barrier.subresourceRange.baseArrayLayer = 0;
+    barrier.subresourceRange.layerCount = 1;
+    barrier.srcAccessMask = src_access_mask;
+    barrier.dstAccessMask = dst_access_mask;
+    command_buffer->CmdPipelineBarrier(src_stage_mask, dst_stage_mask, 0,
+                                       0, nullptr, 0, nullptr, 1, &barrier);
+}
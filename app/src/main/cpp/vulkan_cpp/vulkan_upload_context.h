@@ -0,0 +1,152 @@
+//
+// Created by hj6231 on 2024/2/11.
+//
+
+#pragma once
+#include <deque>
+#include <functional>
+#include <vector>
+#include <vulkan/vulkan.h>
+#include "vulkan_command_buffer.h"
+#include "vulkan_command_pool.h"
+#include "vulkan_fence.h"
+#include "vulkan_host_importer.h"
+#include "vulkan_queue.h"
+#include "vulkan_semaphore.h"
+
+class VulkanLogicDevice;
+class VulkanMipmapGenerator;
+
+typedef struct {
+    VkImage image;
+    // 只有 mipmap_generator 使用
+    VkFormat format;
+    uint32_t width;
+    uint32_t height;
+    uint32_t mip_levels;
+    // 只 copy mip 0, 其余 level 用 blit 生成. blit 只能在 graphic queue 上执行
+    bool generate_mipmaps;
+    // 不为 nullptr 时代替 blit 生成其余 level, 例如 compute shader
+    VulkanMipmapGenerator* mipmap_generator;
+    // 上传完成后的 layout, 以及之后使用这个 image 的 stage 和 access
+    VkImageLayout final_layout;
+    VkPipelineStageFlags dst_stage_mask;
+    VkAccessFlags dst_access_mask;
+} image_upload_t;
+
+// blit 以外的 mipmap 生成方式, 在 graphic queue 的 command buffer 上录制.
+// 调用时所有 level 在 TRANSFER_DST_OPTIMAL, mip 0 的 copy 之后只有 execution dependency (TRANSFER stage),
+// 返回时所有 level 在 upload.final_layout, 对 upload.dst_stage_mask/dst_access_mask 可见
+class VulkanMipmapGenerator {
+public:
+    virtual ~VulkanMipmapGenerator() = default;
+    // 在录制任何命令之前检查. 返回 true 之后 CmdGenerateMipmaps 只会因为创建资源失败 (例如内存不足) 而失败,
+    // 这时 VulkanUploadContext 退回 blit, 所以 image 也要有 TRANSFER_SRC
+    virtual bool CanGenerateMipmaps(const image_upload_t& upload) const = 0;
+    // 失败时不录制任何命令
+    virtual bool CmdGenerateMipmaps(const VulkanCommandBuffer* command_buffer, const image_upload_t& upload) = 0;
+};
+
+typedef struct {
+    uint64_t images;
+    uint64_t bytes;
+    // bytes 里 CPU 复制到 staging 的部分和 GPU 直接从 import 的 host 内存读取的部分
+    uint64_t copied_bytes;
+    uint64_t imported_bytes;
+    uint64_t batches;
+    // vkQueueSubmit 的次数, 包括只用来 signal fence 的空提交
+    uint64_t submits;
+} upload_stats_t;
+
+// 把 layout 转换, copy 和生成 mipmap 的命令录到同一批 command buffer 里, Submit 时一起提交, 不等待 queue idle.
+// 有只支持 transfer 的 queue family 时 copy 在 transfer queue 上执行, 再通过 queue family ownership transfer
+// 交给 graphic queue, 两次提交之间用 semaphore 同步. 调用者用 Submit 返回的 ticket 查询是否完成.
+// graphic queue 上之后提交的渲染命令由 barrier 保证看到上传的内容, 不需要在 CPU 上等待.
+// 只在一个线程使用
+class VulkanUploadContext {
+public:
+    // transfer_queue 为 nullptr 时所有命令都在 graphic queue 上执行
+    VulkanUploadContext(VulkanLogicDevice* device,
+                        VulkanQueue* graphic_queue, uint32_t graphic_queue_family_index,
+                        VulkanQueue* transfer_queue, uint32_t transfer_queue_family_index);
+    VulkanUploadContext(const VulkanUploadContext&) = delete;
+    ~VulkanUploadContext();
+
+    int Create();
+    // 没有提交的命令会先提交, 然后等待全部完成
+    void Destroy();
+
+    // data 先复制到 device 的 staging ring, regions 的 bufferOffset 相对于 data.
+    // image 的 sharingMode 必须是 EXCLUSIVE, 当前 layout 是 UNDEFINED, regions 覆盖整个 subresource
+    bool UploadImage(const image_upload_t& upload, const void* data, VkDeviceSize size,
+                     uint32_t region_count, const VkBufferImageCopy* regions);
+    // 和上面相同, 但由 write 直接往 staging 里写 size 字节, 例如解码或者展开像素, 省掉一次中间 buffer
+    bool UploadImage(const image_upload_t& upload, VkDeviceSize size, const std::function<void(void* staging)>& write,
+                     uint32_t region_count, const VkBufferImageCopy* regions);
+    // 和第一个 UploadImage 相同, 但 size 不小于 HOST_IMPORT_MIN_SIZE 并且 device 打开了 host import 时,
+    // 把 data 所在的内存直接 import 成 copy 的 src buffer, 不经过 staging. 这时 [data, data + size) 必须保持 map,
+    // 并且在 Submit 返回的 ticket 完成之前不能修改或者 unmap, 例如整个上传期间都打开的 mmap 文件.
+    // import 失败时自动退回复制到 staging
+    bool UploadImageFromHost(const image_upload_t& upload, const void* data, VkDeviceSize size,
+                             uint32_t region_count, const VkBufferImageCopy* regions);
+    // 没有新的命令时返回上一次提交的 ticket
+    uint64_t Submit();
+    // 不阻塞
+    bool IsComplete(uint64_t ticket);
+    void Wait(uint64_t ticket);
+
+    bool dedicated_transfer_queue() const;
+    upload_stats_t stats() const;
+    void LogStats(const char* tag) const;
+
+    // 每个 level 一次 blit 和两个 barrier, 前置条件和 VulkanMipmapGenerator 相同. 公开出来给 benchmark 对比
+    static void CmdGenerateMipmaps(VulkanCommandBuffer* command_buffer, const image_upload_t& upload);
+
+    // 更小的上传复制到 staging 比单独 import 一次 (创建 buffer, vkAllocateMemory) 更便宜
+    const static VkDeviceSize HOST_IMPORT_MIN_SIZE = 256 * 1024;
+
+    VulkanUploadContext& operator = (const VulkanUploadContext&) = delete;
+private:
+    typedef struct {
+        uint64_t ticket;
+        // 没有 transfer queue 时为 nullptr
+        VulkanCommandBuffer* transfer_command_buffer;
+        VulkanSemaphore* transfer_semaphore;
+        VulkanCommandBuffer* graphic_command_buffer;
+        VulkanFence* fence;
+        // 这一批 copy 读取的 host import, fence signal 之后释放
+        std::vector<host_import_t> imports;
+    } upload_batch_t;
+
+    // 在 Reserve 和 import 之前调用, 通过之后 RecordImageUpload 总是把 image 转换到 final_layout
+    static bool ValidateImageUpload(const image_upload_t& upload, uint32_t region_count,
+                                    const VkBufferImageCopy* regions);
+    // regions 的 bufferOffset 已经是相对于 buffer 的偏移
+    void RecordImageUpload(const image_upload_t& upload, VkBuffer buffer, VkDeviceSize size,
+                           uint32_t region_count, const VkBufferImageCopy* regions);
+    void BeginBatch();
+    void RecycleCompleted();
+    void RecycleFront();
+    static void CmdImageBarrier(const VulkanCommandBuffer* command_buffer, VkImage image, uint32_t mip_levels,
+                                VkImageLayout old_layout, VkImageLayout new_layout,
+                                VkPipelineStageFlags src_stage_mask, VkAccessFlags src_access_mask,
+                                VkPipelineStageFlags dst_stage_mask, VkAccessFlags dst_access_mask,
+                                uint32_t src_queue_family_index, uint32_t dst_queue_family_index);
+
+    VulkanLogicDevice* device_;
+    VulkanQueue* graphic_queue_;
+    uint32_t graphic_queue_family_index_;
+    VulkanQueue* transfer_queue_;
+    uint32_t transfer_queue_family_index_;
+    VulkanCommandPool* graphic_command_pool_;
+    VulkanCommandPool* transfer_command_pool_;
+
+    bool recording_;
+    upload_batch_t open_batch_;
+    std::deque<upload_batch_t> batches_;
+    std::vector<upload_batch_t> free_batches_;
+    uint64_t submitted_ticket_;
+    uint64_t completed_ticket_;
+
+    upload_stats_t stats_;
+};
@@ -16,6 +16,15 @@ bool CheckValidationLayerSupport(const std::vector<VkLayerProperties>& layer_pro
     return support;
 }
 
+bool CheckInstanceExtensionSupport(const std::vector<VkExtensionProperties>& extension_properties, const char* extension_name) {
+    for (const auto& extension_property : extension_properties) {
+        if (strcmp(extension_name, extension_property.extensionName) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
 bool CheckPhysicalDeviceGraphicSupport(const VulkanPhysicalDevice& device) {
     std::vector<VkQueueFamilyProperties> family_properties = device.GetQueueFamilyProperties();
     bool graphic =
@@ -65,3 +74,41 @@ void GetPresentQueueFamilyIndexes(const VulkanPhysicalDevice& device, VkSurfaceK
     }
     *len = num;
 }
+
+bool GetTransferQueueFamilyIndex(const VulkanPhysicalDevice& device, uint32_t* index) {
+    std::vector<VkQueueFamilyProperties> family_properties = device.GetQueueFamilyProperties();
+    for (uint32_t i = 0; i < family_properties.size(); ++i) {
+        VkQueueFlags flags = family_properties[i].queueFlags;
+        if ((flags & VK_QUEUE_TRANSFER_BIT) && !(flags & (VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT))) {
+            *index = i;
+            return true;
+        }
+    }
+    return false;
+}
+
+bool GetComputeQueueFamilyIndex(const VulkanPhysicalDevice& device, uint32_t* index) {
+    std::vector<VkQueueFamilyProperties> family_properties = device.GetQueueFamilyProperties();
+    for (uint32_t i = 0; i < family_properties.size(); ++i) {
+        VkQueueFlags flags = family_properties[i].queueFlags;
+        if ((flags & VK_QUEUE_COMPUTE_BIT) && !(flags & VK_QUEUE_GRAPHICS_BIT)) {
+            *index = i;
+            return true;
+        }
+    }
+    return false;
+}
+
+VkDeviceSize GetMinImportedHostPointerAlignment(const VulkanPhysicalDevice& device) {
+    if (!CheckInstanceExtensionSupport(device.EnumerateExtensionProperties(),
+                                       VK_EXT_EXTERNAL_MEMORY_HOST_EXTENSION_NAME)) {
+        return 0;
+    }
+    VkPhysicalDeviceExternalMemoryHostPropertiesEXT host_properties{};
+    host_properties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_EXTERNAL_MEMORY_HOST_PROPERTIES_EXT;
+    VkPhysicalDeviceProperties2 properties{};
+    properties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2;
+    properties.pNext = &host_properties;
+    device.GetProperties2(&properties);
+    return host_properties.minImportedHostPointerAlignment;
+}
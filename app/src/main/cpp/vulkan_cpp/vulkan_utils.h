@@ -9,6 +9,8 @@
 
 bool CheckValidationLayerSupport(const std::vector<VkLayerProperties>& layer_properties);
 
+bool CheckInstanceExtensionSupport(const std::vector<VkExtensionProperties>& extension_properties, const char* extension_name);
+
 bool CheckPhysicalDeviceGraphicSupport(const VulkanPhysicalDevice& device);
 
 bool CheckPhysicalDeviceSwapChainSupport(const VulkanPhysicalDevice& device);
@@ -17,4 +19,13 @@ bool CheckPhysicalDeviceSamplerAnisotropySupport(const VulkanPhysicalDevice& dev
 
 void GetGraphicQueueFamilyIndexes(const VulkanPhysicalDevice& device, uint32_t* indexes, uint32_t max_len, uint32_t* len);
 
-void GetPresentQueueFamilyIndexes(const VulkanPhysicalDevice& device, VkSurfaceKHR surface, uint32_t* indexes, uint32_t max_len, uint32_t* len);
\ No newline at end of file
+void GetPresentQueueFamilyIndexes(const VulkanPhysicalDevice& device, VkSurfaceKHR surface, uint32_t* indexes, uint32_t max_len, uint32_t* len);
+
+// 只支持 transfer, 不支持 graphic 和 compute 的 queue family, 通常对应独立的 DMA 引擎. 没有时返回 false
+bool GetTransferQueueFamilyIndex(const VulkanPhysicalDevice& device, uint32_t* index);
+
+// 支持 compute, 不支持 graphic 的 queue family (async compute), 和 graphic queue 并行执行. 没有时返回 false
+bool GetComputeQueueFamilyIndex(const VulkanPhysicalDevice& device, uint32_t* index);
+
+// device 支持 VK_EXT_external_memory_host 时返回 minImportedHostPointerAlignment, 不支持返回 0
+VkDeviceSize GetMinImportedHostPointerAlignment(const VulkanPhysicalDevice& device);
@@ -101,7 +101,8 @@ void DepthTriangle::DestroyPipeline() {
 }
 
 void DepthTriangle::Draw(const VulkanCommandBuffer* command_buffer,
-                    const VulkanFrameBuffer* frame_buffer) const {
+                    const VulkanFrameBuffer* frame_buffer,
+                    const frame_context_t* frame) const {
 
     /* typedef struct VkCommandBufferBeginInfo {
         VkStructureType                          sType;
@@ -154,6 +155,14 @@ void DepthTriangle::Draw(const VulkanCommandBuffer* command_buffer,
     command_buffer->EndCommandBuffer();
 }
 
+void DepthTriangle::Resize(VkExtent2D frame_buffer_size) {
+    VulkanObject::Resize(frame_buffer_size);
+    DestroyDepthImageView();
+    DestroyDepthImage();
+    CreateDepthImage();
+    CreateDepthImageView();
+}
+
 void DepthTriangle::LoadResource() {
     CreateDepthImage();
     CreateDepthImageView();
@@ -279,27 +288,9 @@ void DepthTriangle::CreateVertexBuffer() {
     buffer_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
     vertex_buffer_ = device_->CreateBuffer(&buffer_info);
     assert(vertex_buffer_);
-    VkMemoryRequirements mem_requirements{};
-    vertex_buffer_->GetBufferMemoryRequirements(&mem_requirements);
-    VkPhysicalDeviceMemoryProperties mem_properties{};
-    device_->GetPhysicalDeviceMemoryProperties(&mem_properties);
-
-    /* typedef struct VkMemoryAllocateInfo {
-        VkStructureType    sType;
-        const void*        pNext;
-        VkDeviceSize       allocationSize;
-        uint32_t           memoryTypeIndex;
-    } VkMemoryAllocateInfo; */
-    VkMemoryAllocateInfo alloc_info{};
-    alloc_info.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-    alloc_info.allocationSize = mem_requirements.size;
-    VkResult ret = VulkanLogicDevice::GetMemoryType(&mem_properties, mem_requirements.memoryTypeBits,
-                                                    VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT | VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
-                                                    &alloc_info.memoryTypeIndex);
-    assert(ret == VK_SUCCESS);
-    vertex_memory_ = device_->AllocateMemory(&alloc_info);
+    vertex_memory_ = device_->AllocateBufferMemory(vertex_buffer_, MEMORY_USAGE_CPU_TO_GPU);
     assert(vertex_memory_);
-    ret = vertex_memory_->BindBufferMemory(vertex_buffer_->buffer(), 0);
+    VkResult ret = vertex_memory_->BindBufferMemory(vertex_buffer_->buffer(), 0);
     assert(ret == VK_SUCCESS);
 
     void* data = nullptr;
@@ -332,27 +323,9 @@ void DepthTriangle::CreateIndexBuffer() {
     buffer_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
     indices_buffer_ = device_->CreateBuffer(&buffer_info);
     assert(indices_buffer_);
-    VkMemoryRequirements mem_requirements{};
-    indices_buffer_->GetBufferMemoryRequirements(&mem_requirements);
-    VkPhysicalDeviceMemoryProperties mem_properties{};
-    device_->GetPhysicalDeviceMemoryProperties(&mem_properties);
-
-    /* typedef struct VkMemoryAllocateInfo {
-        VkStructureType    sType;
-        const void*        pNext;
-        VkDeviceSize       allocationSize;
-        uint32_t           memoryTypeIndex;
-    } VkMemoryAllocateInfo; */
-    VkMemoryAllocateInfo alloc_info{};
-    alloc_info.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-    alloc_info.allocationSize = mem_requirements.size;
-    VkResult ret = VulkanLogicDevice::GetMemoryType(&mem_properties, mem_requirements.memoryTypeBits,
-                                                    VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT | VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
-                                                    &alloc_info.memoryTypeIndex);
-    assert(ret == VK_SUCCESS);
-    indices_memory_ = device_->AllocateMemory(&alloc_info);
+    indices_memory_ = device_->AllocateBufferMemory(indices_buffer_, MEMORY_USAGE_CPU_TO_GPU);
     assert(indices_memory_);
-    ret = indices_memory_->BindBufferMemory(indices_buffer_->buffer(), 0);
+    VkResult ret = indices_memory_->BindBufferMemory(indices_buffer_->buffer(), 0);
     assert(ret == VK_SUCCESS);
 
     void* data = nullptr;
@@ -385,20 +358,7 @@ void DepthTriangle::CreateDepthImage() {
     depth_attachment_image_ = device_->CreateImage(&imageInfo);
     assert(depth_attachment_image_);
 
-    VkMemoryRequirements mem_requirements;
-    depth_attachment_image_->GetImageMemoryRequirements(&mem_requirements);
-
-    VkPhysicalDeviceMemoryProperties mem_properties{};
-    device_->GetPhysicalDeviceMemoryProperties(&mem_properties);
-
-    VkMemoryAllocateInfo alloc_info{};
-    alloc_info.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-    alloc_info.allocationSize = mem_requirements.size;
-    VkResult ret = VulkanLogicDevice::GetMemoryType(&mem_properties, mem_requirements.memoryTypeBits,
-                                                    VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
-                                                    &alloc_info.memoryTypeIndex);
-    assert(ret == VK_SUCCESS);
-    depth_attachment_image_memory_ = device_->AllocateMemory(&alloc_info);
+    depth_attachment_image_memory_ = device_->AllocateImageMemory(depth_attachment_image_, MEMORY_USAGE_GPU_ONLY);
     depth_attachment_image_memory_->BindImageMemory(depth_attachment_image_->image(), 0);
 //    TransitionImageLayout();
 }
@@ -23,7 +23,9 @@ public:
     } vertex_t;
 
     void Draw(const VulkanCommandBuffer* command_buffer,
-              const VulkanFrameBuffer* frame_buffer) const override;
+              const VulkanFrameBuffer* frame_buffer,
+              const frame_context_t* frame) const override;
+    void Resize(VkExtent2D frame_buffer_size) override;
 protected:
     void LoadResource() override;
     void CreateRenderPass() override;
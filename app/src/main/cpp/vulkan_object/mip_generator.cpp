@@ -0,0 +1,433 @@
+//
+// Created by hj6231 on 2024/2/16.
+//
+
+#include "mip_generator.h"
+
+#include <cassert>
+#include <cstring>
+#include "log.h"
+
+// levels 只在 case 里用常量下标访问, 不需要 shaderStorageImageArrayDynamicIndexing.
+// 没有用到的数组元素由 C++ 填成最后一个 level 的 view, 不会写
+static const char kComputeShaderSource[] =
+        "#version 450\n"
+        "#ifndef IMAGE_FORMAT\n"
+        "#define IMAGE_FORMAT rgba8\n"
+        "#endif\n"
+        "layout(local_size_x = 256, local_size_y = 1, local_size_z = 1) in;\n"
+        "layout(binding = 0, IMAGE_FORMAT) uniform coherent image2D levels[13];\n"
+        "layout(std430, binding = 1) coherent buffer Counter {\n"
+        "    uint counter;\n"
+        "};\n"
+        "layout(push_constant) uniform Params {\n"
+        "    ivec2 size;\n"
+        "    int mip_levels;\n"
+        "    uint workgroup_count;\n"
+        "} params;\n"
+        "shared vec4 s_texels[256];\n"
+        "shared bool s_last;\n"
+        "#ifdef FILTER_KAISER\n"
+        "const float KAISER_WEIGHTS[6] = float[6](-0.020992, 0.094502, 0.426490, 0.426490, 0.094502, -0.020992);\n"
+        "#endif\n"
+        "ivec2 LevelSize(int level) {\n"
+        "    return max(params.size >> level, ivec2(1));\n"
+        "}\n"
+        "vec4 Load(int level, ivec2 p) {\n"
+        "    p = clamp(p, ivec2(0), LevelSize(level) - 1);\n"
+        "    return level == 0 ? imageLoad(levels[0], p) : imageLoad(levels[6], p);\n"
+        "}\n"
+        "void Store(int level, ivec2 p, vec4 value) {\n"
+        "    if (level >= params.mip_levels || any(greaterThanEqual(p, LevelSize(level)))) {\n"
+        "        return;\n"
+        "    }\n"
+        "    switch (level) {\n"
+        "        case 1: imageStore(levels[1], p, value); break;\n"
+        "        case 2: imageStore(levels[2], p, value); break;\n"
+        "        case 3: imageStore(levels[3], p, value); break;\n"
+        "        case 4: imageStore(levels[4], p, value); break;\n"
+        "        case 5: imageStore(levels[5], p, value); break;\n"
+        "        case 6: imageStore(levels[6], p, value); break;\n"
+        "        case 7: imageStore(levels[7], p, value); break;\n"
+        "        case 8: imageStore(levels[8], p, value); break;\n"
+        "        case 9: imageStore(levels[9], p, value); break;\n"
+        "        case 10: imageStore(levels[10], p, value); break;\n"
+        "        case 11: imageStore(levels[11], p, value); break;\n"
+        "        case 12: imageStore(levels[12], p, value); break;\n"
+        "    }\n"
+        "}\n"
+        // 从 image 里的 level 算出 level + 1 的 p
+        "vec4 ReduceFromImage(int level, ivec2 p) {\n"
+        "#ifdef FILTER_KAISER\n"
+        "    if (level == 0) {\n"
+        "        vec4 sum = vec4(0.0);\n"
+        "        for (int y = 0; y < 6; ++y) {\n"
+        "            vec4 row = vec4(0.0);\n"
+        "            for (int x = 0; x < 6; ++x) {\n"
+        "                row += KAISER_WEIGHTS[x] * Load(0, p * 2 + ivec2(x - 2, y - 2));\n"
+        "            }\n"
+        "            sum += KAISER_WEIGHTS[y] * row;\n"
+        "        }\n"
+        "        return max(sum, vec4(0.0));\n"
+        "    }\n"
+        "#endif\n"
+        "    ivec2 s = p * 2;\n"
+        "    return (Load(level, s) + Load(level, s + ivec2(1, 0)) +\n"
+        "            Load(level, s + ivec2(0, 1)) + Load(level, s + ivec2(1, 1))) * 0.25;\n"
+        "}\n"
+        // 一个 workgroup 从 base 的 64x64 算出 base + 1 到 base + 6
+        "void Downsample(int base, ivec2 group) {\n"
+        "    int t = int(gl_LocalInvocationIndex);\n"
+        "    ivec2 p2 = group * 16 + ivec2(t % 16, t / 16);\n"
+        "    ivec2 size1 = LevelSize(base + 1);\n"
+        "    vec4 sum = vec4(0.0);\n"
+        "    for (int i = 0; i < 4; ++i) {\n"
+        "        ivec2 p1 = p2 * 2 + ivec2(i & 1, i >> 1);\n"
+        "        vec4 value = ReduceFromImage(base, min(p1, size1 - 1));\n"
+        "        Store(base + 1, p1, value);\n"
+        "        sum += value;\n"
+        "    }\n"
+        "    s_texels[t] = sum * 0.25;\n"
+        "    Store(base + 2, p2, s_texels[t]);\n"
+        "    barrier();\n"
+        "    int side = 8;\n"
+        "    for (int level = base + 3; level <= base + 6 && level < params.mip_levels; ++level) {\n"
+        "        ivec2 src_size = LevelSize(level - 1);\n"
+        "        ivec2 src_origin = group * side * 2;\n"
+        "        ivec2 q = ivec2(t % side, t / side);\n"
+        "        bool active = t < side * side;\n"
+        "        vec4 value = vec4(0.0);\n"
+        "        if (active) {\n"
+        "            for (int i = 0; i < 4; ++i) {\n"
+        "                ivec2 src = min(src_origin + q * 2 + ivec2(i & 1, i >> 1), src_size - 1) - src_origin;\n"
+        "                src = max(src, ivec2(0));\n"
+        "                value += s_texels[src.y * side * 2 + src.x];\n"
+        "            }\n"
+        "            value *= 0.25;\n"
+        "        }\n"
+        "        barrier();\n"
+        "        if (active) {\n"
+        "            s_texels[t] = value;\n"
+        "            Store(level, group * side + q, value);\n"
+        "        }\n"
+        "        barrier();\n"
+        "        side /= 2;\n"
+        "    }\n"
+        "}\n"
+        "void main() {\n"
+        "    Downsample(0, ivec2(gl_WorkGroupID.xy));\n"
+        "    if (params.mip_levels <= 7) {\n"
+        "        return;\n"
+        "    }\n"
+        "    memoryBarrierImage();\n"
+        "    barrier();\n"
+        "    if (gl_LocalInvocationIndex == 0u) {\n"
+        "        s_last = atomicAdd(counter, 1u) == params.workgroup_count - 1u;\n"
+        "    }\n"
+        "    barrier();\n"
+        "    if (!s_last) {\n"
+        "        return;\n"
+        "    }\n"
+        "    if (gl_LocalInvocationIndex == 0u) {\n"
+        "        counter = 0u;\n"
+        "    }\n"
+        "    Downsample(6, ivec2(0));\n"
+        "}\n";
+
+static void CmdImageBarrier(const VulkanCommandBuffer* command_buffer, VkImage image, uint32_t mip_levels,
+                            VkImageLayout old_layout, VkImageLayout new_layout,
+                            VkPipelineStageFlags src_stage_mask, VkAccessFlags src_access_mask,
+                            VkPipelineStageFlags dst_stage_mask, VkAccessFlags dst_access_mask) {
+    VkImageMemoryBarrier barrier{};
+    barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+    barrier.oldLayout = old_layout;
+    barrier.newLayout = new_layout;
+    barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.image = image;
+    barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    barrier.subresourceRange.baseMipLevel = 0;
+    barrier.subresourceRange.levelCount = mip_levels;
+    barrier.subresourceRange.baseArrayLayer = 0;
+    barrier.subresourceRange.layerCount = 1;
+    barrier.srcAccessMask = src_access_mask;
+    barrier.dstAccessMask = dst_access_mask;
+    command_buffer->CmdPipelineBarrier(src_stage_mask, dst_stage_mask, 0, 0, nullptr, 0, nullptr, 1, &barrier);
+}
+
+MipGenerator::MipGenerator(VulkanLogicDevice* device, VkFormat format, MipFilter filter) :
+        device_(device),
+        format_(format),
+        filter_(filter),
+        descriptor_set_layout_(nullptr),
+        descriptor_pool_(nullptr),
+        pipeline_layout_(nullptr),
+        pipeline_(nullptr),
+        counter_buffer_(nullptr),
+        counter_memory_(nullptr) {
+}
+
+MipGenerator::~MipGenerator() {
+    Destroy();
+}
+
+int MipGenerator::Create() {
+    if (ImageFormatQualifier(format_) == nullptr) {
+        LOG_E("MipGenerator", "format %d is not supported\n", format_);
+        return -1;
+    }
+    VulkanShaderModule* shader_module = VulkanObject::CreateShaderModule(device_, "mip_generator.comp",
+                                                                         shaderc_compute_shader,
+                                                                         kComputeShaderSource, false, macros());
+    if (shader_module == nullptr) {
+        return -1;
+    }
+    CreateDescriptorSetLayout();
+    CreateDescriptorPool();
+    CreatePipelineLayout();
+    CreateCounterBuffer();
+
+    VkPipelineShaderStageCreateInfo stage_info{};
+    stage_info.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+    stage_info.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+    stage_info.module = shader_module->shader_module();
+    stage_info.pName = "main";
+    VkComputePipelineCreateInfo pipeline_info{};
+    pipeline_info.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+    pipeline_info.stage = stage_info;
+    pipeline_info.layout = pipeline_layout_->layout();
+    pipeline_info.basePipelineHandle = VK_NULL_HANDLE;
+    pipeline_info.basePipelineIndex = -1;
+    pipeline_ = device_->CreateComputePipeline(&pipeline_info);
+    VulkanLogicDevice::DestroyShaderModule(&shader_module);
+    return pipeline_ != nullptr ? 0 : -1;
+}
+
+void MipGenerator::Destroy() {
+    ReleaseJobs();
+    VulkanLogicDevice::DestroyPipelines(&pipeline_);
+    VulkanLogicDevice::DestroyPipelineLayout(&pipeline_layout_);
+    VulkanLogicDevice::DestroyDescriptorPool(&descriptor_pool_);
+    VulkanLogicDevice::DestroyDescriptorSetLayout(&descriptor_set_layout_);
+    if (counter_memory_ != nullptr) {
+        counter_memory_->UnmapMemory();
+    }
+    VulkanLogicDevice::FreeMemory(&counter_memory_);
+    VulkanLogicDevice::DestroyBuffer(&counter_buffer_);
+}
+
+bool MipGenerator::IsSupported(uint32_t width, uint32_t height) const {
+    if (ImageFormatQualifier(format_) == nullptr || width == 0 || height == 0 ||
+            width > MAX_SIZE || height > MAX_SIZE) {
+        return false;
+    }
+    VkFormatProperties properties{};
+    device_->GetPhysicalDeviceFormatProperties(format_, &properties);
+    return (properties.optimalTilingFeatures & VK_FORMAT_FEATURE_STORAGE_IMAGE_BIT) != 0;
+}
+
+bool MipGenerator::CanGenerateMipmaps(const image_upload_t& upload) const {
+    return pipeline_ != nullptr && jobs_.size() < MAX_JOBS && upload.format == format_ &&
+           upload.mip_levels > 0 && upload.mip_levels <= MAX_LEVELS && IsSupported(upload.width, upload.height);
+}
+
+bool MipGenerator::CmdGenerateMipmaps(const VulkanCommandBuffer* command_buffer, const image_upload_t& upload) {
+    if (!CanGenerateMipmaps(upload)) {
+        return false;
+    }
+    job_t job{};
+    for (uint32_t level = 0; level < upload.mip_levels; ++level) {
+        VkImageViewCreateInfo view_info{};
+        view_info.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+        view_info.image = upload.image;
+        view_info.viewType = VK_IMAGE_VIEW_TYPE_2D;
+        view_info.format = format_;
+        view_info.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+        view_info.subresourceRange.baseMipLevel = level;
+        view_info.subresourceRange.levelCount = 1;
+        view_info.subresourceRange.baseArrayLayer = 0;
+        view_info.subresourceRange.layerCount = 1;
+        VulkanImageView* view = device_->CreateImageView(&view_info);
+        if (view == nullptr) {
+            for (auto& created : job.views) {
+                VulkanLogicDevice::DestroyImageView(&created);
+            }
+            return false;
+        }
+        job.views.push_back(view);
+    }
+    VkDescriptorSetLayout set_layout = descriptor_set_layout_->descriptor_set_layout();
+    job.descriptor_set = descriptor_pool_->AllocateDescriptorSet(&set_layout);
+    assert(job.descriptor_set);
+
+    VkDescriptorImageInfo image_infos[MAX_LEVELS];
+    for (uint32_t i = 0; i < MAX_LEVELS; ++i) {
+        uint32_t level = i < upload.mip_levels ? i : upload.mip_levels - 1;
+        image_infos[i].sampler = VK_NULL_HANDLE;
+        image_infos[i].imageView = job.views[level]->image_view();
+        image_infos[i].imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+    }
+    VkDescriptorBufferInfo counter_info{};
+    counter_info.buffer = counter_buffer_->buffer();
+    counter_info.offset = jobs_.size() * COUNTER_STRIDE;
+    counter_info.range = sizeof(uint32_t);
+    VkWriteDescriptorSet writes[2] = {};
+    writes[0].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+    writes[0].dstSet = job.descriptor_set->descriptor_set();
+    writes[0].dstBinding = 0;
+    writes[0].descriptorCount = MAX_LEVELS;
+    writes[0].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+    writes[0].pImageInfo = image_infos;
+    writes[1].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+    writes[1].dstSet = job.descriptor_set->descriptor_set();
+    writes[1].dstBinding = 1;
+    writes[1].descriptorCount = 1;
+    writes[1].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    writes[1].pBufferInfo = &counter_info;
+    device_->UpdateDescriptorSets(2, writes);
+
+    // mip 0 的 copy 写完之后才能读, 其余 level 的内容不需要保留
+    CmdImageBarrier(command_buffer, upload.image, upload.mip_levels,
+                    VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_GENERAL,
+                    VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT,
+                    VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT);
+    if (upload.mip_levels > 1) {
+        push_constants_t constants{};
+        constants.width = static_cast<int32_t>(upload.width);
+        constants.height = static_cast<int32_t>(upload.height);
+        constants.mip_levels = static_cast<int32_t>(upload.mip_levels);
+        uint32_t groups_x = (upload.width + TILE_SIZE - 1) / TILE_SIZE;
+        uint32_t groups_y = (upload.height + TILE_SIZE - 1) / TILE_SIZE;
+        constants.workgroup_count = groups_x * groups_y;
+        VkDescriptorSet descriptor_set = job.descriptor_set->descriptor_set();
+        command_buffer->CmdBindPipeline(VK_PIPELINE_BIND_POINT_COMPUTE, pipeline_->pipeline());
+        command_buffer->CmdBindDescriptorSets(VK_PIPELINE_BIND_POINT_COMPUTE, pipeline_layout_->layout(), 0, 1,
+                                              &descriptor_set, 0, nullptr);
+        command_buffer->CmdPushConstants(pipeline_layout_->layout(), VK_SHADER_STAGE_COMPUTE_BIT, 0,
+                                         sizeof(constants), &constants);
+        command_buffer->CmdDispatch(groups_x, groups_y, 1);
+    }
+    CmdImageBarrier(command_buffer, upload.image, upload.mip_levels,
+                    VK_IMAGE_LAYOUT_GENERAL, upload.final_layout,
+                    VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_WRITE_BIT,
+                    upload.dst_stage_mask, upload.dst_access_mask);
+    jobs_.push_back(job);
+    return true;
+}
+
+void MipGenerator::ReleaseJobs() {
+    for (auto& job : jobs_) {
+        VulkanDescriptorPool::FreeDescriptorSet(&job.descriptor_set);
+        for (auto& view : job.views) {
+            VulkanLogicDevice::DestroyImageView(&view);
+        }
+    }
+    jobs_.clear();
+}
+
+const char* MipGenerator::FilterName(MipFilter filter) {
+    switch (filter) {
+        case MIP_FILTER_BOX: return "box";
+        case MIP_FILTER_KAISER: return "kaiser";
+        default: return "unknown";
+    }
+}
+
+uint32_t MipGenerator::GetMipLevels(uint32_t width, uint32_t height) {
+    uint32_t size = width > height ? width : height;
+    uint32_t levels = 1;
+    while (size > 1) {
+        size >>= 1;
+        ++levels;
+    }
+    return levels;
+}
+
+const char* MipGenerator::ImageFormatQualifier(VkFormat format) {
+    switch (format) {
+        case VK_FORMAT_R8G8B8A8_UNORM: return "rgba8";
+        case VK_FORMAT_R16G16B16A16_SFLOAT: return "rgba16f";
+        case VK_FORMAT_R32G32B32A32_SFLOAT: return "rgba32f";
+        default: return nullptr;
+    }
+}
+
+shader_macro_list_t MipGenerator::macros() const {
+    // 和 shader_archiver 里列出的组合一致, rgba8 + BOX 是默认组合
+    shader_macro_list_t macros;
+    if (filter_ == MIP_FILTER_KAISER) {
+        macros.push_back(std::make_pair("FILTER_KAISER", "1"));
+    }
+    if (format_ != VK_FORMAT_R8G8B8A8_UNORM) {
+        macros.push_back(std::make_pair("IMAGE_FORMAT", ImageFormatQualifier(format_)));
+    }
+    return macros;
+}
+
+void MipGenerator::CreateDescriptorSetLayout() {
+    VkDescriptorSetLayoutBinding bindings[2] = {};
+    bindings[0].binding = 0;
+    bindings[0].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+    bindings[0].descriptorCount = MAX_LEVELS;
+    bindings[0].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+    bindings[1].binding = 1;
+    bindings[1].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    bindings[1].descriptorCount = 1;
+    bindings[1].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+    VkDescriptorSetLayoutCreateInfo layout_info{};
+    layout_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+    layout_info.bindingCount = 2;
+    layout_info.pBindings = bindings;
+    descriptor_set_layout_ = device_->CreateDescriptorSetLayout(&layout_info);
+    assert(descriptor_set_layout_);
+}
+
+void MipGenerator::CreateDescriptorPool() {
+    VkDescriptorPoolSize pool_sizes[2] = {};
+    pool_sizes[0].type = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+    pool_sizes[0].descriptorCount = MAX_JOBS * MAX_LEVELS;
+    pool_sizes[1].type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    pool_sizes[1].descriptorCount = MAX_JOBS;
+    VkDescriptorPoolCreateInfo pool_info{};
+    pool_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+    // ReleaseJobs 单独释放 descriptor set
+    pool_info.flags = VK_DESCRIPTOR_POOL_CREATE_FREE_DESCRIPTOR_SET_BIT;
+    pool_info.maxSets = MAX_JOBS;
+    pool_info.poolSizeCount = 2;
+    pool_info.pPoolSizes = pool_sizes;
+    descriptor_pool_ = device_->CreateDescriptorPool(&pool_info);
+    assert(descriptor_pool_);
+}
+
+void MipGenerator::CreatePipelineLayout() {
+    VkPushConstantRange push_constant_range{};
+    push_constant_range.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+    push_constant_range.offset = 0;
+    push_constant_range.size = sizeof(push_constants_t);
+    VkDescriptorSetLayout set_layout = descriptor_set_layout_->descriptor_set_layout();
+    VkPipelineLayoutCreateInfo layout_info{};
+    layout_info.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+    layout_info.setLayoutCount = 1;
+    layout_info.pSetLayouts = &set_layout;
+    layout_info.pushConstantRangeCount = 1;
+    layout_info.pPushConstantRanges = &push_constant_range;
+    pipeline_layout_ = device_->CreatePipelineLayout(&layout_info);
+    assert(pipeline_layout_);
+}
+
+void MipGenerator::CreateCounterBuffer() {
+    VkBufferCreateInfo buffer_info{};
+    buffer_info.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+    buffer_info.size = MAX_JOBS * COUNTER_STRIDE;
+    buffer_info.usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT;
+    buffer_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+    counter_buffer_ = device_->CreateBuffer(&buffer_info);
+    assert(counter_buffer_);
+    counter_memory_ = device_->AllocateBufferMemory(counter_buffer_, MEMORY_USAGE_CPU_TO_GPU);
+    assert(counter_memory_);
+    counter_memory_->BindBufferMemory(counter_buffer_->buffer(), 0);
+    void* data = nullptr;
+    VkResult ret = counter_memory_->MapMemory(0, buffer_info.size, &data);
+    assert(ret == VK_SUCCESS);
+    memset(data, 0, buffer_info.size);
+}
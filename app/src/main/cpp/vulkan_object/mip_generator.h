@@ -0,0 +1,88 @@
+//
+// Created by hj6231 on 2024/2/16.
+//
+
+#pragma once
+#include <vector>
+#include "vulkan_object.h"
+#include "vulkan_upload_context.h"
+
+enum MipFilter {
+    // 2x2 平均, 和线性过滤的 blit 结果一致
+    MIP_FILTER_BOX = 0,
+    // mip 1 用 6x6 的 Kaiser 窗 sinc, 比 box 更清晰, 摩尔纹更少
+    MIP_FILTER_KAISER,
+};
+
+// 一次 dispatch 生成整条 mip 链 (single pass downsampler), 代替每个 level 一次 blit 加两个 barrier.
+// 每个 workgroup 负责 mip 0 的一块 64x64, 在 shared memory 里算出 mip 1 到 mip 6 的对应部分;
+// 用 atomic counter 找出最后完成的 workgroup, 由它从 mip 6 (最大 64x64) 继续算出剩下的 level.
+// 所有 level 都是 storage image, 不要求 format 支持 blit 和线性过滤, 但要支持 STORAGE_IMAGE.
+// 只用 compute, 可以录制在 async compute queue 的 command buffer 上.
+// KAISER 只作用在 mip 0 -> mip 1: 单 pass 里 tile 之间不能交换相邻像素, 之后的 level 和 BOX 一样是 2x2 平均
+class MipGenerator : public VulkanMipmapGenerator {
+public:
+    MipGenerator(VulkanLogicDevice* device, VkFormat format, MipFilter filter);
+    ~MipGenerator() override;
+    MipGenerator(const MipGenerator&) = delete;
+    MipGenerator& operator = (const MipGenerator&) = delete;
+
+    int Create();
+    // 调用者保证录制过的命令都已经执行完
+    void Destroy();
+
+    // format 有对应的 shader, device 支持 STORAGE_IMAGE, 尺寸不超过 MAX_SIZE
+    bool IsSupported(uint32_t width, uint32_t height) const;
+    // IsSupported, format 和 level 数符合, 并且还有空闲的 job
+    bool CanGenerateMipmaps(const image_upload_t& upload) const override;
+    // image 的 usage 要包含 STORAGE, format 和构造时的一致. 每次调用创建的 image view 和 descriptor set
+    // 保留到 ReleaseJobs 或 Destroy, 超过 MAX_JOBS 次返回 false
+    bool CmdGenerateMipmaps(const VulkanCommandBuffer* command_buffer, const image_upload_t& upload) override;
+    // 调用者保证之前录制的命令都已经执行完
+    void ReleaseJobs();
+
+    static const char* FilterName(MipFilter filter);
+    static uint32_t GetMipLevels(uint32_t width, uint32_t height);
+
+    const static uint32_t MAX_SIZE = 4096;
+    const static uint32_t MAX_LEVELS = 13;
+    const static uint32_t MAX_JOBS = 16;
+    // 每个 workgroup 负责的 mip 0 区域边长
+    const static uint32_t TILE_SIZE = 64;
+private:
+    typedef struct {
+        int32_t width;
+        int32_t height;
+        int32_t mip_levels;
+        uint32_t workgroup_count;
+    } push_constants_t;
+
+    typedef struct {
+        std::vector<VulkanImageView*> views;
+        VulkanDescriptorSet* descriptor_set;
+    } job_t;
+
+    // IMAGE_FORMAT 宏, format 不支持时返回 nullptr
+    static const char* ImageFormatQualifier(VkFormat format);
+    shader_macro_list_t macros() const;
+    void CreateDescriptorSetLayout();
+    void CreateDescriptorPool();
+    void CreatePipelineLayout();
+    void CreateCounterBuffer();
+
+    VulkanLogicDevice* device_;
+    VkFormat format_;
+    MipFilter filter_;
+
+    VulkanDescriptorSetLayout* descriptor_set_layout_;
+    VulkanDescriptorPool* descriptor_pool_;
+    VulkanPipelineLayout* pipeline_layout_;
+    VulkanPipeline* pipeline_;
+    // 每个 job 一个 counter, 间隔 COUNTER_STRIDE 满足 minStorageBufferOffsetAlignment.
+    // 初始为 0, 最后一个 workgroup 用完后清零, 不需要每次 fill
+    VulkanBuffer* counter_buffer_;
+    VulkanMemory* counter_memory_;
+    std::vector<job_t> jobs_;
+
+    const static uint32_t COUNTER_STRIDE = 256;
+};
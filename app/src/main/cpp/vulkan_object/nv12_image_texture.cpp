@@ -26,15 +26,16 @@ const char Nv12ImageTexture::kFragShaderSource[] =
         "}\n";
 
 Nv12ImageTexture::Nv12ImageTexture(AAssetManager* asset_manager,
-                                   VulkanCommandPool* command_pool,
-                                   VulkanQueue* graphic_queue,
+                                   VulkanUploadContext* upload_context,
                                    VulkanLogicDevice* device,
                                    VkFormat swap_chain_image_format,
-                                   VkExtent2D frame_buffer_size) :
+                                   VkExtent2D frame_buffer_size,
+                                   VkExtent2D stream_size,
+                                   uint32_t stream_slots) :
         VulkanObject(device, swap_chain_image_format, frame_buffer_size),
         asset_manager_(asset_manager),
-        command_pool_(command_pool),
-        graphic_queue_(graphic_queue),
+        upload_context_(upload_context),
+        texture_asset_(nullptr),
         texture_image_(nullptr),
         texture_image_memory_(nullptr),
         texture_image_view_(nullptr),
@@ -46,7 +47,11 @@ Nv12ImageTexture::Nv12ImageTexture(AAssetManager* asset_manager,
         vulkan_descriptor_pool_(nullptr),
         descriptor_set_layout_(nullptr),
         vulkan_descriptor_set_(nullptr),
-        pipeline_layout_(nullptr) {
+        pipeline_layout_(nullptr),
+        stream_size_(stream_size),
+        stream_slots_(stream_slots),
+        stream_(nullptr),
+        stream_source_(nullptr) {
     vertex_str_ = kVertShaderSource;
     fragment_str_ = kFragShaderSource;
 }
@@ -101,6 +106,10 @@ void Nv12ImageTexture::DestroyPipeline() {
     }
 
     VulkanDescriptorPool::FreeDescriptorSet(&vulkan_descriptor_set_);
+    for (auto& descriptor_set : stream_descriptor_sets_) {
+        VulkanDescriptorPool::FreeDescriptorSet(&descriptor_set);
+    }
+    stream_descriptor_sets_.clear();
     VulkanLogicDevice::DestroyDescriptorSetLayout(&descriptor_set_layout_);
     VulkanLogicDevice::DestroyPipelineLayout(&pipeline_layout_);
     VulkanLogicDevice::DestroyDescriptorPool(&vulkan_descriptor_pool_);
@@ -114,10 +123,23 @@ void Nv12ImageTexture::DestroyPipeline() {
     VulkanLogicDevice::DestroyImageView(&texture_image_view_);
     VulkanLogicDevice::FreeMemory(&texture_image_memory_);
     VulkanLogicDevice::DestroyImage(&texture_image_);
+    // 上传可能直接读取 asset 的内存, 到这里 GPU 已经 idle
+    if (texture_asset_ != nullptr) {
+        AAsset_close(texture_asset_);
+        texture_asset_ = nullptr;
+    }
+    if (stream_ != nullptr) {
+        stream_->LogStats("Nv12ImageTexture");
+        delete stream_;
+        stream_ = nullptr;
+    }
+    delete stream_source_;
+    stream_source_ = nullptr;
 }
 
 void Nv12ImageTexture::Draw(const VulkanCommandBuffer* command_buffer,
-                            const VulkanFrameBuffer* frame_buffer) const {
+                            const VulkanFrameBuffer* frame_buffer,
+                            const frame_context_t* frame) const {
     /* typedef struct VkCommandBufferBeginInfo {
         VkStructureType                          sType;
         const void*                              pNext;
@@ -130,6 +152,13 @@ void Nv12ImageTexture::Draw(const VulkanCommandBuffer* command_buffer,
     begin_info.pInheritanceInfo = nullptr; // Optional
     VkResult ret = command_buffer->BeginCommandBuffer(&begin_info);
     assert(ret == VK_SUCCESS);
+    // copy 不能在 render pass 里录制. 这一帧上传下一个 slot, 前一帧的 slot 可能还在被采样
+    int slot = -1;
+    if (stream_ != nullptr) {
+        int timestamp_scope = command_buffer->CmdBeginTimestampScope("nv12_stream_upload");
+        slot = stream_->CmdUpload(command_buffer, stream_source_, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT);
+        command_buffer->CmdEndTimestampScope(timestamp_scope);
+    }
     /* typedef struct VkRenderPassBeginInfo {
         VkStructureType        sType;
         const void*            pNext;
@@ -159,9 +188,14 @@ void Nv12ImageTexture::Draw(const VulkanCommandBuffer* command_buffer,
     command_buffer->CmdSetViewport(1, &viewport);
     VkRect2D scissor = GetScissor();
     command_buffer->CmdSetScissor(1, &scissor);
-    VkDescriptorSet descriptor_sets[] = {vulkan_descriptor_set_->descriptor_set()};
-    command_buffer->CmdBindDescriptorSets(VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline_layout_->layout(), 0, 1, descriptor_sets, 0, nullptr);
-    command_buffer->CmdDrawIndexed(static_cast<uint32_t>(indices.size()), 1, 0, 0, 0);
+    // 还没有收到任何一帧时只清屏
+    if (stream_ == nullptr || slot >= 0) {
+        const VulkanDescriptorSet* descriptor_set =
+                stream_ != nullptr ? stream_descriptor_sets_[slot] : vulkan_descriptor_set_;
+        VkDescriptorSet descriptor_sets[] = {descriptor_set->descriptor_set()};
+        command_buffer->CmdBindDescriptorSets(VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline_layout_->layout(), 0, 1, descriptor_sets, 0, nullptr);
+        command_buffer->CmdDrawIndexed(static_cast<uint32_t>(indices.size()), 1, 0, 0, 0);
+    }
     command_buffer->CmdEndRenderPass();
     command_buffer->EndCommandBuffer();
 }
@@ -176,8 +210,15 @@ void Nv12ImageTexture::LoadResource() {
     VkSamplerYcbcrConversionInfo ycbcr_conversion_info{};
     ycbcr_conversion_info.sType = VK_STRUCTURE_TYPE_SAMPLER_YCBCR_CONVERSION_INFO;
     ycbcr_conversion_info.conversion = ycbcr_conversion->ycbcr_conversion();
-    CreateTextureImage();
-    CreateTextureImageView(&ycbcr_conversion_info);
+    if (stream_slots_ > 0) {
+        stream_ = new Nv12StreamRing(device_, stream_size_.width, stream_size_.height, stream_slots_);
+        int ret = stream_->Create(&ycbcr_conversion_info);
+        assert(ret == 0);
+        stream_source_ = new SyntheticNv12Source(stream_size_.width, stream_size_.height);
+    } else {
+        CreateTextureImage();
+        CreateTextureImageView(&ycbcr_conversion_info);
+    }
     CreateTextureSampler(&ycbcr_conversion_info);
     VulkanLogicDevice::DestroySamplerYcbcrConversion(&ycbcr_conversion);
 }
@@ -286,27 +327,9 @@ void Nv12ImageTexture::CreateVertexBuffer() {
     buffer_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
     vertex_buffer_ = device_->CreateBuffer(&buffer_info);
     assert(vertex_buffer_);
-    VkMemoryRequirements mem_requirements{};
-    vertex_buffer_->GetBufferMemoryRequirements(&mem_requirements);
-    VkPhysicalDeviceMemoryProperties mem_properties{};
-    device_->GetPhysicalDeviceMemoryProperties(&mem_properties);
-
-    /* typedef struct VkMemoryAllocateInfo {
-        VkStructureType    sType;
-        const void*        pNext;
-        VkDeviceSize       allocationSize;
-        uint32_t           memoryTypeIndex;
-    } VkMemoryAllocateInfo; */
-    VkMemoryAllocateInfo alloc_info{};
-    alloc_info.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-    alloc_info.allocationSize = mem_requirements.size;
-    VkResult ret = VulkanLogicDevice::GetMemoryType(&mem_properties, mem_requirements.memoryTypeBits,
-                                                    VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT | VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
-                                                    &alloc_info.memoryTypeIndex);
-    assert(ret == VK_SUCCESS);
-    vertex_memory_ = device_->AllocateMemory(&alloc_info);
+    vertex_memory_ = device_->AllocateBufferMemory(vertex_buffer_, MEMORY_USAGE_CPU_TO_GPU);
     assert(vertex_memory_);
-    ret = vertex_memory_->BindBufferMemory(vertex_buffer_->buffer(), 0);
+    VkResult ret = vertex_memory_->BindBufferMemory(vertex_buffer_->buffer(), 0);
     assert(ret == VK_SUCCESS);
 
     void* data = nullptr;
@@ -339,27 +362,9 @@ void Nv12ImageTexture::CreateIndexBuffer() {
     buffer_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
     indices_buffer_ = device_->CreateBuffer(&buffer_info);
     assert(indices_buffer_);
-    VkMemoryRequirements mem_requirements{};
-    indices_buffer_->GetBufferMemoryRequirements(&mem_requirements);
-    VkPhysicalDeviceMemoryProperties mem_properties{};
-    device_->GetPhysicalDeviceMemoryProperties(&mem_properties);
-
-    /* typedef struct VkMemoryAllocateInfo {
-        VkStructureType    sType;
-        const void*        pNext;
-        VkDeviceSize       allocationSize;
-        uint32_t           memoryTypeIndex;
-    } VkMemoryAllocateInfo; */
-    VkMemoryAllocateInfo alloc_info{};
-    alloc_info.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-    alloc_info.allocationSize = mem_requirements.size;
-    VkResult ret = VulkanLogicDevice::GetMemoryType(&mem_properties, mem_requirements.memoryTypeBits,
-                                                    VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT | VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
-                                                    &alloc_info.memoryTypeIndex);
-    assert(ret == VK_SUCCESS);
-    indices_memory_ = device_->AllocateMemory(&alloc_info);
+    indices_memory_ = device_->AllocateBufferMemory(indices_buffer_, MEMORY_USAGE_CPU_TO_GPU);
     assert(indices_memory_);
-    ret = indices_memory_->BindBufferMemory(indices_buffer_->buffer(), 0);
+    VkResult ret = indices_memory_->BindBufferMemory(indices_buffer_->buffer(), 0);
     assert(ret == VK_SUCCESS);
 
     void* data = nullptr;
@@ -381,9 +386,18 @@ void Nv12ImageTexture::CreateDescriptorSets() {
     descriptor_set_layout_ = CreateDescriptorSetLayout();
     assert(descriptor_set_layout_);
     VkDescriptorSetLayout set_layout1 = descriptor_set_layout_->descriptor_set_layout();
+    if (stream_ != nullptr) {
+        for (uint32_t i = 0; i < stream_->slot_count(); ++i) {
+            VulkanDescriptorSet* descriptor_set = vulkan_descriptor_pool_->AllocateDescriptorSet(&set_layout1);
+            assert(descriptor_set);
+            BindDescriptorSetWithBuffer(descriptor_set, stream_->image_view(i));
+            stream_descriptor_sets_.push_back(descriptor_set);
+        }
+        return;
+    }
     vulkan_descriptor_set_ = vulkan_descriptor_pool_->AllocateDescriptorSet(&set_layout1);
     assert(vulkan_descriptor_set_);
-    BindDescriptorSetWithBuffer();
+    BindDescriptorSetWithBuffer(vulkan_descriptor_set_, texture_image_view_);
 }
 
 VulkanSamplerYcbcrConversion* Nv12ImageTexture::CreateSamplerYcbcrConversion() {
@@ -425,59 +439,48 @@ VulkanSamplerYcbcrConversion* Nv12ImageTexture::CreateSamplerYcbcrConversion() {
 }
 
 void Nv12ImageTexture::CreateTextureImage() {
-    AAsset* file = AAssetManager_open(asset_manager_,
-                                      "texture_512x512.NV12", AASSET_MODE_BUFFER);
-    assert(file);
-    size_t file_length = AAsset_getLength(file);
-    char* file_content = new char[file_length];
-    AAsset_read(file, file_content, file_length);
-    AAsset_close(file);
+    // asset 保持打开, map 的内容直接交给上传, 支持 host import 时 GPU 从这里 copy, 否则只复制一次到 staging
+    texture_asset_ = AAssetManager_open(asset_manager_,
+                                        "texture_512x512.NV12", AASSET_MODE_BUFFER);
+    assert(texture_asset_);
+    const void* file_content = AAsset_getBuffer(texture_asset_);
+    assert(file_content);
 
     int tex_width = 512, tex_height = 512;
     VkDeviceSize image_size = tex_width * tex_height * 3 / 2;
-
-    VulkanBuffer* staging_buffer;
-    VulkanMemory* staging_buffer_memory;
-
-    VkBufferCreateInfo buffer_info{};
-    buffer_info.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
-    buffer_info.size = image_size;
-    buffer_info.usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
-    buffer_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
-    staging_buffer = device_->CreateBuffer(&buffer_info);
-    assert(staging_buffer);
-    VkMemoryRequirements mem_requirements{};
-    staging_buffer->GetBufferMemoryRequirements(&mem_requirements);
-    VkPhysicalDeviceMemoryProperties mem_properties{};
-    device_->GetPhysicalDeviceMemoryProperties(&mem_properties);
-
-    VkMemoryAllocateInfo alloc_info{};
-    alloc_info.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-    alloc_info.allocationSize = mem_requirements.size;
-    VkResult ret = VulkanLogicDevice::GetMemoryType(&mem_properties, mem_requirements.memoryTypeBits,
-                                                    VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-                                                    &alloc_info.memoryTypeIndex);
-    assert(ret == VK_SUCCESS);
-    staging_buffer_memory = device_->AllocateMemory(&alloc_info);
-    assert(staging_buffer_memory);
-    staging_buffer_memory->BindBufferMemory(staging_buffer->buffer(), 0);
-
-    void* data;
-    staging_buffer_memory->MapMemory(0, mem_requirements.size, &data);
-    memcpy(data, file_content, image_size);
-    staging_buffer_memory->UnmapMemory();
+    assert(static_cast<VkDeviceSize>(AAsset_getLength(texture_asset_)) >= image_size);
 
     CreateImage(tex_width, tex_height, texture_image_, texture_image_memory_);
 
-    TransitionImageLayout(texture_image_->image(), VK_IMAGE_LAYOUT_UNDEFINED,
-                          VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL);
-    CopyBufferToImage(staging_buffer->buffer(), texture_image_->image(),
-                      static_cast<uint32_t>(tex_width), static_cast<uint32_t>(tex_height));
-    TransitionImageLayout(texture_image_->image(), VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-                          VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
-
-    VulkanLogicDevice::DestroyBuffer(&staging_buffer);
-    VulkanLogicDevice::FreeMemory(&staging_buffer_memory);
+    image_upload_t upload{};
+    upload.image = texture_image_->image();
+    upload.width = static_cast<uint32_t>(tex_width);
+    upload.height = static_cast<uint32_t>(tex_height);
+    upload.mip_levels = 1;
+    upload.generate_mipmaps = false;
+    upload.final_layout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+    upload.dst_stage_mask = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
+    upload.dst_access_mask = VK_ACCESS_SHADER_READ_BIT;
+    /* typedef struct VkBufferImageCopy {
+        VkDeviceSize                bufferOffset;
+        uint32_t                    bufferRowLength;
+        uint32_t                    bufferImageHeight;
+        VkImageSubresourceLayers    imageSubresource;
+        VkOffset3D                  imageOffset;
+        VkExtent3D                  imageExtent;
+    } VkBufferImageCopy; */
+    // Y 和 UV 两个平面分别 copy, UV 紧跟在 Y 后面
+    VkBufferImageCopy regions[2] = {};
+    regions[0].bufferOffset = 0;
+    regions[0].imageSubresource.aspectMask = VK_IMAGE_ASPECT_PLANE_0_BIT;
+    regions[0].imageSubresource.layerCount = 1;
+    regions[0].imageExtent = {upload.width, upload.height, 1};
+    regions[1].bufferOffset = upload.width * upload.height;
+    regions[1].imageSubresource.aspectMask = VK_IMAGE_ASPECT_PLANE_1_BIT;
+    regions[1].imageSubresource.layerCount = 1;
+    regions[1].imageExtent = {upload.width / 2, upload.height / 2, 1};
+    bool uploaded = upload_context_->UploadImageFromHost(upload, file_content, image_size, 2, regions);
+    assert(uploaded);
 }
 
 void Nv12ImageTexture::CreateTextureImageView(const VkSamplerYcbcrConversionInfo* ycbcr_conversion_info) {
@@ -555,164 +558,19 @@ void Nv12ImageTexture::CreateImage(uint32_t width, uint32_t height,
     image = device_->CreateImage(&imageInfo);
     assert(image);
 
-    VkMemoryRequirements mem_requirements;
-    image->GetImageMemoryRequirements(&mem_requirements);
-
-    VkPhysicalDeviceMemoryProperties mem_properties{};
-    device_->GetPhysicalDeviceMemoryProperties(&mem_properties);
-
-    VkMemoryAllocateInfo alloc_info{};
-    alloc_info.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-    alloc_info.allocationSize = mem_requirements.size;
-    VkResult ret = VulkanLogicDevice::GetMemoryType(&mem_properties, mem_requirements.memoryTypeBits,
-                                                    VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
-                                                    &alloc_info.memoryTypeIndex);
-    assert(ret == VK_SUCCESS);
-    image_memory = device_->AllocateMemory(&alloc_info);
+    image_memory = device_->AllocateImageMemory(image, MEMORY_USAGE_GPU_ONLY);
     image_memory->BindImageMemory(image->image(), 0);
 }
 
-void Nv12ImageTexture::TransitionImageLayout(VkImage image, VkImageLayout oldLayout,
-                                             VkImageLayout newLayout) {
-    VkCommandBufferAllocateInfo allocInfo{};
-    allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
-    allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
-    allocInfo.commandPool = command_pool_->command_pool();
-    allocInfo.commandBufferCount = 1;
-    VulkanCommandBuffer* command_buffer =
-            command_pool_->AllocateCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY);
-
-    VkCommandBufferBeginInfo begin_info{};
-    begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
-    begin_info.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
-    command_buffer->BeginCommandBuffer(&begin_info);
-
-    VkImageMemoryBarrier barrier{};
-    barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
-    barrier.oldLayout = oldLayout;
-    barrier.newLayout = newLayout;
-    barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-    barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-    barrier.image = image;
-    barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-    barrier.subresourceRange.baseMipLevel = 0;
-    barrier.subresourceRange.levelCount = 1;
-    barrier.subresourceRange.baseArrayLayer = 0;
-    barrier.subresourceRange.layerCount = 1;
-
-    VkPipelineStageFlags sourceStage;
-    VkPipelineStageFlags destinationStage;
-
-    if (oldLayout == VK_IMAGE_LAYOUT_UNDEFINED) {
-        barrier.srcAccessMask = 0;
-        barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
-
-        sourceStage = VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
-        destinationStage = VK_PIPELINE_STAGE_TRANSFER_BIT;
-    } else {
-        barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
-        barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
-
-        sourceStage = VK_PIPELINE_STAGE_TRANSFER_BIT;
-        destinationStage = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
-    }
-    command_buffer->CmdPipelineBarrier(
-            sourceStage, destinationStage,
-            0,
-            0, nullptr,
-            0, nullptr,
-            1, &barrier
-    );
-
-    command_buffer->EndCommandBuffer();
-    VkCommandBuffer command_buffers[] = {command_buffer->command_buffer()};
-    VkSubmitInfo submitInfo{};
-    submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
-    submitInfo.commandBufferCount = 1;
-    submitInfo.pCommandBuffers = command_buffers;
-
-    graphic_queue_->QueueSubmit( 1, &submitInfo, VK_NULL_HANDLE);
-    graphic_queue_->QueueWaitIdle();
-    VulkanCommandPool::FreeCommandBuffer(&command_buffer);
-}
-
-void Nv12ImageTexture::CopyBufferToImage(VkBuffer buffer, VkImage image, uint32_t width, uint32_t height) {
-    VkCommandBufferAllocateInfo allocInfo{};
-    allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
-    allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
-    allocInfo.commandPool = command_pool_->command_pool();
-    allocInfo.commandBufferCount = 1;
-    VulkanCommandBuffer* command_buffer =
-            command_pool_->AllocateCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY);
-    /*  typedef struct VkCommandBufferBeginInfo {
-        VkStructureType                          sType;
-        const void*                              pNext;
-        VkCommandBufferUsageFlags                flags;
-        const VkCommandBufferInheritanceInfo*    pInheritanceInfo;
-    } VkCommandBufferBeginInfo; */
-    VkCommandBufferBeginInfo command_buffer_begin_info{};
-    command_buffer_begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
-    command_buffer_begin_info.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
-    VkResult ret = command_buffer->BeginCommandBuffer(&command_buffer_begin_info);
-    assert(ret == VK_SUCCESS);
-
-    /* typedef struct VkBufferImageCopy {
-        VkDeviceSize                bufferOffset;
-        uint32_t                    bufferRowLength;
-        uint32_t                    bufferImageHeight;
-        VkImageSubresourceLayers    imageSubresource;
-        VkOffset3D                  imageOffset;
-        VkExtent3D                  imageExtent;
-    } VkBufferImageCopy; */
-    VkBufferImageCopy regions[2];
-    regions[0].bufferOffset = 0;
-    regions[0].bufferRowLength = 0;
-    regions[0].bufferImageHeight = 0;
-    regions[0].imageSubresource.aspectMask = VK_IMAGE_ASPECT_PLANE_0_BIT ;
-    regions[0].imageSubresource.mipLevel = 0;
-    regions[0].imageSubresource.baseArrayLayer = 0;
-    regions[0].imageSubresource.layerCount = 1;
-    regions[0].imageOffset = {0, 0, 0};
-    regions[0].imageExtent = {
-            width,
-            height,
-            1
-    };
-    regions[1].bufferOffset = 512*512;
-    regions[1].bufferRowLength = 0;
-    regions[1].bufferImageHeight = 0;
-    regions[1].imageSubresource.aspectMask = VK_IMAGE_ASPECT_PLANE_1_BIT;
-    regions[1].imageSubresource.mipLevel = 0;
-    regions[1].imageSubresource.baseArrayLayer = 0;
-    regions[1].imageSubresource.layerCount = 1;
-    regions[1].imageOffset = {0, 0, 0};
-    regions[1].imageExtent = {
-            width / 2,
-            height / 2,
-            1
-    };
-    command_buffer->CmdCopyBufferToImage(buffer, image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 2, regions);
-
-    command_buffer->EndCommandBuffer();
-    VkCommandBuffer command_buffers[] = {command_buffer->command_buffer()};
-    VkSubmitInfo submitInfo{};
-    submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
-    submitInfo.commandBufferCount = 1;
-    submitInfo.pCommandBuffers = command_buffers;
-
-    graphic_queue_->QueueSubmit( 1, &submitInfo, VK_NULL_HANDLE);
-    graphic_queue_->QueueWaitIdle();
-    VulkanCommandPool::FreeCommandBuffer(&command_buffer);
-}
-
 VulkanDescriptorPool*  Nv12ImageTexture::CreateDescriptorPool() {
     /* typedef struct VkDescriptorPoolSize {
         VkDescriptorType    type;
         uint32_t            descriptorCount;
     } VkDescriptorPoolSize; */
+    uint32_t set_count = stream_ != nullptr ? stream_->slot_count() : 1;
     VkDescriptorPoolSize pool_size{};
     pool_size.type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-    pool_size.descriptorCount = 1;
+    pool_size.descriptorCount = set_count;
     /* typedef struct VkDescriptorPoolCreateInfo {
         VkStructureType                sType;
         const void*                    pNext;
@@ -724,7 +582,7 @@ VulkanDescriptorPool*  Nv12ImageTexture::CreateDescriptorPool() {
     VkDescriptorPoolCreateInfo pool_info{};
     pool_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
     pool_info.flags = VK_DESCRIPTOR_POOL_CREATE_FREE_DESCRIPTOR_SET_BIT;
-    pool_info.maxSets = 1;
+    pool_info.maxSets = set_count;
     pool_info.poolSizeCount = 1;
     pool_info.pPoolSizes = &pool_size;
     return device_->CreateDescriptorPool(&pool_info);
@@ -760,7 +618,8 @@ VulkanDescriptorSetLayout* Nv12ImageTexture::CreateDescriptorSetLayout() const {
     return device_->CreateDescriptorSetLayout(&layout_info);
 }
 
-void Nv12ImageTexture::BindDescriptorSetWithBuffer() const {
+void Nv12ImageTexture::BindDescriptorSetWithBuffer(const VulkanDescriptorSet* descriptor_set,
+                                                   const VulkanImageView* image_view) const {
     /* typedef struct VkDescriptorImageInfo {
         VkSampler        sampler;
         VkImageView      imageView;
@@ -768,7 +627,7 @@ void Nv12ImageTexture::BindDescriptorSetWithBuffer() const {
     } VkDescriptorImageInfo; */
     VkDescriptorImageInfo  image_info{};
     image_info.sampler = texture_image_sampler_->sampler();
-    image_info.imageView = texture_image_view_->image_view();
+    image_info.imageView = image_view->image_view();
     image_info.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
     /* typedef struct VkWriteDescriptorSet {
         VkStructureType                  sType;
@@ -784,7 +643,7 @@ void Nv12ImageTexture::BindDescriptorSetWithBuffer() const {
     } VkWriteDescriptorSet; */
     VkWriteDescriptorSet descriptor_write{};
     descriptor_write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-    descriptor_write.dstSet = vulkan_descriptor_set_->descriptor_set();
+    descriptor_write.dstSet = descriptor_set->descriptor_set();
     descriptor_write.dstBinding = 0;
     descriptor_write.dstArrayElement = 0;
     descriptor_write.descriptorCount = 1;
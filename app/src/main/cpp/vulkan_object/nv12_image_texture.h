@@ -3,18 +3,22 @@
 //
 #pragma once
 #include "vulkan_object.h"
+#include "vulkan_upload_context.h"
+#include "nv12_stream.h"
 #include <glm/glm.hpp>
-#include <android/asset_manager.h>
-#include <android/asset_manager_jni.h>
+#include "android_compat.h"
 
+// stream_slots 为 0 时显示 texture_512x512.NV12, 否则每帧从 SyntheticNv12Source 读一帧 stream_size 大小的 NV12,
+// 通过 Nv12StreamRing 上传后采样. stream_slots 不能少于 frames in flight
 class Nv12ImageTexture : public VulkanObject {
 public:
     Nv12ImageTexture(AAssetManager* asset_manager,
-                     VulkanCommandPool* command_pool,
-                     VulkanQueue* graphic_queue,
+                     VulkanUploadContext* upload_context,
                      VulkanLogicDevice* device,
                      VkFormat swap_chain_image_format,
-                     VkExtent2D frame_buffer_size);
+                     VkExtent2D frame_buffer_size,
+                     VkExtent2D stream_size = VkExtent2D{0, 0},
+                     uint32_t stream_slots = 0);
     ~Nv12ImageTexture() = default;
 
     typedef struct  {
@@ -26,7 +30,8 @@ public:
     void DestroyPipeline() override;
 
     void Draw(const VulkanCommandBuffer* command_buffer,
-              const VulkanFrameBuffer* frame_buffer) const override;
+              const VulkanFrameBuffer* frame_buffer,
+              const frame_context_t* frame) const override;
 protected:
     void LoadResource() override;
     void CreateRenderPass() override;
@@ -44,13 +49,10 @@ private:
     void CreateTextureImageView(const VkSamplerYcbcrConversionInfo* ycbcr_conversion_info);
     void CreateTextureSampler(const VkSamplerYcbcrConversionInfo* ycbcr_conversion_info);
     void CreateImage(uint32_t width, uint32_t height, VulkanImage*& image, VulkanMemory*& image_memory);
-    void TransitionImageLayout(VkImage image, VkImageLayout oldLayout,
-                               VkImageLayout newLayout);
-    void CopyBufferToImage(VkBuffer buffer, VkImage image, uint32_t width, uint32_t height);
 
     VulkanDescriptorPool*  CreateDescriptorPool();
     VulkanDescriptorSetLayout* CreateDescriptorSetLayout() const;
-    void BindDescriptorSetWithBuffer() const;
+    void BindDescriptorSetWithBuffer(const VulkanDescriptorSet* descriptor_set, const VulkanImageView* image_view) const;
 
     VulkanPipelineLayout* CreatePipelineLayout(const VulkanDescriptorSetLayout* descriptor_set_layout) const;
     VulkanPipeline* CreateGraphicsPipeline(const VulkanShaderModule* vert_shader_module,
@@ -88,9 +90,10 @@ private:
             {1, 0, VK_FORMAT_R32G32_SFLOAT, offsetof(vertex_t, coordinate)}};
 
     AAssetManager* asset_manager_;
-    VulkanCommandPool* command_pool_;
-    VulkanQueue* graphic_queue_;
+    VulkanUploadContext* upload_context_;
 
+    // 静态纹理的 asset, 上传直接读取它 map 的内存, 和 texture_image_ 一起释放
+    AAsset* texture_asset_;
     VulkanImage* texture_image_;
     VulkanMemory* texture_image_memory_;
     VulkanImageView* texture_image_view_;
@@ -107,6 +110,14 @@ private:
     VulkanDescriptorSet* vulkan_descriptor_set_;
 
     VulkanPipelineLayout* pipeline_layout_;
+
+    VkExtent2D stream_size_;
+    uint32_t stream_slots_;
+    // Draw 是 const, 通过指针修改 ring 和 source 的状态
+    Nv12StreamRing* stream_;
+    Nv12FrameSource* stream_source_;
+    // 每个 slot 一个, 绑定对应 slot 的 image view
+    std::vector<VulkanDescriptorSet*> stream_descriptor_sets_;
 };
 
 
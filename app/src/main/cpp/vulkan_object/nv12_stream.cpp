@@ -0,0 +1,386 @@
+//
+// Created by hj6231 on 2024/2/16.
+//
+
+#include "nv12_stream.h"
+
+#include <cassert>
+#include <chrono>
+#include <cstring>
+#include <sys/mman.h>
+#include "log.h"
+
+static uint64_t NowNs() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static VkDeviceSize AlignUp(VkDeviceSize value, VkDeviceSize alignment) {
+    return (value + alignment - 1) / alignment * alignment;
+}
+
+static void FillSyntheticFrame(uint32_t width, uint32_t height, uint64_t frame, uint8_t* y, uint8_t* uv) {
+    for (uint32_t row = 0; row < height; ++row) {
+        memset(y + static_cast<size_t>(row) * width, static_cast<int>((row + frame) & 0xff), width);
+    }
+    // 色度平面每行 width / 2 个 CbCr, 随帧数缓慢变化
+    for (uint32_t row = 0; row < height / 2; ++row) {
+        memset(uv + static_cast<size_t>(row) * width, static_cast<int>((row * 2 + frame / 4) & 0xff), width);
+    }
+}
+
+SyntheticNv12Source::SyntheticNv12Source(uint32_t width, uint32_t height) :
+        width_(width),
+        height_(height),
+        frame_(0) {
+}
+
+bool SyntheticNv12Source::ReadFrame(uint8_t* y, uint8_t* uv) {
+    FillSyntheticFrame(width_, height_, frame_, y, uv);
+    ++frame_;
+    return true;
+}
+
+PooledNv12Source::PooledNv12Source(uint32_t width, uint32_t height, uint32_t buffer_count) :
+        width_(width),
+        height_(height),
+        uv_offset_(static_cast<size_t>(AlignUp(static_cast<VkDeviceSize>(width) * height, 256))),
+        buffer_size_(uv_offset_ + static_cast<size_t>(width) * height / 2),
+        buffers_(buffer_count, nullptr),
+        frame_(0) {
+    assert(buffer_count > 0);
+}
+
+PooledNv12Source::~PooledNv12Source() {
+    for (auto& buffer : buffers_) {
+        if (buffer != nullptr) {
+            munmap(buffer, buffer_size_);
+            buffer = nullptr;
+        }
+    }
+}
+
+int PooledNv12Source::Create() {
+    // 匿名 mmap 按页对齐, 和解码器或者 gralloc 的输出 buffer 一样可以整块 import
+    for (auto& buffer : buffers_) {
+        void* data = mmap(nullptr, buffer_size_, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (data == MAP_FAILED) {
+            LOG_E("PooledNv12Source", "map %zu bytes failed\n", buffer_size_);
+            return -1;
+        }
+        buffer = static_cast<uint8_t*>(data);
+    }
+    return 0;
+}
+
+bool PooledNv12Source::ReadFrame(uint8_t* y, uint8_t* uv) {
+    nv12_frame_t frame{};
+    AcquireFrame(&frame);
+    memcpy(y, frame.y, static_cast<size_t>(width_) * height_);
+    memcpy(uv, frame.uv, static_cast<size_t>(width_) * height_ / 2);
+    return true;
+}
+
+bool PooledNv12Source::provides_frames() const {
+    return true;
+}
+
+bool PooledNv12Source::AcquireFrame(nv12_frame_t* frame) {
+    uint8_t* buffer = buffers_[frame_ % buffers_.size()];
+    FillSyntheticFrame(width_, height_, frame_, buffer, buffer + uv_offset_);
+    ++frame_;
+    frame->y = buffer;
+    frame->uv = buffer + uv_offset_;
+    frame->allocation = buffer;
+    frame->allocation_size = buffer_size_;
+    return true;
+}
+
+Nv12StreamRing::Nv12StreamRing(VulkanLogicDevice* device, uint32_t width, uint32_t height, uint32_t slot_count) :
+        device_(device),
+        width_(width),
+        height_(height),
+        slots_(slot_count, slot_t{}),
+        staging_buffer_(nullptr),
+        staging_memory_(nullptr),
+        staging_data_(nullptr),
+        host_import_(true),
+        current_(-1),
+        stats_{} {
+    // 4:2:0 的色度平面宽高各是一半
+    assert(width % 2 == 0 && height % 2 == 0);
+    assert(slot_count > 0);
+}
+
+Nv12StreamRing::~Nv12StreamRing() {
+    Destroy();
+}
+
+int Nv12StreamRing::Create(const VkSamplerYcbcrConversionInfo* ycbcr_conversion_info) {
+    assert(staging_buffer_ == nullptr);
+    VkPhysicalDeviceProperties properties{};
+    device_->GetPhysicalDeviceProperties(&properties);
+    VkDeviceSize alignment = properties.limits.optimalBufferCopyOffsetAlignment;
+    alignment = alignment > PLANE_ALIGNMENT ? alignment : PLANE_ALIGNMENT;
+    VkDeviceSize y_size = AlignUp(static_cast<VkDeviceSize>(width_) * height_, alignment);
+    VkDeviceSize uv_size = AlignUp(static_cast<VkDeviceSize>(width_) * height_ / 2, alignment);
+
+    VkBufferCreateInfo buffer_info{};
+    buffer_info.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+    buffer_info.size = (y_size + uv_size) * slots_.size();
+    buffer_info.usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
+    buffer_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+    staging_buffer_ = device_->CreateBuffer(&buffer_info);
+    if (staging_buffer_ == nullptr) {
+        LOG_E("Nv12StreamRing", "create staging buffer failed\n");
+        return -1;
+    }
+    void* mapped = nullptr;
+    staging_memory_ = device_->AllocateBufferMemory(staging_buffer_, MEMORY_USAGE_CPU_ONLY);
+    if (staging_memory_ == nullptr || staging_memory_->BindBufferMemory(staging_buffer_->buffer(), 0) != VK_SUCCESS ||
+            staging_memory_->MapMemory(0, buffer_info.size, &mapped) != VK_SUCCESS) {
+        LOG_E("Nv12StreamRing", "allocate %llu bytes staging memory failed\n",
+              (long long unsigned int) buffer_info.size);
+        Destroy();
+        return -1;
+    }
+    staging_data_ = static_cast<uint8_t*>(mapped);
+
+    for (size_t i = 0; i < slots_.size(); ++i) {
+        slot_t& slot = slots_[i];
+        slot.y_offset = (y_size + uv_size) * i;
+        slot.uv_offset = slot.y_offset + y_size;
+        slot.import_index = -1;
+
+        VkImageCreateInfo image_info{};
+        image_info.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+        image_info.imageType = VK_IMAGE_TYPE_2D;
+        image_info.extent = {width_, height_, 1};
+        image_info.mipLevels = 1;
+        image_info.arrayLayers = 1;
+        image_info.format = VK_FORMAT_G8_B8R8_2PLANE_420_UNORM;
+        image_info.tiling = VK_IMAGE_TILING_OPTIMAL;
+        image_info.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+        image_info.usage = VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
+        image_info.samples = VK_SAMPLE_COUNT_1_BIT;
+        image_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+        slot.image = device_->CreateImage(&image_info);
+        if (slot.image == nullptr) {
+            LOG_E("Nv12StreamRing", "create %ux%u NV12 image failed\n", width_, height_);
+            Destroy();
+            return -1;
+        }
+        slot.memory = device_->AllocateImageMemory(slot.image, MEMORY_USAGE_GPU_ONLY);
+        if (slot.memory == nullptr || slot.memory->BindImageMemory(slot.image->image(), 0) != VK_SUCCESS) {
+            LOG_E("Nv12StreamRing", "allocate NV12 image memory failed\n");
+            Destroy();
+            return -1;
+        }
+        if (ycbcr_conversion_info != nullptr) {
+            VkImageViewCreateInfo view_info{};
+            view_info.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+            view_info.pNext = ycbcr_conversion_info;
+            view_info.image = slot.image->image();
+            view_info.viewType = VK_IMAGE_VIEW_TYPE_2D;
+            view_info.format = VK_FORMAT_G8_B8R8_2PLANE_420_UNORM;
+            view_info.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+            view_info.subresourceRange.levelCount = 1;
+            view_info.subresourceRange.layerCount = 1;
+            slot.view = device_->CreateImageView(&view_info);
+            assert(slot.view);
+        }
+    }
+    current_ = -1;
+    LOG_D("Nv12StreamRing", "%u slots of %ux%u, staging %.2f MiB\n",
+          static_cast<uint32_t>(slots_.size()), width_, height_, buffer_info.size / (1024.0 * 1024.0));
+    return 0;
+}
+
+void Nv12StreamRing::Destroy() {
+    ReleaseImports();
+    for (auto& slot : slots_) {
+        VulkanLogicDevice::DestroyImageView(&slot.view);
+        VulkanLogicDevice::DestroyImage(&slot.image);
+        VulkanLogicDevice::FreeMemory(&slot.memory);
+    }
+    staging_data_ = nullptr;
+    VulkanLogicDevice::FreeMemory(&staging_memory_);
+    VulkanLogicDevice::DestroyBuffer(&staging_buffer_);
+    current_ = -1;
+}
+
+int Nv12StreamRing::CmdUpload(const VulkanCommandBuffer* command_buffer, Nv12FrameSource* source,
+                              VkPipelineStageFlags dst_stage_mask) {
+    uint32_t next = current_ < 0 ? 0 : (static_cast<uint32_t>(current_) + 1) % slots_.size();
+    slot_t& slot = slots_[next];
+    uint64_t begin = NowNs();
+    VkBuffer src_buffer = staging_buffer_->buffer();
+    VkDeviceSize y_offset = slot.y_offset;
+    VkDeviceSize uv_offset = slot.uv_offset;
+    int import_index = -1;
+    bool read;
+    if (source->provides_frames()) {
+        nv12_frame_t frame{};
+        read = source->AcquireFrame(&frame);
+        if (read) {
+            import_index = FindImport(frame, next);
+        }
+        if (import_index >= 0) {
+            import_entry_t& entry = imports_[import_index];
+            const auto* allocation = static_cast<const uint8_t*>(entry.allocation);
+            src_buffer = entry.import.buffer->buffer();
+            y_offset = entry.import.offset + (frame.y - allocation);
+            uv_offset = entry.import.offset + (frame.uv - allocation);
+            stats_.imported_bytes += frame_bytes();
+        } else if (read) {
+            memcpy(staging_data_ + slot.y_offset, frame.y, static_cast<size_t>(width_) * height_);
+            memcpy(staging_data_ + slot.uv_offset, frame.uv, static_cast<size_t>(width_) * height_ / 2);
+            stats_.copied_bytes += frame_bytes();
+        }
+    } else {
+        read = source->ReadFrame(staging_data_ + slot.y_offset, staging_data_ + slot.uv_offset);
+        if (read) {
+            stats_.copied_bytes += frame_bytes();
+        }
+    }
+    stats_.write_ns += NowNs() - begin;
+    if (!read) {
+        ++stats_.repeated;
+        return current_;
+    }
+    slot.import_index = import_index;
+
+    // 整个 image 都会被覆盖, 旧内容不需要保留, 从 UNDEFINED 转换. 只需要等上次采样这个 slot 的读完成
+    VkImageMemoryBarrier barrier{};
+    barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+    barrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+    barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.image = slot.image->image();
+    // 多平面 image 不是 disjoint 时用 COLOR 表示所有平面
+    barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    barrier.subresourceRange.levelCount = 1;
+    barrier.subresourceRange.layerCount = 1;
+    barrier.srcAccessMask = 0;
+    barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    command_buffer->CmdPipelineBarrier(dst_stage_mask, VK_PIPELINE_STAGE_TRANSFER_BIT, 0,
+                                       0, nullptr, 0, nullptr, 1, &barrier);
+
+    VkBufferImageCopy regions[2] = {};
+    regions[0].bufferOffset = y_offset;
+    regions[0].imageSubresource.aspectMask = VK_IMAGE_ASPECT_PLANE_0_BIT;
+    regions[0].imageSubresource.layerCount = 1;
+    regions[0].imageExtent = {width_, height_, 1};
+    regions[1].bufferOffset = uv_offset;
+    regions[1].imageSubresource.aspectMask = VK_IMAGE_ASPECT_PLANE_1_BIT;
+    regions[1].imageSubresource.layerCount = 1;
+    regions[1].imageExtent = {width_ / 2, height_ / 2, 1};
+    command_buffer->CmdCopyBufferToImage(src_buffer, slot.image->image(),
+                                         VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 2, regions);
+
+    barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+    barrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+    barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+    command_buffer->CmdPipelineBarrier(VK_PIPELINE_STAGE_TRANSFER_BIT, dst_stage_mask, 0,
+                                       0, nullptr, 0, nullptr, 1, &barrier);
+
+    current_ = static_cast<int>(next);
+    ++stats_.frames;
+    stats_.bytes += frame_bytes();
+    return current_;
+}
+
+void Nv12StreamRing::set_host_import(bool enabled) {
+    host_import_ = enabled;
+}
+
+VulkanImageView* Nv12StreamRing::image_view(uint32_t slot) const {
+    return slots_[slot].view;
+}
+
+uint32_t Nv12StreamRing::slot_count() const {
+    return static_cast<uint32_t>(slots_.size());
+}
+
+VkDeviceSize Nv12StreamRing::frame_bytes() const {
+    return static_cast<VkDeviceSize>(width_) * height_ * 3 / 2;
+}
+
+nv12_stream_stats_t Nv12StreamRing::stats() const {
+    return stats_;
+}
+
+void Nv12StreamRing::LogStats(const char* tag) const {
+    LOG_D(tag, "nv12 stream %ux%u: %llu frames uploaded, %llu repeated, %.2f MiB (%.2f MiB imported), "
+               "%.3f MiB copied per frame, avg staging write %.3f ms\n",
+          width_, height_, (long long unsigned int) stats_.frames, (long long unsigned int) stats_.repeated,
+          stats_.bytes / (1024.0 * 1024.0), stats_.imported_bytes / (1024.0 * 1024.0),
+          stats_.frames > 0 ? stats_.copied_bytes / (1024.0 * 1024.0) / stats_.frames : 0.0,
+          stats_.frames + stats_.repeated > 0 ? stats_.write_ns / 1e6 / (stats_.frames + stats_.repeated) : 0.0);
+}
+
+int Nv12StreamRing::FindImport(const nv12_frame_t& frame, uint32_t next) {
+    VulkanHostImporter* importer = device_->host_importer();
+    if (!host_import_ || importer == nullptr || frame.allocation == nullptr) {
+        return -1;
+    }
+    int found = -1;
+    for (size_t i = 0; i < imports_.size(); ++i) {
+        if (imports_[i].allocation == frame.allocation && imports_[i].allocation_size == frame.allocation_size) {
+            found = static_cast<int>(i);
+            break;
+        }
+    }
+    if (found < 0) {
+        // 其他 slot 引用的 import 可能还在被 GPU 读取, 只有 next 上次用过的和没人引用的可以替换
+        if (imports_.size() < MAX_IMPORTS) {
+            imports_.push_back(import_entry_t{});
+            found = static_cast<int>(imports_.size() - 1);
+        } else {
+            for (size_t i = 0; i < imports_.size(); ++i) {
+                bool referenced = false;
+                for (size_t j = 0; j < slots_.size(); ++j) {
+                    referenced = referenced || (j != next && slots_[j].import_index == static_cast<int>(i));
+                }
+                if (!referenced && (found < 0 || imports_[i].last_used < imports_[found].last_used)) {
+                    found = static_cast<int>(i);
+                }
+            }
+            if (found < 0) {
+                return -1;
+            }
+            VulkanHostImporter::Release(&imports_[found].import);
+        }
+        import_entry_t& entry = imports_[found];
+        entry.allocation = frame.allocation;
+        entry.allocation_size = frame.allocation_size;
+        if (!importer->Import(frame.allocation, frame.allocation_size, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+                              &entry.import)) {
+            LOG_W("Nv12StreamRing", "import %zu bytes failed, copy frames through staging\n", frame.allocation_size);
+        }
+    }
+    import_entry_t& entry = imports_[found];
+    entry.last_used = stats_.frames;
+    if (entry.import.buffer == nullptr) {
+        return -1;
+    }
+    // 和 staging 一样, 两个平面的 bufferOffset 都按 16 对齐
+    const auto* allocation = static_cast<const uint8_t*>(entry.allocation);
+    if ((entry.import.offset + (frame.y - allocation)) % 16 != 0 ||
+            (entry.import.offset + (frame.uv - allocation)) % 16 != 0) {
+        return -1;
+    }
+    return found;
+}
+
+void Nv12StreamRing::ReleaseImports() {
+    for (auto& entry : imports_) {
+        VulkanHostImporter::Release(&entry.import);
+    }
+    imports_.clear();
+    for (auto& slot : slots_) {
+        slot.import_index = -1;
+    }
+}
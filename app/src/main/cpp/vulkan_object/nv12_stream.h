@@ -0,0 +1,156 @@
+//
+// Created by hj6231 on 2024/2/16.
+//
+
+#pragma once
+#include <cstdint>
+#include <vector>
+#include "vulkan_logic_device.h"
+
+// 已经在 CPU 内存里的一帧, y 和 uv 都在 [allocation, allocation + allocation_size) 里面
+typedef struct {
+    const uint8_t* y;
+    const uint8_t* uv;
+    // 帧所在的整块分配 (解码器的输出 buffer, mmap 的文件), Nv12StreamRing 按它缓存 host import
+    const void* allocation;
+    size_t allocation_size;
+} nv12_frame_t;
+
+// 视频帧来源, 例如 camera 或者解码器的输出. y 平面 width * height 字节, uv 平面是交错的 CbCr,
+// width * height / 2 字节, 行之间没有 padding
+class Nv12FrameSource {
+public:
+    virtual ~Nv12FrameSource() = default;
+    // 在录制 command buffer 的线程调用, 把下一帧直接写进 staging. 没有新的帧时返回 false, 继续显示上一帧
+    virtual bool ReadFrame(uint8_t* y, uint8_t* uv) = 0;
+    // 返回 true 时 Nv12StreamRing 改用 AcquireFrame, 帧不经过 ReadFrame 写进 staging
+    virtual bool provides_frames() const { return false; }
+    // 返回下一帧在 source 自己内存里的位置, 不复制. 这块内存在之后 slot_count 次 AcquireFrame 之内
+    // 保持有效并且不被修改 (GPU 可能还在从它 copy). ring 缓存的 import 一直引用这块内存到 Nv12StreamRing::Destroy,
+    // 所以 source 要在 ring 之后销毁. 没有新的帧时返回 false
+    virtual bool AcquireFrame(nv12_frame_t* frame) { (void) frame; return false; }
+};
+
+// 生成和 SyntheticNv12Source 相同的帧, 但写进自己的 buffer_count 块页对齐的内存里轮流使用, 模拟解码器的输出池.
+// buffer_count 不能少于 Nv12StreamRing 的 slot_count
+class PooledNv12Source : public Nv12FrameSource {
+public:
+    PooledNv12Source(uint32_t width, uint32_t height, uint32_t buffer_count);
+    ~PooledNv12Source() override;
+    PooledNv12Source(const PooledNv12Source&) = delete;
+    PooledNv12Source& operator = (const PooledNv12Source&) = delete;
+
+    // 失败返回 -1
+    int Create();
+    bool ReadFrame(uint8_t* y, uint8_t* uv) override;
+    bool provides_frames() const override;
+    bool AcquireFrame(nv12_frame_t* frame) override;
+private:
+    uint32_t width_;
+    uint32_t height_;
+    // uv 平面在每块内存里的偏移, 按 256 对齐
+    size_t uv_offset_;
+    size_t buffer_size_;
+    std::vector<uint8_t*> buffers_;
+    uint64_t frame_;
+};
+
+// 合成的测试帧: 每帧移动一行的水平渐变, 每行一次 memset, 开销和从 camera buffer memcpy 相当
+class SyntheticNv12Source : public Nv12FrameSource {
+public:
+    SyntheticNv12Source(uint32_t width, uint32_t height);
+    bool ReadFrame(uint8_t* y, uint8_t* uv) override;
+private:
+    uint32_t width_;
+    uint32_t height_;
+    uint64_t frame_;
+};
+
+typedef struct {
+    // 上传的帧数和字节数
+    uint64_t frames;
+    uint64_t bytes;
+    // source 没有新帧, 继续采样上一帧的次数
+    uint64_t repeated;
+    // ReadFrame 写 staging, 或者 AcquireFrame 加上复制到 staging 的 CPU 耗时之和
+    uint64_t write_ns;
+    // bytes 里 CPU 写进 staging 的部分, 和 GPU 直接从 import 的 source 内存 copy 的部分
+    uint64_t copied_bytes;
+    uint64_t imported_bytes;
+} nv12_stream_stats_t;
+
+// VK_FORMAT_G8_B8R8_2PLANE_420_UNORM image 的环, 每个 slot 一个 image 和一个持久 map 的 staging buffer 里
+// 两个平面各自的区域. 每帧 CmdUpload 把新的帧写进下一个 slot 并录制 copy, 这一帧采样这个 slot,
+// 前一帧的 slot 这时可能还在被 GPU 采样. slot 数不少于 frames in flight 并且每帧最多调用一次 CmdUpload 时,
+// 要写的 slot 上次使用的那一帧已经被 frame fence 等待过, 不需要额外的同步.
+// source 提供自己内存里的帧并且 device 打开了 host import 时, 把帧所在的分配 import 成 buffer 直接 copy,
+// 不经过 staging; import 失败或者平面偏移不满足对齐时退回复制到 staging.
+// 只在一个线程使用
+class Nv12StreamRing {
+public:
+    Nv12StreamRing(VulkanLogicDevice* device, uint32_t width, uint32_t height, uint32_t slot_count);
+    ~Nv12StreamRing();
+    Nv12StreamRing(const Nv12StreamRing&) = delete;
+    Nv12StreamRing& operator = (const Nv12StreamRing&) = delete;
+
+    // ycbcr_conversion_info 为 nullptr 时不创建 image view, 例如只测上传的 benchmark
+    int Create(const VkSamplerYcbcrConversionInfo* ycbcr_conversion_info);
+    // 调用者保证录制过的命令都已经执行完
+    void Destroy();
+
+    // 在 render pass 之外录制. 从 source 读一帧到下一个 slot, copy 之后转换到 SHADER_READ_ONLY_OPTIMAL,
+    // 对 dst_stage_mask 可见. 返回这一帧应该采样的 slot, 还没有收到过任何一帧时返回 -1
+    int CmdUpload(const VulkanCommandBuffer* command_buffer, Nv12FrameSource* source,
+                  VkPipelineStageFlags dst_stage_mask);
+
+    // 默认打开, 关闭时 AcquireFrame 的帧总是复制到 staging, 给 benchmark 对比
+    void set_host_import(bool enabled);
+
+    VulkanImageView* image_view(uint32_t slot) const;
+    uint32_t slot_count() const;
+    // 一帧两个平面的字节数
+    VkDeviceSize frame_bytes() const;
+    nv12_stream_stats_t stats() const;
+    void LogStats(const char* tag) const;
+
+    // 和 VulkanStagingRing 一样, copy 的 bufferOffset 至少按这个对齐
+    const static VkDeviceSize PLANE_ALIGNMENT = 256;
+    // 缓存的 import 个数, 超过时替换没有被任何 slot 引用的最久没用的一个
+    const static uint32_t MAX_IMPORTS = 8;
+private:
+    typedef struct {
+        VulkanImage* image;
+        VulkanMemory* memory;
+        VulkanImageView* view;
+        // 在 staging buffer 里的偏移
+        VkDeviceSize y_offset;
+        VkDeviceSize uv_offset;
+        // 上次 copy 读取的 imports_ 下标, -1 表示读的是 staging
+        int import_index;
+    } slot_t;
+
+    typedef struct {
+        const void* allocation;
+        size_t allocation_size;
+        // import 失败时 buffer 为 nullptr, 同一块内存不再重试
+        host_import_t import;
+        uint64_t last_used;
+    } import_entry_t;
+
+    // 返回 frame 所在分配的 import 下标, 不能 import 时返回 -1. next 是即将写入的 slot, 它上次引用的 import 可以替换
+    int FindImport(const nv12_frame_t& frame, uint32_t next);
+    void ReleaseImports();
+
+    VulkanLogicDevice* device_;
+    uint32_t width_;
+    uint32_t height_;
+    std::vector<slot_t> slots_;
+    VulkanBuffer* staging_buffer_;
+    VulkanMemory* staging_memory_;
+    uint8_t* staging_data_;
+    bool host_import_;
+    std::vector<import_entry_t> imports_;
+    // 最近一次上传的 slot, -1 表示还没有
+    int current_;
+    nv12_stream_stats_t stats_;
+};
@@ -8,6 +8,7 @@
 #include <array>
 #include <algorithm>
 #include <random>
+#include "log.h"
 
 static const char kComputeShaderSource[] =
         "#version 450\n"
@@ -22,29 +23,49 @@ static const char kComputeShaderSource[] =
         "layout(std140, binding = 1) readonly buffer ParticleSSBOIn {\n"
         "    Particle particlesIn[ ];\n"
         "};\n"
-        "layout(std140, binding = 2) buffer ParticleSSBOOut {\n"
+        "layout(std140, binding = 2) writeonly buffer ParticleSSBOOut {\n"
         "        Particle particlesOut[ ];\n"
         "};\n"
+        "layout(push_constant) uniform PushConstants {\n"
+        "    uint particleCount;\n"
+        "} pc;\n"
         "layout (local_size_x = 256, local_size_y = 1, local_size_z = 1) in;\n"
         "void main() {\n"
         "    uint index = gl_GlobalInvocationID.x;\n"
-        "    Particle particleIn = particlesIn[index];\n"
-        "    particlesOut[index].position = particleIn.position + particleIn.velocity.xy * ubo.deltaTime;\n"
-        "    particlesOut[index].velocity = particleIn.velocity;\n"
-        "    if ((particlesOut[index].position.x <= -1.0) || (particlesOut[index].position.x >= 1.0)) {\n"
-        "        particlesOut[index].velocity.x = -particlesOut[index].velocity.x;\n"
+        "    if (index >= pc.particleCount) {\n"
+        "        return;\n"
         "    }\n"
-        "    if ((particlesOut[index].position.y <= -1.0) || (particlesOut[index].position.y >= 1.0)) {\n"
-        "        particlesOut[index].velocity.y = -particlesOut[index].velocity.y;\n"
+        "    Particle particle = particlesIn[index];\n"
+        "    particle.position += particle.velocity.xy * ubo.deltaTime;\n"
+        "    if ((particle.position.x <= -1.0) || (particle.position.x >= 1.0)) {\n"
+        "        particle.velocity.x = -particle.velocity.x;\n"
         "    }\n"
+        "    if ((particle.position.y <= -1.0) || (particle.position.y >= 1.0)) {\n"
+        "        particle.velocity.y = -particle.velocity.y;\n"
+        "    }\n"
+        "    particlesOut[index] = particle;\n"
         "}\n";
 
 Particle::Particle(VulkanLogicDevice* device,
                    VkFormat swap_chain_image_format,
-                   VkExtent2D frame_buffer_size) :
+                   VkExtent2D frame_buffer_size,
+                   const FrameContextRing* frame_contexts,
+                   uint32_t particle_count) :
         device_(device),
         swap_chain_image_format_(swap_chain_image_format),
-        frame_buffer_size_(frame_buffer_size) {
+        frame_buffer_size_(frame_buffer_size),
+        frame_contexts_(frame_contexts),
+        pipeline_(nullptr),
+        descriptor_pool_(nullptr),
+        descriptor_set_layout_(nullptr),
+        pipeline_layout_(nullptr),
+        particle_count_(particle_count > 0 ? particle_count : DEFAULT_PARTICLE_COUNT),
+        staging_buffer_(nullptr),
+        staging_memory_(nullptr),
+        staging_recorded_(false),
+        staging_frame_index_(0),
+        current_(0) {
+    assert(frame_contexts_->uniform_slice_size() >= sizeof(delta_time_t));
 }
 
 int Particle::CreatePipeline() {
@@ -89,12 +110,20 @@ int Particle::CreatePipeline() {
 void Particle::DestroyPipeline() {
     VulkanLogicDevice::DestroyPipelineLayout(&pipeline_layout_);
     VulkanLogicDevice::DestroyPipelines(&pipeline_);
+    for (auto& descriptor_set : descriptor_sets_) {
+        VulkanDescriptorPool::FreeDescriptorSet(&descriptor_set);
+    }
+    descriptor_sets_.clear();
+    VulkanLogicDevice::DestroyDescriptorSetLayout(&descriptor_set_layout_);
+    VulkanLogicDevice::DestroyDescriptorPool(&descriptor_pool_);
     DestroyStorageBuffer();
-    DestroyUinformBuffer();
 }
 
-void Particle::Draw(const VulkanCommandBuffer* command_buffer) const {
-    CopyDataToUinformBuffer();
+void Particle::Draw(const VulkanCommandBuffer* command_buffer, const frame_context_t* frame) {
+    CopyDataToUinformBuffer(frame);
+    if (staging_recorded_ && frame->index == staging_frame_index_) {
+        DestroyStagingBuffer();
+    }
 
     VkCommandBufferBeginInfo commandBufferBeginInfo{
         .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
@@ -104,69 +133,67 @@ void Particle::Draw(const VulkanCommandBuffer* command_buffer) const {
     };
     VkResult ret = command_buffer->BeginCommandBuffer(&commandBufferBeginInfo);
     assert(ret == VK_SUCCESS);
+    if (staging_buffer_ != nullptr && !staging_recorded_) {
+        CmdUploadInitialState(command_buffer, frame);
+    }
+    int timestamp_scope = command_buffer->CmdBeginTimestampScope("particle_compute");
     command_buffer->CmdBindPipeline(VK_PIPELINE_BIND_POINT_COMPUTE, pipeline_->pipeline());
-    VkDescriptorSet descriptorSets[] = {descriptor_set_->descriptor_set()};
+    VkDescriptorSet descriptorSets[] = {descriptor_sets_[current_]->descriptor_set()};
+    uint32_t dynamicOffsets[] = { static_cast<uint32_t>(frame->uniform_offset) };
     command_buffer->CmdBindDescriptorSets(VK_PIPELINE_BIND_POINT_COMPUTE, pipeline_layout_->layout(), 0, 1,
-                                          descriptorSets, 0, nullptr);
-    command_buffer->CmdDispatch(PARTICLE_COUNT / 256, 1, 1);
+                                          descriptorSets, 1, dynamicOffsets);
+    command_buffer->CmdPushConstants(pipeline_layout_->layout(), VK_SHADER_STAGE_COMPUTE_BIT, 0,
+                                     sizeof(particle_count_), &particle_count_);
+    // 最后一组越界的 invocation 在 shader 里直接返回
+    command_buffer->CmdDispatch((particle_count_ + GROUP_SIZE - 1) / GROUP_SIZE, 1, 1);
+    command_buffer->CmdEndTimestampScope(timestamp_scope);
+
+    // 这一步写的 buffer 接下来被同一帧的 vertex input 和下一步的 compute 读取
+    current_ = (current_ + 1) % static_cast<uint32_t>(storage_buffers_.size());
+    VkBufferMemoryBarrier barrier{
+        .sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER,
+        .pNext = nullptr,
+        .srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT,
+        .dstAccessMask = VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT | VK_ACCESS_SHADER_READ_BIT,
+        .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+        .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+        .buffer = storage_buffers_[current_]->buffer(),
+        .offset = 0,
+        .size = VK_WHOLE_SIZE
+    };
+    command_buffer->CmdPipelineBarrier(VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                                       VK_PIPELINE_STAGE_VERTEX_INPUT_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0,
+                                       0, nullptr, 1, &barrier, 0, nullptr);
 //    command_buffer->EndCommandBuffer();
 }
 
 VkBuffer Particle::GetVertexBuffer() const {
-    return storage_buffer_->buffer();
+    return storage_buffers_[current_]->buffer();
 }
 
-void Particle::LoadResource() {
-    CreateUinformBuffer();
-    CreateStorageBuffer();
-}
-
-void Particle::CreateUinformBuffer() {
-    VkBufferCreateInfo bufferCreateInfo {
-        .sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
-        .pNext = nullptr,
-        .flags = 0,
-        .size = sizeof(delta_time_t),
-        .usage = VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
-        .sharingMode = VK_SHARING_MODE_EXCLUSIVE,
-        .queueFamilyIndexCount = 0,
-        .pQueueFamilyIndices = nullptr
-    };
-    uniform_buffer_ = device_->CreateBuffer(&bufferCreateInfo);
-    assert(uniform_buffer_);
-    VkMemoryRequirements mem_requirements{};
-    uniform_buffer_->GetBufferMemoryRequirements(&mem_requirements);
-    VkPhysicalDeviceMemoryProperties mem_properties{};
-    device_->GetPhysicalDeviceMemoryProperties(&mem_properties);
-
-    uint32_t memoryTypeIndex = 0;
-    VkResult ret = VulkanLogicDevice::GetMemoryType(&mem_properties, mem_requirements.memoryTypeBits,
-                                                    VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT | VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
-                                                    &memoryTypeIndex);
-    assert(ret == VK_SUCCESS);
-    VkMemoryAllocateInfo alloc_info{
-        .sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO,
-        .pNext = nullptr,
-        .allocationSize = mem_requirements.size,
-        .memoryTypeIndex = memoryTypeIndex
-    };
-    uniform_buffer_memory_ = device_->AllocateMemory(&alloc_info);
-    assert(uniform_buffer_memory_);
-    uniform_buffer_memory_->BindBufferMemory(uniform_buffer_->buffer(), 0);
-    uniform_buffer_memory_->MapMemory(0, mem_requirements.size, &uniform_buffer_data_);
+uint32_t Particle::particle_count() const {
+    return particle_count_;
 }
 
-void Particle::DestroyUinformBuffer() {
-    uniform_buffer_memory_->UnmapMemory();
-    uniform_buffer_data_ = nullptr;
-    VulkanLogicDevice::FreeMemory(&uniform_buffer_memory_);
-    VulkanLogicDevice::DestroyBuffer(&uniform_buffer_);
+void Particle::LoadResource() {
+    // 一个 buffer 要能整个绑定成 storage buffer, 一次 dispatch 的 group 数也有上限
+    VkPhysicalDeviceProperties properties{};
+    device_->GetPhysicalDeviceProperties(&properties);
+    uint64_t max_count = std::min<uint64_t>(properties.limits.maxStorageBufferRange / sizeof(particle_t),
+                                            static_cast<uint64_t>(properties.limits.maxComputeWorkGroupCount[0]) *
+                                            GROUP_SIZE);
+    if (particle_count_ > max_count) {
+        LOG_W("Particle", "%u particles exceed device limits, use %llu\n", particle_count_,
+              (long long unsigned int) max_count);
+        particle_count_ = static_cast<uint32_t>(max_count);
+    }
+    CreateStorageBuffer();
 }
 
-void Particle::CopyDataToUinformBuffer() const {
+void Particle::CopyDataToUinformBuffer(const frame_context_t* frame) {
     delta_time_t delta_time;
     delta_time.t = 30.f * 2.0f;
-    memcpy(uniform_buffer_data_, &delta_time, sizeof(delta_time_t));
+    memcpy(frame->uniform_data, &delta_time, sizeof(delta_time_t));
 }
 
 void Particle::CreateStorageBuffer() {
@@ -174,52 +201,87 @@ void Particle::CreateStorageBuffer() {
             .sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
             .pNext = nullptr,
             .flags = 0,
-            .size = sizeof (particle_t) * PARTICLE_COUNT,
+            .size = sizeof (particle_t) * particle_count_,
             .usage = VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT ,
             .sharingMode = VK_SHARING_MODE_EXCLUSIVE,
             .queueFamilyIndexCount = 0,
             .pQueueFamilyIndices = nullptr
     };
-    storage_buffer_ = device_->CreateBuffer(&bufferCreateInfo);
-    assert(storage_buffer_);
-    VkMemoryRequirements mem_requirements{};
-    storage_buffer_->GetBufferMemoryRequirements(&mem_requirements);
-    VkPhysicalDeviceMemoryProperties mem_properties{};
-    device_->GetPhysicalDeviceMemoryProperties(&mem_properties);
-
-    uint32_t memoryTypeIndex = 0;
-    VkResult ret = VulkanLogicDevice::GetMemoryType(&mem_properties, mem_requirements.memoryTypeBits,
-                                                    VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT | VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
-                                                    &memoryTypeIndex);
-    assert(ret == VK_SUCCESS);
-    VkMemoryAllocateInfo alloc_info {
-            .sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO,
-            .pNext = nullptr,
-            .allocationSize = mem_requirements.size,
-            .memoryTypeIndex = memoryTypeIndex
+    uint32_t buffer_count = frame_contexts_->frame_count() + 1;
+    storage_buffers_.assign(buffer_count, nullptr);
+    storage_buffer_memories_.assign(buffer_count, nullptr);
+    for (uint32_t i = 0; i < buffer_count; ++i) {
+        storage_buffers_[i] = device_->CreateBuffer(&bufferCreateInfo);
+        assert(storage_buffers_[i]);
+        storage_buffer_memories_[i] = device_->AllocateBufferMemory(storage_buffers_[i], MEMORY_USAGE_GPU_ONLY);
+        assert(storage_buffer_memories_[i]);
+        storage_buffer_memories_[i]->BindBufferMemory(storage_buffers_[i]->buffer(), 0);
+    }
+    // 只有第一步读的 buffer 需要初始状态, 其余的在读之前都会被 compute 写满
+    current_ = 0;
+    VkBufferCreateInfo stagingCreateInfo = bufferCreateInfo;
+    stagingCreateInfo.usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
+    staging_buffer_ = device_->CreateBuffer(&stagingCreateInfo);
+    assert(staging_buffer_);
+    staging_memory_ = device_->AllocateBufferMemory(staging_buffer_, MEMORY_USAGE_CPU_ONLY);
+    assert(staging_memory_);
+    staging_memory_->BindBufferMemory(staging_buffer_->buffer(), 0);
+    void* staging_data;
+    staging_memory_->MapMemory(0, stagingCreateInfo.size, &staging_data);
+    CopyDataToyStorageBuffer(staging_data);
+    staging_memory_->UnmapMemory();
+    staging_recorded_ = false;
+}
+
+void Particle::CmdUploadInitialState(const VulkanCommandBuffer* command_buffer, const frame_context_t* frame) {
+    VkBufferCopy region{
+        .srcOffset = 0,
+        .dstOffset = 0,
+        .size = sizeof (particle_t) * particle_count_
     };
-    storage_buffer_memory_ = device_->AllocateMemory(&alloc_info);
-    assert(storage_buffer_memory_);
-    storage_buffer_memory_->BindBufferMemory(storage_buffer_->buffer(), 0);
-    void* storage_buffer_data;
-    storage_buffer_memory_->MapMemory(0, mem_requirements.size, &storage_buffer_data);
-    CopyDataToyStorageBuffer(storage_buffer_data, mem_requirements.size);
-    storage_buffer_memory_->UnmapMemory();
+    command_buffer->CmdCopyBuffer(staging_buffer_->buffer(), storage_buffers_[0]->buffer(), 1, &region);
+    VkBufferMemoryBarrier barrier{
+        .sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER,
+        .pNext = nullptr,
+        .srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT,
+        .dstAccessMask = VK_ACCESS_SHADER_READ_BIT,
+        .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+        .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+        .buffer = storage_buffers_[0]->buffer(),
+        .offset = 0,
+        .size = VK_WHOLE_SIZE
+    };
+    command_buffer->CmdPipelineBarrier(VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0,
+                                       0, nullptr, 1, &barrier, 0, nullptr);
+    staging_recorded_ = true;
+    staging_frame_index_ = frame->index;
+}
+
+void Particle::DestroyStagingBuffer() {
+    VulkanLogicDevice::FreeMemory(&staging_memory_);
+    VulkanLogicDevice::DestroyBuffer(&staging_buffer_);
+    staging_recorded_ = false;
 }
 
 void Particle::DestroyStorageBuffer() {
-    VulkanLogicDevice::FreeMemory(&storage_buffer_memory_);
-    VulkanLogicDevice::DestroyBuffer(&storage_buffer_);
+    DestroyStagingBuffer();
+    for (size_t i = 0; i < storage_buffers_.size(); ++i) {
+        VulkanLogicDevice::FreeMemory(&storage_buffer_memories_[i]);
+        VulkanLogicDevice::DestroyBuffer(&storage_buffers_[i]);
+    }
+    storage_buffers_.clear();
+    storage_buffer_memories_.clear();
 }
 
-void Particle::CopyDataToyStorageBuffer(void* data, size_t size) {
+void Particle::CopyDataToyStorageBuffer(void* data) {
     // Initialize particles
     std::default_random_engine rndEngine((unsigned)time(nullptr));
     std::uniform_real_distribution<float> rndDist(0.0f, 1.0f);
 
-    // Initial particle positions on a circle
-    std::vector<particle_t> particles(PARTICLE_COUNT);
-    for (auto& particle : particles) {
+    // Initial particle positions on a circle. 直接写进 map 的 staging, 上百万个粒子时不再多一份临时数组
+    auto* particles = static_cast<particle_t*>(data);
+    for (uint32_t i = 0; i < particle_count_; ++i) {
+        particle_t& particle = particles[i];
         float r = 0.25f * sqrt(rndDist(rndEngine));
         float theta = rndDist(rndEngine) * 2.0f * 3.14159265358979323846f;
         float x = r * cos(theta) * (float)frame_buffer_size_.height / (float)frame_buffer_size_.width;
@@ -228,20 +290,21 @@ void Particle::CopyDataToyStorageBuffer(void* data, size_t size) {
         particle.velocity = glm::normalize(glm::vec2(x,y)) * 0.00025f;
         particle.color = glm::vec4(rndDist(rndEngine), rndDist(rndEngine), rndDist(rndEngine), 1.0f);
     }
-    memcpy(data, particles.data(), size);
 }
 
 void Particle::CreateDescriptorPool() {
     std::array<VkDescriptorPoolSize, 2> descriptorPoolSize{};
-    descriptorPoolSize[0].type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-    descriptorPoolSize[0].descriptorCount = 1;
+    descriptorPoolSize[0].type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
+    uint32_t set_count = static_cast<uint32_t>(storage_buffers_.size());
+    descriptorPoolSize[0].descriptorCount = set_count;
     descriptorPoolSize[1].type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
-    descriptorPoolSize[1].descriptorCount = 2;
+    descriptorPoolSize[1].descriptorCount = 2 * set_count;
+    // FreeDescriptorSet 需要 FREE_DESCRIPTOR_SET_BIT
     VkDescriptorPoolCreateInfo descriptorPoolCreateInfo {
             .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO,
             .pNext = nullptr,
-            .flags = 0,
-            .maxSets = 1,
+            .flags = VK_DESCRIPTOR_POOL_CREATE_FREE_DESCRIPTOR_SET_BIT,
+            .maxSets = set_count,
             .poolSizeCount = static_cast<uint32_t>(descriptorPoolSize.size()),
             .pPoolSizes = descriptorPoolSize.data(),
     };
@@ -252,7 +315,7 @@ void Particle::CreateDescriptorPool() {
 void Particle::CreateDescriptorSetLayout() {
     std::array<VkDescriptorSetLayoutBinding, 3> descriptorSetLayoutBindings;
     descriptorSetLayoutBindings[0].binding = 0;
-    descriptorSetLayoutBindings[0].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+    descriptorSetLayoutBindings[0].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
     descriptorSetLayoutBindings[0].descriptorCount = 1;
     descriptorSetLayoutBindings[0].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
     descriptorSetLayoutBindings[0].pImmutableSamplers = nullptr;
@@ -283,95 +346,100 @@ void Particle::CreateDescriptorSetLayout() {
 
 void Particle::CreateDescriptorSet() {
     VkDescriptorSetLayout layouts[] = {descriptor_set_layout_->descriptor_set_layout()};
-    descriptor_set_ = descriptor_pool_->AllocateDescriptorSet(layouts);
-    assert(descriptor_set_);
+    descriptor_sets_.assign(storage_buffers_.size(), nullptr);
+    for (auto& descriptor_set : descriptor_sets_) {
+        descriptor_set = descriptor_pool_->AllocateDescriptorSet(layouts);
+        assert(descriptor_set);
+    }
 }
 
 void Particle::UpdateDescriptorSet() {
     VkDescriptorBufferInfo uniformDescriptorBufferInfo {
-        .buffer = uniform_buffer_->buffer(),
+        .buffer = frame_contexts_->uniform_buffer(),
         .offset = 0,
         .range = sizeof(delta_time_t)
     };
-    VkDescriptorBufferInfo storageDescriptorBufferInfo {
-        .buffer = storage_buffer_->buffer(),
-        .offset = 0,
-        .range = sizeof(particle_t) * PARTICLE_COUNT
-    };
-
-    std::array<VkWriteDescriptorSet, 3> descriptorWrites;
-    descriptorWrites[0]  = {
-        .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
-        .pNext = nullptr,
-        .dstSet = descriptor_set_->descriptor_set(),
-        .dstBinding = 0,
-        .dstArrayElement = 0,
-        .descriptorCount = 1,
-        .descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,
-        .pImageInfo = nullptr,
-        .pBufferInfo = &uniformDescriptorBufferInfo,
-        .pTexelBufferView = nullptr
-    };
-    descriptorWrites[1] = {
-        .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
-        .pNext = nullptr,
-        .dstSet = descriptor_set_->descriptor_set(),
-        .dstBinding = 1,
-        .dstArrayElement = 0,
-        .descriptorCount = 1,
-        .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
-        .pImageInfo = nullptr,
-        .pBufferInfo = &storageDescriptorBufferInfo,
-        .pTexelBufferView = nullptr
-    };
-    descriptorWrites[2] = {
-        .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
-        .pNext = nullptr,
-        .dstSet = descriptor_set_->descriptor_set(),
-        .dstBinding = 2,
-        .dstArrayElement = 0,
-        .descriptorCount = 1,
-        .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
-        .pImageInfo = nullptr,
-        .pBufferInfo = &storageDescriptorBufferInfo,
-        .pTexelBufferView = nullptr
-    };
-    device_->UpdateDescriptorSets(3, descriptorWrites.data());
+    // set i 读 buffer i, 写 buffer i + 1, 每一步换到下一个 set
+    size_t buffer_count = storage_buffers_.size();
+    for (size_t i = 0; i < buffer_count; ++i) {
+        VkDescriptorBufferInfo storageInDescriptorBufferInfo {
+            .buffer = storage_buffers_[i]->buffer(),
+            .offset = 0,
+            .range = sizeof(particle_t) * particle_count_
+        };
+        VkDescriptorBufferInfo storageOutDescriptorBufferInfo {
+            .buffer = storage_buffers_[(i + 1) % buffer_count]->buffer(),
+            .offset = 0,
+            .range = sizeof(particle_t) * particle_count_
+        };
+
+        std::array<VkWriteDescriptorSet, 3> descriptorWrites;
+        descriptorWrites[0]  = {
+            .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+            .pNext = nullptr,
+            .dstSet = descriptor_sets_[i]->descriptor_set(),
+            .dstBinding = 0,
+            .dstArrayElement = 0,
+            .descriptorCount = 1,
+            .descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC,
+            .pImageInfo = nullptr,
+            .pBufferInfo = &uniformDescriptorBufferInfo,
+            .pTexelBufferView = nullptr
+        };
+        descriptorWrites[1] = {
+            .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+            .pNext = nullptr,
+            .dstSet = descriptor_sets_[i]->descriptor_set(),
+            .dstBinding = 1,
+            .dstArrayElement = 0,
+            .descriptorCount = 1,
+            .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+            .pImageInfo = nullptr,
+            .pBufferInfo = &storageInDescriptorBufferInfo,
+            .pTexelBufferView = nullptr
+        };
+        descriptorWrites[2] = {
+            .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+            .pNext = nullptr,
+            .dstSet = descriptor_sets_[i]->descriptor_set(),
+            .dstBinding = 2,
+            .dstArrayElement = 0,
+            .descriptorCount = 1,
+            .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+            .pImageInfo = nullptr,
+            .pBufferInfo = &storageOutDescriptorBufferInfo,
+            .pTexelBufferView = nullptr
+        };
+        device_->UpdateDescriptorSets(3, descriptorWrites.data());
+    }
 }
 
 void Particle::CreatePipelineLayout() {
     VkDescriptorSetLayout descriptorSetLayouts[] = { descriptor_set_layout_->descriptor_set_layout() };
+    VkPushConstantRange pushConstantRange {
+            .stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
+            .offset = 0,
+            .size = sizeof(uint32_t)
+    };
     VkPipelineLayoutCreateInfo pipelineLayoutCreateInfo {
             .sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO,
             .pNext = nullptr,
             .flags = 0,
             .setLayoutCount = 1,
             .pSetLayouts = descriptorSetLayouts,
-            .pushConstantRangeCount = 0,
-            .pPushConstantRanges = nullptr
+            .pushConstantRangeCount = 1,
+            .pPushConstantRanges = &pushConstantRange
     };
     pipeline_layout_ =  device_->CreatePipelineLayout(&pipelineLayoutCreateInfo);
     assert(pipeline_layout_);
 }
 
+std::vector<shader_source_t> Particle::shader_sources() const {
+    return {shader_source_t{"ComputeShaderSrc", shaderc_compute_shader, kComputeShaderSource}};
+}
+
 VulkanShaderModule* Particle::CreateShaderModule(const std::string& name,
                                                      shaderc_shader_kind kind,
                                                      const std::string& source) const {
-    std::vector<uint32_t> code =
-            VulkanObject::CompileFile(name, kind, source);
-    if (code.empty()) {
-        return nullptr;
-    }
-    /*typedef struct VkShaderModuleCreateInfo {
-        VkStructureType              sType;
-        const void*                  pNext;
-        VkShaderModuleCreateFlags    flags;
-        size_t                       codeSize;
-        const uint32_t*              pCode;
-    } VkShaderModuleCreateInfo;*/
-    VkShaderModuleCreateInfo shader_module_create_info{};
-    shader_module_create_info.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
-    shader_module_create_info.codeSize = code.size() * sizeof (uint32_t);
-    shader_module_create_info.pCode = code.data();
-    return device_->CreateShaderModule(&shader_module_create_info);
+    return VulkanObject::CreateShaderModule(device_, name, kind, source);
 }
\ No newline at end of file
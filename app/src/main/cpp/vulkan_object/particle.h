@@ -4,6 +4,7 @@
 
 #pragma once
 #include "vulkan_object.h"
+#include "frame_context.h"
 #include "glm/glm.hpp"
 
 typedef struct {
@@ -16,31 +17,43 @@ typedef struct{
     float t;
 } delta_time_t;
 
+// 粒子状态放在 frame_count + 1 个 storage buffer 组成的环里, 每一步从当前的 buffer 读, 写到下一个, 然后交换.
+// 第 k 帧写的 buffer 上一次被读是在 k - frame_count 帧, 那一帧的 fence 已经等待过, 所以 compute 写的 buffer
+// 不会是还在 flight 的帧正在渲染的 buffer
 class Particle {
 public:
+    // particle_count 为 0 时使用 DEFAULT_PARTICLE_COUNT, 超过 device 限制时在 CreatePipeline 里减少
     Particle(VulkanLogicDevice* device,
              VkFormat swap_chain_image_format,
-             VkExtent2D frame_buffer_size);
+             VkExtent2D frame_buffer_size,
+             const FrameContextRing* frame_contexts,
+             uint32_t particle_count = 0);
     ~Particle() = default;
 
     int CreatePipeline();
     void DestroyPipeline();
 
-    void Draw(const VulkanCommandBuffer* command_buffer) const;
+    // 录制一步模拟并交换 buffer, 之后 GetVertexBuffer 返回这一步写的 buffer, 对 vertex input 可见
+    void Draw(const VulkanCommandBuffer* command_buffer, const frame_context_t* frame);
 
     VkBuffer GetVertexBuffer() const;
+    uint32_t particle_count() const;
+    std::vector<shader_source_t> shader_sources() const;
 
-    const static int PARTICLE_COUNT = 8192;
+    const static uint32_t DEFAULT_PARTICLE_COUNT = 8192;
+    // 和 compute shader 的 local_size_x 一致
+    const static uint32_t GROUP_SIZE = 256;
 private:
     void LoadResource();
 
-    void CreateUinformBuffer();
-    void DestroyUinformBuffer();
-    void CopyDataToUinformBuffer() const;
+    static void CopyDataToUinformBuffer(const frame_context_t* frame);
 
     void CreateStorageBuffer();
     void DestroyStorageBuffer();
-    void CopyDataToyStorageBuffer(void* data, size_t size);
+    void CopyDataToyStorageBuffer(void* data);
+    // 第一次 Draw 时把 staging 里的初始状态 copy 到 buffer 0, 在这一步的 compute 之前可见
+    void CmdUploadInitialState(const VulkanCommandBuffer* command_buffer, const frame_context_t* frame);
+    void DestroyStagingBuffer();
 
     void CreateDescriptorPool();
     void CreateDescriptorSetLayout();
@@ -55,20 +68,28 @@ private:
     VulkanLogicDevice* device_;
     VkFormat swap_chain_image_format_;
     VkExtent2D frame_buffer_size_;
+    // delta time 放在每一帧自己的 uniform slice 里, 用 dynamic offset 绑定
+    const FrameContextRing* frame_contexts_;
 
     VulkanPipeline* pipeline_;
 
     VulkanDescriptorPool* descriptor_pool_;
     VulkanDescriptorSetLayout* descriptor_set_layout_;
-    VulkanDescriptorSet* descriptor_set_;
+    // descriptor_sets_[i] 从 storage_buffers_[i] 读, 写到下一个 buffer
+    std::vector<VulkanDescriptorSet*> descriptor_sets_;
     VulkanPipelineLayout* pipeline_layout_;
 
-    VulkanBuffer* uniform_buffer_;
-    VulkanMemory* uniform_buffer_memory_;
-    void* uniform_buffer_data_;
-
-    VulkanBuffer* storage_buffer_;
-    VulkanMemory* storage_buffer_memory_;
+    uint32_t particle_count_;
+    // GPU_ONLY, 每一步 compute 都完整读写一遍, 不经过 PCIe
+    std::vector<VulkanBuffer*> storage_buffers_;
+    std::vector<VulkanMemory*> storage_buffer_memories_;
+    // buffer 0 的初始状态. 录制 copy 的 context 下一次 Draw 时它的 fence 已经等待过, 这时释放
+    VulkanBuffer* staging_buffer_;
+    VulkanMemory* staging_memory_;
+    bool staging_recorded_;
+    uint32_t staging_frame_index_;
+    // 保存最新状态的 buffer
+    uint32_t current_;
 };
 
 
@@ -40,7 +40,8 @@ ParticleGraphic::ParticleGraphic(VulkanLogicDevice* device,
                                  Particle* particle) :
         VulkanObject(device, swap_chain_image_format, frame_buffer_size),
         particle_(particle) {
-
+    vertex_str_ = kVertShaderSource;
+    fragment_str_ = kFragShaderSource;
 }
 
 int ParticleGraphic::CreatePipeline() {
@@ -96,18 +97,15 @@ int ParticleGraphic::CreatePipeline() {
         .primitiveRestartEnable = VK_FALSE
     };
 
-    VkViewport viewport = {0, 0,
-                           (float)frame_buffer_size_.width, (float)frame_buffer_size_.height,
-                           0.0f, 1.0f};
-    VkRect2D scissor = {{0, 0,}, {frame_buffer_size_.width, frame_buffer_size_.height}};
+    // viewport 和 scissor 是 dynamic state, surface 大小变化时不需要重建 pipeline
     VkPipelineViewportStateCreateInfo pipelineViewportStateCreateInfo {
         .sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO,
         .pNext = nullptr,
         .flags = 0,
         .viewportCount = 1,
-        .pViewports = &viewport,
+        .pViewports = nullptr,
         .scissorCount = 1,
-        .pScissors = &scissor
+        .pScissors = nullptr
     };
 
     VkPipelineRasterizationStateCreateInfo pipelineRasterizationStateCreateInfo {
@@ -172,12 +170,13 @@ int ParticleGraphic::CreatePipeline() {
         .blendConstants = {}
     };
 
+    VkDynamicState dynamicStates[] = { VK_DYNAMIC_STATE_VIEWPORT, VK_DYNAMIC_STATE_SCISSOR };
     VkPipelineDynamicStateCreateInfo pipelineDynamicStateCreateInfo{
         .sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO,
         .pNext = nullptr,
         .flags = 0,
-        .dynamicStateCount = 0,
-        .pDynamicStates = nullptr
+        .dynamicStateCount = 2,
+        .pDynamicStates = dynamicStates
     };
 
     VkPipelineLayoutCreateInfo pipelineLayoutCreateInfo {
@@ -268,7 +267,8 @@ void ParticleGraphic::DestroyPipeline() {
 }
 
 void ParticleGraphic::Draw(const VulkanCommandBuffer* command_buffer,
-          const VulkanFrameBuffer* frame_buffer) const {
+          const VulkanFrameBuffer* frame_buffer,
+          const frame_context_t* frame) const {
     VkCommandBufferBeginInfo commandBufferBeginInfo{
         .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
         .pNext = nullptr,
@@ -288,12 +288,18 @@ void ParticleGraphic::Draw(const VulkanCommandBuffer* command_buffer,
         .clearValueCount = 1,
         .pClearValues = &clear_color
     };
+    int timestamp_scope = command_buffer->CmdBeginTimestampScope("particle_render_pass");
     command_buffer->CmdBeginRenderPass(&renderPassBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
     command_buffer->CmdBindPipeline(VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline_->pipeline());
+    VkViewport viewport = GetVkViewport();
+    command_buffer->CmdSetViewport(1, &viewport);
+    VkRect2D scissor = GetScissor();
+    command_buffer->CmdSetScissor(1, &scissor);
     VkBuffer vertex_buffers[] = {particle_->GetVertexBuffer()};
     VkDeviceSize offsets[] = {0};
     command_buffer->CmdBindVertexBuffers(0, 1, vertex_buffers, offsets);
-    command_buffer->CmdDraw(Particle::PARTICLE_COUNT, 1, 0, 0);
+    command_buffer->CmdDraw(particle_->particle_count(), 1, 0, 0);
     command_buffer->CmdEndRenderPass();
+    command_buffer->CmdEndTimestampScope(timestamp_scope);
     command_buffer->EndCommandBuffer();
 }
\ No newline at end of file
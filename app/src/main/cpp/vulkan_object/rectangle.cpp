@@ -86,7 +86,8 @@ void Rectangle::DestroyPipeline() {
 }
 
 void Rectangle::Draw(const VulkanCommandBuffer* command_buffer,
-                     const VulkanFrameBuffer* frame_buffer) const {
+                     const VulkanFrameBuffer* frame_buffer,
+                     const frame_context_t* frame) const {
     /* typedef struct VkCommandBufferBeginInfo {
         VkStructureType                          sType;
         const void*                              pNext;
@@ -235,25 +236,7 @@ void Rectangle::CreateVertexBuffer() {
     buffer_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
     vertex_buffer_ = device_->CreateBuffer(&buffer_info);
     assert(vertex_buffer_);
-    VkMemoryRequirements mem_requirements{};
-    vertex_buffer_->GetBufferMemoryRequirements(&mem_requirements);
-    VkPhysicalDeviceMemoryProperties mem_properties{};
-    device_->GetPhysicalDeviceMemoryProperties(&mem_properties);
-
-    /* typedef struct VkMemoryAllocateInfo {
-        VkStructureType    sType;
-        const void*        pNext;
-        VkDeviceSize       allocationSize;
-        uint32_t           memoryTypeIndex;
-    } VkMemoryAllocateInfo; */
-    VkMemoryAllocateInfo alloc_info{};
-    alloc_info.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-    alloc_info.allocationSize = mem_requirements.size;
-    VkResult ret = VulkanLogicDevice::GetMemoryType(&mem_properties, mem_requirements.memoryTypeBits,
-                                                    VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT | VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
-                                                    &alloc_info.memoryTypeIndex);
-    assert(ret == VK_SUCCESS);
-    vertex_memory_ = device_->AllocateMemory(&alloc_info);
+    vertex_memory_ = device_->AllocateBufferMemory(vertex_buffer_, MEMORY_USAGE_CPU_TO_GPU);
     assert(vertex_memory_);
     vertex_memory_->BindBufferMemory(vertex_buffer_->buffer(), 0);
     void* data;
@@ -22,7 +22,8 @@ public:
     void DestroyPipeline() override;
 
     void Draw(const VulkanCommandBuffer* command_buffer,
-              const VulkanFrameBuffer* frame_buffer) const override;
+              const VulkanFrameBuffer* frame_buffer,
+              const frame_context_t* frame) const override;
 protected:
     void LoadResource() override {}
     void CreateRenderPass() override;
@@ -106,7 +106,8 @@ void RectangleMultisample::DestroyPipeline() {
 }
 
 void RectangleMultisample::Draw(const VulkanCommandBuffer* command_buffer,
-                           const VulkanFrameBuffer* frame_buffer) const {
+                           const VulkanFrameBuffer* frame_buffer,
+                           const frame_context_t* frame) const {
 //    CopyDataToUniformBuffer();
     /* typedef struct VkCommandBufferBeginInfo {
         VkStructureType                          sType;
@@ -154,6 +155,14 @@ void RectangleMultisample::Draw(const VulkanCommandBuffer* command_buffer,
     command_buffer->EndCommandBuffer();
 }
 
+void RectangleMultisample::Resize(VkExtent2D frame_buffer_size) {
+    VulkanObject::Resize(frame_buffer_size);
+    DestroyColorAttachment();
+    CreateColorAttachment();
+    // projection 和宽高比相关
+    CopyDataToUniformBuffer();
+}
+
 void RectangleMultisample::LoadResource() {
     CreateUniformBufferAndMap();
     CopyDataToUniformBuffer();
@@ -308,25 +317,7 @@ void RectangleMultisample::CreateVertexBuffer() {
     buffer_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
     vertex_buffer_ = device_->CreateBuffer(&buffer_info);
     assert(vertex_buffer_);
-    VkMemoryRequirements mem_requirements{};
-    vertex_buffer_->GetBufferMemoryRequirements(&mem_requirements);
-    VkPhysicalDeviceMemoryProperties mem_properties{};
-    device_->GetPhysicalDeviceMemoryProperties(&mem_properties);
-
-    /* typedef struct VkMemoryAllocateInfo {
-        VkStructureType    sType;
-        const void*        pNext;
-        VkDeviceSize       allocationSize;
-        uint32_t           memoryTypeIndex;
-    } VkMemoryAllocateInfo; */
-    VkMemoryAllocateInfo alloc_info{};
-    alloc_info.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-    alloc_info.allocationSize = mem_requirements.size;
-    VkResult ret = VulkanLogicDevice::GetMemoryType(&mem_properties, mem_requirements.memoryTypeBits,
-                                                    VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT | VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
-                                                    &alloc_info.memoryTypeIndex);
-    assert(ret == VK_SUCCESS);
-    vertex_memory_ = device_->AllocateMemory(&alloc_info);
+    vertex_memory_ = device_->AllocateBufferMemory(vertex_buffer_, MEMORY_USAGE_CPU_TO_GPU);
     assert(vertex_memory_);
     vertex_memory_->BindBufferMemory(vertex_buffer_->buffer(), 0);
     void* data;
@@ -369,20 +360,7 @@ void RectangleMultisample::CreateColorAttachment() {
     color_attachment_image_ = device_->CreateImage(&imageInfo);
     assert(color_attachment_image_);
 
-    VkMemoryRequirements mem_requirements;
-    color_attachment_image_->GetImageMemoryRequirements(&mem_requirements);
-
-    VkPhysicalDeviceMemoryProperties mem_properties{};
-    device_->GetPhysicalDeviceMemoryProperties(&mem_properties);
-
-    VkMemoryAllocateInfo alloc_info{};
-    alloc_info.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-    alloc_info.allocationSize = mem_requirements.size;
-    VkResult ret = VulkanLogicDevice::GetMemoryType(&mem_properties, mem_requirements.memoryTypeBits,
-                                                    VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
-                                                    &alloc_info.memoryTypeIndex);
-    assert(ret == VK_SUCCESS);
-    color_attachment_image_memory_ = device_->AllocateMemory(&alloc_info);
+    color_attachment_image_memory_ = device_->AllocateImageMemory(color_attachment_image_, MEMORY_USAGE_GPU_ONLY);
     color_attachment_image_memory_->BindImageMemory(color_attachment_image_->image(), 0);
 
     VkImageViewCreateInfo view_info{};
@@ -422,29 +400,11 @@ void RectangleMultisample::CreateUniformBufferAndMap() {
     buffer_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
     uniform_buffer_ = device_->CreateBuffer(&buffer_info);
     assert(uniform_buffer_);
-    VkMemoryRequirements mem_requirements{};
-    uniform_buffer_->GetBufferMemoryRequirements(&mem_requirements);
-    VkPhysicalDeviceMemoryProperties mem_properties{};
-    device_->GetPhysicalDeviceMemoryProperties(&mem_properties);
-
-    /* typedef struct VkMemoryAllocateInfo {
-        VkStructureType    sType;
-        const void*        pNext;
-        VkDeviceSize       allocationSize;
-        uint32_t           memoryTypeIndex;
-    } VkMemoryAllocateInfo; */
-    VkMemoryAllocateInfo alloc_info{};
-    alloc_info.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-    alloc_info.allocationSize = mem_requirements.size;
-    VkResult ret = VulkanLogicDevice::GetMemoryType(&mem_properties, mem_requirements.memoryTypeBits,
-                                                    VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT | VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
-                                                    &alloc_info.memoryTypeIndex);
-    assert(ret == VK_SUCCESS);
-    uniform_memory_ = device_->AllocateMemory(&alloc_info);
+    uniform_memory_ = device_->AllocateBufferMemory(uniform_buffer_, MEMORY_USAGE_CPU_TO_GPU);
     assert(uniform_memory_);
     uniform_memory_->BindBufferMemory(uniform_buffer_->buffer(), 0);
 
-    uniform_memory_->MapMemory(0, mem_requirements.size, &uniform_buffer_mapped_);
+    uniform_memory_->MapMemory(0, buffer_info.size, &uniform_buffer_mapped_);
 }
 
 void RectangleMultisample::CopyDataToUniformBuffer() const {
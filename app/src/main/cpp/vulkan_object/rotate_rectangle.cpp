@@ -34,17 +34,17 @@ const char RotateRectangle::kFragShaderSource[] =
 
 RotateRectangle::RotateRectangle(VulkanLogicDevice* device,
                                  VkFormat swap_chain_image_format,
-                                 VkExtent2D frame_buffer_size) :
+                                 VkExtent2D frame_buffer_size,
+                                 const FrameContextRing* frame_contexts) :
         VulkanObject(device, swap_chain_image_format, frame_buffer_size),
         descriptor_set_layout_(nullptr),
         vertex_buffer_(nullptr),
-        uniform_buffer_(nullptr),
         vertex_memory_(nullptr),
-        uniform_memory_(nullptr),
-        uniform_buffer_mapped_(nullptr),
+        frame_contexts_(frame_contexts),
         pipeline_layout_(nullptr),
         vulkan_descriptor_pool_(nullptr),
         vulkan_descriptor_set_(nullptr) {
+    assert(frame_contexts_->uniform_slice_size() >= sizeof(mvp_t));
     vertex_str_ = kVertShaderSource;
     fragment_str_ = kFragShaderSource;
 }
@@ -95,7 +95,6 @@ int RotateRectangle::CreatePipeline() {
 void RotateRectangle::DestroyPipeline() {
     vulkan_descriptor_pool_->FreeDescriptorSet(&vulkan_descriptor_set_);
     VulkanLogicDevice::DestroyDescriptorPool(&vulkan_descriptor_pool_);
-    UnmapAndDestroyUniformBuffer();
     DestroyVertexBuffer();
     VulkanLogicDevice::DestroyPipelineLayout(&pipeline_layout_);
     if (pipeline_ != nullptr) {
@@ -105,8 +104,9 @@ void RotateRectangle::DestroyPipeline() {
 }
 
 void RotateRectangle::Draw(const VulkanCommandBuffer* command_buffer,
-                     const VulkanFrameBuffer* frame_buffer) const {
-    CopyDataToUniformBuffer();
+                     const VulkanFrameBuffer* frame_buffer,
+                     const frame_context_t* frame) const {
+    CopyDataToUniformBuffer(frame);
     /* typedef struct VkCommandBufferBeginInfo {
         VkStructureType                          sType;
         const void*                              pNext;
@@ -147,15 +147,15 @@ void RotateRectangle::Draw(const VulkanCommandBuffer* command_buffer,
     VkRect2D scissor = GetScissor();
     command_buffer->CmdSetScissor(1, &scissor);
     VkDescriptorSet descriptor_sets[] = {vulkan_descriptor_set_->descriptor_set()};
-    command_buffer->CmdBindDescriptorSets(VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline_layout_->layout(), 0, 1, descriptor_sets, 0, nullptr);
+    uint32_t dynamic_offsets[] = {static_cast<uint32_t>(frame->uniform_offset)};
+    command_buffer->CmdBindDescriptorSets(VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline_layout_->layout(), 0, 1, descriptor_sets, 1, dynamic_offsets);
     command_buffer->CmdDraw(4, 1, 0, 0);
     command_buffer->CmdEndRenderPass();
     command_buffer->EndCommandBuffer();
 }
 
 void RotateRectangle::LoadResource() {
-    CreateUniformBufferAndMap();
-    CopyDataToUniformBuffer();
+    // uniform buffer 由 FrameContextRing 提供, 每帧在 Draw 里写
 }
 
 void RotateRectangle::CreateRenderPass() {
@@ -254,7 +254,7 @@ VulkanDescriptorSetLayout* RotateRectangle::CreateDescriptorSetLayout() const {
     } VkDescriptorSetLayoutBinding; */
     VkDescriptorSetLayoutBinding layout_binding{};
     layout_binding.binding = 0;
-    layout_binding.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+    layout_binding.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
     layout_binding.descriptorCount = 1;
     layout_binding.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
 
@@ -290,25 +290,7 @@ void RotateRectangle::CreateVertexBuffer() {
     buffer_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
     vertex_buffer_ = device_->CreateBuffer(&buffer_info);
     assert(vertex_buffer_);
-    VkMemoryRequirements mem_requirements{};
-    vertex_buffer_->GetBufferMemoryRequirements(&mem_requirements);
-    VkPhysicalDeviceMemoryProperties mem_properties{};
-    device_->GetPhysicalDeviceMemoryProperties(&mem_properties);
-
-    /* typedef struct VkMemoryAllocateInfo {
-        VkStructureType    sType;
-        const void*        pNext;
-        VkDeviceSize       allocationSize;
-        uint32_t           memoryTypeIndex;
-    } VkMemoryAllocateInfo; */
-    VkMemoryAllocateInfo alloc_info{};
-    alloc_info.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-    alloc_info.allocationSize = mem_requirements.size;
-    VkResult ret = VulkanLogicDevice::GetMemoryType(&mem_properties, mem_requirements.memoryTypeBits,
-                                                    VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT | VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
-                                                    &alloc_info.memoryTypeIndex);
-    assert(ret == VK_SUCCESS);
-    vertex_memory_ = device_->AllocateMemory(&alloc_info);
+    vertex_memory_ = device_->AllocateBufferMemory(vertex_buffer_, MEMORY_USAGE_CPU_TO_GPU);
     assert(vertex_memory_);
     vertex_memory_->BindBufferMemory(vertex_buffer_->buffer(), 0);
     void* data;
@@ -333,50 +315,7 @@ void RotateRectangle::CreateDescriptorSets() {
     BindDescriptorSetWithBuffer();
 }
 
-void RotateRectangle::CreateUniformBufferAndMap() {
-/* typedef struct VkBufferCreateInfo {
-        VkStructureType        sType;
-        const void*            pNext;
-        VkBufferCreateFlags    flags;
-        VkDeviceSize           size;
-        VkBufferUsageFlags     usage;
-        VkSharingMode          sharingMode;
-        uint32_t               queueFamilyIndexCount;
-        const uint32_t*        pQueueFamilyIndices;
-    } VkBufferCreateInfo; */
-    VkBufferCreateInfo buffer_info{};
-    buffer_info.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
-    buffer_info.size = sizeof(mvp_t);
-    buffer_info.usage = VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT;
-    buffer_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
-    uniform_buffer_ = device_->CreateBuffer(&buffer_info);
-    assert(uniform_buffer_);
-    VkMemoryRequirements mem_requirements{};
-    uniform_buffer_->GetBufferMemoryRequirements(&mem_requirements);
-    VkPhysicalDeviceMemoryProperties mem_properties{};
-    device_->GetPhysicalDeviceMemoryProperties(&mem_properties);
-
-    /* typedef struct VkMemoryAllocateInfo {
-        VkStructureType    sType;
-        const void*        pNext;
-        VkDeviceSize       allocationSize;
-        uint32_t           memoryTypeIndex;
-    } VkMemoryAllocateInfo; */
-    VkMemoryAllocateInfo alloc_info{};
-    alloc_info.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-    alloc_info.allocationSize = mem_requirements.size;
-    VkResult ret = VulkanLogicDevice::GetMemoryType(&mem_properties, mem_requirements.memoryTypeBits,
-                                                    VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT | VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
-                                                    &alloc_info.memoryTypeIndex);
-    assert(ret == VK_SUCCESS);
-    uniform_memory_ = device_->AllocateMemory(&alloc_info);
-    assert(uniform_memory_);
-    uniform_memory_->BindBufferMemory(uniform_buffer_->buffer(), 0);
-
-    uniform_memory_->MapMemory(0, mem_requirements.size, &uniform_buffer_mapped_);
-}
-
-void RotateRectangle::CopyDataToUniformBuffer() const {
+void RotateRectangle::CopyDataToUniformBuffer(const frame_context_t* frame) const {
     static auto startTime = std::chrono::high_resolution_clock::now();
     auto currentTime = std::chrono::high_resolution_clock::now();
     float time = std::chrono::duration<float, std::chrono::seconds::period>(currentTime - startTime).count();
@@ -385,13 +324,7 @@ void RotateRectangle::CopyDataToUniformBuffer() const {
     ubo.view = glm::lookAt(glm::vec3(2.0f, 2.0f, 2.0f), glm::vec3(0.0f, 0.0f, 0.0f), glm::vec3(0.0f, 0.0f, 1.0f));
     ubo.project = glm::perspective(glm::radians(45.0f), (float)frame_buffer_size_.width/(float)frame_buffer_size_.height, 0.1f, 10.0f);
     ubo.project[1][1] *= -1;
-    memcpy(uniform_buffer_mapped_, &ubo, sizeof(ubo));
-}
-
-void RotateRectangle::UnmapAndDestroyUniformBuffer() {
-    uniform_memory_->UnmapMemory();
-    VulkanLogicDevice::FreeMemory(&uniform_memory_);
-    VulkanLogicDevice::DestroyBuffer(&uniform_buffer_);
+    memcpy(frame->uniform_data, &ubo, sizeof(ubo));
 }
 
 VulkanDescriptorPool*  RotateRectangle::CreateDescriptorPool() {
@@ -400,7 +333,7 @@ VulkanDescriptorPool*  RotateRectangle::CreateDescriptorPool() {
         uint32_t            descriptorCount;
     } VkDescriptorPoolSize; */
     VkDescriptorPoolSize pool_size{};
-    pool_size.type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+    pool_size.type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
     pool_size.descriptorCount = 1;
     /* typedef struct VkDescriptorPoolCreateInfo {
         VkStructureType                sType;
@@ -431,7 +364,7 @@ void RotateRectangle::BindDescriptorSetWithBuffer() {
         VkDeviceSize    range;
     } VkDescriptorBufferInfo; */
     VkDescriptorBufferInfo buffer_info{};
-    buffer_info.buffer = uniform_buffer_->buffer();
+    buffer_info.buffer = frame_contexts_->uniform_buffer();
     buffer_info.offset = 0;
     buffer_info.range = sizeof(mvp_t);
     /* typedef struct VkWriteDescriptorSet {
@@ -452,7 +385,7 @@ void RotateRectangle::BindDescriptorSetWithBuffer() {
     descriptorWrite.dstBinding = 0;
     descriptorWrite.dstArrayElement = 0;
     descriptorWrite.descriptorCount = 1;
-    descriptorWrite.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+    descriptorWrite.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
     descriptorWrite.pImageInfo = nullptr; // Optional
     descriptorWrite.pBufferInfo = &buffer_info;
     descriptorWrite.pTexelBufferView = nullptr; // Optional
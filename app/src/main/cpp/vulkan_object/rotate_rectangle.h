@@ -8,9 +8,11 @@
 
 class RotateRectangle : public VulkanObject {
 public:
+    // frame_contexts 的 uniform slice 不能小于 mvp_t
     RotateRectangle(VulkanLogicDevice* device,
                     VkFormat swap_chain_image_format,
-                    VkExtent2D frame_buffer_size);
+                    VkExtent2D frame_buffer_size,
+                    const FrameContextRing* frame_contexts);
     ~RotateRectangle() = default;
 
     typedef struct  {
@@ -28,7 +30,8 @@ public:
     void DestroyPipeline() override;
 
     void Draw(const VulkanCommandBuffer* command_buffer,
-              const VulkanFrameBuffer* frame_buffer) const override;
+              const VulkanFrameBuffer* frame_buffer,
+              const frame_context_t* frame) const override;
 protected:
     void LoadResource() override;
     void CreateRenderPass() override;
@@ -40,9 +43,7 @@ protected:
 
     void CreateDescriptorSets() override;
 
-    void CreateUniformBufferAndMap();
-    void CopyDataToUniformBuffer() const;
-    void UnmapAndDestroyUniformBuffer();
+    void CopyDataToUniformBuffer(const frame_context_t* frame) const;
 
     VulkanDescriptorPool*  CreateDescriptorPool();
     VulkanDescriptorSetLayout* CreateDescriptorSetLayout() const;
@@ -57,10 +58,9 @@ protected:
 
     VulkanDescriptorSetLayout* descriptor_set_layout_;
     VulkanBuffer* vertex_buffer_;
-    VulkanBuffer* uniform_buffer_;
     VulkanMemory* vertex_memory_;
-    VulkanMemory* uniform_memory_;
-    void* uniform_buffer_mapped_;
+    // mvp 放在每一帧自己的 uniform slice 里, 用 dynamic offset 绑定
+    const FrameContextRing* frame_contexts_;
     VulkanPipelineLayout* pipeline_layout_;
     VulkanDescriptorPool* vulkan_descriptor_pool_;
     VulkanDescriptorSet* vulkan_descriptor_set_;
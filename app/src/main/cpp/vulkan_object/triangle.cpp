@@ -95,7 +95,8 @@ void Triangle::DestroyPipeline() {
 }
 
 void Triangle::Draw(const VulkanCommandBuffer* command_buffer,
-                    const VulkanFrameBuffer* frame_buffer) const {
+                    const VulkanFrameBuffer* frame_buffer,
+                    const frame_context_t* frame) const {
 
     /* typedef struct VkCommandBufferBeginInfo {
         VkStructureType                          sType;
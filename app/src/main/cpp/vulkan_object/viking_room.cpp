@@ -3,19 +3,29 @@
 //
 
 #include "viking_room.h"
+#include "image_decoder.h"
 #include "log.h"
+#include "mesh_builder.h"
+#include "obj_parser.h"
+#include "texture_file.h"
 
-#define STB_IMAGE_IMPLEMENTATION
-#include <stb_image.h>
-#define TINYOBJLOADER_IMPLEMENTATION
-#include <tiny_obj_loader.h>
-#include <sstream>
 #include <map>
 #include <unordered_map>
 #define GLM_FORCE_RADIANS
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/type_ptr.hpp>
+#include <algorithm>
 #include <array>
+#include <cfloat>
+#include <chrono>
+
+const static char TEXTURE_PNG[] = "viking_room.png";
+
+static uint64_t NowNs() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+}
 
 const char VikingRoom::kVertShaderSource[] =
         "#version 450\n"
@@ -42,30 +52,40 @@ const char VikingRoom::kFragShaderSource[] =
         "}\n";
 
 VikingRoom::VikingRoom(AAssetManager* asset_manager,
-                       VulkanCommandPool* command_pool,
-                       VulkanQueue* graphic_queue,
+                       VulkanUploadContext* upload_context,
                        VulkanLogicDevice* device,
                        VkFormat swap_chain_image_format,
-                       VkExtent2D frame_buffer_size) :
+                       VkExtent2D frame_buffer_size,
+                       const FrameContextRing* frame_contexts,
+                       bool optimize_mesh,
+                       bool quantize_vertices) :
         VulkanObject(device, swap_chain_image_format, frame_buffer_size),
         asset_manager_(asset_manager),
-        command_pool_(command_pool),
-        graphic_queue_(graphic_queue),
+        upload_context_(upload_context),
         pipeline_layout_(nullptr),
         vertex_buffer_(nullptr),
         vertex_memory_(nullptr),
         indices_buffer_(nullptr),
         indices_memory_(nullptr),
-        mvp_buffer_(nullptr),
-        mvp_memory_(nullptr) ,
-        uniform_buffer_mapped_(nullptr) ,
+        frame_contexts_(frame_contexts),
+        texture_format_(VK_FORMAT_R8G8B8A8_UNORM),
         texture_image_(nullptr) ,
         texture_image_memory_(nullptr) ,
         texture_image_view_(nullptr) ,
         texture_image_sampler_(nullptr) ,
         descriptor_pool_(nullptr) ,
         descriptor_set_layout_(nullptr) ,
-        descriptor_set_(nullptr) {
+        descriptor_set_(nullptr),
+        index_type_(VK_INDEX_TYPE_UINT16),
+        index_count_(0),
+        optimize_mesh_(optimize_mesh),
+        vertex_source_(nullptr),
+        vertex_source_size_(0),
+        index_source_(nullptr),
+        index_source_size_(0),
+        vertex_layout_(quantize_vertices, false),
+        dequantize_(1.0f) {
+    assert(frame_contexts_->uniform_slice_size() >= sizeof(mvp_t));
     vertex_str_ = kVertShaderSource;
     fragment_str_ = kFragShaderSource;
 }
@@ -94,6 +114,8 @@ int VikingRoom::CreatePipeline() {
     CreateRenderPass();
     CreateVertexBuffer();
     CreateIndexBuffer();
+    // 数据已经复制到 buffer 里, 不再需要 map 的文件
+    mesh_file_.Close();
 
     descriptor_set_layouts.push_back(descriptor_set_layout_->descriptor_set_layout());
     pipeline_layout_ = CreatePipelineLayout(descriptor_set_layouts);
@@ -109,6 +131,10 @@ int VikingRoom::CreatePipeline() {
         goto ERROR_EXIT;
     }
     pipeline_ = pipeline;
+    // PNG 在 ImageDecoder 的 worker 线程解码, 纹理放到 pipeline 创建之后, 解码和前面的工作重叠
+    CreateTextureImage();
+    CreateTextureImageViewAndSampler();
+    BindTextureDescriptorSetWithImage();
 
     VulkanLogicDevice::DestroyShaderModule(&vert_shader_module);
     VulkanLogicDevice::DestroyShaderModule(&frag_shader_module);
@@ -118,6 +144,17 @@ int VikingRoom::CreatePipeline() {
     return -1;
 }
 
+std::vector<std::string> VikingRoom::image_assets() const {
+    // 和 CreateCompressedTextureImage 的选择一致, 能用 KTX2 时不需要解码 PNG
+    TextureFile texture_file;
+    if (texture_file.OpenBest(asset_manager_, "viking_room", [this](uint32_t vk_format) {
+        return IsTextureFormatSupported(vk_format);
+    })) {
+        return std::vector<std::string>();
+    }
+    return std::vector<std::string>{TEXTURE_PNG};
+}
+
 void VikingRoom::DestroyPipeline() {
     if (pipeline_ != nullptr) {
         VulkanLogicDevice::DestroyPipelines(&pipeline_);
@@ -132,12 +169,12 @@ void VikingRoom::DestroyPipeline() {
     DestroyDepthImage();
     DestroyTextureImageViewAndSampler();
     DestroyTextureImage();
-    DestroyMvpBuffer();
 }
 
 void VikingRoom::Draw(const VulkanCommandBuffer* command_buffer,
-                      const VulkanFrameBuffer* frame_buffer) const {
-    CopyDataToUniformBuffer();
+                      const VulkanFrameBuffer* frame_buffer,
+                      const frame_context_t* frame) const {
+    CopyDataToUniformBuffer(frame);
     /* typedef struct VkCommandBufferBeginInfo {
         VkStructureType                          sType;
         const void*                              pNext;
@@ -172,6 +209,7 @@ void VikingRoom::Draw(const VulkanCommandBuffer* command_buffer,
 
     render_pass_info.clearValueCount = 2;
     render_pass_info.pClearValues = clear_colors;
+    int timestamp_scope = command_buffer->CmdBeginTimestampScope("viking_room_render_pass");
     command_buffer->CmdBeginRenderPass(&render_pass_info, VK_SUBPASS_CONTENTS_INLINE);
     command_buffer->CmdBindPipeline(VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline_->pipeline());
     VkViewport viewport = GetVkViewport();
@@ -179,23 +217,29 @@ void VikingRoom::Draw(const VulkanCommandBuffer* command_buffer,
     VkRect2D scissor = GetScissor();
     command_buffer->CmdSetScissor(1, &scissor);
 
-//    command_buffer->CmdBindIndexBuffer(indices_buffer_->buffer(), 0, VK_INDEX_TYPE_UINT16);
+    command_buffer->CmdBindIndexBuffer(indices_buffer_->buffer(), 0, index_type_);
     VkBuffer vertexes[] = {vertex_buffer_->buffer()};
     VkDeviceSize offsets[] = {0};
     command_buffer->CmdBindVertexBuffers(0, 1, vertexes, offsets);
     VkDescriptorSet descriptor_sets[] = {descriptor_set_->descriptor_set()};
-    command_buffer->CmdBindDescriptorSets(VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline_layout_->layout(), 0, 1, descriptor_sets, 0, nullptr);
-//    command_buffer->CmdDrawIndexed(static_cast<uint32_t>(indices_.size()), 1, 0, 0, 0);
-    command_buffer->CmdDraw(static_cast<uint32_t>(vertices_.size()), 1, 0, 0);
+    uint32_t dynamic_offsets[] = {static_cast<uint32_t>(frame->uniform_offset)};
+    command_buffer->CmdBindDescriptorSets(VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline_layout_->layout(), 0, 1, descriptor_sets, 1, dynamic_offsets);
+    command_buffer->CmdDrawIndexed(index_count_, 1, 0, 0, 0);
     command_buffer->CmdEndRenderPass();
+    command_buffer->CmdEndTimestampScope(timestamp_scope);
     command_buffer->EndCommandBuffer();
 }
 
+void VikingRoom::Resize(VkExtent2D frame_buffer_size) {
+    VulkanObject::Resize(frame_buffer_size);
+    DestroyDepthImageView();
+    DestroyDepthImage();
+    CreateDepthImage();
+    CreateDepthImageView();
+}
+
 void VikingRoom::LoadResource() {
     ReadVerticesIndexes();
-    CreateMvpBuffer();
-    CreateTextureImage();
-    CreateTextureImageViewAndSampler();
     CreateDepthImage();
     CreateDepthImageView();
 }
@@ -315,38 +359,20 @@ void VikingRoom::CreateVertexBuffer() {
     } VkBufferCreateInfo; */
     VkBufferCreateInfo buffer_info{};
     buffer_info.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
-    buffer_info.size = sizeof(vertices_[0]) * vertices_.size();
+    buffer_info.size = vertex_source_size_;
     buffer_info.usage = VK_BUFFER_USAGE_VERTEX_BUFFER_BIT;
     buffer_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
     vertex_buffer_ = device_->CreateBuffer(&buffer_info);
     assert(vertex_buffer_);
-    VkMemoryRequirements mem_requirements{};
-    vertex_buffer_->GetBufferMemoryRequirements(&mem_requirements);
-    VkPhysicalDeviceMemoryProperties mem_properties{};
-    device_->GetPhysicalDeviceMemoryProperties(&mem_properties);
-
-    /* typedef struct VkMemoryAllocateInfo {
-        VkStructureType    sType;
-        const void*        pNext;
-        VkDeviceSize       allocationSize;
-        uint32_t           memoryTypeIndex;
-    } VkMemoryAllocateInfo; */
-    VkMemoryAllocateInfo alloc_info{};
-    alloc_info.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-    alloc_info.allocationSize = mem_requirements.size;
-    VkResult ret = VulkanLogicDevice::GetMemoryType(&mem_properties, mem_requirements.memoryTypeBits,
-                                                    VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT | VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
-                                                    &alloc_info.memoryTypeIndex);
-    assert(ret == VK_SUCCESS);
-    vertex_memory_ = device_->AllocateMemory(&alloc_info);
+    vertex_memory_ = device_->AllocateBufferMemory(vertex_buffer_, MEMORY_USAGE_CPU_TO_GPU);
     assert(vertex_memory_);
-    ret = vertex_memory_->BindBufferMemory(vertex_buffer_->buffer(), 0);
+    VkResult ret = vertex_memory_->BindBufferMemory(vertex_buffer_->buffer(), 0);
     assert(ret == VK_SUCCESS);
 
     void* data = nullptr;
     ret = vertex_memory_->MapMemory(0, buffer_info.size, &data);
     assert(ret == VK_SUCCESS);
-    memcpy(data, vertices_.data(), buffer_info.size);
+    memcpy(data, vertex_source_, buffer_info.size);
     vertex_memory_->UnmapMemory();
 }
 
@@ -368,38 +394,20 @@ void VikingRoom::CreateIndexBuffer() {
     } VkBufferCreateInfo; */
     VkBufferCreateInfo buffer_info{};
     buffer_info.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
-    buffer_info.size = sizeof(indices_[0]) * indices_.size();
+    buffer_info.size = index_source_size_;
     buffer_info.usage = VK_BUFFER_USAGE_INDEX_BUFFER_BIT;
     buffer_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
     indices_buffer_ = device_->CreateBuffer(&buffer_info);
     assert(indices_buffer_);
-    VkMemoryRequirements mem_requirements{};
-    indices_buffer_->GetBufferMemoryRequirements(&mem_requirements);
-    VkPhysicalDeviceMemoryProperties mem_properties{};
-    device_->GetPhysicalDeviceMemoryProperties(&mem_properties);
-
-    /* typedef struct VkMemoryAllocateInfo {
-        VkStructureType    sType;
-        const void*        pNext;
-        VkDeviceSize       allocationSize;
-        uint32_t           memoryTypeIndex;
-    } VkMemoryAllocateInfo; */
-    VkMemoryAllocateInfo alloc_info{};
-    alloc_info.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-    alloc_info.allocationSize = mem_requirements.size;
-    VkResult ret = VulkanLogicDevice::GetMemoryType(&mem_properties, mem_requirements.memoryTypeBits,
-                                                    VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT | VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
-                                                    &alloc_info.memoryTypeIndex);
-    assert(ret == VK_SUCCESS);
-    indices_memory_ = device_->AllocateMemory(&alloc_info);
+    indices_memory_ = device_->AllocateBufferMemory(indices_buffer_, MEMORY_USAGE_CPU_TO_GPU);
     assert(indices_memory_);
-    ret = indices_memory_->BindBufferMemory(indices_buffer_->buffer(), 0);
+    VkResult ret = indices_memory_->BindBufferMemory(indices_buffer_->buffer(), 0);
     assert(ret == VK_SUCCESS);
 
     void* data = nullptr;
     ret = indices_memory_->MapMemory(0, buffer_info.size, &data);
     assert(ret == VK_SUCCESS);
-    memcpy(data, indices_.data(), buffer_info.size);
+    memcpy(data, index_source_, buffer_info.size);
     indices_memory_->UnmapMemory();
 }
 
@@ -418,161 +426,213 @@ void VikingRoom::CreateDescriptorSets() {
     descriptor_set_ = descriptor_pool_->AllocateDescriptorSet(&set_layout1);
     assert(descriptor_set_);
     BindMvpDescriptorSetWithBuffer();
-    BindTextureDescriptorSetWithImage();
 }
 
 void VikingRoom::ReadVerticesIndexes() {
+    uint64_t begin = NowNs();
+    // .mesh 里是焊接重排之后的数据, 关闭优化时只能解析 OBJ
+    if (optimize_mesh_ && ReadMeshFile()) {
+        LOG_D("VikingRoom", "viking_room.mesh: %u vertices, %u indices, mapped in %.3f ms\n",
+              mesh_file_.header().vertex_count, index_count_, (NowNs() - begin) / 1e6);
+    } else {
+        ReadObjFile();
+        vertex_source_ = vertices_.data();
+        vertex_source_size_ = sizeof(vertices_[0]) * vertices_.size();
+        index_source_ = index_data_.data();
+        index_source_size_ = index_data_.size();
+        LOG_D("VikingRoom", "viking_room.obj.txt parsed in %.3f ms\n", (NowNs() - begin) / 1e6);
+    }
+    if (vertex_layout_.quantized()) {
+        QuantizeVertices();
+    }
+    vertex_binding_descriptions_ = {vertex_layout_.binding_description(0)};
+    vertex_attribute_descriptions_ = vertex_layout_.attribute_descriptions(0);
+}
+
+bool VikingRoom::ReadMeshFile() {
+    if (!mesh_file_.Open(asset_manager_, "viking_room.mesh")) {
+        return false;
+    }
+    // 文件里是 vertex_t, 也就是没有 normal 的 float 格式
+    VertexLayout file_layout(false, false);
+    if (file_layout.stride() != sizeof(vertex_t) ||
+            !mesh_file_.MatchLayout(file_layout.stride(), file_layout.mesh_attributes())) {
+        LOG_W("VikingRoom", "viking_room.mesh does not match vertex_t, fall back to OBJ\n");
+        mesh_file_.Close();
+        return false;
+    }
+    const mesh_file_header_t& header = mesh_file_.header();
+    vertex_source_ = mesh_file_.vertex_data();
+    vertex_source_size_ = mesh_file_.vertex_data_size();
+    index_source_ = mesh_file_.index_data();
+    index_source_size_ = mesh_file_.index_data_size();
+    index_type_ = header.index_size == sizeof(uint16_t) ? VK_INDEX_TYPE_UINT16 : VK_INDEX_TYPE_UINT32;
+    index_count_ = header.index_count;
+    return true;
+}
+
+void VikingRoom::QuantizeVertices() {
+    uint64_t begin = NowNs();
+    // .mesh 的 vertex 数据从 16 字节对齐的位置开始, 可以直接当 vertex_t 读
+    const auto* vertices = static_cast<const vertex_t*>(vertex_source_);
+    size_t count = vertex_source_size_ / sizeof(vertex_t);
+    float bounds_min[3] = {FLT_MAX, FLT_MAX, FLT_MAX};
+    float bounds_max[3] = {-FLT_MAX, -FLT_MAX, -FLT_MAX};
+    for (size_t i = 0; i < count; ++i) {
+        for (int k = 0; k < 3; ++k) {
+            bounds_min[k] = std::min(bounds_min[k], vertices[i].pos[k]);
+            bounds_max[k] = std::max(bounds_max[k], vertices[i].pos[k]);
+        }
+    }
+    vertex_layout_.SetBounds(bounds_min, bounds_max);
+    uint32_t stride = vertex_layout_.stride();
+    quantized_vertices_.resize(count * stride);
+    for (size_t i = 0; i < count; ++i) {
+        if (!vertex_layout_.EncodeVertex(&vertices[i].pos.x, &vertices[i].coordinate.x, nullptr,
+                                         quantized_vertices_.data() + i * stride)) {
+            LOG_W("VikingRoom", "texcoord out of [0, 1], keep float vertices\n");
+            vertex_layout_ = VertexLayout(false, false);
+            std::vector<uint8_t>().swap(quantized_vertices_);
+            return;
+        }
+    }
+    vertex_layout_.GetDequantizeMatrix(glm::value_ptr(dequantize_));
+    vertex_source_ = quantized_vertices_.data();
+    vertex_source_size_ = quantized_vertices_.size();
+    LOG_D("VikingRoom", "%u vertices quantized from %u to %u bytes in %.3f ms\n", (unsigned) count,
+          (unsigned) sizeof(vertex_t), stride, (NowNs() - begin) / 1e6);
+}
+
+void VikingRoom::ReadObjFile() {
     AAsset* file = AAssetManager_open(asset_manager_,
                                       "viking_room.obj.txt", AASSET_MODE_BUFFER);
     assert(file);
+    // 直接解析 map 进来的文件, 不再复制到 stringstream
     size_t file_length = AAsset_getLength(file);
-    char* file_content = new char[file_length + 1];
-    memset(file_content, 0, file_length + 1);
-    int len = AAsset_read(file, file_content, file_length);
+    const auto* file_content = static_cast<const char*>(AAsset_getBuffer(file));
+    assert(file_content);
+    ObjParser parser;
+    bool success = parser.Parse(file_content, file_length);
     AAsset_close(file);
-    std::stringstream sstr(file_content);
-    delete[] file_content;
-    LOG_D("", "file_length %d len %d\n", file_length, len);
-    LOG_D("", "sstr %d \n", sstr.str().length());
-
-    tinyobj::attrib_t attrib;
-    std::vector<tinyobj::shape_t> shapes;
-    std::vector<tinyobj::material_t> materials;
-    std::string warn, err;
-    bool success = tinyobj::LoadObj(&attrib, &shapes, &materials, &warn, &err, &sstr);
     assert(success);
-    for (const auto& shape : shapes) {
-        for (const auto& index : shape.mesh.indices) {
-            vertex_t vertex{};
-
-            vertex.pos = {
-                    attrib.vertices[3 * index.vertex_index + 0],
-                    attrib.vertices[3 * index.vertex_index + 1],
-                    attrib.vertices[3 * index.vertex_index + 2]
-            };
-
+    parser.LogStats("VikingRoom");
+
+    const std::vector<float>& positions = parser.positions();
+    const std::vector<float>& texcoords = parser.texcoords();
+    MeshBuilder builder(sizeof(vertex_t), optimize_mesh_);
+    builder.Reserve(parser.indices().size());
+    for (const auto& index : parser.indices()) {
+        // 焊接时按字节比较, padding 也要是 0
+        vertex_t vertex{};
+
+        vertex.pos = {
+                positions[3 * index.position + 0],
+                positions[3 * index.position + 1],
+                positions[3 * index.position + 2]
+        };
+
+        if (index.texcoord >= 0) {
             vertex.coordinate = {
-                    attrib.texcoords[2 * index.texcoord_index + 0],
-                    1.0f - attrib.texcoords[2 * index.texcoord_index + 1]
+                    texcoords[2 * index.texcoord + 0],
+                    1.0f - texcoords[2 * index.texcoord + 1]
             };
-            vertices_.push_back(vertex);
-//            indices_.push_back(static_cast<uint32_t>(vertices_.size()));
         }
+        builder.AddVertex(&vertex);
     }
-    LOG_D("", "vertices_ %d \n", vertices_.size());
-}
-
-void VikingRoom::CreateMvpBuffer() {
-    /* typedef struct VkBufferCreateInfo {
-        VkStructureType        sType;
-        const void*            pNext;
-        VkBufferCreateFlags    flags;
-        VkDeviceSize           size;
-        VkBufferUsageFlags     usage;
-        VkSharingMode          sharingMode;
-        uint32_t               queueFamilyIndexCount;
-        const uint32_t*        pQueueFamilyIndices;
-    } VkBufferCreateInfo; */
-    VkBufferCreateInfo buffer_info{};
-    buffer_info.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
-    buffer_info.size = sizeof(mvp_t);
-    buffer_info.usage = VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT;
-    buffer_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
-    mvp_buffer_ = device_->CreateBuffer(&buffer_info);
-    assert(mvp_buffer_);
-    VkMemoryRequirements mem_requirements{};
-    mvp_buffer_->GetBufferMemoryRequirements(&mem_requirements);
-    VkPhysicalDeviceMemoryProperties mem_properties{};
-    device_->GetPhysicalDeviceMemoryProperties(&mem_properties);
-
-    /* typedef struct VkMemoryAllocateInfo {
-        VkStructureType    sType;
-        const void*        pNext;
-        VkDeviceSize       allocationSize;
-        uint32_t           memoryTypeIndex;
-    } VkMemoryAllocateInfo; */
-    VkMemoryAllocateInfo alloc_info{};
-    alloc_info.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-    alloc_info.allocationSize = mem_requirements.size;
-    VkResult ret = VulkanLogicDevice::GetMemoryType(&mem_properties, mem_requirements.memoryTypeBits,
-                                                    VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT | VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
-                                                    &alloc_info.memoryTypeIndex);
-    assert(ret == VK_SUCCESS);
-    mvp_memory_ = device_->AllocateMemory(&alloc_info);
-    assert(mvp_memory_);
-    ret = mvp_memory_->BindBufferMemory(mvp_buffer_->buffer(), 0);
-    assert(ret == VK_SUCCESS);
-
-    ret = mvp_memory_->MapMemory(0, buffer_info.size, &uniform_buffer_mapped_);
-    assert(ret == VK_SUCCESS);
-}
-
-void VikingRoom::DestroyMvpBuffer() {
-    mvp_memory_->UnmapMemory();
-    VulkanLogicDevice::FreeMemory(&mvp_memory_);
-    VulkanLogicDevice::DestroyBuffer(&mvp_buffer_);
+    builder.Build();
+    builder.LogStats("VikingRoom");
+
+    vertices_.resize(builder.vertex_count());
+    memcpy(vertices_.data(), builder.vertices().data(), builder.vertices().size());
+    const auto* index_begin = static_cast<const uint8_t*>(builder.index_data());
+    index_data_.assign(index_begin, index_begin + builder.index_data_size());
+    index_type_ = builder.uint16_indices() ? VK_INDEX_TYPE_UINT16 : VK_INDEX_TYPE_UINT32;
+    index_count_ = builder.index_count();
 }
 
 void VikingRoom::CreateTextureImage() {
-    AAsset* file = AAssetManager_open(asset_manager_,
-                                      "viking_room.png", AASSET_MODE_BUFFER);
-    size_t file_length = AAsset_getLength(file);
-    char* file_content = new char[file_length];
-    AAsset_read(file, file_content, file_length);
-    AAsset_close(file);
-
-    int tex_width, tex_height, tex_channels;
-    stbi_uc* pixels = stbi_load_from_memory((stbi_uc*)file_content, file_length, &tex_width, &tex_height, &tex_channels, STBI_rgb_alpha);
-    delete[] file_content;
-    VkDeviceSize image_size = tex_width * tex_height * 4;
-
-    VulkanBuffer* staging_buffer;
-    VulkanMemory* staging_buffer_memory;
+    uint64_t begin = NowNs();
+    if (CreateCompressedTextureImage()) {
+        LOG_D("VikingRoom", "texture %s loaded in %.3f ms\n",
+              TextureFile::FormatSuffix(static_cast<uint32_t>(texture_format_)), (NowNs() - begin) / 1e6);
+        return;
+    }
+    texture_format_ = VK_FORMAT_R8G8B8A8_UNORM;
+    // Tutorial 在 CreatePipeline 之前已经 Prefetch, 这里通常只是取走 worker 解码好的结果
+    decoded_image_t image{};
+    bool decoded = ImageDecoder::Instance()->Take(asset_manager_, TEXTURE_PNG, &image);
+    assert(decoded);
+    int tex_width = static_cast<int>(image.width);
+    int tex_height = static_cast<int>(image.height);
+    VkDeviceSize image_size = static_cast<VkDeviceSize>(tex_width) * tex_height * 4;
 
-    VkBufferCreateInfo buffer_info{};
-    buffer_info.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
-    buffer_info.size = image_size;
-    buffer_info.usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
-    buffer_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
-    staging_buffer = device_->CreateBuffer(&buffer_info);
-    assert(staging_buffer);
-    VkMemoryRequirements mem_requirements{};
-    staging_buffer->GetBufferMemoryRequirements(&mem_requirements);
-    VkPhysicalDeviceMemoryProperties mem_properties{};
-    device_->GetPhysicalDeviceMemoryProperties(&mem_properties);
-
-    VkMemoryAllocateInfo alloc_info{};
-    alloc_info.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-    alloc_info.allocationSize = mem_requirements.size;
-    VkResult ret = VulkanLogicDevice::GetMemoryType(&mem_properties, mem_requirements.memoryTypeBits,
-                                                    VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-                                                    &alloc_info.memoryTypeIndex);
-    assert(ret == VK_SUCCESS);
-    staging_buffer_memory = device_->AllocateMemory(&alloc_info);
-    assert(staging_buffer_memory);
-    staging_buffer_memory->BindBufferMemory(staging_buffer->buffer(), 0);
+    CreateImage(tex_width, tex_height, VK_FORMAT_R8G8B8A8_UNORM,
+                VK_IMAGE_TILING_OPTIMAL, VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT,
+                texture_image_, texture_image_memory_);
 
-    void* data;
-    staging_buffer_memory->MapMemory(0, mem_requirements.size, &data);
-    memcpy(data, pixels, image_size);
-    staging_buffer_memory->UnmapMemory();
-    stbi_image_free(pixels);
+    // 只录制命令, 由 Tutorial 和其他上传一起提交
+    image_upload_t upload{};
+    upload.image = texture_image_->image();
+    upload.width = static_cast<uint32_t>(tex_width);
+    upload.height = static_cast<uint32_t>(tex_height);
+    upload.mip_levels = 1;
+    upload.generate_mipmaps = false;
+    upload.final_layout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+    upload.dst_stage_mask = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
+    upload.dst_access_mask = VK_ACCESS_SHADER_READ_BIT;
+    VkBufferImageCopy region{};
+    region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    region.imageSubresource.layerCount = 1;
+    region.imageExtent = {upload.width, upload.height, 1};
+    // RGB 在展开成 RGBA 的同时写进 staging
+    bool uploaded = upload_context_->UploadImage(upload, image_size, [&image](void* staging) {
+        ImageDecoder::Instance()->CopyToRgba(image, staging);
+    }, 1, &region);
+    assert(uploaded);
+    ImageDecoder::Free(&image);
+    LOG_D("VikingRoom", "texture png decoded in %.3f ms\n", (NowNs() - begin) / 1e6);
+}
 
-    CreateImage(tex_width, tex_height, VK_FORMAT_R8G8B8A8_UNORM,
+bool VikingRoom::CreateCompressedTextureImage() {
+    // 按质量从高到低选第一个 device 能采样和线性过滤的格式, 压缩 feature 在创建 device 时已经按支持情况打开
+    TextureFile texture_file;
+    bool opened = texture_file.OpenBest(asset_manager_, "viking_room", [this](uint32_t vk_format) {
+        return IsTextureFormatSupported(vk_format);
+    });
+    if (!opened) {
+        return false;
+    }
+    texture_format_ = static_cast<VkFormat>(texture_file.vk_format());
+    CreateImage(texture_file.width(), texture_file.height(), texture_format_,
                 VK_IMAGE_TILING_OPTIMAL, VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT,
                 texture_image_, texture_image_memory_);
 
-    TransitionImageLayout(texture_image_->image(),
-                          VK_IMAGE_LAYOUT_UNDEFINED,
-                          VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL);
-    CopyBufferToImage(staging_buffer->buffer(), texture_image_->image(),
-                      static_cast<uint32_t>(tex_width), static_cast<uint32_t>(tex_height));
-    TransitionImageLayout(texture_image_->image(),
-                          VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-                          VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
-
-    VulkanLogicDevice::DestroyBuffer(&staging_buffer);
-    VulkanLogicDevice::FreeMemory(&staging_buffer_memory);
+    // 这个场景不用 mipmap, 只上传 level 0
+    image_upload_t upload{};
+    upload.image = texture_image_->image();
+    upload.width = texture_file.width();
+    upload.height = texture_file.height();
+    upload.mip_levels = 1;
+    upload.generate_mipmaps = false;
+    upload.final_layout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+    upload.dst_stage_mask = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
+    upload.dst_access_mask = VK_ACCESS_SHADER_READ_BIT;
+    VkBufferImageCopy region{};
+    region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    region.imageSubresource.layerCount = 1;
+    region.imageExtent = {upload.width, upload.height, 1};
+    bool uploaded = upload_context_->UploadImage(upload, texture_file.level_data(0), texture_file.level_size(0),
+                                                 1, &region);
+    assert(uploaded);
+    return true;
+}
+
+bool VikingRoom::IsTextureFormatSupported(uint32_t vk_format) const {
+    VkFormatProperties properties{};
+    device_->GetPhysicalDeviceFormatProperties(static_cast<VkFormat>(vk_format), &properties);
+    VkFormatFeatureFlags required = VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT |
+                                    VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_LINEAR_BIT;
+    return (properties.optimalTilingFeatures & required) == required;
 }
 
 void VikingRoom::DestroyTextureImage() {
@@ -585,7 +645,7 @@ void VikingRoom::CreateTextureImageViewAndSampler() {
     view_info.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
     view_info.image = texture_image_->image();
     view_info.viewType = VK_IMAGE_VIEW_TYPE_2D;
-    view_info.format = VK_FORMAT_R8G8B8A8_UNORM;
+    view_info.format = texture_format_;
     view_info.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
     view_info.subresourceRange.baseMipLevel = 0;
     view_info.subresourceRange.levelCount = 1;
@@ -653,20 +713,7 @@ void VikingRoom::CreateDepthImage() {
     depth_attachment_image_ = device_->CreateImage(&imageInfo);
     assert(depth_attachment_image_);
 
-    VkMemoryRequirements mem_requirements;
-    depth_attachment_image_->GetImageMemoryRequirements(&mem_requirements);
-
-    VkPhysicalDeviceMemoryProperties mem_properties{};
-    device_->GetPhysicalDeviceMemoryProperties(&mem_properties);
-
-    VkMemoryAllocateInfo alloc_info{};
-    alloc_info.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-    alloc_info.allocationSize = mem_requirements.size;
-    VkResult ret = VulkanLogicDevice::GetMemoryType(&mem_properties, mem_requirements.memoryTypeBits,
-                                                    VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
-                                                    &alloc_info.memoryTypeIndex);
-    assert(ret == VK_SUCCESS);
-    depth_attachment_image_memory_ = device_->AllocateMemory(&alloc_info);
+    depth_attachment_image_memory_ = device_->AllocateImageMemory(depth_attachment_image_, MEMORY_USAGE_GPU_ONLY);
     depth_attachment_image_memory_->BindImageMemory(depth_attachment_image_->image(), 0);
 }
 
@@ -789,143 +836,17 @@ void VikingRoom::CreateImage(uint32_t width, uint32_t height, VkFormat format,
     image = device_->CreateImage(&imageInfo);
     assert(image);
 
-    VkMemoryRequirements mem_requirements;
-    image->GetImageMemoryRequirements(&mem_requirements);
-
-    VkPhysicalDeviceMemoryProperties mem_properties{};
-    device_->GetPhysicalDeviceMemoryProperties(&mem_properties);
-
-    VkMemoryAllocateInfo alloc_info{};
-    alloc_info.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-    alloc_info.allocationSize = mem_requirements.size;
-    VkResult ret = VulkanLogicDevice::GetMemoryType(&mem_properties, mem_requirements.memoryTypeBits,
-                                     VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
-                                     &alloc_info.memoryTypeIndex);
-    assert(ret == VK_SUCCESS);
-    image_memory = device_->AllocateMemory(&alloc_info);
+    image_memory = device_->AllocateImageMemory(image, MEMORY_USAGE_GPU_ONLY);
     image_memory->BindImageMemory(image->image(), 0);
 }
 
-void VikingRoom::TransitionImageLayout(VkImage image, VkImageLayout oldLayout,
-                                       VkImageLayout newLayout) const {
-    VkCommandBufferAllocateInfo allocInfo{};
-    allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
-    allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
-    allocInfo.commandPool = command_pool_->command_pool();
-    allocInfo.commandBufferCount = 1;
-    VulkanCommandBuffer* command_buffer =
-            command_pool_->AllocateCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY);
-
-    VkCommandBufferBeginInfo begin_info{};
-    begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
-    begin_info.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
-    command_buffer->BeginCommandBuffer(&begin_info);
-
-    VkImageMemoryBarrier barrier{};
-    barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
-    barrier.oldLayout = oldLayout;
-    barrier.newLayout = newLayout;
-    barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-    barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-    barrier.image = image;
-    barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-    barrier.subresourceRange.baseMipLevel = 0;
-    barrier.subresourceRange.levelCount = 1;
-    barrier.subresourceRange.baseArrayLayer = 0;
-    barrier.subresourceRange.layerCount = 1;
-
-    VkPipelineStageFlags sourceStage;
-    VkPipelineStageFlags destinationStage;
-
-    if (oldLayout == VK_IMAGE_LAYOUT_UNDEFINED && newLayout == VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL) {
-        barrier.srcAccessMask = 0;
-        barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
-        sourceStage = VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
-        destinationStage = VK_PIPELINE_STAGE_TRANSFER_BIT;
-    } else if (oldLayout == VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL && newLayout == VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL) {
-        barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
-        barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
-        sourceStage = VK_PIPELINE_STAGE_TRANSFER_BIT;
-        destinationStage = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
-    } else {
-        throw std::invalid_argument("unsupported layout transition!");
-    }
-
-    command_buffer->CmdPipelineBarrier(
-            sourceStage, destinationStage,
-            0,
-            0, nullptr,
-            0, nullptr,
-            1, &barrier
-    );
-
-    command_buffer->EndCommandBuffer();
-    VkCommandBuffer command_buffers[] = {command_buffer->command_buffer()};
-    VkSubmitInfo submitInfo{};
-    submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
-    submitInfo.commandBufferCount = 1;
-    submitInfo.pCommandBuffers = command_buffers;
-
-    graphic_queue_->QueueSubmit( 1, &submitInfo, VK_NULL_HANDLE);
-    graphic_queue_->QueueWaitIdle();
-    VulkanCommandPool::FreeCommandBuffer(&command_buffer);
-}
-
-void VikingRoom::CopyBufferToImage(VkBuffer buffer, VkImage image, uint32_t width, uint32_t height) const {
-    VkCommandBufferAllocateInfo allocInfo{};
-    allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
-    allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
-    allocInfo.commandPool = command_pool_->command_pool();
-    allocInfo.commandBufferCount = 1;
-    VulkanCommandBuffer* command_buffer =
-            command_pool_->AllocateCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY);
-    /*  typedef struct VkCommandBufferBeginInfo {
-        VkStructureType                          sType;
-        const void*                              pNext;
-        VkCommandBufferUsageFlags                flags;
-        const VkCommandBufferInheritanceInfo*    pInheritanceInfo;
-    } VkCommandBufferBeginInfo; */
-    VkCommandBufferBeginInfo command_buffer_begin_info{};
-    command_buffer_begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
-    command_buffer_begin_info.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
-    VkResult ret = command_buffer->BeginCommandBuffer(&command_buffer_begin_info);
-    assert(ret == VK_SUCCESS);
-
-    VkBufferImageCopy region{};
-    region.bufferOffset = 0;
-    region.bufferRowLength = 0;
-    region.bufferImageHeight = 0;
-    region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-    region.imageSubresource.mipLevel = 0;
-    region.imageSubresource.baseArrayLayer = 0;
-    region.imageSubresource.layerCount = 1;
-    region.imageOffset = {0, 0, 0};
-    region.imageExtent = {
-            width,
-            height,
-            1
-    };
-    command_buffer->CmdCopyBufferToImage(buffer, image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &region);
-
-    command_buffer->EndCommandBuffer();
-    VkCommandBuffer command_buffers[] = {command_buffer->command_buffer()};
-    VkSubmitInfo submitInfo{};
-    submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
-    submitInfo.commandBufferCount = 1;
-    submitInfo.pCommandBuffers = command_buffers;
-
-    graphic_queue_->QueueSubmit( 1, &submitInfo, VK_NULL_HANDLE);
-    graphic_queue_->QueueWaitIdle();
-    VulkanCommandPool::FreeCommandBuffer(&command_buffer);
-}
-
 VulkanDescriptorPool*  VikingRoom::CreateDescriptorPool() const {
     /* typedef struct VkDescriptorPoolSize {
         VkDescriptorType    type;
         uint32_t            descriptorCount;
     } VkDescriptorPoolSize; */
     VkDescriptorPoolSize pool_sizes[2];
-    pool_sizes[0].type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+    pool_sizes[0].type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
     pool_sizes[0].descriptorCount = 1;
     pool_sizes[1].type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
     pool_sizes[1].descriptorCount = 1;
@@ -956,7 +877,7 @@ VulkanDescriptorSetLayout* VikingRoom::CreateDescriptorSetLayout() const {
     } VkDescriptorSetLayoutBinding; */
     std::array<VkDescriptorSetLayoutBinding, 2> bindings{};
     bindings[0].binding = 0;
-    bindings[0].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+    bindings[0].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
     bindings[0].descriptorCount = 1;
     bindings[0].stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
     bindings[1].binding = 1;
@@ -1020,7 +941,7 @@ void VikingRoom::BindMvpDescriptorSetWithBuffer() const {
         VkDeviceSize    range;
     } VkDescriptorBufferInfo; */
     VkDescriptorBufferInfo  buffer_info{};
-    buffer_info.buffer = mvp_buffer_->buffer();
+    buffer_info.buffer = frame_contexts_->uniform_buffer();
     buffer_info.offset = 0;
     buffer_info.range = sizeof(mvp_t);
     /* typedef struct VkWriteDescriptorSet {
@@ -1041,23 +962,23 @@ void VikingRoom::BindMvpDescriptorSetWithBuffer() const {
     descriptor_write.dstBinding = 0;
     descriptor_write.dstArrayElement = 0;
     descriptor_write.descriptorCount = 1;
-    descriptor_write.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+    descriptor_write.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
     descriptor_write.pImageInfo = nullptr; // Optional
     descriptor_write.pBufferInfo = &buffer_info;
     descriptor_write.pTexelBufferView = nullptr; // Optional
     device_->UpdateDescriptorSets(1, &descriptor_write);
 }
 
-void VikingRoom::CopyDataToUniformBuffer() const {
+void VikingRoom::CopyDataToUniformBuffer(const frame_context_t* frame) const {
     static auto startTime = std::chrono::high_resolution_clock::now();
     auto currentTime = std::chrono::high_resolution_clock::now();
     float time = std::chrono::duration<float, std::chrono::seconds::period>(currentTime - startTime).count();
     mvp_t ubo;
-    ubo.model = glm::rotate(glm::mat4(1.0f), time * glm::radians(10.0f), glm::vec3(0.0f, 0.0f, 1.0f));
+    ubo.model = glm::rotate(glm::mat4(1.0f), time * glm::radians(10.0f), glm::vec3(0.0f, 0.0f, 1.0f)) * dequantize_;
     ubo.view = glm::lookAt(glm::vec3(10.0f, 10.0f, 10.0f), glm::vec3(0.0f, 0.0f, 0.0f), glm::vec3(0.0f, 0.0f, 1.0f));
     ubo.project = glm::perspective(glm::radians(45.0f), (float)frame_buffer_size_.width/(float)frame_buffer_size_.height, 0.1f, 20.0f);
     ubo.project[1][1] *= -1;
-    memcpy(uniform_buffer_mapped_, &ubo, sizeof(ubo));
+    memcpy(frame->uniform_data, &ubo, sizeof(ubo));
 }
 
 std::vector<VkPipelineShaderStageCreateInfo> VikingRoom::GetPipelineShaderStageCreateInfos(
@@ -5,22 +5,28 @@
 #pragma once
 
 #include "vulkan_object.h"
+#include "vulkan_upload_context.h"
 #include <glm/glm.hpp>
-#include <android/asset_manager.h>
-#include <android/asset_manager_jni.h>
+#include "android_compat.h"
+#include "mesh_file.h"
+#include "vertex_layout.h"
 
 class VikingRoom  : public VulkanObject {
 public:
     VikingRoom(AAssetManager* asset_manager,
-               VulkanCommandPool* command_pool,
-               VulkanQueue* graphic_queue,
+               VulkanUploadContext* upload_context,
                VulkanLogicDevice* device,
                VkFormat swap_chain_image_format,
-               VkExtent2D frame_buffer_size);
+               VkExtent2D frame_buffer_size,
+               const FrameContextRing* frame_contexts,
+               bool optimize_mesh = true,
+               bool quantize_vertices = false);
 
     ~VikingRoom() = default;
     int CreatePipeline() override;
     void DestroyPipeline() override;
+    // 没有 device 支持的 KTX2 时是 viking_room.png
+    std::vector<std::string> image_assets() const override;
 
     struct vertex_t {
         glm::vec3 pos;
@@ -34,7 +40,9 @@ public:
     } mvp_t;
 
     void Draw(const VulkanCommandBuffer* command_buffer,
-              const VulkanFrameBuffer* frame_buffer) const override;
+              const VulkanFrameBuffer* frame_buffer,
+              const frame_context_t* frame) const override;
+    void Resize(VkExtent2D frame_buffer_size) override;
 protected:
     void LoadResource() override;
     void CreateRenderPass() override;
@@ -48,11 +56,18 @@ protected:
     void CreateDescriptorSets() override;
 private:
     void ReadVerticesIndexes();
-
-    void CreateMvpBuffer();
-    void DestroyMvpBuffer();
+    // 读取离线生成的 viking_room.mesh, 文件不存在或者 vertex layout 不一致时返回 false
+    bool ReadMeshFile();
+    // 按 vertex_layout_ 把 vertex_source_ 的 vertex_t 编码成量化格式
+    void QuantizeVertices();
+    // 解析 OBJ 并在运行时焊接重排
+    void ReadObjFile();
 
     void CreateTextureImage();
+    // 从离线压缩的 viking_room.<suffix>.ktx2 创建, 没有 device 支持的格式时返回 false
+    bool CreateCompressedTextureImage();
+    // device 能采样和线性过滤的格式
+    bool IsTextureFormatSupported(uint32_t vk_format) const;
     void DestroyTextureImage();
     void CreateTextureImageViewAndSampler();
     void DestroyTextureImageViewAndSampler();
@@ -70,15 +85,12 @@ private:
     void CreateImage(uint32_t width, uint32_t height, VkFormat format,
                  VkImageTiling tiling, VkImageUsageFlags usage,
                  VulkanImage*& image, VulkanMemory*& image_memory) const;
-    void TransitionImageLayout(VkImage image, VkImageLayout oldLayout,
-                               VkImageLayout newLayout) const;
-    void CopyBufferToImage(VkBuffer buffer, VkImage image, uint32_t width, uint32_t height) const;
 
     VulkanDescriptorPool*  CreateDescriptorPool() const;
     VulkanDescriptorSetLayout* CreateDescriptorSetLayout() const;
     void BindTextureDescriptorSetWithImage() const;
     void BindMvpDescriptorSetWithBuffer() const;
-    void CopyDataToUniformBuffer() const;
+    void CopyDataToUniformBuffer(const frame_context_t* frame) const;
 
     // GraphicsPipelineCreateInfo
     static std::vector<VkPipelineShaderStageCreateInfo> GetPipelineShaderStageCreateInfos(
@@ -98,8 +110,7 @@ private:
     static const char kFragShaderSource[];
 
     AAssetManager* asset_manager_;
-    VulkanCommandPool* command_pool_;
-    VulkanQueue* graphic_queue_;
+    VulkanUploadContext* upload_context_;
 
     VulkanPipelineLayout* pipeline_layout_;
 
@@ -109,10 +120,11 @@ private:
     VulkanBuffer* indices_buffer_;
     VulkanMemory* indices_memory_;
 
-    VulkanBuffer* mvp_buffer_;
-    VulkanMemory* mvp_memory_;
-    void* uniform_buffer_mapped_;
+    // mvp 放在每一帧自己的 uniform slice 里, 用 dynamic offset 绑定
+    const FrameContextRing* frame_contexts_;
 
+    // 压缩格式或者 PNG 解码后的 R8G8B8A8_UNORM
+    VkFormat texture_format_;
     VulkanImage* texture_image_;
     VulkanMemory* texture_image_memory_;
     VulkanImageView* texture_image_view_;
@@ -123,13 +135,27 @@ private:
     VulkanDescriptorSet* descriptor_set_;
 
     std::vector<vertex_t> vertices_;
-    const std::vector<uint16_t> indices_ = {
-            0,1,2,3,4,5
-    };
+    // MeshBuilder 输出的 uint16 或 uint32 index
+    std::vector<uint8_t> index_data_;
+    VkIndexType index_type_;
+    uint32_t index_count_;
+    // false 时不焊接不重排, 和每个三角形顶点单独一个 vertex 的旧数据等价, 用于对比
+    bool optimize_mesh_;
+    // map 进来的 .mesh 文件, buffer 创建之后关闭
+    MeshFile mesh_file_;
+    // CreateVertexBuffer/CreateIndexBuffer 复制的数据, 指向 mesh_file_ 或者 vertices_/index_data_
+    const void* vertex_source_;
+    size_t vertex_source_size_;
+    const void* index_source_;
+    size_t index_source_size_;
+    // GPU 上的 vertex 格式, vertex_t 和 .mesh 文件是其中的 float 格式
+    VertexLayout vertex_layout_;
+    std::vector<uint8_t> quantized_vertices_;
+    // 量化的 position 还原到包围盒, 乘在 model 矩阵右边
+    glm::mat4 dequantize_;
 
     const std::vector<VkDynamicState> dynamic_states_ = { VK_DYNAMIC_STATE_VIEWPORT, VK_DYNAMIC_STATE_SCISSOR };
-    const std::vector<VkVertexInputBindingDescription> vertex_binding_descriptions_ = {{0, sizeof (vertex_t), VK_VERTEX_INPUT_RATE_VERTEX}};
-    const std::vector<VkVertexInputAttributeDescription> vertex_attribute_descriptions_ = {
-            {0, 0, VK_FORMAT_R32G32B32_SFLOAT, offsetof(vertex_t, pos)},
-            {1, 0, VK_FORMAT_R32G32_SFLOAT, offsetof(vertex_t, coordinate)}};
+    // ReadVerticesIndexes 确定 vertex_layout_ 之后由它生成
+    std::vector<VkVertexInputBindingDescription> vertex_binding_descriptions_;
+    std::vector<VkVertexInputAttributeDescription> vertex_attribute_descriptions_;
 };
@@ -6,6 +6,9 @@
 
 #include <cassert>
 #include "log.h"
+#ifdef VULKAN_RUNTIME_SHADERC
+#include "spirv_cache.h"
+#endif
 
 VulkanObject::VulkanObject(VulkanLogicDevice* device,
                            VkFormat swap_chain_image_format,
@@ -23,6 +26,10 @@ VulkanObject::VulkanObject(VulkanLogicDevice* device,
         depth_attachment_image_view_(nullptr) {
 }
 
+void VulkanObject::Resize(VkExtent2D frame_buffer_size) {
+    frame_buffer_size_ = frame_buffer_size;
+}
+
 VkViewport VulkanObject::GetVkViewport() const {
     /*typedef struct VkViewport {
         float    x;
@@ -66,36 +73,86 @@ VulkanPipeline* VulkanObject::pipeline() {
     return pipeline_;
 }
 
+std::vector<shader_source_t> VulkanObject::shader_sources() const {
+    std::vector<shader_source_t> sources;
+    if (!vertex_str_.empty()) {
+        sources.push_back(shader_source_t{"VertShaderSrc", shaderc_vertex_shader, vertex_str_});
+    }
+    if (!fragment_str_.empty()) {
+        sources.push_back(shader_source_t{"FragShaderSrc", shaderc_fragment_shader, fragment_str_});
+    }
+    return sources;
+}
+
+std::vector<std::string> VulkanObject::image_assets() const {
+    return std::vector<std::string>();
+}
+
+void VulkanObject::AddShaderTasks(ParallelSetup* setup,
+                                  const std::string& object,
+                                  const std::vector<shader_source_t>& sources) {
+#ifdef VULKAN_RUNTIME_SHADERC
+    for (const auto& source : sources) {
+        // 结果留在 SpirvCache 里, 这里只关心是否成功
+        setup->Add(object, ParallelSetup::PHASE_SHADER, [source]() {
+            return CompileFile(source.name, source.kind, source.source).empty() ? -1 : 0;
+        });
+    }
+#else
+    (void) setup;
+    (void) object;
+    (void) sources;
+#endif
+}
+
+#ifdef VULKAN_RUNTIME_SHADERC
 std::vector<uint32_t> VulkanObject::CompileFile(const std::string& source_name,
                                                 shaderc_shader_kind kind,
                                                 const std::string& source,
-                                                bool optimize) {
-    shaderc::Compiler compiler;
-    shaderc::CompileOptions options;
-
-//    // Like -DMY_DEFINE=1
-//    options.AddMacroDefinition("MY_DEFINE", "1");
-    if (optimize) options.SetOptimizationLevel(shaderc_optimization_level_size);
-
-    shaderc::SpvCompilationResult module =
-            compiler.CompileGlslToSpv(source, kind, source_name.c_str(), options);
+                                                bool optimize,
+                                                const shader_macro_list_t& macros) {
+    return SpirvCache::Instance()->Compile(source_name, kind, source, macros,
+                                           optimize ? shaderc_optimization_level_size
+                                                    : shaderc_optimization_level_zero);
+}
+#endif
 
-    if (module.GetCompilationStatus() != shaderc_compilation_status_success) {
-        LOG_E("CompileFile", "module.GetCompilationStatus() %d", module.GetCompilationStatus());
-        return {};
+VulkanShaderModule* VulkanObject::CreateShaderModule(const VulkanLogicDevice* device,
+                                                     const std::string& name,
+                                                     shaderc_shader_kind kind,
+                                                     const std::string& source,
+                                                     bool optimize,
+                                                     const shader_macro_list_t& macros) {
+    shaderc_optimization_level level = optimize ? shaderc_optimization_level_size : shaderc_optimization_level_zero;
+    const uint32_t* code = nullptr;
+    size_t code_size = 0;
+    // 指向 archive 的 mapping, 不复制
+    if (!ShaderArchive::Instance()->Find(kind, source, macros, level, &code, &code_size)) {
+#ifdef VULKAN_RUNTIME_SHADERC
+        std::vector<uint32_t> compiled = CompileFile(name, kind, source, optimize, macros);
+        if (compiled.empty()) {
+            return nullptr;
+        }
+        return CreateShaderModule(device, compiled.data(), compiled.size() * sizeof(uint32_t));
+#else
+        LOG_E("CreateShaderModule", "%s is not in %s, rebuild the shader_archive target "
+                                    "or configure with -DVULKAN_RUNTIME_SHADERC=ON\n",
+              name.c_str(), ShaderArchive::ASSET_NAME);
+        return nullptr;
+#endif
     }
-
-    return {module.cbegin(), module.cend()};
+    return CreateShaderModule(device, code, code_size);
 }
 
 VulkanShaderModule* VulkanObject::CreateShaderModule(const std::string& name,
                                                      shaderc_shader_kind kind,
                                                      const std::string& source) const {
-    std::vector<uint32_t> code =
-            CompileFile(name, kind, source);
-    if (code.empty()) {
-        return nullptr;
-    }
+    return CreateShaderModule(device_, name, kind, source);
+}
+
+VulkanShaderModule* VulkanObject::CreateShaderModule(const VulkanLogicDevice* device,
+                                                     const uint32_t* code,
+                                                     size_t code_size) {
     /*typedef struct VkShaderModuleCreateInfo {
         VkStructureType              sType;
         const void*                  pNext;
@@ -105,9 +162,9 @@ VulkanShaderModule* VulkanObject::CreateShaderModule(const std::string& name,
     } VkShaderModuleCreateInfo;*/
     VkShaderModuleCreateInfo shader_module_create_info{};
     shader_module_create_info.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
-    shader_module_create_info.codeSize = code.size() * sizeof (uint32_t);
-    shader_module_create_info.pCode = code.data();
-    return device_->CreateShaderModule(&shader_module_create_info);
+    shader_module_create_info.codeSize = code_size;
+    shader_module_create_info.pCode = code;
+    return device->CreateShaderModule(&shader_module_create_info);
 }
 
 void VulkanObject::DestroyRenderPass() {
@@ -4,8 +4,12 @@
 
 #pragma once
 #include <string>
+#include <vector>
 #include <vulkan/vulkan.h>
 #include "shaderc.hpp"
+#include "shader_archive.h"
+#include "parallel_setup.h"
+#include "frame_context.h"
 #include "vulkan_logic_device.h"
 #include "vulkan_shader_module.h"
 #include "vulkan_render_pass.h"
@@ -14,6 +18,13 @@
 #include "vulkan_descriptor_pool.h"
 #include "vulkan_render_pass.h"
 
+// CreatePipeline 用到的一个 shader stage, 参数和 CreateShaderModule 的一致
+typedef struct {
+    std::string name;
+    shaderc_shader_kind kind;
+    std::string source;
+} shader_source_t;
+
 class VulkanObject {
 public:
     VulkanObject(VulkanLogicDevice* device,
@@ -24,8 +35,14 @@ public:
     virtual int CreatePipeline() = 0;
     virtual void DestroyPipeline() = 0;
 
+    // frame 是正在录制的 frame context, 每帧变化的 uniform 写进它的 uniform slice, 用 dynamic offset 绑定
     virtual void Draw(const VulkanCommandBuffer* command_buffer,
-                      const VulkanFrameBuffer* frame_buffer) const = 0;
+                      const VulkanFrameBuffer* frame_buffer,
+                      const frame_context_t* frame) const = 0;
+
+    // swap chain 重建后调用, 只重建和 frame buffer 大小相关的 attachment,
+    // pipeline 使用 dynamic viewport/scissor, 不需要重建
+    virtual void Resize(VkExtent2D frame_buffer_size);
 
     virtual VkViewport GetVkViewport() const;
     virtual VkRect2D GetScissor() const;
@@ -35,10 +52,32 @@ public:
     VulkanImageView* depth_attachment_image_view();
     VulkanPipeline* pipeline();
 
+    // 默认是 vertex_str_ 和 fragment_str_
+    virtual std::vector<shader_source_t> shader_sources() const;
+    // CreatePipeline 里用 ImageDecoder::Take 取的图片, 调用者先 Prefetch, 解码和 shader/pipeline 创建重叠.
+    // 默认没有
+    virtual std::vector<std::string> image_assets() const;
+    // 每个 stage 一个 PHASE_SHADER 任务, 提前编译进 SpirvCache, 之后的 CreatePipeline 直接命中.
+    // 没有 VULKAN_RUNTIME_SHADERC 时 shader 都在 ShaderArchive 里, 不添加任务
+    static void AddShaderTasks(ParallelSetup* setup,
+                               const std::string& object,
+                               const std::vector<shader_source_t>& sources);
+
+    // 先从 ShaderArchive 里找, 找不到时只有 VULKAN_RUNTIME_SHADERC 的版本会在运行时编译
+    static VulkanShaderModule* CreateShaderModule(const VulkanLogicDevice* device,
+                                                  const std::string& name,
+                                                  shaderc_shader_kind kind,
+                                                  const std::string& source,
+                                                  bool optimize = false,
+                                                  const shader_macro_list_t& macros = shader_macro_list_t());
+#ifdef VULKAN_RUNTIME_SHADERC
+    // 经过 SpirvCache, 命中时不调用 shaderc
     static std::vector<uint32_t> CompileFile(const std::string& source_name,
                                              shaderc_shader_kind kind,
                                              const std::string& source,
-                                             bool optimize = false);
+                                             bool optimize = false,
+                                             const shader_macro_list_t& macros = shader_macro_list_t());
+#endif
 protected:
     virtual void LoadResource() = 0;
     virtual void CreateRenderPass() = 0;
@@ -56,6 +95,9 @@ protected:
     VulkanShaderModule* CreateShaderModule(const std::string& name,
                                            shaderc_shader_kind kind,
                                            const std::string& source) const;
+    static VulkanShaderModule* CreateShaderModule(const VulkanLogicDevice* device,
+                                                  const uint32_t* code,
+                                                  size_t code_size);
 
     VulkanLogicDevice* device_;
     VkFormat swap_chain_image_format_;
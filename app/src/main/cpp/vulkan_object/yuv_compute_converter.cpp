@@ -0,0 +1,284 @@
+//
+// Created by hj6231 on 2024/2/16.
+//
+
+#include "yuv_compute_converter.h"
+
+#include <cassert>
+#include "log.h"
+
+// 帧按 uint 读, 不需要 8 位 storage 的扩展. int 的 >> 是算术右移, 和 CPU 的定点运算一致.
+// vec4 / 255.0 写进 rgba8 时舍入回原来的整数
+static const char kComputeShaderSource[] =
+        "#version 450\n"
+        "layout(local_size_x = 8, local_size_y = 8, local_size_z = 1) in;\n"
+        "layout(binding = 0, rgba8) uniform writeonly image2D dst;\n"
+        "layout(std430, binding = 1) readonly buffer Frame {\n"
+        "    uint frame[];\n"
+        "};\n"
+        "layout(push_constant) uniform Params {\n"
+        "    ivec2 size;\n"
+        "    int yuv_layout;\n"
+        "    int y_offset;\n"
+        "    int y_scale;\n"
+        "    int rv;\n"
+        "    int gu;\n"
+        "    int gv;\n"
+        "    int bu;\n"
+        "} params;\n"
+        "const int LAYOUT_NV12 = 0;\n"
+        "const int LAYOUT_I420 = 2;\n"
+        "const int COEFFICIENT_BITS = 12;\n"
+        "int LoadByte(uint offset) {\n"
+        "    return int((frame[offset >> 2] >> ((offset & 3u) * 8u)) & 0xffu);\n"
+        "}\n"
+        "void Store(ivec2 p, int y, int u, int v) {\n"
+        "    int luma = params.y_scale * (y - params.y_offset) + (1 << (COEFFICIENT_BITS - 1));\n"
+        "    ivec3 rgb = ivec3(luma + params.rv * v,\n"
+        "                      luma - params.gu * u - params.gv * v,\n"
+        "                      luma + params.bu * u) >> COEFFICIENT_BITS;\n"
+        "    imageStore(dst, p, vec4(vec3(clamp(rgb, 0, 255)) / 255.0, 1.0));\n"
+        "}\n"
+        "void main() {\n"
+        "    ivec2 block = ivec2(gl_GlobalInvocationID.xy);\n"
+        "    ivec2 chroma_size = params.size >> 1;\n"
+        "    if (any(greaterThanEqual(block, chroma_size))) {\n"
+        "        return;\n"
+        "    }\n"
+        "    uint width = uint(params.size.x);\n"
+        "    uint luma_size = width * uint(params.size.y);\n"
+        "    uint chroma_index = uint(block.y * chroma_size.x + block.x);\n"
+        "    int u;\n"
+        "    int v;\n"
+        "    if (params.yuv_layout == LAYOUT_I420) {\n"
+        "        u = LoadByte(luma_size + chroma_index);\n"
+        "        v = LoadByte(luma_size + luma_size / 4u + chroma_index);\n"
+        "    } else {\n"
+        "        int first = LoadByte(luma_size + chroma_index * 2u);\n"
+        "        int second = LoadByte(luma_size + chroma_index * 2u + 1u);\n"
+        "        u = params.yuv_layout == LAYOUT_NV12 ? first : second;\n"
+        "        v = params.yuv_layout == LAYOUT_NV12 ? second : first;\n"
+        "    }\n"
+        "    u -= 128;\n"
+        "    v -= 128;\n"
+        "    ivec2 p = block * 2;\n"
+        "    uint row = uint(p.y) * width + uint(p.x);\n"
+        "    Store(p, LoadByte(row), u, v);\n"
+        "    Store(p + ivec2(1, 0), LoadByte(row + 1u), u, v);\n"
+        "    Store(p + ivec2(0, 1), LoadByte(row + width), u, v);\n"
+        "    Store(p + ivec2(1, 1), LoadByte(row + width + 1u), u, v);\n"
+        "}\n";
+
+static void CmdImageBarrier(const VulkanCommandBuffer* command_buffer, VkImage image,
+                            VkImageLayout old_layout, VkImageLayout new_layout,
+                            VkPipelineStageFlags src_stage_mask, VkAccessFlags src_access_mask,
+                            VkPipelineStageFlags dst_stage_mask, VkAccessFlags dst_access_mask) {
+    VkImageMemoryBarrier barrier{};
+    barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+    barrier.oldLayout = old_layout;
+    barrier.newLayout = new_layout;
+    barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.image = image;
+    barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    barrier.subresourceRange.baseMipLevel = 0;
+    barrier.subresourceRange.levelCount = 1;
+    barrier.subresourceRange.baseArrayLayer = 0;
+    barrier.subresourceRange.layerCount = 1;
+    barrier.srcAccessMask = src_access_mask;
+    barrier.dstAccessMask = dst_access_mask;
+    command_buffer->CmdPipelineBarrier(src_stage_mask, dst_stage_mask, 0, 0, nullptr, 0, nullptr, 1, &barrier);
+}
+
+YuvComputeConverter::YuvComputeConverter(VulkanLogicDevice* device) :
+        device_(device),
+        descriptor_set_layout_(nullptr),
+        descriptor_pool_(nullptr),
+        pipeline_layout_(nullptr),
+        pipeline_(nullptr) {
+}
+
+YuvComputeConverter::~YuvComputeConverter() {
+    Destroy();
+}
+
+int YuvComputeConverter::Create() {
+    VulkanShaderModule* shader_module = VulkanObject::CreateShaderModule(device_, "yuv_compute_converter.comp",
+                                                                         shaderc_compute_shader,
+                                                                         kComputeShaderSource, false);
+    if (shader_module == nullptr) {
+        return -1;
+    }
+    CreateDescriptorSetLayout();
+    CreateDescriptorPool();
+    CreatePipelineLayout();
+
+    VkPipelineShaderStageCreateInfo stage_info{};
+    stage_info.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+    stage_info.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+    stage_info.module = shader_module->shader_module();
+    stage_info.pName = "main";
+    VkComputePipelineCreateInfo pipeline_info{};
+    pipeline_info.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+    pipeline_info.stage = stage_info;
+    pipeline_info.layout = pipeline_layout_->layout();
+    pipeline_info.basePipelineHandle = VK_NULL_HANDLE;
+    pipeline_info.basePipelineIndex = -1;
+    pipeline_ = device_->CreateComputePipeline(&pipeline_info);
+    VulkanLogicDevice::DestroyShaderModule(&shader_module);
+    return pipeline_ != nullptr ? 0 : -1;
+}
+
+void YuvComputeConverter::Destroy() {
+    ReleaseJobs();
+    VulkanLogicDevice::DestroyPipelines(&pipeline_);
+    VulkanLogicDevice::DestroyPipelineLayout(&pipeline_layout_);
+    VulkanLogicDevice::DestroyDescriptorPool(&descriptor_pool_);
+    VulkanLogicDevice::DestroyDescriptorSetLayout(&descriptor_set_layout_);
+}
+
+bool YuvComputeConverter::IsSupported(uint32_t width, uint32_t height) const {
+    if (width == 0 || height == 0 || width % 2 != 0 || height % 2 != 0 || width > MAX_SIZE || height > MAX_SIZE) {
+        return false;
+    }
+    VkFormatProperties properties{};
+    device_->GetPhysicalDeviceFormatProperties(VK_FORMAT_R8G8B8A8_UNORM, &properties);
+    return (properties.optimalTilingFeatures & VK_FORMAT_FEATURE_STORAGE_IMAGE_BIT) != 0;
+}
+
+bool YuvComputeConverter::CmdConvert(const VulkanCommandBuffer* command_buffer, const yuv_conversion_t& conversion) {
+    if (pipeline_ == nullptr || jobs_.size() >= MAX_JOBS || !IsSupported(conversion.width, conversion.height)) {
+        return false;
+    }
+    job_t job{};
+    VkImageViewCreateInfo view_info{};
+    view_info.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+    view_info.image = conversion.image;
+    view_info.viewType = VK_IMAGE_VIEW_TYPE_2D;
+    view_info.format = VK_FORMAT_R8G8B8A8_UNORM;
+    view_info.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    view_info.subresourceRange.levelCount = 1;
+    view_info.subresourceRange.layerCount = 1;
+    job.view = device_->CreateImageView(&view_info);
+    if (job.view == nullptr) {
+        return false;
+    }
+    VkDescriptorSetLayout set_layout = descriptor_set_layout_->descriptor_set_layout();
+    job.descriptor_set = descriptor_pool_->AllocateDescriptorSet(&set_layout);
+    assert(job.descriptor_set);
+
+    VkDescriptorImageInfo image_info{};
+    image_info.sampler = VK_NULL_HANDLE;
+    image_info.imageView = job.view->image_view();
+    image_info.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+    // shader 按 uint 读, 范围向上取整到 4 字节. buffer 末尾不够 4 字节时调用者多分配几个字节
+    VkDescriptorBufferInfo buffer_info{};
+    buffer_info.buffer = conversion.buffer;
+    buffer_info.offset = conversion.offset;
+    buffer_info.range = (YuvConverter::FrameBytes(conversion.width, conversion.height) + 3) / 4 * 4;
+    VkWriteDescriptorSet writes[2] = {};
+    writes[0].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+    writes[0].dstSet = job.descriptor_set->descriptor_set();
+    writes[0].dstBinding = 0;
+    writes[0].descriptorCount = 1;
+    writes[0].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+    writes[0].pImageInfo = &image_info;
+    writes[1].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+    writes[1].dstSet = job.descriptor_set->descriptor_set();
+    writes[1].dstBinding = 1;
+    writes[1].descriptorCount = 1;
+    writes[1].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    writes[1].pBufferInfo = &buffer_info;
+    device_->UpdateDescriptorSets(2, writes);
+
+    // 整个 image 都会被覆盖, 从 UNDEFINED 转换, 只需要等上次使用这个 image 的 stage 完成
+    CmdImageBarrier(command_buffer, conversion.image,
+                    VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_GENERAL,
+                    conversion.dst_stage_mask, 0,
+                    VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_WRITE_BIT);
+    yuv_coefficients_t coefficients = YuvConverter::GetCoefficients(conversion.matrix, conversion.range);
+    push_constants_t constants{};
+    constants.width = static_cast<int32_t>(conversion.width);
+    constants.height = static_cast<int32_t>(conversion.height);
+    constants.layout = static_cast<int32_t>(conversion.layout);
+    constants.y_offset = coefficients.y_offset;
+    constants.y_scale = coefficients.y_scale;
+    constants.rv = coefficients.rv;
+    constants.gu = coefficients.gu;
+    constants.gv = coefficients.gv;
+    constants.bu = coefficients.bu;
+    uint32_t group_pixels = GROUP_SIZE * 2;
+    VkDescriptorSet descriptor_set = job.descriptor_set->descriptor_set();
+    command_buffer->CmdBindPipeline(VK_PIPELINE_BIND_POINT_COMPUTE, pipeline_->pipeline());
+    command_buffer->CmdBindDescriptorSets(VK_PIPELINE_BIND_POINT_COMPUTE, pipeline_layout_->layout(), 0, 1,
+                                          &descriptor_set, 0, nullptr);
+    command_buffer->CmdPushConstants(pipeline_layout_->layout(), VK_SHADER_STAGE_COMPUTE_BIT, 0,
+                                     sizeof(constants), &constants);
+    command_buffer->CmdDispatch((conversion.width + group_pixels - 1) / group_pixels,
+                                (conversion.height + group_pixels - 1) / group_pixels, 1);
+    CmdImageBarrier(command_buffer, conversion.image,
+                    VK_IMAGE_LAYOUT_GENERAL, conversion.final_layout,
+                    VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_WRITE_BIT,
+                    conversion.dst_stage_mask, conversion.dst_access_mask);
+    jobs_.push_back(job);
+    return true;
+}
+
+void YuvComputeConverter::ReleaseJobs() {
+    for (auto& job : jobs_) {
+        VulkanDescriptorPool::FreeDescriptorSet(&job.descriptor_set);
+        VulkanLogicDevice::DestroyImageView(&job.view);
+    }
+    jobs_.clear();
+}
+
+void YuvComputeConverter::CreateDescriptorSetLayout() {
+    VkDescriptorSetLayoutBinding bindings[2] = {};
+    bindings[0].binding = 0;
+    bindings[0].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+    bindings[0].descriptorCount = 1;
+    bindings[0].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+    bindings[1].binding = 1;
+    bindings[1].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    bindings[1].descriptorCount = 1;
+    bindings[1].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+    VkDescriptorSetLayoutCreateInfo layout_info{};
+    layout_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+    layout_info.bindingCount = 2;
+    layout_info.pBindings = bindings;
+    descriptor_set_layout_ = device_->CreateDescriptorSetLayout(&layout_info);
+    assert(descriptor_set_layout_);
+}
+
+void YuvComputeConverter::CreateDescriptorPool() {
+    VkDescriptorPoolSize pool_sizes[2] = {};
+    pool_sizes[0].type = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+    pool_sizes[0].descriptorCount = MAX_JOBS;
+    pool_sizes[1].type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    pool_sizes[1].descriptorCount = MAX_JOBS;
+    VkDescriptorPoolCreateInfo pool_info{};
+    pool_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+    // ReleaseJobs 单独释放 descriptor set
+    pool_info.flags = VK_DESCRIPTOR_POOL_CREATE_FREE_DESCRIPTOR_SET_BIT;
+    pool_info.maxSets = MAX_JOBS;
+    pool_info.poolSizeCount = 2;
+    pool_info.pPoolSizes = pool_sizes;
+    descriptor_pool_ = device_->CreateDescriptorPool(&pool_info);
+    assert(descriptor_pool_);
+}
+
+void YuvComputeConverter::CreatePipelineLayout() {
+    VkPushConstantRange push_constant_range{};
+    push_constant_range.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+    push_constant_range.offset = 0;
+    push_constant_range.size = sizeof(push_constants_t);
+    VkDescriptorSetLayout set_layout = descriptor_set_layout_->descriptor_set_layout();
+    VkPipelineLayoutCreateInfo layout_info{};
+    layout_info.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+    layout_info.setLayoutCount = 1;
+    layout_info.pSetLayouts = &set_layout;
+    layout_info.pushConstantRangeCount = 1;
+    layout_info.pPushConstantRanges = &push_constant_range;
+    pipeline_layout_ = device_->CreatePipelineLayout(&layout_info);
+    assert(pipeline_layout_);
+}
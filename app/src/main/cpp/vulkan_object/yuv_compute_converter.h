@@ -0,0 +1,84 @@
+//
+// Created by hj6231 on 2024/2/16.
+//
+
+#pragma once
+#include <vector>
+#include "vulkan_object.h"
+#include "yuv_converter.h"
+
+typedef struct {
+    // 紧密排列的一帧, YuvConverter::FrameBytes 字节. usage 包含 STORAGE_BUFFER, offset 满足
+    // minStorageBufferOffsetAlignment. 写入对 compute shader 可见由调用者保证, host 写入在 submit 时可见
+    VkBuffer buffer;
+    VkDeviceSize offset;
+    uint32_t width;
+    uint32_t height;
+    YuvLayout layout;
+    YuvMatrix matrix;
+    YuvRange range;
+    // R8G8B8A8_UNORM, 和帧一样大, usage 包含 STORAGE. 原有内容不保留
+    VkImage image;
+    // 转换完成后 image 的 layout 和使用它的 stage
+    VkImageLayout final_layout;
+    VkPipelineStageFlags dst_stage_mask;
+    VkAccessFlags dst_access_mask;
+} yuv_conversion_t;
+
+// NV12/NV21/I420 到 RGBA 的 compute shader 转换, 不依赖 VkSamplerYcbcrConversion 和多平面格式.
+// 每个 invocation 负责共用一个 CbCr 的 2x2 像素, 用和 YuvConverter 相同的定点系数和整数运算,
+// 结果和 CPU 转换逐字节一致. 矩阵, range 和排列都是 push constant, 一个 pipeline 覆盖所有组合.
+// 只用 compute, 可以录制在 async compute queue 的 command buffer 上
+class YuvComputeConverter {
+public:
+    explicit YuvComputeConverter(VulkanLogicDevice* device);
+    ~YuvComputeConverter();
+    YuvComputeConverter(const YuvComputeConverter&) = delete;
+    YuvComputeConverter& operator = (const YuvComputeConverter&) = delete;
+
+    int Create();
+    // 调用者保证录制过的命令都已经执行完
+    void Destroy();
+
+    // 宽高是不超过 MAX_SIZE 的偶数, device 支持 R8G8B8A8_UNORM 的 STORAGE_IMAGE
+    bool IsSupported(uint32_t width, uint32_t height) const;
+    // 在 render pass 之外录制. 每次调用创建的 image view 和 descriptor set 保留到 ReleaseJobs 或 Destroy,
+    // 超过 MAX_JOBS 次返回 false
+    bool CmdConvert(const VulkanCommandBuffer* command_buffer, const yuv_conversion_t& conversion);
+    // 调用者保证之前录制的命令都已经执行完
+    void ReleaseJobs();
+
+    const static uint32_t MAX_SIZE = 8192;
+    const static uint32_t MAX_JOBS = 16;
+    // 每个 workgroup 8x8 个 invocation, 覆盖 16x16 像素
+    const static uint32_t GROUP_SIZE = 8;
+private:
+    // 和 shader 里的 Params 一致
+    typedef struct {
+        int32_t width;
+        int32_t height;
+        int32_t layout;
+        int32_t y_offset;
+        int32_t y_scale;
+        int32_t rv;
+        int32_t gu;
+        int32_t gv;
+        int32_t bu;
+    } push_constants_t;
+
+    typedef struct {
+        VulkanImageView* view;
+        VulkanDescriptorSet* descriptor_set;
+    } job_t;
+
+    void CreateDescriptorSetLayout();
+    void CreateDescriptorPool();
+    void CreatePipelineLayout();
+
+    VulkanLogicDevice* device_;
+    VulkanDescriptorSetLayout* descriptor_set_layout_;
+    VulkanDescriptorPool* descriptor_pool_;
+    VulkanPipelineLayout* pipeline_layout_;
+    VulkanPipeline* pipeline_;
+    std::vector<job_t> jobs_;
+};
@@ -0,0 +1,405 @@
+//
+// Created by hj6231 on 2024/2/16.
+//
+
+#include "yuv_converter.h"
+
+#include <cassert>
+#include <chrono>
+#include <cmath>
+#include "log.h"
+
+#if defined(__ARM_NEON)
+#include <arm_neon.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+static uint64_t NowNs() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static const int32_t kRound = 1 << (YuvConverter::COEFFICIENT_BITS - 1);
+
+// 一行像素对应的三个平面的起点. NV12/NV21 的 u 和 v 指向同一行交错的色度, 步长是 2
+typedef struct {
+    const uint8_t* y;
+    const uint8_t* u;
+    const uint8_t* v;
+    uint32_t chroma_step;
+} row_planes_t;
+
+static row_planes_t GetRowPlanes(const uint8_t* src, uint32_t width, uint32_t height, YuvLayout layout,
+                                 uint32_t row) {
+    size_t luma_size = static_cast<size_t>(width) * height;
+    const uint8_t* chroma = src + luma_size;
+    row_planes_t planes{};
+    planes.y = src + static_cast<size_t>(row) * width;
+    if (layout == YUV_LAYOUT_I420) {
+        size_t chroma_row = static_cast<size_t>(row / 2) * (width / 2);
+        planes.u = chroma + chroma_row;
+        planes.v = chroma + luma_size / 4 + chroma_row;
+        planes.chroma_step = 1;
+    } else {
+        const uint8_t* uv = chroma + static_cast<size_t>(row / 2) * width;
+        planes.u = layout == YUV_LAYOUT_NV12 ? uv : uv + 1;
+        planes.v = layout == YUV_LAYOUT_NV12 ? uv + 1 : uv;
+        planes.chroma_step = 2;
+    }
+    return planes;
+}
+
+static inline uint8_t Clamp8(int32_t value) {
+    value >>= YuvConverter::COEFFICIENT_BITS;
+    return static_cast<uint8_t>(value < 0 ? 0 : (value > 255 ? 255 : value));
+}
+
+// [x_begin, width) 逐个像素转换, x_begin 是偶数
+static void ConvertRowTail(const row_planes_t& planes, uint32_t x_begin, uint32_t width,
+                           const yuv_coefficients_t& c, uint8_t* dst) {
+    for (uint32_t x = x_begin; x < width; ++x) {
+        int32_t u = planes.u[x / 2 * planes.chroma_step] - 128;
+        int32_t v = planes.v[x / 2 * planes.chroma_step] - 128;
+        int32_t y = c.y_scale * (planes.y[x] - c.y_offset) + kRound;
+        uint8_t* pixel = dst + static_cast<size_t>(x) * 4;
+        pixel[0] = Clamp8(y + c.rv * v);
+        pixel[1] = Clamp8(y - c.gu * u - c.gv * v);
+        pixel[2] = Clamp8(y + c.bu * u);
+        pixel[3] = 0xff;
+    }
+}
+
+#if defined(__ARM_NEON)
+// vqrshrun 的舍入右移和饱和, 再饱和到 8 位, 和 Clamp8 的结果一致
+static inline uint8x8_t NarrowNeon(int32x4_t low, int32x4_t high) {
+    return vqmovn_u16(vcombine_u16(vqrshrun_n_s32(low, YuvConverter::COEFFICIENT_BITS),
+                                   vqrshrun_n_s32(high, YuvConverter::COEFFICIENT_BITS)));
+}
+
+// 8 个像素, 色度已经按像素复制
+static inline void ConvertNeon8(int16x8_t y, int16x8_t u, int16x8_t v, const yuv_coefficients_t& c,
+                                uint8x8_t* r, uint8x8_t* g, uint8x8_t* b) {
+    int32x4_t y_low = vmull_n_s16(vget_low_s16(y), static_cast<int16_t>(c.y_scale));
+    int32x4_t y_high = vmull_n_s16(vget_high_s16(y), static_cast<int16_t>(c.y_scale));
+    *r = NarrowNeon(vmlal_n_s16(y_low, vget_low_s16(v), static_cast<int16_t>(c.rv)),
+                    vmlal_n_s16(y_high, vget_high_s16(v), static_cast<int16_t>(c.rv)));
+    *g = NarrowNeon(vmlsl_n_s16(vmlsl_n_s16(y_low, vget_low_s16(u), static_cast<int16_t>(c.gu)),
+                                vget_low_s16(v), static_cast<int16_t>(c.gv)),
+                    vmlsl_n_s16(vmlsl_n_s16(y_high, vget_high_s16(u), static_cast<int16_t>(c.gu)),
+                                vget_high_s16(v), static_cast<int16_t>(c.gv)));
+    *b = NarrowNeon(vmlal_n_s16(y_low, vget_low_s16(u), static_cast<int16_t>(c.bu)),
+                    vmlal_n_s16(y_high, vget_high_s16(u), static_cast<int16_t>(c.bu)));
+}
+
+// 返回处理到的 x
+static uint32_t ConvertRowSimd(const row_planes_t& planes, uint32_t width, YuvLayout layout,
+                               const yuv_coefficients_t& c, uint8_t* dst) {
+    const uint8x8_t y_offset = vdup_n_u8(static_cast<uint8_t>(c.y_offset));
+    const uint8x8_t chroma_offset = vdup_n_u8(128);
+    uint8x16x4_t rgba;
+    rgba.val[3] = vdupq_n_u8(0xff);
+    uint32_t x = 0;
+    for (; x + 16 <= width; x += 16) {
+        uint8x16_t y8 = vld1q_u8(planes.y + x);
+        uint8x8_t u8;
+        uint8x8_t v8;
+        if (layout == YUV_LAYOUT_I420) {
+            u8 = vld1_u8(planes.u + x / 2);
+            v8 = vld1_u8(planes.v + x / 2);
+        } else {
+            // vld2 按 CbCr 拆开, NV21 时 u 和 v 指针已经互换
+            uint8x8x2_t uv = vld2_u8((layout == YUV_LAYOUT_NV12 ? planes.u : planes.v) + x);
+            u8 = layout == YUV_LAYOUT_NV12 ? uv.val[0] : uv.val[1];
+            v8 = layout == YUV_LAYOUT_NV12 ? uv.val[1] : uv.val[0];
+        }
+        // 无符号相减后按有符号解释, 得到 [-128, 127] 和 Y - y_offset
+        int16x8_t u = vreinterpretq_s16_u16(vsubl_u8(u8, chroma_offset));
+        int16x8_t v = vreinterpretq_s16_u16(vsubl_u8(v8, chroma_offset));
+        int16x8x2_t u2 = vzipq_s16(u, u);
+        int16x8x2_t v2 = vzipq_s16(v, v);
+        int16x8_t y_low = vreinterpretq_s16_u16(vsubl_u8(vget_low_u8(y8), y_offset));
+        int16x8_t y_high = vreinterpretq_s16_u16(vsubl_u8(vget_high_u8(y8), y_offset));
+        uint8x8_t r[2];
+        uint8x8_t g[2];
+        uint8x8_t b[2];
+        ConvertNeon8(y_low, u2.val[0], v2.val[0], c, &r[0], &g[0], &b[0]);
+        ConvertNeon8(y_high, u2.val[1], v2.val[1], c, &r[1], &g[1], &b[1]);
+        rgba.val[0] = vcombine_u8(r[0], r[1]);
+        rgba.val[1] = vcombine_u8(g[0], g[1]);
+        rgba.val[2] = vcombine_u8(b[0], b[1]);
+        vst4q_u8(dst + static_cast<size_t>(x) * 4, rgba);
+    }
+    return x;
+}
+#elif defined(__SSE2__)
+// pmaddwd 的一对系数, 和 unpack 之后交错的 (first, second) 相乘再相加
+static inline __m128i CoefficientPair(int32_t first, int32_t second) {
+    return _mm_set1_epi32(static_cast<int32_t>((static_cast<uint32_t>(second) << 16) |
+                                               (static_cast<uint32_t>(first) & 0xffff)));
+}
+
+// 8 个像素的 a * first + b * second, 结果是两个 int32x4
+static inline void Madd8(__m128i a, __m128i b, __m128i pair, __m128i* low, __m128i* high) {
+    *low = _mm_madd_epi16(_mm_unpacklo_epi16(a, b), pair);
+    *high = _mm_madd_epi16(_mm_unpackhi_epi16(a, b), pair);
+}
+
+// 算术右移后饱和成 int16, 之后 packus 饱和到 [0, 255], 和 Clamp8 的结果一致
+static inline __m128i Narrow16(__m128i low, __m128i high) {
+    return _mm_packs_epi32(_mm_srai_epi32(low, YuvConverter::COEFFICIENT_BITS),
+                           _mm_srai_epi32(high, YuvConverter::COEFFICIENT_BITS));
+}
+
+typedef struct {
+    __m128i y_rv;
+    __m128i y_gu;
+    __m128i gv_round;
+    __m128i y_bu;
+    __m128i round;
+    __m128i one;
+} sse2_coefficients_t;
+
+// 8 个像素的 RGB, 每个通道 8 个 int16
+static inline void ConvertSse2x8(__m128i y, __m128i u, __m128i v, const sse2_coefficients_t& c,
+                                 __m128i* r, __m128i* g, __m128i* b) {
+    __m128i low;
+    __m128i high;
+    Madd8(y, v, c.y_rv, &low, &high);
+    *r = Narrow16(_mm_add_epi32(low, c.round), _mm_add_epi32(high, c.round));
+    // G 有三项, 第二次 pmaddwd 顺便加上舍入
+    __m128i low2;
+    __m128i high2;
+    Madd8(y, u, c.y_gu, &low, &high);
+    Madd8(v, c.one, c.gv_round, &low2, &high2);
+    *g = Narrow16(_mm_add_epi32(low, low2), _mm_add_epi32(high, high2));
+    Madd8(y, u, c.y_bu, &low, &high);
+    *b = Narrow16(_mm_add_epi32(low, c.round), _mm_add_epi32(high, c.round));
+}
+
+static uint32_t ConvertRowSimd(const row_planes_t& planes, uint32_t width, YuvLayout layout,
+                               const yuv_coefficients_t& c, uint8_t* dst) {
+    sse2_coefficients_t pairs{};
+    pairs.y_rv = CoefficientPair(c.y_scale, c.rv);
+    pairs.y_gu = CoefficientPair(c.y_scale, -c.gu);
+    pairs.gv_round = CoefficientPair(-c.gv, kRound);
+    pairs.y_bu = CoefficientPair(c.y_scale, c.bu);
+    pairs.round = _mm_set1_epi32(kRound);
+    pairs.one = _mm_set1_epi16(1);
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i y_offset = _mm_set1_epi16(static_cast<int16_t>(c.y_offset));
+    const __m128i chroma_offset = _mm_set1_epi16(128);
+    const __m128i low_bytes = _mm_set1_epi16(0xff);
+    const __m128i alpha = _mm_set1_epi8(static_cast<char>(0xff));
+    uint32_t x = 0;
+    for (; x + 16 <= width; x += 16) {
+        __m128i y8 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(planes.y + x));
+        __m128i u;
+        __m128i v;
+        if (layout == YUV_LAYOUT_I420) {
+            u = _mm_unpacklo_epi8(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(planes.u + x / 2)), zero);
+            v = _mm_unpacklo_epi8(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(planes.v + x / 2)), zero);
+        } else {
+            // 每个 16 位 lane 是一对色度, 低字节在前. NV21 时 u 和 v 指针已经互换
+            const uint8_t* row = layout == YUV_LAYOUT_NV12 ? planes.u : planes.v;
+            __m128i pairs16 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(row + x));
+            __m128i first = _mm_and_si128(pairs16, low_bytes);
+            __m128i second = _mm_srli_epi16(pairs16, 8);
+            u = layout == YUV_LAYOUT_NV12 ? first : second;
+            v = layout == YUV_LAYOUT_NV12 ? second : first;
+        }
+        u = _mm_sub_epi16(u, chroma_offset);
+        v = _mm_sub_epi16(v, chroma_offset);
+        __m128i y_low = _mm_sub_epi16(_mm_unpacklo_epi8(y8, zero), y_offset);
+        __m128i y_high = _mm_sub_epi16(_mm_unpackhi_epi8(y8, zero), y_offset);
+        __m128i r[2];
+        __m128i g[2];
+        __m128i b[2];
+        ConvertSse2x8(y_low, _mm_unpacklo_epi16(u, u), _mm_unpacklo_epi16(v, v), pairs, &r[0], &g[0], &b[0]);
+        ConvertSse2x8(y_high, _mm_unpackhi_epi16(u, u), _mm_unpackhi_epi16(v, v), pairs, &r[1], &g[1], &b[1]);
+        __m128i r8 = _mm_packus_epi16(r[0], r[1]);
+        __m128i g8 = _mm_packus_epi16(g[0], g[1]);
+        __m128i b8 = _mm_packus_epi16(b[0], b[1]);
+        // RG 和 BA 两两交错, 再按 16 位交错成 RGBA
+        __m128i rg_low = _mm_unpacklo_epi8(r8, g8);
+        __m128i rg_high = _mm_unpackhi_epi8(r8, g8);
+        __m128i ba_low = _mm_unpacklo_epi8(b8, alpha);
+        __m128i ba_high = _mm_unpackhi_epi8(b8, alpha);
+        auto* out = reinterpret_cast<__m128i*>(dst + static_cast<size_t>(x) * 4);
+        _mm_storeu_si128(out, _mm_unpacklo_epi16(rg_low, ba_low));
+        _mm_storeu_si128(out + 1, _mm_unpackhi_epi16(rg_low, ba_low));
+        _mm_storeu_si128(out + 2, _mm_unpacklo_epi16(rg_high, ba_high));
+        _mm_storeu_si128(out + 3, _mm_unpackhi_epi16(rg_high, ba_high));
+    }
+    return x;
+}
+#else
+static uint32_t ConvertRowSimd(const row_planes_t&, uint32_t, YuvLayout, const yuv_coefficients_t&, uint8_t*) {
+    return 0;
+}
+#endif
+
+YuvConverter::YuvConverter(uint32_t thread_count) :
+        thread_count_(thread_count),
+        stopping_(false),
+        generation_(0),
+        pending_(0),
+        job_{},
+        stats_{} {
+    if (thread_count_ == 0) {
+        thread_count_ = std::thread::hardware_concurrency();
+    }
+    thread_count_ = thread_count_ == 0 ? 1 : (thread_count_ > MAX_THREADS ? MAX_THREADS : thread_count_);
+    // 第 0 份由调用 Convert 的线程处理
+    for (uint32_t i = 1; i < thread_count_; ++i) {
+        workers_.emplace_back(&YuvConverter::WorkerLoop, this, i);
+    }
+}
+
+YuvConverter::~YuvConverter() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    stopping_ = true;
+    lock.unlock();
+    work_cv_.notify_all();
+    for (auto& worker : workers_) {
+        worker.join();
+    }
+}
+
+void YuvConverter::Convert(const uint8_t* src, uint32_t width, uint32_t height, YuvLayout layout,
+                           YuvMatrix matrix, YuvRange range, uint8_t* dst) {
+    assert(width % 2 == 0 && height % 2 == 0);
+    uint64_t begin = NowNs();
+    job_t job{src, width, height, layout, GetCoefficients(matrix, range), dst};
+    std::unique_lock<std::mutex> lock(mutex_);
+    job_ = job;
+    ++generation_;
+    pending_ = static_cast<uint32_t>(workers_.size());
+    lock.unlock();
+    work_cv_.notify_all();
+
+    RunBand(job, 0);
+
+    lock.lock();
+    done_cv_.wait(lock, [this]() { return pending_ == 0; });
+    ++stats_.frames;
+    stats_.pixels += static_cast<uint64_t>(width) * height;
+    stats_.convert_ns += NowNs() - begin;
+}
+
+uint32_t YuvConverter::thread_count() const {
+    return thread_count_;
+}
+
+yuv_convert_stats_t YuvConverter::stats() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return stats_;
+}
+
+void YuvConverter::LogStats(const char* tag) const {
+    yuv_convert_stats_t stats = this->stats();
+    LOG_D(tag, "yuv convert: %llu frames, %.2f Mpixels, %u threads, avg %.3f ms\n",
+          (long long unsigned int) stats.frames, stats.pixels / 1e6, thread_count_,
+          stats.frames > 0 ? stats.convert_ns / 1e6 / stats.frames : 0.0);
+}
+
+yuv_coefficients_t YuvConverter::GetCoefficients(YuvMatrix matrix, YuvRange range) {
+    double kr = 0.299;
+    double kb = 0.114;
+    if (matrix == YUV_MATRIX_BT709) {
+        kr = 0.2126;
+        kb = 0.0722;
+    } else if (matrix == YUV_MATRIX_BT2020) {
+        kr = 0.2627;
+        kb = 0.0593;
+    }
+    double kg = 1.0 - kr - kb;
+    // limited range 把 [16, 235] 和 [16, 240] 拉伸到 [0, 255]
+    double y_scale = range == YUV_RANGE_FULL ? 1.0 : 255.0 / 219.0;
+    double c_scale = range == YUV_RANGE_FULL ? 1.0 : 255.0 / 224.0;
+    const double one = static_cast<double>(1 << COEFFICIENT_BITS);
+    yuv_coefficients_t coefficients{};
+    coefficients.y_offset = range == YUV_RANGE_FULL ? 0 : 16;
+    coefficients.y_scale = static_cast<int32_t>(std::lround(y_scale * one));
+    coefficients.rv = static_cast<int32_t>(std::lround(2.0 * (1.0 - kr) * c_scale * one));
+    coefficients.gu = static_cast<int32_t>(std::lround(2.0 * (1.0 - kb) * kb / kg * c_scale * one));
+    coefficients.gv = static_cast<int32_t>(std::lround(2.0 * (1.0 - kr) * kr / kg * c_scale * one));
+    coefficients.bu = static_cast<int32_t>(std::lround(2.0 * (1.0 - kb) * c_scale * one));
+    return coefficients;
+}
+
+size_t YuvConverter::FrameBytes(uint32_t width, uint32_t height) {
+    return static_cast<size_t>(width) * height * 3 / 2;
+}
+
+void YuvConverter::ConvertRows(const uint8_t* src, uint32_t width, uint32_t height, YuvLayout layout,
+                               const yuv_coefficients_t& coefficients, uint32_t row_begin, uint32_t row_end,
+                               uint8_t* dst) {
+    for (uint32_t row = row_begin; row < row_end; ++row) {
+        row_planes_t planes = GetRowPlanes(src, width, height, layout, row);
+        uint8_t* out = dst + static_cast<size_t>(row) * width * 4;
+        uint32_t x = ConvertRowSimd(planes, width, layout, coefficients, out);
+        ConvertRowTail(planes, x, width, coefficients, out);
+    }
+}
+
+void YuvConverter::ConvertRowsScalar(const uint8_t* src, uint32_t width, uint32_t height, YuvLayout layout,
+                                     const yuv_coefficients_t& coefficients, uint32_t row_begin, uint32_t row_end,
+                                     uint8_t* dst) {
+    for (uint32_t row = row_begin; row < row_end; ++row) {
+        row_planes_t planes = GetRowPlanes(src, width, height, layout, row);
+        ConvertRowTail(planes, 0, width, coefficients, dst + static_cast<size_t>(row) * width * 4);
+    }
+}
+
+const char* YuvConverter::LayoutName(YuvLayout layout) {
+    switch (layout) {
+        case YUV_LAYOUT_NV12: return "nv12";
+        case YUV_LAYOUT_NV21: return "nv21";
+        case YUV_LAYOUT_I420: return "i420";
+        default: return "unknown";
+    }
+}
+
+const char* YuvConverter::MatrixName(YuvMatrix matrix) {
+    switch (matrix) {
+        case YUV_MATRIX_BT601: return "bt601";
+        case YUV_MATRIX_BT709: return "bt709";
+        case YUV_MATRIX_BT2020: return "bt2020";
+        default: return "unknown";
+    }
+}
+
+const char* YuvConverter::RangeName(YuvRange range) {
+    switch (range) {
+        case YUV_RANGE_LIMITED: return "limited";
+        case YUV_RANGE_FULL: return "full";
+        default: return "unknown";
+    }
+}
+
+void YuvConverter::WorkerLoop(uint32_t index) {
+    uint64_t seen = 0;
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (true) {
+        work_cv_.wait(lock, [this, seen]() { return stopping_ || generation_ != seen; });
+        if (stopping_) {
+            return;
+        }
+        seen = generation_;
+        job_t job = job_;
+        lock.unlock();
+        RunBand(job, index);
+        lock.lock();
+        if (--pending_ == 0) {
+            done_cv_.notify_one();
+        }
+    }
+}
+
+void YuvConverter::RunBand(const job_t& job, uint32_t index) const {
+    uint32_t row_pairs = job.height / 2;
+    uint32_t begin = static_cast<uint32_t>(static_cast<uint64_t>(row_pairs) * index / thread_count_) * 2;
+    uint32_t end = static_cast<uint32_t>(static_cast<uint64_t>(row_pairs) * (index + 1) / thread_count_) * 2;
+    ConvertRows(job.src, job.width, job.height, job.layout, job.coefficients, begin, end, job.dst);
+}
@@ -0,0 +1,119 @@
+//
+// Created by hj6231 on 2024/2/16.
+//
+
+#pragma once
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// 4:2:0 的帧在内存里的排列, 平面之间和行之间都没有 padding. 数值和 YuvComputeConverter 的 shader 里一致
+enum YuvLayout {
+    // Y 平面之后是交错的 CbCr, MediaCodec 和大多数 camera HAL 的输出
+    YUV_LAYOUT_NV12 = 0,
+    // Y 平面之后是交错的 CrCb, Camera1 预览的默认格式
+    YUV_LAYOUT_NV21,
+    // Y, Cb, Cr 三个平面
+    YUV_LAYOUT_I420,
+};
+
+enum YuvMatrix {
+    YUV_MATRIX_BT601 = 0,
+    YUV_MATRIX_BT709,
+    YUV_MATRIX_BT2020,
+};
+
+enum YuvRange {
+    // Y 在 [16, 235], CbCr 在 [16, 240]
+    YUV_RANGE_LIMITED = 0,
+    YUV_RANGE_FULL,
+};
+
+// 定点系数, 1.0 对应 1 << YuvConverter::COEFFICIENT_BITS. u = Cb - 128, v = Cr - 128, 每个通道
+//   R = clamp((y_scale * (Y - y_offset) + rv * v + round) >> COEFFICIENT_BITS, 0, 255)
+//   G = clamp((y_scale * (Y - y_offset) - gu * u - gv * v + round) >> COEFFICIENT_BITS, 0, 255)
+//   B = clamp((y_scale * (Y - y_offset) + bu * u + round) >> COEFFICIENT_BITS, 0, 255)
+// CPU 和 compute shader 都只做这几步整数运算, 结果逐字节一致. 所有系数都在 int16 范围内
+typedef struct {
+    int32_t y_offset;
+    int32_t y_scale;
+    int32_t rv;
+    int32_t gu;
+    int32_t gv;
+    int32_t bu;
+} yuv_coefficients_t;
+
+typedef struct {
+    uint64_t frames;
+    uint64_t pixels;
+    // Convert 的墙钟时间之和
+    uint64_t convert_ns;
+} yuv_convert_stats_t;
+
+// YUV 4:2:0 到 RGBA8 的 CPU 转换, 作为没有 compute 时的 fallback 和 GPU 结果的参考.
+// 色度不插值, 每个 CbCr 直接用于对应的 2x2 像素. 每一行 NEON 和 SSE2 一次处理 16 个像素,
+// 一帧按行分给常驻的 worker 线程和调用 Convert 的线程. Convert 同一时间只能在一个线程调用
+class YuvConverter {
+public:
+    // thread_count 包括调用 Convert 的线程, 为 0 时用 CPU 核数, 最多 MAX_THREADS
+    explicit YuvConverter(uint32_t thread_count = 0);
+    ~YuvConverter();
+    YuvConverter(const YuvConverter&) = delete;
+    YuvConverter& operator = (const YuvConverter&) = delete;
+
+    // src 有 FrameBytes 字节, dst 有 width * height * 4 字节, alpha 是 0xff. width 和 height 是偶数
+    void Convert(const uint8_t* src, uint32_t width, uint32_t height, YuvLayout layout,
+                 YuvMatrix matrix, YuvRange range, uint8_t* dst);
+
+    uint32_t thread_count() const;
+    yuv_convert_stats_t stats() const;
+    void LogStats(const char* tag) const;
+
+    static yuv_coefficients_t GetCoefficients(YuvMatrix matrix, YuvRange range);
+    // 三种排列都是 width * height * 3 / 2
+    static size_t FrameBytes(uint32_t width, uint32_t height);
+    // 在当前线程转换 [row_begin, row_end) 行, row_begin 是偶数
+    static void ConvertRows(const uint8_t* src, uint32_t width, uint32_t height, YuvLayout layout,
+                            const yuv_coefficients_t& coefficients, uint32_t row_begin, uint32_t row_end,
+                            uint8_t* dst);
+    // 逐个像素的参考实现, 用来验证 SIMD 和 GPU 的结果
+    static void ConvertRowsScalar(const uint8_t* src, uint32_t width, uint32_t height, YuvLayout layout,
+                                  const yuv_coefficients_t& coefficients, uint32_t row_begin, uint32_t row_end,
+                                  uint8_t* dst);
+
+    static const char* LayoutName(YuvLayout layout);
+    static const char* MatrixName(YuvMatrix matrix);
+    static const char* RangeName(YuvRange range);
+
+    const static int32_t COEFFICIENT_BITS = 12;
+    const static uint32_t MAX_THREADS = 8;
+private:
+    typedef struct {
+        const uint8_t* src;
+        uint32_t width;
+        uint32_t height;
+        YuvLayout layout;
+        yuv_coefficients_t coefficients;
+        uint8_t* dst;
+    } job_t;
+
+    void WorkerLoop(uint32_t index);
+    // 第 index 个线程负责的行, 按 2 行对齐
+    void RunBand(const job_t& job, uint32_t index) const;
+
+    uint32_t thread_count_;
+    std::vector<std::thread> workers_;
+    mutable std::mutex mutex_;
+    std::condition_variable work_cv_;
+    std::condition_variable done_cv_;
+    bool stopping_;
+    // 每次 Convert 加 1, worker 由此知道有新的一帧
+    uint64_t generation_;
+    // 还没有完成当前帧的 worker 数
+    uint32_t pending_;
+    job_t job_;
+    yuv_convert_stats_t stats_;
+};
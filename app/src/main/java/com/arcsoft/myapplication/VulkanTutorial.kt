@@ -9,7 +9,7 @@ class VulkanTutorial(context:Context) {
     private var mHandle : Long = 0
 
     init {
-        mHandle = create(context.assets)
+        mHandle = create(context.assets, context.cacheDir.absolutePath)
     }
 
     fun destroy() {
@@ -35,7 +35,7 @@ class VulkanTutorial(context:Context) {
         resume(mHandle)
     }
 
-    private external fun create(assetManager : AssetManager) : Long
+    private external fun create(assetManager : AssetManager, cacheDirectory : String) : Long
     private external fun destroy(handle: Long)
 
     private external fun surfaceCreated(handle: Long, surface:Surface)